@@ -84,6 +84,39 @@ void R_StudioInit()
 	g_StudioRenderer.Init();
 }
 
+/*
+====================
+R_StudioQueuePrepass
+
+====================
+*/
+void R_StudioQueuePrepass(cl_entity_t* ent)
+{
+	g_StudioRenderer.StudioQueuePrepass(ent);
+}
+
+/*
+====================
+R_StudioRunPrepass
+
+====================
+*/
+void R_StudioRunPrepass()
+{
+	g_StudioRenderer.StudioRunPrepass();
+}
+
+/*
+====================
+R_StudioShutdown
+
+====================
+*/
+void R_StudioShutdown()
+{
+	g_StudioRenderer.StudioShutdownPrepass();
+}
+
 // The simple drawing interface we'll pass back to the engine
 r_studio_interface_t studio =
 	{
@@ -10,18 +10,33 @@
 #include "cl_entity.h"
 #include "dlight.h"
 #include "triangleapi.h"
+#include "event_api.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <memory.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "studio_util.h"
 #include "r_studioint.h"
 
 #include "StudioModelRenderer.h"
 #include "GameStudioModelRenderer.h"
 
+// The bone setup uses SSE only where the build already lets the compiler use it,
+// so the x87 Linux build (-mno-sse) keeps the plain C versions
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define STUDIO_SSE
+#include <xmmintrin.h>
+#endif
+
 extern cvar_t* tfc_newmodels;
+extern Vector v_origin;
 
 extern extra_player_info_t g_PlayerExtraInfo[MAX_PLAYERS_HUD + 1];
 
@@ -51,6 +66,11 @@ void CStudioModelRenderer::Init()
 	m_pCvarHiModels = IEngineStudio.GetCvar("cl_himodels");
 	m_pCvarDeveloper = IEngineStudio.GetCvar("developer");
 	m_pCvarDrawEntities = IEngineStudio.GetCvar("r_drawentities");
+	m_pCvarBoneCache = CVAR_CREATE("r_studio_bonecache", "1", FCVAR_ARCHIVE);
+	m_pCvarBonePrepass = CVAR_CREATE("r_studio_prepass", "1", FCVAR_ARCHIVE);
+	m_pCvarLod = CVAR_CREATE("r_studio_lod", "1", FCVAR_ARCHIVE);
+	m_pCvarLodDist = CVAR_CREATE("r_studio_lod_dist", "1024", FCVAR_ARCHIVE);
+	m_pCvarLodRate = CVAR_CREATE("r_studio_lod_rate", "20", FCVAR_ARCHIVE);
 
 	m_pChromeSprite = IEngineStudio.GetChromeSprite();
 
@@ -77,6 +97,11 @@ CStudioModelRenderer::CStudioModelRenderer()
 	m_pCvarHiModels = NULL;
 	m_pCvarDeveloper = NULL;
 	m_pCvarDrawEntities = NULL;
+	m_pCvarBoneCache = NULL;
+	m_pCvarBonePrepass = NULL;
+	m_pCvarLod = NULL;
+	m_pCvarLodDist = NULL;
+	m_pCvarLodRate = NULL;
 	m_pChromeSprite = NULL;
 	m_pStudioModelCount = NULL;
 	m_pModelsDrawn = NULL;
@@ -89,6 +114,11 @@ CStudioModelRenderer::CStudioModelRenderer()
 	m_pSubModel = NULL;
 	m_pPlayerInfo = NULL;
 	m_pRenderModel = NULL;
+	memset(m_pBoneCache, 0, sizeof(m_pBoneCache));
+	m_pBoneCacheSlot = NULL;
+	memset(m_pLodCache, 0, sizeof(m_pLodCache));
+	m_pLodSlot = NULL;
+	m_nStudioLod = 0;
 }
 
 /*
@@ -99,6 +129,11 @@ CStudioModelRenderer::CStudioModelRenderer()
 */
 CStudioModelRenderer::~CStudioModelRenderer()
 {
+	for (int i = 0; i < STUDIO_BONECACHE_SIZE; i++)
+	{
+		delete m_pBoneCache[i];
+		delete m_pLodCache[i];
+	}
 }
 
 /*
@@ -334,8 +369,11 @@ StudioSlerpBones
 void CStudioModelRenderer::StudioSlerpBones(vec4_t q1[], float pos1[][3], vec4_t q2[], float pos2[][3], float s)
 {
 	int i;
-	vec4_t q3;
 	float s1;
+	float cosom, omega, sinom;
+	float sclp[MAXSTUDIOBONES];
+	float sclq[MAXSTUDIOBONES];
+	const int numbones = m_pStudioHeader->numbones;
 
 	if (s < 0)
 		s = 0;
@@ -344,13 +382,48 @@ void CStudioModelRenderer::StudioSlerpBones(vec4_t q1[], float pos1[][3], vec4_t
 
 	s1 = 1.0 - s;
 
-	for (i = 0; i < m_pStudioHeader->numbones; i++)
+	// Same result as QuaternionSlerp on each bone, split into passes over all
+	// the bones: the dot products, the weights, which need the trig, and the
+	// blend, which does a whole quaternion at a time with SSE.
+
+	for (i = 0; i < numbones; i++)
 	{
-		QuaternionSlerp(q1[i], q2[i], s, q3);
-		q1[i][0] = q3[0];
-		q1[i][1] = q3[1];
-		q1[i][2] = q3[2];
-		q1[i][3] = q3[3];
+		sclq[i] = q1[i][0] * q2[i][0] + q1[i][1] * q2[i][1] + q1[i][2] * q2[i][2] + q1[i][3] * q2[i][3];
+	}
+
+	for (i = 0; i < numbones; i++)
+	{
+		// take the short way round, flipping q2 if it's backwards
+		const float sign = (sclq[i] < 0) ? -1.0f : 1.0f;
+
+		cosom = sclq[i] * sign;
+
+		if ((1.0 - cosom) > 0.000001)
+		{
+			omega = acos(cosom);
+			sinom = sin(omega);
+			sclp[i] = sin(s1 * omega) / sinom;
+			sclq[i] = sign * sin(s * omega) / sinom;
+		}
+		else
+		{
+			sclp[i] = s1;
+			sclq[i] = sign * s;
+		}
+	}
+
+	for (i = 0; i < numbones; i++)
+	{
+#ifdef STUDIO_SSE
+		const __m128 a = _mm_mul_ps(_mm_set1_ps(sclp[i]), _mm_loadu_ps(q1[i]));
+		const __m128 b = _mm_mul_ps(_mm_set1_ps(sclq[i]), _mm_loadu_ps(q2[i]));
+		_mm_storeu_ps(q1[i], _mm_add_ps(a, b));
+#else
+		q1[i][0] = sclp[i] * q1[i][0] + sclq[i] * q2[i][0];
+		q1[i][1] = sclp[i] * q1[i][1] + sclq[i] * q2[i][1];
+		q1[i][2] = sclp[i] * q1[i][2] + sclq[i] * q2[i][2];
+		q1[i][3] = sclp[i] * q1[i][3] + sclq[i] * q2[i][3];
+#endif
 		pos1[i][0] = pos1[i][0] * s1 + pos2[i][0] * s;
 		pos1[i][1] = pos1[i][1] * s1 + pos2[i][1] * s;
 		pos1[i][2] = pos1[i][2] * s1 + pos2[i][2] * s;
@@ -709,6 +782,24 @@ void CStudioModelRenderer::StudioFxTransform(cl_entity_t* ent, float transform[3
 	}
 }
 
+/*
+====================
+StudioFxAltersBones
+
+====================
+*/
+static bool StudioFxAltersBones(cl_entity_t* ent)
+{
+	switch (ent->curstate.renderfx)
+	{
+	case kRenderFxDistort:
+	case kRenderFxHologram:
+	case kRenderFxExplode:
+		return true;
+	}
+	return false;
+}
+
 /*
 ====================
 StudioEstimateFrame
@@ -773,64 +864,59 @@ float CStudioModelRenderer::StudioEstimateFrame(mstudioseqdesc_t* pseqdesc)
 
 /*
 ====================
-StudioSetupBones
+StudioInSequenceTransition
 
 ====================
 */
-void CStudioModelRenderer::StudioSetupBones()
+bool CStudioModelRenderer::StudioInSequenceTransition()
 {
-	int i;
-	double f;
+	return m_fDoInterp &&
+		   0 != m_pCurrentEntity->latched.sequencetime &&
+		   (m_pCurrentEntity->latched.sequencetime + 0.2 > m_clTime) &&
+		   (m_pCurrentEntity->latched.prevsequence < m_pStudioHeader->numseq);
+}
 
-	mstudiobone_t* pbones;
+/*
+====================
+StudioCalcPose
+
+Evaluates the current sequence, its blends and any blend from the
+last sequence into m_Pose.pos / m_Pose.q.  Only reads the entity,
+so it can run on a worker's renderer during the bone pre-pass.
+====================
+*/
+void CStudioModelRenderer::StudioCalcPose(double f)
+{
 	mstudioseqdesc_t* pseqdesc;
 	mstudioanim_t* panim;
 
-	static float pos[MAXSTUDIOBONES][3];
-	static vec4_t q[MAXSTUDIOBONES];
-	float bonematrix[3][4];
-
-	static float pos2[MAXSTUDIOBONES][3];
-	static vec4_t q2[MAXSTUDIOBONES];
-	static float pos3[MAXSTUDIOBONES][3];
-	static vec4_t q3[MAXSTUDIOBONES];
-	static float pos4[MAXSTUDIOBONES][3];
-	static vec4_t q4[MAXSTUDIOBONES];
-
-	if (m_pCurrentEntity->curstate.sequence >= m_pStudioHeader->numseq)
-	{
-		m_pCurrentEntity->curstate.sequence = 0;
-	}
+	float(*pos)[3] = m_Pose.pos;
+	vec4_t* q = m_Pose.q;
+	float(*pos2)[3] = m_Pose.pos2;
+	vec4_t* q2 = m_Pose.q2;
+	float(*pos3)[3] = m_Pose.pos3;
+	vec4_t* q3 = m_Pose.q3;
+	float(*pos4)[3] = m_Pose.pos4;
+	vec4_t* q4 = m_Pose.q4;
 
 	pseqdesc = (mstudioseqdesc_t*)((byte*)m_pStudioHeader + m_pStudioHeader->seqindex) + m_pCurrentEntity->curstate.sequence;
 
-	// always want new gait sequences to start on frame zero
-	/*	if ( m_pPlayerInfo )
-	{
-		int playerNum = m_pCurrentEntity->index - 1;
-
-		// new jump gaitsequence?  start from frame zero
-		if ( m_nPlayerGaitSequences[ playerNum ] != m_pPlayerInfo->gaitsequence )
-		{
-	//		m_pPlayerInfo->gaitframe = 0.0;
-			gEngfuncs.Con_Printf( "Setting gaitframe to 0\n" );
-		}
+	panim = StudioGetAnim(m_pRenderModel, pseqdesc);
 
-		m_nPlayerGaitSequences[ playerNum ] = m_pPlayerInfo->gaitsequence;
-//		gEngfuncs.Con_Printf( "index: %d     gaitsequence: %d\n",playerNum, m_pPlayerInfo->gaitsequence);
-	}
-*/
-	f = StudioEstimateFrame(pseqdesc);
+	// far enough away that only the nearest blend is evaluated
+	const bool blendlayers = m_nStudioLod < 2;
 
-	if (m_pCurrentEntity->latched.prevframe > f)
+	if (!blendlayers && pseqdesc->numblends > 1)
 	{
-		//Con_DPrintf("%f %f\n", m_pCurrentEntity->prevframe, f );
+		if (m_pCurrentEntity->curstate.blending[0] >= 128)
+			panim += m_pStudioHeader->numbones;
+		if (pseqdesc->numblends == 4 && m_pCurrentEntity->curstate.blending[1] >= 128)
+			panim += 2 * m_pStudioHeader->numbones;
 	}
 
-	panim = StudioGetAnim(m_pRenderModel, pseqdesc);
 	StudioCalcRotations(pos, q, pseqdesc, panim, f);
 
-	if (pseqdesc->numblends > 1)
+	if (blendlayers && pseqdesc->numblends > 1)
 	{
 		float s;
 		float dadt;
@@ -859,14 +945,11 @@ void CStudioModelRenderer::StudioSetupBones()
 		}
 	}
 
-	if (m_fDoInterp &&
-		0 != m_pCurrentEntity->latched.sequencetime &&
-		(m_pCurrentEntity->latched.sequencetime + 0.2 > m_clTime) &&
-		(m_pCurrentEntity->latched.prevsequence < m_pStudioHeader->numseq))
+	if (blendlayers && StudioInSequenceTransition())
 	{
 		// blend from last sequence
-		static float pos1b[MAXSTUDIOBONES][3];
-		static vec4_t q1b[MAXSTUDIOBONES];
+		float(*pos1b)[3] = m_Pose.pos1b;
+		vec4_t* q1b = m_Pose.q1b;
 		float s;
 
 		if (m_pCurrentEntity->latched.prevsequence >= m_pStudioHeader->numseq)
@@ -906,13 +989,89 @@ void CStudioModelRenderer::StudioSetupBones()
 		s = 1.0 - (m_clTime - m_pCurrentEntity->latched.sequencetime) / 0.2;
 		StudioSlerpBones(q, pos, q1b, pos1b, s);
 	}
-	else
+}
+
+/*
+====================
+StudioConcatTransforms
+
+ConcatTransforms, a whole row of the result at a time
+with SSE. Each bone needs its parent's transform, so the
+bones can't be batched, but the rows can.
+====================
+*/
+static void StudioConcatTransforms(float in1[3][4], float in2[3][4], float out[3][4])
+{
+#ifdef STUDIO_SSE
+	const __m128 row0 = _mm_loadu_ps(in2[0]);
+	const __m128 row1 = _mm_loadu_ps(in2[1]);
+	const __m128 row2 = _mm_loadu_ps(in2[2]);
+	const __m128 row3 = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f); // the implied bottom row of in2
+
+	for (int i = 0; i < 3; i++)
+	{
+		__m128 r = _mm_mul_ps(_mm_set1_ps(in1[i][0]), row0);
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(in1[i][1]), row1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(in1[i][2]), row2));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(in1[i][3]), row3));
+		_mm_storeu_ps(out[i], r);
+	}
+#else
+	ConcatTransforms(in1, in2, out);
+#endif
+}
+
+/*
+====================
+StudioSetupBones
+
+====================
+*/
+void CStudioModelRenderer::StudioSetupBones()
+{
+	int i;
+	double f;
+
+	mstudiobone_t* pbones;
+	mstudioseqdesc_t* pseqdesc;
+	mstudioanim_t* panim;
+
+	float(*pos)[3] = m_Pose.pos;
+	vec4_t* q = m_Pose.q;
+	float(*bonematrix)[3][4] = m_Pose.bonematrix;
+
+	float(*pos2)[3] = m_Pose.pos2;
+	vec4_t* q2 = m_Pose.q2;
+
+	if (m_pCurrentEntity->curstate.sequence >= m_pStudioHeader->numseq)
 	{
-		//Con_DPrintf("prevframe = %4.2f\n", f);
-		m_pCurrentEntity->latched.prevframe = f;
+		m_pCurrentEntity->curstate.sequence = 0;
 	}
 
-	pbones = (mstudiobone_t*)((byte*)m_pStudioHeader + m_pStudioHeader->boneindex);
+	pseqdesc = (mstudioseqdesc_t*)((byte*)m_pStudioHeader + m_pStudioHeader->seqindex) + m_pCurrentEntity->curstate.sequence;
+
+	// always want new gait sequences to start on frame zero
+	/*	if ( m_pPlayerInfo )
+	{
+		int playerNum = m_pCurrentEntity->index - 1;
+
+		// new jump gaitsequence?  start from frame zero
+		if ( m_nPlayerGaitSequences[ playerNum ] != m_pPlayerInfo->gaitsequence )
+		{
+	//		m_pPlayerInfo->gaitframe = 0.0;
+			gEngfuncs.Con_Printf( "Setting gaitframe to 0\n" );
+		}
+
+		m_nPlayerGaitSequences[ playerNum ] = m_pPlayerInfo->gaitsequence;
+//		gEngfuncs.Con_Printf( "index: %d     gaitsequence: %d\n",playerNum, m_pPlayerInfo->gaitsequence);
+	}
+*/
+	f = StudioEstimateFrame(pseqdesc);
+
+	if (m_pCurrentEntity->latched.prevframe > f)
+	{
+		//Con_DPrintf("%f %f\n", m_pCurrentEntity->prevframe, f );
+	}
 
 	// bounds checking
 	if (m_pPlayerInfo)
@@ -923,6 +1082,32 @@ void CStudioModelRenderer::StudioSetupBones()
 		}
 	}
 
+	m_nStudioLod = m_pPlayerInfo ? 0 : StudioLodLevel(m_pCurrentEntity, m_pStudioHeader, m_vRenderOrigin);
+
+	if (StudioCheckBoneCache(f))
+	{
+		m_pCurrentEntity->latched.prevframe = f;
+		return;
+	}
+
+	if (!StudioLodPose())
+	{
+		if (!StudioPrepassPose(f))
+		{
+			StudioCalcPose(f);
+		}
+
+		StudioUpdateLodPose();
+	}
+
+	if (!StudioInSequenceTransition())
+	{
+		//Con_DPrintf("prevframe = %4.2f\n", f);
+		m_pCurrentEntity->latched.prevframe = f;
+	}
+
+	pbones = (mstudiobone_t*)((byte*)m_pStudioHeader + m_pStudioHeader->boneindex);
+
 	// calc gait animation
 	if (m_pPlayerInfo && m_pPlayerInfo->gaitsequence != 0)
 	{
@@ -961,30 +1146,39 @@ void CStudioModelRenderer::StudioSetupBones()
 		}
 	}
 
+	// local bone matrices don't depend on each other, so build them all first
 	for (i = 0; i < m_pStudioHeader->numbones; i++)
 	{
-		const int parent = pbones[i].parent;
+		QuaternionMatrix(q[i], bonematrix[i]);
+
+		bonematrix[i][0][3] = pos[i][0];
+		bonematrix[i][1][3] = pos[i][1];
+		bonematrix[i][2][3] = pos[i][2];
+	}
 
-		QuaternionMatrix(q[i], bonematrix);
+	// in hardware the light transforms are the bone transforms, unless an
+	// effect has distorted the root bone
+	const bool hardware = 0 != IEngineStudio.IsHardware();
+	const bool sharelight = hardware && !StudioFxAltersBones(m_pCurrentEntity);
 
-		bonematrix[0][3] = pos[i][0];
-		bonematrix[1][3] = pos[i][1];
-		bonematrix[2][3] = pos[i][2];
+	for (i = 0; i < m_pStudioHeader->numbones; i++)
+	{
+		const int parent = pbones[i].parent;
 
 		if (parent == -1)
 		{
-			if (0 != IEngineStudio.IsHardware())
+			if (hardware)
 			{
-				ConcatTransforms((*m_protationmatrix), bonematrix, (*m_pbonetransform)[i]);
+				StudioConcatTransforms((*m_protationmatrix), bonematrix[i], (*m_pbonetransform)[i]);
 
 				// MatrixCopy should be faster...
-				//ConcatTransforms ((*m_protationmatrix), bonematrix, (*m_plighttransform)[i]);
+				//ConcatTransforms ((*m_protationmatrix), bonematrix[i], (*m_plighttransform)[i]);
 				MatrixCopy((*m_pbonetransform)[i], (*m_plighttransform)[i]);
 			}
 			else
 			{
-				ConcatTransforms((*m_paliastransform), bonematrix, (*m_pbonetransform)[i]);
-				ConcatTransforms((*m_protationmatrix), bonematrix, (*m_plighttransform)[i]);
+				StudioConcatTransforms((*m_paliastransform), bonematrix[i], (*m_pbonetransform)[i]);
+				StudioConcatTransforms((*m_protationmatrix), bonematrix[i], (*m_plighttransform)[i]);
 			}
 
 			// Apply client-side effects to the transformation matrix
@@ -992,12 +1186,307 @@ void CStudioModelRenderer::StudioSetupBones()
 		}
 		else if (parent >= 0 && parent < m_pStudioHeader->numbones)
 		{
-			ConcatTransforms((*m_pbonetransform)[parent], bonematrix, (*m_pbonetransform)[i]);
-			ConcatTransforms((*m_plighttransform)[parent], bonematrix, (*m_plighttransform)[i]);
+			StudioConcatTransforms((*m_pbonetransform)[parent], bonematrix[i], (*m_pbonetransform)[i]);
+			if (sharelight)
+				MatrixCopy((*m_pbonetransform)[i], (*m_plighttransform)[i]);
+			else
+				StudioConcatTransforms((*m_plighttransform)[parent], bonematrix[i], (*m_plighttransform)[i]);
 		}
 	}
+
+	StudioUpdateBoneCache();
+}
+
+/*
+====================
+StudioCheckBoneCache
+
+====================
+*/
+bool CStudioModelRenderer::StudioCheckBoneCache(double f)
+{
+	studio_bonecache_t* cache;
+	studio_bonekey_t* key = &m_BoneCacheKey;
+	const int index = m_pCurrentEntity->index;
+
+	m_pBoneCacheSlot = NULL;
+
+	if (!m_pCvarBoneCache || 0 == m_pCvarBoneCache->value)
+		return false;
+
+	// temp entities and the view model don't have a slot, and the random or
+	// time based effects change the bones every frame anyway
+	if (index <= 0 || StudioFxAltersBones(m_pCurrentEntity))
+		return false;
+
+	// still blending out of the last sequence
+	if (StudioInSequenceTransition())
+		return false;
+
+	// a distant model's pose trails its state and keeps moving between
+	// samples even when the state doesn't, so it can't be keyed on the state
+	if (0 != m_nStudioLod)
+		return false;
+
+	memset(key, 0, sizeof(*key));
+	key->header = m_pStudioHeader;
+	key->numbones = m_pStudioHeader->numbones;
+	key->sequence = m_pCurrentEntity->curstate.sequence;
+	key->frame = f;
+	key->dadt = StudioEstimateInterpolant();
+	key->hardware = IEngineStudio.IsHardware();
+	memcpy(key->controller, m_pCurrentEntity->curstate.controller, sizeof(key->controller));
+	memcpy(key->prevcontroller, m_pCurrentEntity->latched.prevcontroller, sizeof(key->prevcontroller));
+	memcpy(key->blending, m_pCurrentEntity->curstate.blending, sizeof(key->blending));
+	memcpy(key->prevblending, m_pCurrentEntity->latched.prevblending, sizeof(key->prevblending));
+	key->mouthopen = m_pCurrentEntity->mouth.mouthopen;
+	memcpy(key->rotationmatrix, (*m_protationmatrix), sizeof(key->rotationmatrix));
+	if (0 == key->hardware)
+		memcpy(key->aliastransform, (*m_paliastransform), sizeof(key->aliastransform));
+	if (m_pPlayerInfo)
+	{
+		key->gaitsequence = m_pPlayerInfo->gaitsequence;
+		key->gaitframe = m_pPlayerInfo->gaitframe;
+	}
+
+	cache = m_pBoneCache[index % STUDIO_BONECACHE_SIZE];
+	if (!cache)
+	{
+		cache = m_pBoneCache[index % STUDIO_BONECACHE_SIZE] = new studio_bonecache_t;
+		cache->entity = NULL;
+	}
+
+	m_pBoneCacheSlot = cache;
+
+	if (cache->entity != m_pCurrentEntity || 0 != memcmp(&cache->key, key, sizeof(*key)))
+		return false;
+
+	memcpy((*m_pbonetransform), cache->bonetransform, key->numbones * sizeof(cache->bonetransform[0]));
+	memcpy((*m_plighttransform), cache->lighttransform, key->numbones * sizeof(cache->lighttransform[0]));
+
+	return true;
+}
+
+/*
+====================
+StudioUpdateBoneCache
+
+====================
+*/
+void CStudioModelRenderer::StudioUpdateBoneCache()
+{
+	studio_bonecache_t* cache = m_pBoneCacheSlot;
+
+	if (!cache)
+		return;
+
+	cache->entity = m_pCurrentEntity;
+	memcpy(&cache->key, &m_BoneCacheKey, sizeof(cache->key));
+	memcpy(cache->bonetransform, (*m_pbonetransform), m_BoneCacheKey.numbones * sizeof(cache->bonetransform[0]));
+	memcpy(cache->lighttransform, (*m_plighttransform), m_BoneCacheKey.numbones * sizeof(cache->lighttransform[0]));
+
+	m_pBoneCacheSlot = NULL;
+}
+
+
+/////////////////////
+// Animation level of detail
+//
+// Models far enough away have their pose evaluated a few times a second
+// instead of every frame, and the frames in between slerp between the
+// last two evaluations.  That puts them one evaluation behind, which
+// nobody can see at that distance.  The furthest also lose their blend
+// layers and sequence transitions, keeping just the nearest blend.
+
+// bounding radius of a man sized model, the distance cvar is for one of these
+#define STUDIO_LOD_RADIUS 40.0f
+
+/*
+====================
+StudioLodLevel
+
+Scaled by the model's size and the field of view, so what counts is
+roughly how big the model is on screen
+====================
+*/
+int CStudioModelRenderer::StudioLodLevel(cl_entity_t* ent, studiohdr_t* phdr, const float* vieworg)
+{
+	mstudioseqdesc_t* pseqdesc;
+	Vector delta;
+	float radius, dist, lodDist;
+
+	if (!m_pCvarLod || 0 == m_pCvarLod->value || !m_pCvarLodDist || m_pCvarLodDist->value <= 0)
+		return 0;
+
+	// players get their blending and gait worked out every frame, and the
+	// view model is always right in front of us
+	if (0 != ent->player || ent->index <= 0 || ent == gEngfuncs.GetViewModel())
+		return 0;
+
+	if (ent->curstate.sequence >= phdr->numseq)
+		return 0;
+
+	pseqdesc = (mstudioseqdesc_t*)((byte*)phdr + phdr->seqindex) + ent->curstate.sequence;
+	radius = 0.5 * (pseqdesc->bbmax - pseqdesc->bbmin).Length();
+	if (radius < 1)
+		radius = STUDIO_LOD_RADIUS;
+
+	delta = ent->origin - Vector(vieworg[0], vieworg[1], vieworg[2]);
+	dist = delta.Length() * (STUDIO_LOD_RADIUS / radius);
+
+	// zooming in brings things closer
+	if (0 != gHUD.m_iFOV && gHUD.m_iFOV < 90)
+		dist *= tan(gHUD.m_iFOV * (M_PI / 360));
+
+	lodDist = m_pCvarLodDist->value;
+	if (dist >= 2 * lodDist)
+		return 2;
+	if (dist >= lodDist)
+		return 1;
+	return 0;
+}
+
+/*
+====================
+StudioLodInterval
+
+====================
+*/
+float CStudioModelRenderer::StudioLodInterval(int lod)
+{
+	float rate = 20;
+
+	if (m_pCvarLodRate && m_pCvarLodRate->value > 0)
+		rate = m_pCvarLodRate->value;
+
+	// each level halves the rate
+	return (1 << (lod - 1)) / rate;
+}
+
+/*
+====================
+StudioLodCurrent
+
+====================
+*/
+bool CStudioModelRenderer::StudioLodCurrent(studio_lodcache_t* cache, cl_entity_t* ent, studiohdr_t* phdr, int lod, double time)
+{
+	double age;
+
+	if (!cache || 0 == cache->numsamples || cache->entity != ent || cache->header != phdr || cache->sequence != ent->curstate.sequence)
+		return false;
+
+	age = time - cache->time[cache->newest];
+	return age >= 0 && age < StudioLodInterval(lod);
+}
+
+/*
+====================
+StudioLodPose
+
+====================
+*/
+bool CStudioModelRenderer::StudioLodPose()
+{
+	studio_lodcache_t* cache;
+	const int index = m_pCurrentEntity->index;
+	double age;
+
+	m_pLodSlot = NULL;
+
+	if (0 == m_nStudioLod || index <= 0)
+		return false;
+
+	cache = m_pLodCache[index % STUDIO_BONECACHE_SIZE];
+	if (!cache)
+	{
+		cache = m_pLodCache[index % STUDIO_BONECACHE_SIZE] = new studio_lodcache_t;
+		cache->entity = NULL;
+		cache->numsamples = 0;
+		cache->newest = 0;
+	}
+
+	m_pLodSlot = cache;
+
+	if (StudioLodCurrent(cache, m_pCurrentEntity, m_pStudioHeader, m_nStudioLod, m_clTime))
+	{
+		StudioLodBlend(cache);
+		return true;
+	}
+
+	// a different model or sequence, or not drawn for a while, so the old
+	// samples are no use to interpolate from
+	age = m_clTime - cache->time[cache->newest];
+	if (cache->entity != m_pCurrentEntity || cache->header != m_pStudioHeader || cache->sequence != m_pCurrentEntity->curstate.sequence || age < 0 || age > 2 * StudioLodInterval(m_nStudioLod))
+	{
+		cache->numsamples = 0;
+	}
+
+	return false;
+}
+
+/*
+====================
+StudioUpdateLodPose
+
+====================
+*/
+void CStudioModelRenderer::StudioUpdateLodPose()
+{
+	studio_lodcache_t* cache = m_pLodSlot;
+	const int numbones = m_pStudioHeader->numbones;
+
+	if (!cache)
+		return;
+
+	if (0 != cache->numsamples)
+		cache->newest ^= 1;
+	if (cache->numsamples < 2)
+		cache->numsamples++;
+
+	cache->entity = m_pCurrentEntity;
+	cache->header = m_pStudioHeader;
+	cache->sequence = m_pCurrentEntity->curstate.sequence;
+	cache->time[cache->newest] = m_clTime;
+	memcpy(cache->pos[cache->newest], m_Pose.pos, numbones * sizeof(cache->pos[0][0]));
+	memcpy(cache->q[cache->newest], m_Pose.q, numbones * sizeof(cache->q[0][0]));
+
+	StudioLodBlend(cache);
+
+	m_pLodSlot = NULL;
 }
 
+/*
+====================
+StudioLodBlend
+
+====================
+*/
+void CStudioModelRenderer::StudioLodBlend(studio_lodcache_t* cache)
+{
+	const int numbones = m_pStudioHeader->numbones;
+	const int newest = cache->newest;
+	const int oldest = newest ^ 1;
+	double spacing;
+	float s;
+
+	if (cache->numsamples < 2)
+	{
+		memcpy(m_Pose.pos, cache->pos[newest], numbones * sizeof(m_Pose.pos[0]));
+		memcpy(m_Pose.q, cache->q[newest], numbones * sizeof(m_Pose.q[0]));
+		return;
+	}
+
+	// reaches the newest sample just as the next one is due
+	spacing = cache->time[newest] - cache->time[oldest];
+	s = spacing > 0 ? (m_clTime - cache->time[newest]) / spacing : 1;
+	s = V_max(0.0f, V_min(s, 1.0f));
+
+	memcpy(m_Pose.pos, cache->pos[oldest], numbones * sizeof(m_Pose.pos[0]));
+	memcpy(m_Pose.q, cache->q[oldest], numbones * sizeof(m_Pose.q[0]));
+
+	StudioSlerpBones(m_Pose.q, m_Pose.pos, cache->q[newest], cache->pos[newest], s);
+}
 
 /*
 ====================
@@ -1038,9 +1527,9 @@ void CStudioModelRenderer::StudioMergeBones(model_t* m_pSubModel)
 	mstudioseqdesc_t* pseqdesc;
 	mstudioanim_t* panim;
 
-	static float pos[MAXSTUDIOBONES][3];
+	float(*pos)[3] = m_Pose.pos;
 	float bonematrix[3][4];
-	static vec4_t q[MAXSTUDIOBONES];
+	vec4_t* q = m_Pose.q;
 
 	if (m_pCurrentEntity->curstate.sequence >= m_pStudioHeader->numseq)
 	{
@@ -1737,3 +2226,392 @@ void CStudioModelRenderer::StudioRenderFinal()
 		StudioRenderFinal_Software();
 	}
 }
+
+/////////////////////
+// Bone pre-pass
+//
+// HUD_AddEntity queues every studio entity going into the visible list,
+// and HUD_CreateEntities evaluates their animation on a few worker threads,
+// each with its own renderer and scratch.  The draw then only has to check
+// the pose is still for the same state and build the matrices.
+//
+// Players are left to the draw, since their blending and gait are worked out
+// there, and so are models whose sequences live in demand loaded groups.
+
+#define STUDIO_PREPASS_MAX_ENTITIES 512
+#define STUDIO_PREPASS_MAX_INDEX 4096
+#define STUDIO_PREPASS_MAX_THREADS 4
+
+// fewer than this isn't worth waking the workers for
+#define STUDIO_PREPASS_MIN_ENTITIES 4
+
+typedef struct studio_prepose_s
+{
+	cl_entity_t* entity;
+	studiohdr_t* header;
+	bool valid;
+	int lod;
+	studio_posekey_t key;
+	float pos[MAXSTUDIOBONES][3];
+	vec4_t q[MAXSTUDIOBONES];
+} studio_prepose_t;
+
+struct StudioPrepass
+{
+	std::vector<std::thread> Threads;
+	// one per worker, the last is used by the main thread
+	std::vector<CStudioModelRenderer*> Renderers;
+	std::mutex Mutex;
+	std::condition_variable Start;
+	std::condition_variable Done;
+	int Generation = 0;
+	int Running = 0;
+	bool QuittingTime = false;
+
+	std::atomic<int> Next;
+	double Time;
+	bool Interp;
+	float ViewOrigin[3]; // best guess at this frame's view, for the level of detail
+
+	// entities queued this frame, allocated on first use
+	studio_prepose_t* Poses = NULL;
+	int NumPoses = 0;
+	bool Collecting = false;
+	// entity index -> pose + 1
+	short Slot[STUDIO_PREPASS_MAX_INDEX];
+};
+
+static StudioPrepass s_Prepass;
+
+/*
+====================
+StudioPrepassEntity
+
+====================
+*/
+static void StudioPrepassEntity(CStudioModelRenderer* renderer, studio_prepose_t* pose)
+{
+	mstudioseqdesc_t* pseqdesc;
+	double f;
+
+	renderer->m_pCurrentEntity = pose->entity;
+	renderer->m_pRenderModel = pose->entity->model;
+	renderer->m_pStudioHeader = pose->header;
+	renderer->m_pPlayerInfo = NULL;
+	renderer->m_clTime = s_Prepass.Time;
+	renderer->m_fDoInterp = s_Prepass.Interp;
+	renderer->m_nStudioLod = pose->lod;
+
+	pseqdesc = (mstudioseqdesc_t*)((byte*)pose->header + pose->header->seqindex) + pose->entity->curstate.sequence;
+	f = renderer->StudioEstimateFrame(pseqdesc);
+
+	renderer->StudioPoseKey(&pose->key, f);
+	renderer->StudioCalcPose(f);
+
+	memcpy(pose->pos, renderer->m_Pose.pos, pose->header->numbones * sizeof(pose->pos[0]));
+	memcpy(pose->q, renderer->m_Pose.q, pose->header->numbones * sizeof(pose->q[0]));
+	pose->valid = true;
+}
+
+/*
+====================
+StudioPrepassWork
+
+====================
+*/
+static void StudioPrepassWork(CStudioModelRenderer* renderer)
+{
+	int i;
+
+	while ((i = s_Prepass.Next++) < s_Prepass.NumPoses)
+	{
+		StudioPrepassEntity(renderer, &s_Prepass.Poses[i]);
+	}
+}
+
+/*
+====================
+StudioPrepassThread
+
+====================
+*/
+static void StudioPrepassThread(CStudioModelRenderer* renderer)
+{
+	int generation = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock lock{s_Prepass.Mutex};
+			s_Prepass.Start.wait(lock, [&]()
+				{ return s_Prepass.QuittingTime || s_Prepass.Generation != generation; });
+
+			if (s_Prepass.QuittingTime)
+				return;
+
+			generation = s_Prepass.Generation;
+		}
+
+		StudioPrepassWork(renderer);
+
+		{
+			std::lock_guard guard{s_Prepass.Mutex};
+			if (--s_Prepass.Running == 0)
+				s_Prepass.Done.notify_one();
+		}
+	}
+}
+
+/*
+====================
+StudioPrepassViewOrigin
+
+The view for this frame isn't set up until after the entities have
+been added, so guess it from where the local player is now.  The draw
+still checks the level of detail against the real view.
+====================
+*/
+static void StudioPrepassViewOrigin(float* vieworg)
+{
+	cl_entity_t* player = gEngfuncs.GetLocalPlayer();
+	float view_ofs[3];
+
+	if (0 == g_iUser1 && player)
+	{
+		gEngfuncs.pEventAPI->EV_LocalPlayerViewheight(view_ofs);
+		VectorAdd(player->origin, view_ofs, vieworg);
+	}
+	else
+	{
+		// spectator cameras go wherever they like, the last frame's view will have to do
+		VectorCopy(v_origin, vieworg);
+	}
+}
+
+/*
+====================
+StudioQueuePrepass
+
+====================
+*/
+void CStudioModelRenderer::StudioQueuePrepass(cl_entity_t* ent)
+{
+	studiohdr_t* phdr;
+	mstudioseqdesc_t* pseqdesc;
+	studio_prepose_t* pose;
+	int i, lod;
+
+	if (!s_Prepass.Collecting)
+	{
+		// first entity of a new frame, forget the last one's
+		for (i = 0; i < s_Prepass.NumPoses; i++)
+		{
+			s_Prepass.Slot[s_Prepass.Poses[i].entity->index] = 0;
+		}
+		s_Prepass.NumPoses = 0;
+		s_Prepass.Collecting = true;
+
+		StudioPrepassViewOrigin(s_Prepass.ViewOrigin);
+	}
+
+	if (!m_pCvarBonePrepass || 0 == m_pCvarBonePrepass->value)
+		return;
+
+	if (!ent->model || ent->model->type != mod_studio || 0 != ent->player)
+		return;
+
+	if (ent->index <= 0 || ent->index >= STUDIO_PREPASS_MAX_INDEX || 0 != s_Prepass.Slot[ent->index])
+		return;
+
+	// these get their bones from somewhere else
+	if (ent->curstate.movetype == MOVETYPE_FOLLOW || ent->curstate.renderfx == kRenderFxDeadPlayer)
+		return;
+
+	if (s_Prepass.NumPoses == STUDIO_PREPASS_MAX_ENTITIES)
+		return;
+
+	phdr = (studiohdr_t*)IEngineStudio.Mod_Extradata(ent->model);
+	if (!phdr || phdr->numbones > MAXSTUDIOBONES || ent->curstate.sequence >= phdr->numseq)
+		return;
+
+	// distant models between evaluations are interpolated by the draw
+	lod = StudioLodLevel(ent, phdr, s_Prepass.ViewOrigin);
+	if (0 != lod && StudioLodCurrent(m_pLodCache[ent->index % STUDIO_BONECACHE_SIZE], ent, phdr, lod, gEngfuncs.GetClientTime()))
+		return;
+
+	// sequence groups other than the first may need loading, which only the draw can do
+	pseqdesc = (mstudioseqdesc_t*)((byte*)phdr + phdr->seqindex);
+	if (0 != pseqdesc[ent->curstate.sequence].seqgroup)
+		return;
+	if (ent->latched.prevsequence < phdr->numseq && 0 != pseqdesc[ent->latched.prevsequence].seqgroup)
+		return;
+
+	if (!s_Prepass.Poses)
+	{
+		s_Prepass.Poses = new studio_prepose_t[STUDIO_PREPASS_MAX_ENTITIES];
+	}
+
+	pose = &s_Prepass.Poses[s_Prepass.NumPoses++];
+	pose->entity = ent;
+	pose->header = phdr;
+	pose->lod = lod;
+	pose->valid = false;
+
+	s_Prepass.Slot[ent->index] = s_Prepass.NumPoses;
+}
+
+/*
+====================
+StudioRunPrepass
+
+====================
+*/
+void CStudioModelRenderer::StudioRunPrepass()
+{
+	int framecount;
+	double time, oldtime;
+	size_t i, numthreads;
+
+	s_Prepass.Collecting = false;
+
+	if (s_Prepass.NumPoses < STUDIO_PREPASS_MIN_ENTITIES)
+		return;
+
+	if (s_Prepass.Threads.empty())
+	{
+		numthreads = std::thread::hardware_concurrency();
+		numthreads = (numthreads > 1) ? numthreads - 1 : 0;
+		if (numthreads > STUDIO_PREPASS_MAX_THREADS)
+			numthreads = STUDIO_PREPASS_MAX_THREADS;
+
+		// nothing to gain from a single core
+		if (0 == numthreads)
+			return;
+
+		s_Prepass.QuittingTime = false;
+		for (i = 0; i <= numthreads; i++)
+		{
+			s_Prepass.Renderers.push_back(new CStudioModelRenderer());
+		}
+		for (i = 0; i < numthreads; i++)
+		{
+			s_Prepass.Threads.emplace_back(StudioPrepassThread, s_Prepass.Renderers[i]);
+		}
+	}
+
+	IEngineStudio.GetTimes(&framecount, &time, &oldtime);
+
+	s_Prepass.Time = time;
+	s_Prepass.Interp = m_fDoInterp;
+	s_Prepass.Next = 0;
+
+	{
+		std::lock_guard guard{s_Prepass.Mutex};
+		s_Prepass.Running = s_Prepass.Threads.size();
+		s_Prepass.Generation++;
+	}
+	s_Prepass.Start.notify_all();
+
+	// help out rather than sit idle
+	StudioPrepassWork(s_Prepass.Renderers.back());
+
+	{
+		std::unique_lock lock{s_Prepass.Mutex};
+		s_Prepass.Done.wait(lock, []()
+			{ return s_Prepass.Running == 0; });
+	}
+}
+
+/*
+====================
+StudioShutdownPrepass
+
+====================
+*/
+void CStudioModelRenderer::StudioShutdownPrepass()
+{
+	if (!s_Prepass.Threads.empty())
+	{
+		{
+			std::lock_guard guard{s_Prepass.Mutex};
+			s_Prepass.QuittingTime = true;
+		}
+		s_Prepass.Start.notify_all();
+
+		for (auto& thread : s_Prepass.Threads)
+		{
+			thread.join();
+		}
+		s_Prepass.Threads.clear();
+	}
+
+	for (auto renderer : s_Prepass.Renderers)
+	{
+		delete renderer;
+	}
+	s_Prepass.Renderers.clear();
+
+	delete[] s_Prepass.Poses;
+	s_Prepass.Poses = NULL;
+	s_Prepass.NumPoses = 0;
+	memset(s_Prepass.Slot, 0, sizeof(s_Prepass.Slot));
+}
+
+/*
+====================
+StudioPoseKey
+
+====================
+*/
+void CStudioModelRenderer::StudioPoseKey(studio_posekey_t* key, double f)
+{
+	memset(key, 0, sizeof(*key));
+
+	key->header = m_pStudioHeader;
+	key->numbones = m_pStudioHeader->numbones;
+	key->sequence = m_pCurrentEntity->curstate.sequence;
+	key->prevsequence = m_pCurrentEntity->latched.prevsequence;
+	key->interp = m_fDoInterp ? 1 : 0;
+	key->frame = f;
+	key->cltime = m_clTime;
+	key->dadt = StudioEstimateInterpolant();
+	key->prevframe = m_pCurrentEntity->latched.prevframe;
+	key->sequencetime = m_pCurrentEntity->latched.sequencetime;
+	memcpy(key->controller, m_pCurrentEntity->curstate.controller, sizeof(key->controller));
+	memcpy(key->prevcontroller, m_pCurrentEntity->latched.prevcontroller, sizeof(key->prevcontroller));
+	memcpy(key->blending, m_pCurrentEntity->curstate.blending, sizeof(key->blending));
+	memcpy(key->prevblending, m_pCurrentEntity->latched.prevblending, sizeof(key->prevblending));
+	memcpy(key->prevseqblending, m_pCurrentEntity->latched.prevseqblending, sizeof(key->prevseqblending));
+	key->mouthopen = m_pCurrentEntity->mouth.mouthopen;
+	key->lod = m_nStudioLod;
+}
+
+/*
+====================
+StudioPrepassPose
+
+====================
+*/
+bool CStudioModelRenderer::StudioPrepassPose(double f)
+{
+	studio_prepose_t* pose;
+	studio_posekey_t key;
+	const int index = m_pCurrentEntity->index;
+
+	if (m_pPlayerInfo || index <= 0 || index >= STUDIO_PREPASS_MAX_INDEX || 0 == s_Prepass.Slot[index])
+		return false;
+
+	pose = &s_Prepass.Poses[s_Prepass.Slot[index] - 1];
+	if (!pose->valid || pose->entity != m_pCurrentEntity || pose->header != m_pStudioHeader)
+		return false;
+
+	// anything changed since the pre-pass, evaluate it again
+	StudioPoseKey(&key, f);
+	if (0 != memcmp(&key, &pose->key, sizeof(key)))
+		return false;
+
+	memcpy(m_Pose.pos, pose->pos, key.numbones * sizeof(pose->pos[0]));
+	memcpy(m_Pose.q, pose->q, key.numbones * sizeof(pose->q[0]));
+
+	return true;
+}
@@ -7,6 +7,92 @@
 
 #pragma once
 
+// Number of entities whose final bone transforms are kept between draws
+#define STUDIO_BONECACHE_SIZE 512
+
+// Everything StudioSetupBones reads from the entity and the renderer,
+// compared as a block to decide whether its bones are unchanged
+typedef struct studio_bonekey_s
+{
+	studiohdr_t* header;
+	int numbones;
+	int sequence;
+	int gaitsequence;
+	double frame;
+	float gaitframe;
+	float dadt;
+	int hardware;
+	byte controller[4];
+	byte prevcontroller[4];
+	byte blending[2];
+	byte prevblending[2];
+	byte mouthopen;
+	float rotationmatrix[3][4];
+	float aliastransform[3][4];
+} studio_bonekey_t;
+
+typedef struct studio_bonecache_s
+{
+	cl_entity_t* entity;
+	studio_bonekey_t key;
+	float bonetransform[MAXSTUDIOBONES][3][4];
+	float lighttransform[MAXSTUDIOBONES][3][4];
+} studio_bonecache_t;
+
+// Working space for evaluating one model's pose.  Each renderer has its
+// own, so the bone pre-pass can run several at once.
+typedef struct studio_posescratch_s
+{
+	float pos[MAXSTUDIOBONES][3];
+	vec4_t q[MAXSTUDIOBONES];
+	float pos2[MAXSTUDIOBONES][3];
+	vec4_t q2[MAXSTUDIOBONES];
+	float pos3[MAXSTUDIOBONES][3];
+	vec4_t q3[MAXSTUDIOBONES];
+	float pos4[MAXSTUDIOBONES][3];
+	vec4_t q4[MAXSTUDIOBONES];
+	float pos1b[MAXSTUDIOBONES][3];
+	vec4_t q1b[MAXSTUDIOBONES];
+	float bonematrix[MAXSTUDIOBONES][3][4];
+} studio_posescratch_t;
+
+// The last two poses evaluated for a distant entity, which the frames
+// in between are interpolated from
+typedef struct studio_lodcache_s
+{
+	cl_entity_t* entity;
+	studiohdr_t* header;
+	int sequence;
+	int numsamples;
+	int newest;
+	double time[2];
+	float pos[2][MAXSTUDIOBONES][3];
+	vec4_t q[2][MAXSTUDIOBONES];
+} studio_lodcache_t;
+
+// Everything StudioCalcPose reads, so a draw can tell whether the
+// pose the pre-pass evaluated for an entity still applies
+typedef struct studio_posekey_s
+{
+	studiohdr_t* header;
+	int numbones;
+	int sequence;
+	int prevsequence;
+	int interp;
+	double frame;
+	double cltime;
+	float dadt;
+	float prevframe;
+	float sequencetime;
+	byte controller[4];
+	byte prevcontroller[4];
+	byte blending[2];
+	byte prevblending[2];
+	byte prevseqblending[2];
+	byte mouthopen;
+	int lod; // level of detail, which decides whether blend layers are used
+} studio_posekey_t;
+
 /*
 ====================
 CStudioModelRenderer
@@ -41,6 +127,48 @@ public:
 	// Set up model bone positions
 	virtual void StudioSetupBones();
 
+	// Reuse the entity's bones from its last draw if nothing they depend on has changed
+	virtual bool StudioCheckBoneCache(double f);
+
+	// Remember the bones just set up for the next draw
+	virtual void StudioUpdateBoneCache();
+
+	// Evaluate the entity's animation into m_Pose
+	virtual void StudioCalcPose(double f);
+
+	// Still blending out of the previous sequence?
+	virtual bool StudioInSequenceTransition();
+
+	// Bone pre-pass: entities are queued as they are added to the visible
+	// list, and their poses evaluated on worker threads before drawing
+	virtual void StudioQueuePrepass(cl_entity_t* ent);
+	virtual void StudioRunPrepass();
+	virtual void StudioShutdownPrepass();
+
+	// Fill in the key for the current entity's pose
+	virtual void StudioPoseKey(studio_posekey_t* key, double f);
+
+	// Copy the pre-pass pose for the current entity into m_Pose, if it's still valid
+	virtual bool StudioPrepassPose(double f);
+
+	// Level of detail for an entity's animation seen from vieworg, 0 for full rate
+	virtual int StudioLodLevel(cl_entity_t* ent, studiohdr_t* phdr, const float* vieworg);
+
+	// Seconds between pose evaluations at a level of detail
+	virtual float StudioLodInterval(int lod);
+
+	// Can the entity's pose still be interpolated from its last samples?
+	virtual bool StudioLodCurrent(studio_lodcache_t* cache, cl_entity_t* ent, studiohdr_t* phdr, int lod, double time);
+
+	// Interpolate the current entity's pose into m_Pose, if it isn't due a new one
+	virtual bool StudioLodPose();
+
+	// Remember the pose just evaluated as the entity's newest sample
+	virtual void StudioUpdateLodPose();
+
+	// Blend the samples for the current time into m_Pose
+	virtual void StudioLodBlend(studio_lodcache_t* cache);
+
 	// Find final attachment points
 	virtual void StudioCalcAttachments();
 
@@ -116,6 +244,16 @@ public:
 	cvar_t* m_pCvarDeveloper;
 	// Draw entities bone hit boxes, etc?
 	cvar_t* m_pCvarDrawEntities;
+	// Reuse bone transforms of entities that haven't animated?
+	cvar_t* m_pCvarBoneCache;
+	// Evaluate poses on worker threads ahead of drawing?
+	cvar_t* m_pCvarBonePrepass;
+	// Throttle the animation of distant models?
+	cvar_t* m_pCvarLod;
+	// Distance at which a man sized model drops to the first level of detail
+	cvar_t* m_pCvarLodDist;
+	// Pose evaluations per second at the first level of detail
+	cvar_t* m_pCvarLodRate;
 
 	// The entity which we are currently rendering.
 	cl_entity_t* m_pCurrentEntity;
@@ -156,6 +294,22 @@ public:
 	float m_rgCachedBoneTransform[MAXSTUDIOBONES][3][4];
 	float m_rgCachedLightTransform[MAXSTUDIOBONES][3][4];
 
+	// Per entity bone transforms from the last draw, allocated on first use
+	studio_bonecache_t* m_pBoneCache[STUDIO_BONECACHE_SIZE];
+	// Slot and key for the entity whose bones are being set up, NULL if it can't be cached
+	studio_bonecache_t* m_pBoneCacheSlot;
+	studio_bonekey_t m_BoneCacheKey;
+
+	// Per entity pose samples for distant models, allocated on first use
+	studio_lodcache_t* m_pLodCache[STUDIO_BONECACHE_SIZE];
+	// Slot for the entity whose bones are being set up, NULL at full detail
+	studio_lodcache_t* m_pLodSlot;
+	// Level of detail of the entity whose bones are being set up
+	int m_nStudioLod;
+
+	// Pose scratch for this renderer
+	studio_posescratch_t m_Pose;
+
 	// Software renderer scale factors
 	float m_fSoftwareXScale, m_fSoftwareYScale;
 
@@ -44,21 +44,33 @@ inline const char* CVAR_GET_STRING(const char* x) { return gEngfuncs.pfnGetCvarS
 inline struct cvar_s* CVAR_CREATE(const char* cv, const char* val, const int flags) { return gEngfuncs.pfnRegisterVariable((char*)cv, (char*)val, flags); }
 
 #define SPR_Load (*gEngfuncs.pfnSPR_Load)
-#define SPR_Set (*gEngfuncs.pfnSPR_Set)
+#define SPR_Set HudSprite_Set
 #define SPR_Frames (*gEngfuncs.pfnSPR_Frames)
 #define SPR_GetList (*gEngfuncs.pfnSPR_GetList)
 
+// HUD sprite batching, see hud_spritebatch.cpp
+void HudSprite_Init();
+void HudSprite_Set(HSPRITE hPic, int r, int g, int b);
+void HudSprite_Draw(int frame, int x, int y, const Rect* prc);
+void HudSprite_DrawHoles(int frame, int x, int y, const Rect* prc);
+void HudSprite_DrawAdditive(int frame, int x, int y, const Rect* prc);
+void HudSprite_EnableScissor(int x, int y, int width, int height);
+void HudSprite_DisableScissor();
+void HudSprite_Flush();
+void HudSprite_BeginFrame();
+void HudSprite_EndFrame();
+
 // SPR_Draw  draws a the current sprite as solid
-#define SPR_Draw (*gEngfuncs.pfnSPR_Draw)
+#define SPR_Draw HudSprite_Draw
 // SPR_DrawHoles  draws the current sprites,  with color index255 not drawn (transparent)
-#define SPR_DrawHoles (*gEngfuncs.pfnSPR_DrawHoles)
+#define SPR_DrawHoles HudSprite_DrawHoles
 // SPR_DrawAdditive  adds the sprites RGB values to the background  (additive transulency)
-#define SPR_DrawAdditive (*gEngfuncs.pfnSPR_DrawAdditive)
+#define SPR_DrawAdditive HudSprite_DrawAdditive
 
 // SPR_EnableScissor  sets a clipping rect for HUD sprites.  (0,0) is the top-left hand corner of the screen.
-#define SPR_EnableScissor (*gEngfuncs.pfnSPR_EnableScissor)
+#define SPR_EnableScissor HudSprite_EnableScissor
 // SPR_DisableScissor  disables the clipping rect
-#define SPR_DisableScissor (*gEngfuncs.pfnSPR_DisableScissor)
+#define SPR_DisableScissor HudSprite_DisableScissor
 //
 #define FillRGBA (*gEngfuncs.pfnFillRGBA)
 
@@ -1,6 +1,8 @@
 // Client side entity management functions
 
+#include <algorithm>
 #include <memory.h>
+#include <vector>
 
 #include "hud.h"
 #include "cl_util.h"
@@ -18,8 +20,13 @@
 extern IParticleMan* g_pParticleMan;
 
 void Game_AddObjects();
+void R_StudioQueuePrepass(cl_entity_t* ent);
+void R_StudioRunPrepass();
 
 extern Vector v_origin;
+extern cvar_t* cl_tempent_max;
+extern cvar_t* cl_tempent_lod;
+extern cvar_t* cl_tempent_tracemove;
 
 bool g_iAlive = true;
 
@@ -58,6 +65,9 @@ int DLLEXPORT HUD_AddEntity(int type, struct cl_entity_s* ent, const char* model
 			return 0; // don't draw the player we are following in eye
 	}
 
+	if (type == ET_NORMAL)
+		R_StudioQueuePrepass(ent);
+
 	return 1;
 }
 
@@ -310,6 +320,9 @@ void DLLEXPORT HUD_CreateEntities()
 	Game_AddObjects();
 
 	GetClientVoiceMgr()->CreateEntities();
+
+	// evaluate the bones of everything added this frame before drawing starts
+	R_StudioRunPrepass();
 }
 
 
@@ -358,6 +371,241 @@ void DLLEXPORT HUD_StudioEvent(const struct mstudioevent_s* event, const struct
 	}
 }
 
+/*
+=================
+Temp entity batch
+
+The engine owns the temp entities and hands us its linked list every
+frame.  We gather the live ones into a contiguous array that is reused
+from frame to frame and run each step of the simulation over the whole
+array in turn.  The array also remembers where each colliding tent was
+last traced, so a tent that has barely moved doesn't pay for a trace.
+=================
+*/
+#define TENT_HASH_SIZE 4096 // power of two, only ever half full
+
+typedef struct
+{
+	TEMPENTITY* tent;
+	Vector traceorigin; // where the last collision trace ended
+	Vector endorigin;	// origin and die time when the frame finished,
+	float enddie;		// to spot a tent the engine has handed out again
+	float dist;			// squared distance from the view
+	bool skip;			// done with this tent for the frame
+} tentbatch_t;
+
+static std::vector<tentbatch_t> s_TentBatch[2];
+static std::vector<tentbatch_t*> s_TentVisible;
+static int s_CurTentBatch;
+static int s_TentHash[TENT_HASH_SIZE]; // index + 1 into the previous frame's batch
+
+/*
+=================
+TEnt_Hash
+=================
+*/
+static int TEnt_Hash(const TEMPENTITY* pTemp)
+{
+	return (int)(((uintptr_t)pTemp >> 3) * 2654435761u) & (TENT_HASH_SIZE - 1);
+}
+
+/*
+=================
+TEnt_FindPrevious
+
+Returns the record from last frame for a tent that is still the same tent
+=================
+*/
+static const tentbatch_t* TEnt_FindPrevious(TEMPENTITY* pTemp)
+{
+	const std::vector<tentbatch_t>& prev = s_TentBatch[s_CurTentBatch ^ 1];
+	const tentbatch_t* t;
+	int h, i;
+
+	for (h = TEnt_Hash(pTemp); (i = s_TentHash[h]) != 0; h = (h + 1) & (TENT_HASH_SIZE - 1))
+	{
+		t = &prev[i - 1];
+		if (t->tent != pTemp)
+			continue;
+
+		if (t->enddie != pTemp->die || t->endorigin[0] != pTemp->entity.origin[0] || t->endorigin[1] != pTemp->entity.origin[1] || t->endorigin[2] != pTemp->entity.origin[2])
+			return NULL;
+		return t;
+	}
+
+	return NULL;
+}
+
+/*
+=================
+TEnt_FinishBatch
+
+Remembers this frame's tents for the next one
+=================
+*/
+static void TEnt_FinishBatch()
+{
+	std::vector<tentbatch_t>& batch = s_TentBatch[s_CurTentBatch];
+	int i, h, count;
+
+	memset(s_TentHash, 0, sizeof(s_TentHash));
+
+	// Anything past half the table is simply traced from where it was last frame
+	count = V_min((int)batch.size(), TENT_HASH_SIZE / 2);
+	for (i = 0; i < count; i++)
+	{
+		batch[i].endorigin = batch[i].tent->entity.origin;
+		batch[i].enddie = batch[i].tent->die;
+
+		for (h = TEnt_Hash(batch[i].tent); s_TentHash[h] != 0; h = (h + 1) & (TENT_HASH_SIZE - 1))
+			;
+		s_TentHash[h] = i + 1;
+	}
+
+	s_CurTentBatch ^= 1;
+}
+
+/*
+=================
+TEnt_Collide
+
+Traces a tent from start to where it has moved to and bounces it off
+whatever it hits
+=================
+*/
+static void TEnt_Collide(TEMPENTITY* pTemp, const Vector& start, float gravity, double client_time, void (*Callback_TempEntPlaySound)(TEMPENTITY* pTemp, float damp))
+{
+	Vector traceNormal;
+	float traceFraction = 1;
+
+	if ((pTemp->flags & FTENT_COLLIDEALL) != 0)
+	{
+		pmtrace_t pmtrace;
+		physent_t* pe;
+
+		gEngfuncs.pEventAPI->EV_SetTraceHull(2);
+
+		gEngfuncs.pEventAPI->EV_PlayerTrace((float*)&start, pTemp->entity.origin, PM_STUDIO_BOX, -1, &pmtrace);
+
+
+		if (pmtrace.fraction != 1)
+		{
+			pe = gEngfuncs.pEventAPI->EV_GetPhysent(pmtrace.ent);
+
+			if (0 == pmtrace.ent || (pe->info != pTemp->clientIndex))
+			{
+				traceFraction = pmtrace.fraction;
+				VectorCopy(pmtrace.plane.normal, traceNormal);
+
+				if (pTemp->hitcallback)
+				{
+					(*pTemp->hitcallback)(pTemp, &pmtrace);
+				}
+			}
+		}
+	}
+	else if ((pTemp->flags & FTENT_COLLIDEWORLD) != 0)
+	{
+		pmtrace_t pmtrace;
+
+		gEngfuncs.pEventAPI->EV_SetTraceHull(2);
+
+		gEngfuncs.pEventAPI->EV_PlayerTrace((float*)&start, pTemp->entity.origin, PM_STUDIO_BOX | PM_WORLD_ONLY, -1, &pmtrace);
+
+		if (pmtrace.fraction != 1)
+		{
+			traceFraction = pmtrace.fraction;
+			VectorCopy(pmtrace.plane.normal, traceNormal);
+
+			if ((pTemp->flags & FTENT_SPARKSHOWER) != 0)
+			{
+				// Chop spark speeds a bit more
+				//
+				VectorScale(pTemp->entity.baseline.origin, 0.6, pTemp->entity.baseline.origin);
+
+				if (Length(pTemp->entity.baseline.origin) < 10)
+				{
+					pTemp->entity.baseline.framerate = 0.0;
+				}
+			}
+
+			if (pTemp->hitcallback)
+			{
+				(*pTemp->hitcallback)(pTemp, &pmtrace);
+			}
+		}
+	}
+
+	if (traceFraction != 1) // Decent collision now, and damping works
+	{
+		float proj, damp;
+
+		// Place at contact point
+		pTemp->entity.origin = start + traceFraction * (pTemp->entity.origin - start);
+		// Damp velocity
+		damp = pTemp->bounceFactor;
+		if ((pTemp->flags & (FTENT_GRAVITY | FTENT_SLOWGRAVITY)) != 0)
+		{
+			damp *= 0.5;
+			if (traceNormal[2] > 0.9) // Hit floor?
+			{
+				if (pTemp->entity.baseline.origin[2] <= 0 && pTemp->entity.baseline.origin[2] >= gravity * 3)
+				{
+					damp = 0; // Stop
+					pTemp->flags &= ~(FTENT_ROTATE | FTENT_GRAVITY | FTENT_SLOWGRAVITY | FTENT_COLLIDEWORLD | FTENT_SMOKETRAIL);
+					pTemp->entity.angles[0] = 0;
+					pTemp->entity.angles[2] = 0;
+				}
+			}
+		}
+
+		if ((pTemp->hitSound) != 0)
+		{
+			Callback_TempEntPlaySound(pTemp, damp);
+		}
+
+		if ((pTemp->flags & FTENT_COLLIDEKILL) != 0)
+		{
+			// die on impact
+			pTemp->flags &= ~FTENT_FADEOUT;
+			pTemp->die = client_time;
+		}
+		else
+		{
+			// Reflect velocity
+			if (damp != 0)
+			{
+				proj = DotProduct(pTemp->entity.baseline.origin, traceNormal);
+				VectorMA(pTemp->entity.baseline.origin, -proj * 2, traceNormal, pTemp->entity.baseline.origin);
+				// Reflect rotation (fake)
+
+				pTemp->entity.angles[1] = -pTemp->entity.angles[1];
+			}
+
+			if (damp != 1)
+			{
+
+				VectorScale(pTemp->entity.baseline.origin, damp, pTemp->entity.baseline.origin);
+				VectorScale(pTemp->entity.angles, 0.9, pTemp->entity.angles);
+			}
+		}
+	}
+}
+
+/*
+=================
+TEnt_CompareVisible
+
+High priority tents first, then the nearest
+=================
+*/
+static bool TEnt_CompareVisible(const tentbatch_t* a, const tentbatch_t* b)
+{
+	if (a->tent->priority != b->tent->priority)
+		return a->tent->priority > b->tent->priority;
+	return a->dist < b->dist;
+}
+
 /*
 =================
 CL_UpdateTEnts
@@ -377,9 +625,12 @@ void DLLEXPORT HUD_TempEntUpdate(
 	//	RecClTempEntUpdate(frametime, client_time, cl_gravity, ppTempEntFree, ppTempEntActive, Callback_AddVisibleEntity, Callback_TempEntPlaySound);
 
 	static int gTempEntFrame = 0;
-	int i;
+	int i, maxVisible;
 	TEMPENTITY *pTemp, *pnext, *pprev;
-	float freq, gravity, gravitySlow, life, fastFreq;
+	const tentbatch_t* prev;
+	float freq, gravity, gravitySlow, life, fastFreq, traceMove, lodDist;
+	Vector delta;
+	std::vector<tentbatch_t>& batch = s_TentBatch[s_CurTentBatch];
 
 	Vector vAngles;
 
@@ -423,12 +674,15 @@ void DLLEXPORT HUD_TempEntUpdate(
 		goto finish;
 	}
 
+	batch.clear();
+
 	pprev = NULL;
 	freq = client_time * 0.01;
 	fastFreq = client_time * 5.5;
 	gravity = -frametime * cl_gravity;
 	gravitySlow = gravity * 0.5;
 
+	// Kill off the dead and gather the rest
 	while (pTemp)
 	{
 		bool active;
@@ -463,272 +717,230 @@ void DLLEXPORT HUD_TempEntUpdate(
 		{
 			pprev = pTemp;
 
-			VectorCopy(pTemp->entity.origin, pTemp->entity.prevstate.origin);
+			tentbatch_t& t = batch.emplace_back();
+			t.tent = pTemp;
+			t.skip = false;
 
-			if ((pTemp->flags & FTENT_SPARKSHOWER) != 0)
+			prev = TEnt_FindPrevious(pTemp);
+			if (prev)
+				t.traceorigin = prev->traceorigin;
+			else
+				t.traceorigin = pTemp->entity.origin;
+		}
+		pTemp = pnext;
+	}
+
+	// Move everything
+	for (tentbatch_t& t : batch)
+	{
+		pTemp = t.tent;
+
+		VectorCopy(pTemp->entity.origin, pTemp->entity.prevstate.origin);
+
+		if ((pTemp->flags & FTENT_SPARKSHOWER) != 0)
+		{
+			// Adjust speed if it's time
+			// Scale is next think time
+			if (client_time > pTemp->entity.baseline.scale)
 			{
-				// Adjust speed if it's time
-				// Scale is next think time
-				if (client_time > pTemp->entity.baseline.scale)
+				// Show Sparks
+				gEngfuncs.pEfxAPI->R_SparkEffect(pTemp->entity.origin, 8, -200, 200);
+
+				// Reduce life
+				pTemp->entity.baseline.framerate -= 0.1;
+
+				if (pTemp->entity.baseline.framerate <= 0.0)
 				{
-					// Show Sparks
-					gEngfuncs.pEfxAPI->R_SparkEffect(pTemp->entity.origin, 8, -200, 200);
-
-					// Reduce life
-					pTemp->entity.baseline.framerate -= 0.1;
-
-					if (pTemp->entity.baseline.framerate <= 0.0)
-					{
-						pTemp->die = client_time;
-					}
-					else
-					{
-						// So it will die no matter what
-						pTemp->die = client_time + 0.5;
-
-						// Next think
-						pTemp->entity.baseline.scale = client_time + 0.1;
-					}
+					pTemp->die = client_time;
+				}
+				else
+				{
+					// So it will die no matter what
+					pTemp->die = client_time + 0.5;
+
+					// Next think
+					pTemp->entity.baseline.scale = client_time + 0.1;
 				}
 			}
-			else if ((pTemp->flags & FTENT_PLYRATTACHMENT) != 0)
-			{
-				cl_entity_t* pClient;
+		}
+		else if ((pTemp->flags & FTENT_PLYRATTACHMENT) != 0)
+		{
+			cl_entity_t* pClient;
 
-				pClient = gEngfuncs.GetEntityByIndex(pTemp->clientIndex);
+			pClient = gEngfuncs.GetEntityByIndex(pTemp->clientIndex);
 
-				VectorAdd(pClient->origin, pTemp->tentOffset, pTemp->entity.origin);
-			}
-			else if ((pTemp->flags & FTENT_SINEWAVE) != 0)
-			{
-				pTemp->x += pTemp->entity.baseline.origin[0] * frametime;
-				pTemp->y += pTemp->entity.baseline.origin[1] * frametime;
+			VectorAdd(pClient->origin, pTemp->tentOffset, pTemp->entity.origin);
+		}
+		else if ((pTemp->flags & FTENT_SINEWAVE) != 0)
+		{
+			pTemp->x += pTemp->entity.baseline.origin[0] * frametime;
+			pTemp->y += pTemp->entity.baseline.origin[1] * frametime;
 
-				pTemp->entity.origin[0] = pTemp->x + sin(pTemp->entity.baseline.origin[2] + client_time * pTemp->entity.prevstate.frame) * (10 * pTemp->entity.curstate.framerate);
-				pTemp->entity.origin[1] = pTemp->y + sin(pTemp->entity.baseline.origin[2] + fastFreq + 0.7) * (8 * pTemp->entity.curstate.framerate);
-				pTemp->entity.origin[2] += pTemp->entity.baseline.origin[2] * frametime;
-			}
-			else if ((pTemp->flags & FTENT_SPIRAL) != 0)
-			{
-				float s, c;
-				s = sin(pTemp->entity.baseline.origin[2] + fastFreq);
-				c = cos(pTemp->entity.baseline.origin[2] + fastFreq);
+			pTemp->entity.origin[0] = pTemp->x + sin(pTemp->entity.baseline.origin[2] + client_time * pTemp->entity.prevstate.frame) * (10 * pTemp->entity.curstate.framerate);
+			pTemp->entity.origin[1] = pTemp->y + sin(pTemp->entity.baseline.origin[2] + fastFreq + 0.7) * (8 * pTemp->entity.curstate.framerate);
+			pTemp->entity.origin[2] += pTemp->entity.baseline.origin[2] * frametime;
+		}
+		else if ((pTemp->flags & FTENT_SPIRAL) != 0)
+		{
+			float s, c;
+			s = sin(pTemp->entity.baseline.origin[2] + fastFreq);
+			c = cos(pTemp->entity.baseline.origin[2] + fastFreq);
 
-				pTemp->entity.origin[0] += pTemp->entity.baseline.origin[0] * frametime + 8 * sin(client_time * 20 + (int)pTemp);
-				pTemp->entity.origin[1] += pTemp->entity.baseline.origin[1] * frametime + 4 * sin(client_time * 30 + (int)pTemp);
-				pTemp->entity.origin[2] += pTemp->entity.baseline.origin[2] * frametime;
-			}
+			pTemp->entity.origin[0] += pTemp->entity.baseline.origin[0] * frametime + 8 * sin(client_time * 20 + (int)pTemp);
+			pTemp->entity.origin[1] += pTemp->entity.baseline.origin[1] * frametime + 4 * sin(client_time * 30 + (int)pTemp);
+			pTemp->entity.origin[2] += pTemp->entity.baseline.origin[2] * frametime;
+		}
 
-			else
-			{
-				for (i = 0; i < 3; i++)
-					pTemp->entity.origin[i] += pTemp->entity.baseline.origin[i] * frametime;
-			}
+		else
+		{
+			for (i = 0; i < 3; i++)
+				pTemp->entity.origin[i] += pTemp->entity.baseline.origin[i] * frametime;
+		}
 
-			if ((pTemp->flags & FTENT_SPRANIMATE) != 0)
+		if ((pTemp->flags & FTENT_SPRANIMATE) != 0)
+		{
+			pTemp->entity.curstate.frame += frametime * pTemp->entity.curstate.framerate;
+			if (pTemp->entity.curstate.frame >= pTemp->frameMax)
 			{
-				pTemp->entity.curstate.frame += frametime * pTemp->entity.curstate.framerate;
-				if (pTemp->entity.curstate.frame >= pTemp->frameMax)
+				pTemp->entity.curstate.frame = pTemp->entity.curstate.frame - (int)(pTemp->entity.curstate.frame);
+
+				if ((pTemp->flags & FTENT_SPRANIMATELOOP) == 0)
 				{
-					pTemp->entity.curstate.frame = pTemp->entity.curstate.frame - (int)(pTemp->entity.curstate.frame);
-
-					if ((pTemp->flags & FTENT_SPRANIMATELOOP) == 0)
-					{
-						// this animating sprite isn't set to loop, so destroy it.
-						pTemp->die = client_time;
-						pTemp = pnext;
-						continue;
-					}
+					// this animating sprite isn't set to loop, so destroy it.
+					pTemp->die = client_time;
+					t.skip = true;
+					continue;
 				}
 			}
-			else if ((pTemp->flags & FTENT_SPRCYCLE) != 0)
+		}
+		else if ((pTemp->flags & FTENT_SPRCYCLE) != 0)
+		{
+			pTemp->entity.curstate.frame += frametime * 10;
+			if (pTemp->entity.curstate.frame >= pTemp->frameMax)
 			{
-				pTemp->entity.curstate.frame += frametime * 10;
-				if (pTemp->entity.curstate.frame >= pTemp->frameMax)
-				{
-					pTemp->entity.curstate.frame = pTemp->entity.curstate.frame - (int)(pTemp->entity.curstate.frame);
-				}
+				pTemp->entity.curstate.frame = pTemp->entity.curstate.frame - (int)(pTemp->entity.curstate.frame);
 			}
+		}
 // Experiment
 #if 0
-			if ( pTemp->flags & FTENT_SCALE )
-				pTemp->entity.curstate.framerate += 20.0 * (frametime / pTemp->entity.curstate.framerate);
+		if ( pTemp->flags & FTENT_SCALE )
+			pTemp->entity.curstate.framerate += 20.0 * (frametime / pTemp->entity.curstate.framerate);
 #endif
 
-			if ((pTemp->flags & FTENT_ROTATE) != 0)
-			{
-				pTemp->entity.angles[0] += pTemp->entity.baseline.angles[0] * frametime;
-				pTemp->entity.angles[1] += pTemp->entity.baseline.angles[1] * frametime;
-				pTemp->entity.angles[2] += pTemp->entity.baseline.angles[2] * frametime;
-
-				VectorCopy(pTemp->entity.angles, pTemp->entity.latched.prevangles);
-			}
+		if ((pTemp->flags & FTENT_ROTATE) != 0)
+		{
+			pTemp->entity.angles[0] += pTemp->entity.baseline.angles[0] * frametime;
+			pTemp->entity.angles[1] += pTemp->entity.baseline.angles[1] * frametime;
+			pTemp->entity.angles[2] += pTemp->entity.baseline.angles[2] * frametime;
 
-			if ((pTemp->flags & (FTENT_COLLIDEALL | FTENT_COLLIDEWORLD)) != 0)
-			{
-				Vector traceNormal;
-				float traceFraction = 1;
+			VectorCopy(pTemp->entity.angles, pTemp->entity.latched.prevangles);
+		}
+	}
 
-				if ((pTemp->flags & FTENT_COLLIDEALL) != 0)
-				{
-					pmtrace_t pmtrace;
-					physent_t* pe;
+	// Collide the ones that care and have moved far enough since their last trace
+	traceMove = V_max(cl_tempent_tracemove->value, 0.0f);
+	for (tentbatch_t& t : batch)
+	{
+		pTemp = t.tent;
 
-					gEngfuncs.pEventAPI->EV_SetTraceHull(2);
+		if (t.skip || (pTemp->flags & (FTENT_COLLIDEALL | FTENT_COLLIDEWORLD)) == 0)
+		{
+			t.traceorigin = pTemp->entity.origin;
+			continue;
+		}
 
-					gEngfuncs.pEventAPI->EV_PlayerTrace(pTemp->entity.prevstate.origin, pTemp->entity.origin, PM_STUDIO_BOX, -1, &pmtrace);
+		delta = pTemp->entity.origin - t.traceorigin;
+		if (DotProduct(delta, delta) < traceMove * traceMove)
+			continue;
 
+		TEnt_Collide(pTemp, t.traceorigin, gravity, client_time, Callback_TempEntPlaySound);
+		t.traceorigin = pTemp->entity.origin;
+	}
 
-					if (pmtrace.fraction != 1)
-					{
-						pe = gEngfuncs.pEventAPI->EV_GetPhysent(pmtrace.ent);
+	// Effects, gravity and custom think
+	for (tentbatch_t& t : batch)
+	{
+		if (t.skip)
+			continue;
 
-						if (0 == pmtrace.ent || (pe->info != pTemp->clientIndex))
-						{
-							traceFraction = pmtrace.fraction;
-							VectorCopy(pmtrace.plane.normal, traceNormal);
+		pTemp = t.tent;
 
-							if (pTemp->hitcallback)
-							{
-								(*pTemp->hitcallback)(pTemp, &pmtrace);
-							}
-						}
-					}
-				}
-				else if ((pTemp->flags & FTENT_COLLIDEWORLD) != 0)
-				{
-					pmtrace_t pmtrace;
-
-					gEngfuncs.pEventAPI->EV_SetTraceHull(2);
-
-					gEngfuncs.pEventAPI->EV_PlayerTrace(pTemp->entity.prevstate.origin, pTemp->entity.origin, PM_STUDIO_BOX | PM_WORLD_ONLY, -1, &pmtrace);
-
-					if (pmtrace.fraction != 1)
-					{
-						traceFraction = pmtrace.fraction;
-						VectorCopy(pmtrace.plane.normal, traceNormal);
-
-						if ((pTemp->flags & FTENT_SPARKSHOWER) != 0)
-						{
-							// Chop spark speeds a bit more
-							//
-							VectorScale(pTemp->entity.baseline.origin, 0.6, pTemp->entity.baseline.origin);
-
-							if (Length(pTemp->entity.baseline.origin) < 10)
-							{
-								pTemp->entity.baseline.framerate = 0.0;
-							}
-						}
-
-						if (pTemp->hitcallback)
-						{
-							(*pTemp->hitcallback)(pTemp, &pmtrace);
-						}
-					}
-				}
+		if ((pTemp->flags & FTENT_FLICKER) != 0 && gTempEntFrame == pTemp->entity.curstate.effects)
+		{
+			dlight_t* dl = gEngfuncs.pEfxAPI->CL_AllocDlight(0);
+			VectorCopy(pTemp->entity.origin, dl->origin);
+			dl->radius = 60;
+			dl->color.r = 255;
+			dl->color.g = 120;
+			dl->color.b = 0;
+			dl->die = client_time + 0.01;
+		}
 
-				if (traceFraction != 1) // Decent collision now, and damping works
-				{
-					float proj, damp;
-
-					// Place at contact point
-					VectorMA(pTemp->entity.prevstate.origin, traceFraction * frametime, pTemp->entity.baseline.origin, pTemp->entity.origin);
-					// Damp velocity
-					damp = pTemp->bounceFactor;
-					if ((pTemp->flags & (FTENT_GRAVITY | FTENT_SLOWGRAVITY)) != 0)
-					{
-						damp *= 0.5;
-						if (traceNormal[2] > 0.9) // Hit floor?
-						{
-							if (pTemp->entity.baseline.origin[2] <= 0 && pTemp->entity.baseline.origin[2] >= gravity * 3)
-							{
-								damp = 0; // Stop
-								pTemp->flags &= ~(FTENT_ROTATE | FTENT_GRAVITY | FTENT_SLOWGRAVITY | FTENT_COLLIDEWORLD | FTENT_SMOKETRAIL);
-								pTemp->entity.angles[0] = 0;
-								pTemp->entity.angles[2] = 0;
-							}
-						}
-					}
-
-					if ((pTemp->hitSound) != 0)
-					{
-						Callback_TempEntPlaySound(pTemp, damp);
-					}
-
-					if ((pTemp->flags & FTENT_COLLIDEKILL) != 0)
-					{
-						// die on impact
-						pTemp->flags &= ~FTENT_FADEOUT;
-						pTemp->die = client_time;
-					}
-					else
-					{
-						// Reflect velocity
-						if (damp != 0)
-						{
-							proj = DotProduct(pTemp->entity.baseline.origin, traceNormal);
-							VectorMA(pTemp->entity.baseline.origin, -proj * 2, traceNormal, pTemp->entity.baseline.origin);
-							// Reflect rotation (fake)
-
-							pTemp->entity.angles[1] = -pTemp->entity.angles[1];
-						}
-
-						if (damp != 1)
-						{
-
-							VectorScale(pTemp->entity.baseline.origin, damp, pTemp->entity.baseline.origin);
-							VectorScale(pTemp->entity.angles, 0.9, pTemp->entity.angles);
-						}
-					}
-				}
-			}
+		if ((pTemp->flags & FTENT_SMOKETRAIL) != 0)
+		{
+			gEngfuncs.pEfxAPI->R_RocketTrail(pTemp->entity.prevstate.origin, pTemp->entity.origin, 1);
+		}
 
+		if ((pTemp->flags & FTENT_GRAVITY) != 0)
+			pTemp->entity.baseline.origin[2] += gravity;
+		else if ((pTemp->flags & FTENT_SLOWGRAVITY) != 0)
+			pTemp->entity.baseline.origin[2] += gravitySlow;
 
-			if ((pTemp->flags & FTENT_FLICKER) != 0 && gTempEntFrame == pTemp->entity.curstate.effects)
+		if ((pTemp->flags & FTENT_CLIENTCUSTOM) != 0)
+		{
+			if (pTemp->callback)
 			{
-				dlight_t* dl = gEngfuncs.pEfxAPI->CL_AllocDlight(0);
-				VectorCopy(pTemp->entity.origin, dl->origin);
-				dl->radius = 60;
-				dl->color.r = 255;
-				dl->color.g = 120;
-				dl->color.b = 0;
-				dl->die = client_time + 0.01;
+				(*pTemp->callback)(pTemp, frametime, client_time);
 			}
+		}
+	}
 
-			if ((pTemp->flags & FTENT_SMOKETRAIL) != 0)
-			{
-				gEngfuncs.pEfxAPI->R_RocketTrail(pTemp->entity.prevstate.origin, pTemp->entity.origin, 1);
-			}
+	// Low priority tents too far away to matter aren't drawn this frame, but live on
+	// like the ones over cl_tempent_max, so they are back if the view gets closer
+	lodDist = V_max(cl_tempent_lod->value, 0.0f);
+	s_TentVisible.clear();
+	for (tentbatch_t& t : batch)
+	{
+		pTemp = t.tent;
 
-			if ((pTemp->flags & FTENT_GRAVITY) != 0)
-				pTemp->entity.baseline.origin[2] += gravity;
-			else if ((pTemp->flags & FTENT_SLOWGRAVITY) != 0)
-				pTemp->entity.baseline.origin[2] += gravitySlow;
+		if (t.skip || (pTemp->flags & FTENT_NOMODEL) != 0)
+			continue;
 
-			if ((pTemp->flags & FTENT_CLIENTCUSTOM) != 0)
-			{
-				if (pTemp->callback)
-				{
-					(*pTemp->callback)(pTemp, frametime, client_time);
-				}
-			}
+		delta = pTemp->entity.origin - v_origin;
+		t.dist = DotProduct(delta, delta);
 
-			// Cull to PVS (not frustum cull, just PVS)
-			if ((pTemp->flags & FTENT_NOMODEL) == 0)
+		if (lodDist != 0 && pTemp->priority == TENTPRIORITY_LOW && t.dist > lodDist * lodDist)
+			continue;
+
+		s_TentVisible.push_back(&t);
+	}
+
+	// Only draw the most important ones when there are too many, the rest carry on
+	// simulating and get another chance next frame
+	maxVisible = (int)s_TentVisible.size();
+	if (cl_tempent_max->value > 0 && maxVisible > (int)cl_tempent_max->value)
+	{
+		maxVisible = (int)cl_tempent_max->value;
+		std::nth_element(s_TentVisible.begin(), s_TentVisible.begin() + maxVisible, s_TentVisible.end(), TEnt_CompareVisible);
+	}
+
+	// Cull to PVS (not frustum cull, just PVS)
+	for (i = 0; i < maxVisible; i++)
+	{
+		pTemp = s_TentVisible[i]->tent;
+
+		if (0 == Callback_AddVisibleEntity(&pTemp->entity))
+		{
+			if ((pTemp->flags & FTENT_PERSIST) == 0)
 			{
-				if (0 == Callback_AddVisibleEntity(&pTemp->entity))
-				{
-					if ((pTemp->flags & FTENT_PERSIST) == 0)
-					{
-						pTemp->die = client_time;		// If we can't draw it this frame, just dump it.
-						pTemp->flags &= ~FTENT_FADEOUT; // Don't fade out, just die
-					}
-				}
+				pTemp->die = client_time;		// If we can't draw it this frame, just dump it.
+				pTemp->flags &= ~FTENT_FADEOUT; // Don't fade out, just die
 			}
 		}
-		pTemp = pnext;
 	}
 
+	TEnt_FinishBatch();
+
 finish:
 	// Restore state info
 	gEngfuncs.pEventAPI->EV_PopPMStates();
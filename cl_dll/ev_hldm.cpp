@@ -260,14 +260,15 @@ char* EV_HLDM_DamageDecal(physent_t* pe)
 	return decalname;
 }
 
-void EV_HLDM_GunshotDecalTrace(pmtrace_t* pTrace, char* decalName)
+// pe is the physent that was hit, ricochet says whether this hit may play a
+// ricochet sound and decals whether r_decals is on
+static void EV_HLDM_GunshotImpact(pmtrace_t* pTrace, char* decalName, physent_t* pe, bool ricochet, bool decals)
 {
 	int iRand;
-	physent_t* pe;
 
 	gEngfuncs.pEfxAPI->R_BulletImpactParticles(pTrace->endpos);
 
-	iRand = gEngfuncs.pfnRandomLong(0, 0x7FFF);
+	iRand = ricochet ? gEngfuncs.pfnRandomLong(0, 0x7FFF) : 0x7FFF;
 	if (iRand < (0x7fff / 2)) // not every bullet makes a sound.
 	{
 		switch (iRand % 5)
@@ -290,12 +291,10 @@ void EV_HLDM_GunshotDecalTrace(pmtrace_t* pTrace, char* decalName)
 		}
 	}
 
-	pe = gEngfuncs.pEventAPI->EV_GetPhysent(pTrace->ent);
-
 	// Only decal brush models such as the world etc.
 	if (decalName && '\0' != decalName[0] && pe && (pe->solid == SOLID_BSP || pe->movetype == MOVETYPE_PUSHSTEP))
 	{
-		if (CVAR_GET_FLOAT("r_decals"))
+		if (decals)
 		{
 			gEngfuncs.pEfxAPI->R_DecalShoot(
 				gEngfuncs.pEfxAPI->Draw_DecalIndex(gEngfuncs.pEfxAPI->Draw_DecalIndexFromName(decalName)),
@@ -304,6 +303,11 @@ void EV_HLDM_GunshotDecalTrace(pmtrace_t* pTrace, char* decalName)
 	}
 }
 
+void EV_HLDM_GunshotDecalTrace(pmtrace_t* pTrace, char* decalName)
+{
+	EV_HLDM_GunshotImpact(pTrace, decalName, gEngfuncs.pEventAPI->EV_GetPhysent(pTrace->ent), true, 0 != CVAR_GET_FLOAT("r_decals"));
+}
+
 void EV_HLDM_DecalGunshot(pmtrace_t* pTrace, int iBulletType)
 {
 	physent_t* pe;
@@ -368,47 +372,105 @@ void EV_HLDM_CheckTracer(int idx, float* vecSrc, float* end, float* forward, flo
 }
 
 
+// most pellets a single batch traces at once
+#define EV_MAX_PELLETS 32
+
+// a surface one or more pellets of a shot have hit
+typedef struct
+{
+	int ent;
+	Vector normal;
+	float dist;
+	physent_t* pe;
+} ev_surface_t;
+
+/*
+================
+EV_HLDM_FindSurface
+
+Returns true if this is the first pellet of the shot to hit the surface
+================
+*/
+static bool EV_HLDM_FindSurface(pmtrace_t* ptr, ev_surface_t* surfaces, int* numsurfaces, ev_surface_t** surface)
+{
+	int i;
+	ev_surface_t* s;
+
+	for (i = 0, s = surfaces; i < *numsurfaces; i++, s++)
+	{
+		if (s->ent == ptr->ent && fabs(s->dist - ptr->plane.dist) < 1 && DotProduct(s->normal, ptr->plane.normal) > 0.99)
+		{
+			*surface = s;
+			return false;
+		}
+	}
+
+	s = &surfaces[(*numsurfaces)++];
+	s->ent = ptr->ent;
+	VectorCopy(ptr->plane.normal, s->normal);
+	s->dist = ptr->plane.dist;
+	s->pe = gEngfuncs.pEventAPI->EV_GetPhysent(ptr->ent);
+
+	*surface = s;
+	return true;
+}
+
 /*
 ================
 FireBullets
 
 Go to the trouble of combining multiple pellets into a single damage call.
+
+The pellets are traced in batches, with the players made solid once per
+batch, and the material sound and ricochet are only played for the first
+pellet to hit each surface.
 ================
 */
 void EV_HLDM_FireBullets(int idx, float* forward, float* right, float* up, int cShots, float* vecSrc, float* vecDirShooting, float flDistance, int iBulletType, int iTracerFreq, int* tracerCount, float flSpreadX, float flSpreadY)
 {
 	int i;
-	pmtrace_t tr;
-	int iShot;
-
-	for (iShot = 1; iShot <= cShots; iShot++)
+	pmtrace_t tr[EV_MAX_PELLETS];
+	Vector vecEnd[EV_MAX_PELLETS];
+	ev_surface_t surfaces[EV_MAX_PELLETS];
+	ev_surface_t* surface;
+	int numsurfaces;
+	int iShot, firstShot, numShots;
+	bool first;
+	const bool decals = 0 != CVAR_GET_FLOAT("r_decals");
+
+	for (firstShot = 0; firstShot < cShots; firstShot += numShots)
 	{
-		Vector vecDir, vecEnd;
+		numShots = V_min(cShots - firstShot, EV_MAX_PELLETS);
 
-		float x, y, z;
-		//We randomize for the Shotgun.
-		if (iBulletType == BULLET_PLAYER_BUCKSHOT)
+		for (iShot = 0; iShot < numShots; iShot++)
 		{
-			do
-			{
-				x = gEngfuncs.pfnRandomFloat(-0.5, 0.5) + gEngfuncs.pfnRandomFloat(-0.5, 0.5);
-				y = gEngfuncs.pfnRandomFloat(-0.5, 0.5) + gEngfuncs.pfnRandomFloat(-0.5, 0.5);
-				z = x * x + y * y;
-			} while (z > 1);
+			Vector vecDir;
 
-			for (i = 0; i < 3; i++)
+			float x, y, z;
+			//We randomize for the Shotgun.
+			if (iBulletType == BULLET_PLAYER_BUCKSHOT)
 			{
-				vecDir[i] = vecDirShooting[i] + x * flSpreadX * right[i] + y * flSpreadY * up[i];
-				vecEnd[i] = vecSrc[i] + flDistance * vecDir[i];
-			}
-		} //But other guns already have their spread randomized in the synched spread.
-		else
-		{
+				do
+				{
+					x = gEngfuncs.pfnRandomFloat(-0.5, 0.5) + gEngfuncs.pfnRandomFloat(-0.5, 0.5);
+					y = gEngfuncs.pfnRandomFloat(-0.5, 0.5) + gEngfuncs.pfnRandomFloat(-0.5, 0.5);
+					z = x * x + y * y;
+				} while (z > 1);
 
-			for (i = 0; i < 3; i++)
+				for (i = 0; i < 3; i++)
+				{
+					vecDir[i] = vecDirShooting[i] + x * flSpreadX * right[i] + y * flSpreadY * up[i];
+					vecEnd[iShot][i] = vecSrc[i] + flDistance * vecDir[i];
+				}
+			} //But other guns already have their spread randomized in the synched spread.
+			else
 			{
-				vecDir[i] = vecDirShooting[i] + flSpreadX * right[i] + flSpreadY * up[i];
-				vecEnd[i] = vecSrc[i] + flDistance * vecDir[i];
+
+				for (i = 0; i < 3; i++)
+				{
+					vecDir[i] = vecDirShooting[i] + flSpreadX * right[i] + flSpreadY * up[i];
+					vecEnd[iShot][i] = vecSrc[i] + flDistance * vecDir[i];
+				}
 			}
 		}
 
@@ -421,38 +483,42 @@ void EV_HLDM_FireBullets(int idx, float* forward, float* right, float* up, int c
 		gEngfuncs.pEventAPI->EV_SetSolidPlayers(idx - 1);
 
 		gEngfuncs.pEventAPI->EV_SetTraceHull(2);
-		gEngfuncs.pEventAPI->EV_PlayerTrace(vecSrc, vecEnd, PM_STUDIO_BOX, -1, &tr);
 
-		EV_HLDM_CheckTracer(idx, vecSrc, tr.endpos, forward, right, iBulletType, iTracerFreq, tracerCount);
-
-		// do damage, paint decals
-		if (tr.fraction != 1.0)
+		for (iShot = 0; iShot < numShots; iShot++)
 		{
-			switch (iBulletType)
-			{
-			default:
-			case BULLET_PLAYER_9MM:
+			gEngfuncs.pEventAPI->EV_PlayerTrace(vecSrc, vecEnd[iShot], PM_STUDIO_BOX, -1, &tr[iShot]);
+		}
 
-				EV_HLDM_PlayTextureSound(idx, &tr, vecSrc, vecEnd, iBulletType);
-				EV_HLDM_DecalGunshot(&tr, iBulletType);
+		// the trace results refer to this set of physents, so the effects
+		// have to be done before they are popped
+		numsurfaces = 0;
 
-				break;
-			case BULLET_PLAYER_MP5:
-
-				EV_HLDM_PlayTextureSound(idx, &tr, vecSrc, vecEnd, iBulletType);
-				EV_HLDM_DecalGunshot(&tr, iBulletType);
-				break;
-			case BULLET_PLAYER_BUCKSHOT:
+		for (iShot = 0; iShot < numShots; iShot++)
+		{
+			EV_HLDM_CheckTracer(idx, vecSrc, tr[iShot].endpos, forward, right, iBulletType, iTracerFreq, tracerCount);
 
-				EV_HLDM_DecalGunshot(&tr, iBulletType);
+			// do damage, paint decals
+			if (tr[iShot].fraction != 1.0)
+			{
+				first = EV_HLDM_FindSurface(&tr[iShot], surfaces, &numsurfaces, &surface);
 
-				break;
-			case BULLET_PLAYER_357:
+				switch (iBulletType)
+				{
+				default:
+				case BULLET_PLAYER_9MM:
+				case BULLET_PLAYER_MP5:
+				case BULLET_PLAYER_357:
 
-				EV_HLDM_PlayTextureSound(idx, &tr, vecSrc, vecEnd, iBulletType);
-				EV_HLDM_DecalGunshot(&tr, iBulletType);
+					if (first)
+						EV_HLDM_PlayTextureSound(idx, &tr[iShot], vecSrc, vecEnd[iShot], iBulletType);
+					break;
+				case BULLET_PLAYER_BUCKSHOT:
+					break;
+				}
 
-				break;
+				// same as EV_HLDM_DecalGunshot, with the physent looked up once per surface
+				if (surface->pe && surface->pe->solid == SOLID_BSP)
+					EV_HLDM_GunshotImpact(&tr[iShot], EV_HLDM_DamageDecal(surface->pe), surface->pe, first, decals);
 			}
 		}
 
@@ -85,6 +85,9 @@ cvar_t* cl_lw = NULL;
 cvar_t* cl_rollangle = nullptr;
 cvar_t* cl_rollspeed = nullptr;
 cvar_t* cl_bobtilt = nullptr;
+cvar_t* cl_tempent_max = nullptr;
+cvar_t* cl_tempent_lod = nullptr;
+cvar_t* cl_tempent_tracemove = nullptr;
 
 void ShutdownInput();
 
@@ -333,10 +336,14 @@ void CHud::Init()
 	default_fov = CVAR_CREATE("default_fov", "90", FCVAR_ARCHIVE);
 	m_pCvarStealMouse = CVAR_CREATE("hud_capturemouse", "1", FCVAR_ARCHIVE);
 	m_pCvarDraw = CVAR_CREATE("hud_draw", "1", FCVAR_ARCHIVE);
+	HudSprite_Init();
 	cl_lw = gEngfuncs.pfnGetCvarPointer("cl_lw");
 	cl_rollangle = CVAR_CREATE("cl_rollangle", "2.0", FCVAR_ARCHIVE);
 	cl_rollspeed = CVAR_CREATE("cl_rollspeed", "200", FCVAR_ARCHIVE);
 	cl_bobtilt = CVAR_CREATE("cl_bobtilt", "0", FCVAR_ARCHIVE);
+	cl_tempent_max = CVAR_CREATE("cl_tempent_max", "256", FCVAR_ARCHIVE);			 // most temp entities drawn in a frame, 0 for no limit
+	cl_tempent_lod = CVAR_CREATE("cl_tempent_lod", "2048", FCVAR_ARCHIVE);			 // low priority temp entities further away are not drawn, 0 to draw them all
+	cl_tempent_tracemove = CVAR_CREATE("cl_tempent_tracemove", "1", FCVAR_ARCHIVE); // distance a colliding temp entity moves between traces
 
 	m_pSpriteList = NULL;
 
@@ -384,6 +391,7 @@ CHud::~CHud()
 	delete[] m_rghSprites;
 	delete[] m_rgrcRects;
 	delete[] m_rgszSpriteNames;
+	delete[] m_rgiSpriteHash;
 
 	if (m_pHudList)
 	{
@@ -404,9 +412,16 @@ CHud::~CHud()
 // returns 0 if sprite not found
 int CHud::GetSpriteIndex(const char* SpriteName)
 {
-	// look through the loaded sprite name list for SpriteName
-	for (int i = 0; i < m_iSpriteCount; i++)
+	int h;
+
+	if (!m_rgiSpriteHash)
+		return -1;
+
+	// look through the hash of loaded sprite names for SpriteName
+	for (h = SpriteNameHash(SpriteName) & m_iSpriteHashMask; m_rgiSpriteHash[h] != -1; h = (h + 1) & m_iSpriteHashMask)
 	{
+		const int i = m_rgiSpriteHash[h];
+
 		if (strncmp(SpriteName, m_rgszSpriteNames + (i * MAX_SPRITE_NAME_LENGTH), MAX_SPRITE_NAME_LENGTH) == 0)
 			return i;
 	}
@@ -414,6 +429,45 @@ int CHud::GetSpriteIndex(const char* SpriteName)
 	return -1; // invalid sprite
 }
 
+// SpriteNameHash()
+// hashes the part of a name GetSpriteIndex compares
+int CHud::SpriteNameHash(const char* SpriteName)
+{
+	unsigned int hash = 2166136261u;
+
+	for (int i = 0; i < MAX_SPRITE_NAME_LENGTH && SpriteName[i]; i++)
+	{
+		hash = (hash ^ (unsigned char)SpriteName[i]) * 16777619u;
+	}
+
+	return (int)(hash & 0x7fffffff);
+}
+
+// BuildSpriteHash()
+// fills the open addressed table GetSpriteIndex looks names up in.  Names are
+// added in order, so a duplicate still finds the first one like the old linear search
+void CHud::BuildSpriteHash()
+{
+	int i, h;
+
+	delete[] m_rgiSpriteHash;
+
+	m_iSpriteHashMask = 1;
+	while (m_iSpriteHashMask < m_iSpriteCount * 2)
+		m_iSpriteHashMask <<= 1;
+
+	m_rgiSpriteHash = new int[m_iSpriteHashMask];
+	memset(m_rgiSpriteHash, -1, m_iSpriteHashMask * sizeof(int));
+	m_iSpriteHashMask--;
+
+	for (i = 0; i < m_iSpriteCount; i++)
+	{
+		for (h = SpriteNameHash(m_rgszSpriteNames + (i * MAX_SPRITE_NAME_LENGTH)) & m_iSpriteHashMask; m_rgiSpriteHash[h] != -1; h = (h + 1) & m_iSpriteHashMask)
+			;
+		m_rgiSpriteHash[h] = i;
+	}
+}
+
 void CHud::VidInit()
 {
 	m_scrinfo.iSize = sizeof(m_scrinfo);
@@ -473,6 +527,8 @@ void CHud::VidInit()
 
 				p++;
 			}
+
+			BuildSpriteHash();
 		}
 	}
 	else
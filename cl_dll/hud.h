@@ -539,6 +539,11 @@ private:
 	HSPRITE* m_rghSprites; /*[HUD_SPRITE_COUNT]*/ // the sprites loaded from hud.txt
 	Rect* m_rgrcRects;							  /*[HUD_SPRITE_COUNT]*/
 	char* m_rgszSpriteNames;					  /*[HUD_SPRITE_COUNT][MAX_SPRITE_NAME_LENGTH]*/
+	int* m_rgiSpriteHash;						  // sprite name hash -> index, -1 for an empty slot
+	int m_iSpriteHashMask;
+
+	int SpriteNameHash(const char* SpriteName);
+	void BuildSpriteHash();
 
 	struct cvar_s* default_fov;
 
@@ -578,7 +583,7 @@ public:
 	bool Redraw(float flTime, bool intermission);
 	bool UpdateClientData(client_data_t* cdata, float time);
 
-	CHud() : m_iSpriteCount(0), m_pHudList(NULL) {}
+	CHud() : m_iSpriteCount(0), m_pHudList(NULL), m_rgiSpriteHash(NULL), m_iSpriteHashMask(0) {}
 	~CHud(); // destructor, frees allocated memory
 
 	// user messages
@@ -138,6 +138,8 @@ bool CHud::Redraw(float flTime, bool intermission)
 	// return 0;
 
 	// draw all registered HUD elements
+	HudSprite_BeginFrame();
+
 	if (0 != m_pCvarDraw->value)
 	{
 		HUDLIST* pList = m_pHudList;
@@ -155,6 +157,9 @@ bool CHud::Redraw(float flTime, bool intermission)
 					pList->p->Draw(flTime);
 			}
 
+			// keep each element's sprites in order with the next one's text and fills
+			HudSprite_Flush();
+
 			pList = pList->pNext;
 		}
 	}
@@ -180,6 +185,8 @@ bool CHud::Redraw(float flTime, bool intermission)
 		SPR_DrawAdditive(i, x, y, NULL);
 	}
 
+	HudSprite_EndFrame();
+
 	/*
 	if ( g_iVisibleMouse )
 	{
@@ -0,0 +1,310 @@
+/***
+*
+*	Copyright (c) 1999, Valve LLC. All rights reserved.
+*	
+*	This product contains software technology licensed from Id 
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc. 
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+//
+// hud_spritebatch.cpp
+//
+// While the HUD is being redrawn, SPR_DrawAdditive only queues a quad.
+// The queue is flushed after each HUD element, sorted by sprite and frame,
+// so every texture is bound once and its quads go out in a single TriAPI
+// batch.  Additive blending doesn't care about the order things are drawn
+// in, so sorting doesn't change the picture.  Anything that does care
+// (solid sprites, holes, scissoring) flushes the queue and goes straight
+// to the engine.
+//
+#include <algorithm>
+#include <vector>
+
+#include "hud.h"
+#include "cl_util.h"
+#include "const.h"
+#include "com_model.h"
+#include "triangleapi.h"
+#include "r_studioint.h"
+
+extern engine_studio_api_t IEngineStudio;
+
+typedef struct
+{
+	HSPRITE hSprite;
+	int frame;
+	int order; // keeps the sort stable
+	float x0, y0, x1, y1;
+	float s0, t0, s1, t1;
+	unsigned char r, g, b;
+} hudquad_t;
+
+static cvar_t* hud_batch = nullptr;
+
+static std::vector<hudquad_t> s_Quads;
+static bool s_bCollecting = false;
+static bool s_bScissor = false;
+
+// what the last SPR_Set asked for
+static HSPRITE s_hSprite = 0;
+static unsigned char s_r, s_g, s_b;
+
+/*
+====================
+HudSprite_Init
+
+====================
+*/
+void HudSprite_Init()
+{
+	hud_batch = CVAR_CREATE("hud_batch", "1", FCVAR_ARCHIVE);
+}
+
+/*
+====================
+HudSprite_Batching
+
+====================
+*/
+static bool HudSprite_Batching()
+{
+	if (!s_bCollecting || s_bScissor)
+		return false;
+
+	// TriAPI can't stand in for the software renderer's sprite drawing
+	if (!hud_batch || 0 == hud_batch->value || 0 == IEngineStudio.IsHardware())
+		return false;
+
+	return true;
+}
+
+/*
+====================
+HudSprite_Set
+
+====================
+*/
+void HudSprite_Set(HSPRITE hPic, int r, int g, int b)
+{
+	s_hSprite = hPic;
+	s_r = V_max(0, V_min(r, 255));
+	s_g = V_max(0, V_min(g, 255));
+	s_b = V_max(0, V_min(b, 255));
+
+	// still needed by whatever is drawn straight away
+	gEngfuncs.pfnSPR_Set(hPic, r, g, b);
+}
+
+/*
+====================
+HudSprite_DrawAdditive
+
+====================
+*/
+void HudSprite_DrawAdditive(int frame, int x, int y, const Rect* prc)
+{
+	hudquad_t quad;
+	int width, height;
+	Rect rc;
+
+	if (!HudSprite_Batching() || 0 == s_hSprite)
+	{
+		gEngfuncs.pfnSPR_DrawAdditive(frame, x, y, prc);
+		return;
+	}
+
+	width = SPR_Width(s_hSprite, frame);
+	height = SPR_Height(s_hSprite, frame);
+	if (width <= 0 || height <= 0)
+		return;
+
+	if (prc)
+	{
+		// clipped to the frame like the engine does
+		rc.left = V_max(prc->left, 0);
+		rc.top = V_max(prc->top, 0);
+		rc.right = V_min(prc->right, width);
+		rc.bottom = V_min(prc->bottom, height);
+	}
+	else
+	{
+		rc.left = rc.top = 0;
+		rc.right = width;
+		rc.bottom = height;
+	}
+
+	if (rc.right <= rc.left || rc.bottom <= rc.top)
+		return;
+
+	quad.hSprite = s_hSprite;
+	quad.frame = frame;
+	quad.order = (int)s_Quads.size();
+	quad.x0 = x;
+	quad.y0 = y;
+	quad.x1 = x + (rc.right - rc.left);
+	quad.y1 = y + (rc.bottom - rc.top);
+	quad.s0 = (float)rc.left / width;
+	quad.t0 = (float)rc.top / height;
+	quad.s1 = (float)rc.right / width;
+	quad.t1 = (float)rc.bottom / height;
+	quad.r = s_r;
+	quad.g = s_g;
+	quad.b = s_b;
+
+	s_Quads.push_back(quad);
+}
+
+/*
+====================
+HudSprite_Draw
+
+====================
+*/
+void HudSprite_Draw(int frame, int x, int y, const Rect* prc)
+{
+	HudSprite_Flush();
+	gEngfuncs.pfnSPR_Draw(frame, x, y, prc);
+}
+
+/*
+====================
+HudSprite_DrawHoles
+
+====================
+*/
+void HudSprite_DrawHoles(int frame, int x, int y, const Rect* prc)
+{
+	HudSprite_Flush();
+	gEngfuncs.pfnSPR_DrawHoles(frame, x, y, prc);
+}
+
+/*
+====================
+HudSprite_EnableScissor
+
+====================
+*/
+void HudSprite_EnableScissor(int x, int y, int width, int height)
+{
+	HudSprite_Flush();
+	s_bScissor = true;
+	gEngfuncs.pfnSPR_EnableScissor(x, y, width, height);
+}
+
+/*
+====================
+HudSprite_DisableScissor
+
+====================
+*/
+void HudSprite_DisableScissor()
+{
+	s_bScissor = false;
+	gEngfuncs.pfnSPR_DisableScissor();
+}
+
+/*
+====================
+HudSprite_CompareQuads
+
+====================
+*/
+static bool HudSprite_CompareQuads(const hudquad_t& a, const hudquad_t& b)
+{
+	if (a.hSprite != b.hSprite)
+		return a.hSprite < b.hSprite;
+	if (a.frame != b.frame)
+		return a.frame < b.frame;
+	return a.order < b.order;
+}
+
+/*
+====================
+HudSprite_Flush
+
+====================
+*/
+void HudSprite_Flush()
+{
+	size_t i, j;
+	model_s* pSprite;
+
+	if (s_Quads.empty())
+		return;
+
+	std::sort(s_Quads.begin(), s_Quads.end(), HudSprite_CompareQuads);
+
+	gEngfuncs.pTriAPI->CullFace(TRI_NONE);
+	gEngfuncs.pTriAPI->RenderMode(kRenderTransAdd);
+
+	for (i = 0; i < s_Quads.size(); i = j)
+	{
+		// every quad of the same sprite frame
+		for (j = i + 1; j < s_Quads.size(); j++)
+		{
+			if (s_Quads[j].hSprite != s_Quads[i].hSprite || s_Quads[j].frame != s_Quads[i].frame)
+				break;
+		}
+
+		pSprite = (model_s*)gEngfuncs.GetSpritePointer(s_Quads[i].hSprite);
+		if (!pSprite || 0 == gEngfuncs.pTriAPI->SpriteTexture(pSprite, s_Quads[i].frame))
+			continue;
+
+		gEngfuncs.pTriAPI->Begin(TRI_QUADS);
+
+		for (size_t k = i; k < j; k++)
+		{
+			const hudquad_t& quad = s_Quads[k];
+
+			gEngfuncs.pTriAPI->Color4ub(quad.r, quad.g, quad.b, 255);
+
+			gEngfuncs.pTriAPI->TexCoord2f(quad.s0, quad.t0);
+			gEngfuncs.pTriAPI->Vertex3f(quad.x0, quad.y0, 0);
+
+			gEngfuncs.pTriAPI->TexCoord2f(quad.s1, quad.t0);
+			gEngfuncs.pTriAPI->Vertex3f(quad.x1, quad.y0, 0);
+
+			gEngfuncs.pTriAPI->TexCoord2f(quad.s1, quad.t1);
+			gEngfuncs.pTriAPI->Vertex3f(quad.x1, quad.y1, 0);
+
+			gEngfuncs.pTriAPI->TexCoord2f(quad.s0, quad.t1);
+			gEngfuncs.pTriAPI->Vertex3f(quad.x0, quad.y1, 0);
+		}
+
+		gEngfuncs.pTriAPI->End();
+	}
+
+	gEngfuncs.pTriAPI->RenderMode(kRenderNormal);
+
+	s_Quads.clear();
+}
+
+/*
+====================
+HudSprite_BeginFrame
+
+====================
+*/
+void HudSprite_BeginFrame()
+{
+	s_Quads.clear();
+	s_bCollecting = true;
+}
+
+/*
+====================
+HudSprite_EndFrame
+
+====================
+*/
+void HudSprite_EndFrame()
+{
+	HudSprite_Flush();
+	s_bCollecting = false;
+}
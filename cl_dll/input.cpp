@@ -33,6 +33,7 @@ float anglemod(float a);
 void IN_Init();
 void IN_Move(float frametime, usercmd_t* cmd);
 void IN_Shutdown();
+void R_StudioShutdown();
 void V_Init();
 void VectorAngles(const float* forward, float* angles);
 int CL_ButtonBits(bool);
@@ -1020,6 +1021,7 @@ void DLLEXPORT HUD_Shutdown()
 
 	ShutdownInput();
 
+	R_StudioShutdown();
 
 	FileSystem_FreeFileSystem();
 	CL_UnloadParticleMan();
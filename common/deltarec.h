@@ -0,0 +1,66 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*	
+*	This product contains software technology licensed from Id 
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc. 
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+
+// deltarec.h -- the entity state recordings sv_deltarecord writes and
+// the deltaprof tool replays
+
+#pragma once
+
+//
+// A recording is a deltarecheader_t, then numfields deltarecfield_t that
+// say where each entity_state_t field delta.lst can name lives in a
+// recorded state, then a stream of chunks.  Every chunk starts with a
+// deltarecchunk_t.  States are stored exactly as they were in memory, so
+// the tool needs nothing from the game's headers.
+//
+#define DELTAREC_IDENT (('C' << 24) + ('E' << 16) + ('R' << 8) + 'D') // little-endian "DREC"
+#define DELTAREC_VERSION 1
+
+#define DELTAREC_MAX_NAME 32
+
+typedef struct
+{
+	int ident;
+	int version;
+	int statesize; // sizeof(entity_state_t) on the server
+	int numfields;
+	int maxclients;
+	int maxentities;
+} deltarecheader_t;
+
+typedef struct
+{
+	char name[DELTAREC_MAX_NAME]; // spelled as in delta.lst, "origin[0]", "rendercolor.r"
+	int offset;
+	int size;
+} deltarecfield_t;
+
+typedef enum
+{
+	DELTAREC_CLASS = 0, // number is a new class, followed by char[DELTAREC_MAX_NAME]
+	DELTAREC_BASELINE,	// number's baseline, followed by the state
+	DELTAREC_FRAME,		// a server frame starts at time
+	DELTAREC_STATE,		// number's state changed, count is its class, followed by the state
+	DELTAREC_PACKET,	// number is the client, followed by count shorts of entities sent to it
+	DELTAREC_END
+} deltarecchunktype_t;
+
+typedef struct
+{
+	int type;
+	int number;
+	int count;
+	float time;
+} deltarecchunk_t;
@@ -41,6 +41,7 @@
 #include "netadr.h"
 #include "pm_shared.h"
 #include "UserMessages.h"
+#include "deltarecord.h"
 
 DLL_GLOBAL unsigned int g_ulFrameCount;
 
@@ -688,6 +689,7 @@ void ServerDeactivate()
 
 	// Peform any shutdown operations here...
 	//
+	DeltaRecord_ServerDeactivate();
 }
 
 void ServerActivate(edict_t* pEdictList, int edictCount, int clientMax)
@@ -780,6 +782,8 @@ static bool g_LastAllowBunnyHoppingState = false;
 //
 void StartFrame()
 {
+	DeltaRecord_StartFrame();
+
 	if (g_pGameRules)
 		g_pGameRules->Think();
 
@@ -1362,6 +1366,8 @@ int AddToFullPack(struct entity_state_s* state, int e, edict_t* ent, edict_t* ho
 		state->health = ent->v.health;
 	}
 
+	DeltaRecord_AddEntity(host, e, ent, state);
+
 	return 1;
 }
 
@@ -1416,6 +1422,8 @@ void CreateBaseline(int player, int eindex, struct entity_state_s* baseline, str
 		baseline->framerate = entity->v.framerate;
 		baseline->gravity = entity->v.gravity;
 	}
+
+	DeltaRecord_Baseline(eindex, baseline);
 }
 
 typedef struct
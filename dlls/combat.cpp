@@ -1501,6 +1501,74 @@ void CBaseEntity::FireBullets(unsigned int cShots, Vector vecSrc, Vector vecDirS
 }
 
 
+// most pellets FireBulletsPlayer traces at once
+#define MAX_PELLET_BATCH 32
+
+/*
+================
+FireBulletPlayerHit
+
+One pellet of FireBulletsPlayer hitting something.  firstOnSurface is
+false if an earlier pellet of the same shot hit the same surface, and
+already played its material sound.
+================
+*/
+static void FireBulletPlayerHit(entvars_t* pevAttacker, TraceResult* ptr, const Vector& vecSrc, const Vector& vecEnd, const Vector& vecDir, int iBulletType, int iDamage, bool firstOnSurface)
+{
+	CBaseEntity* pEntity = CBaseEntity::Instance(ptr->pHit);
+
+	if (0 != iDamage)
+	{
+		pEntity->TraceAttack(pevAttacker, iDamage, vecDir, ptr, DMG_BULLET | ((iDamage > 16) ? DMG_ALWAYSGIB : DMG_NEVERGIB));
+
+		if (firstOnSurface)
+			TEXTURETYPE_PlaySound(ptr, vecSrc, vecEnd, iBulletType);
+		DecalGunshot(ptr, iBulletType);
+	}
+	else
+		switch (iBulletType)
+		{
+		default:
+		case BULLET_PLAYER_9MM:
+			pEntity->TraceAttack(pevAttacker, gSkillData.plrDmg9MM, vecDir, ptr, DMG_BULLET);
+			break;
+
+		case BULLET_PLAYER_MP5:
+			pEntity->TraceAttack(pevAttacker, gSkillData.plrDmgMP5, vecDir, ptr, DMG_BULLET);
+			break;
+
+		case BULLET_PLAYER_BUCKSHOT:
+			// make distance based!
+			pEntity->TraceAttack(pevAttacker, gSkillData.plrDmgBuckshot, vecDir, ptr, DMG_BULLET);
+			break;
+
+		case BULLET_PLAYER_357:
+			pEntity->TraceAttack(pevAttacker, gSkillData.plrDmg357, vecDir, ptr, DMG_BULLET);
+			break;
+
+		//below: added by sfs
+		case BULLET_PLAYER_M4:
+			pEntity->TraceAttack(pevAttacker, gSkillData.plrDmgM4, vecDir, ptr, DMG_BULLET);
+			break;
+
+		case BULLET_PLAYER_M92:
+			pEntity->TraceAttack(pevAttacker, gSkillData.plrDmgM92, vecDir, ptr, DMG_BULLET);
+			break;
+
+		case BULLET_NONE: // FIX
+			pEntity->TraceAttack(pevAttacker, 50, vecDir, ptr, DMG_CLUB);
+			if (firstOnSurface)
+				TEXTURETYPE_PlaySound(ptr, vecSrc, vecEnd, iBulletType);
+			// only decal glass
+			if (!FNullEnt(ptr->pHit) && VARS(ptr->pHit)->rendermode != 0)
+			{
+				UTIL_DecalTrace(ptr, DECAL_GLASSBREAK1 + RANDOM_LONG(0, 2));
+			}
+
+			break;
+		}
+}
+
 /*
 ================
 FireBullets
@@ -1508,15 +1576,24 @@ FireBullets
 Go to the trouble of combining multiple pellets into a single damage call.
 
 This version is used by Players, uses the random seed generator to sync client and server side shots.
+
+Every pellet of a batch is traced before any of them does damage, so they all
+see the world as it was when the shot was fired, as the client does.  The hits
+are then applied grouped by entity, so gMultiDamage collects all the pellets
+that hit one target into a single TakeDamage.
 ================
 */
 Vector CBaseEntity::FireBulletsPlayer(unsigned int cShots, Vector vecSrc, Vector vecDirShooting, Vector vecSpread, float flDistance, int iBulletType, int iTracerFreq, int iDamage, entvars_t* pevAttacker, int shared_rand)
 {
 	static int tracerCount;
-	TraceResult tr;
+	TraceResult tr[MAX_PELLET_BATCH];
+	Vector vecDir[MAX_PELLET_BATCH];
+	Vector vecEnd[MAX_PELLET_BATCH];
+	bool done[MAX_PELLET_BATCH];
 	Vector vecRight = gpGlobals->v_right;
 	Vector vecUp = gpGlobals->v_up;
 	float x = 0, y = 0, z;
+	unsigned int firstShot, numShots, i, j;
 
 	if (pevAttacker == NULL)
 		pevAttacker = pev; // the default attacker is ourselves
@@ -1524,78 +1601,64 @@ Vector CBaseEntity::FireBulletsPlayer(unsigned int cShots, Vector vecSrc, Vector
 	ClearMultiDamage();
 	gMultiDamage.type = DMG_BULLET | DMG_NEVERGIB;
 
-	for (unsigned int iShot = 1; iShot <= cShots; iShot++)
+	for (firstShot = 0; firstShot < cShots; firstShot += numShots)
 	{
-		//Use player's random seed.
-		// get circular gaussian spread
-		x = UTIL_SharedRandomFloat(shared_rand + iShot, -0.5, 0.5) + UTIL_SharedRandomFloat(shared_rand + (1 + iShot), -0.5, 0.5);
-		y = UTIL_SharedRandomFloat(shared_rand + (2 + iShot), -0.5, 0.5) + UTIL_SharedRandomFloat(shared_rand + (3 + iShot), -0.5, 0.5);
-		z = x * x + y * y;
+		numShots = V_min(cShots - firstShot, MAX_PELLET_BATCH);
 
-		Vector vecDir = vecDirShooting +
+		for (i = 0; i < numShots; i++)
+		{
+			const unsigned int iShot = firstShot + i + 1;
+
+			//Use player's random seed.
+			// get circular gaussian spread
+			x = UTIL_SharedRandomFloat(shared_rand + iShot, -0.5, 0.5) + UTIL_SharedRandomFloat(shared_rand + (1 + iShot), -0.5, 0.5);
+			y = UTIL_SharedRandomFloat(shared_rand + (2 + iShot), -0.5, 0.5) + UTIL_SharedRandomFloat(shared_rand + (3 + iShot), -0.5, 0.5);
+			z = x * x + y * y;
+
+			vecDir[i] = vecDirShooting +
 						x * vecSpread.x * vecRight +
 						y * vecSpread.y * vecUp;
-		Vector vecEnd;
 
-		vecEnd = vecSrc + vecDir * flDistance;
-		UTIL_TraceLine(vecSrc, vecEnd, dont_ignore_monsters, ENT(pev) /*pentIgnore*/, &tr);
+			vecEnd[i] = vecSrc + vecDir[i] * flDistance;
+			UTIL_TraceLine(vecSrc, vecEnd[i], dont_ignore_monsters, ENT(pev) /*pentIgnore*/, &tr[i]);
+
+			// misses have nothing to do
+			done[i] = tr[i].flFraction == 1.0;
+		}
 
 		// do damage, paint decals
-		if (tr.flFraction != 1.0)
+		for (i = 0; i < numShots; i++)
 		{
-			CBaseEntity* pEntity = CBaseEntity::Instance(tr.pHit);
+			if (done[i])
+				continue;
 
-			if (0 != iDamage)
+			for (j = i; j < numShots; j++)
 			{
-				pEntity->TraceAttack(pevAttacker, iDamage, vecDir, &tr, DMG_BULLET | ((iDamage > 16) ? DMG_ALWAYSGIB : DMG_NEVERGIB));
+				if (done[j] || tr[j].pHit != tr[i].pHit)
+					continue;
 
-				TEXTURETYPE_PlaySound(&tr, vecSrc, vecEnd, iBulletType);
-				DecalGunshot(&tr, iBulletType);
-			}
-			else
-				switch (iBulletType)
+				// a material sound for each surface is plenty
+				bool firstOnSurface = true;
+				for (unsigned int k = i; k < j; k++)
 				{
-				default:
-				case BULLET_PLAYER_9MM:
-					pEntity->TraceAttack(pevAttacker, gSkillData.plrDmg9MM, vecDir, &tr, DMG_BULLET);
-					break;
-
-				case BULLET_PLAYER_MP5:
-					pEntity->TraceAttack(pevAttacker, gSkillData.plrDmgMP5, vecDir, &tr, DMG_BULLET);
-					break;
-
-				case BULLET_PLAYER_BUCKSHOT:
-					// make distance based!
-					pEntity->TraceAttack(pevAttacker, gSkillData.plrDmgBuckshot, vecDir, &tr, DMG_BULLET);
-					break;
-
-				case BULLET_PLAYER_357:
-					pEntity->TraceAttack(pevAttacker, gSkillData.plrDmg357, vecDir, &tr, DMG_BULLET);
-					break;
-
-				//below: added by sfs
-				case BULLET_PLAYER_M4:
-					pEntity->TraceAttack(pevAttacker, gSkillData.plrDmgM4, vecDir, &tr, DMG_BULLET);
-					break;
-
-				case BULLET_PLAYER_M92:
-					pEntity->TraceAttack(pevAttacker, gSkillData.plrDmgM92, vecDir, &tr, DMG_BULLET);
-					break;
-
-				case BULLET_NONE: // FIX
-					pEntity->TraceAttack(pevAttacker, 50, vecDir, &tr, DMG_CLUB);
-					TEXTURETYPE_PlaySound(&tr, vecSrc, vecEnd, iBulletType);
-					// only decal glass
-					if (!FNullEnt(tr.pHit) && VARS(tr.pHit)->rendermode != 0)
+					if (tr[k].pHit == tr[j].pHit && tr[k].flFraction != 1.0 &&
+						fabs(tr[k].flPlaneDist - tr[j].flPlaneDist) < 1 && DotProduct(tr[k].vecPlaneNormal, tr[j].vecPlaneNormal) > 0.99)
 					{
-						UTIL_DecalTrace(&tr, DECAL_GLASSBREAK1 + RANDOM_LONG(0, 2));
+						firstOnSurface = false;
+						break;
 					}
-
-					break;
 				}
+
+				FireBulletPlayerHit(pevAttacker, &tr[j], vecSrc, vecEnd[j], vecDir[j], iBulletType, iDamage, firstOnSurface);
+				done[j] = true;
+			}
 		}
+
 		// make bullet trails
-		UTIL_BubbleTrail(vecSrc, tr.vecEndPos, (flDistance * tr.flFraction) / 64.0);
+		for (i = 0; i < numShots; i++)
+		{
+			UTIL_BubbleTrail(vecSrc, tr[i].vecEndPos, (flDistance * tr[i].flFraction) / 64.0);
+		}
 	}
 	ApplyMultiDamage(pev, pevAttacker);
 
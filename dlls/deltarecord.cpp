@@ -0,0 +1,361 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*	
+*	This product contains software technology licensed from Id 
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc. 
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+
+#include <stdio.h>
+#include <unordered_map>
+#include <vector>
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "entity_state.h"
+#include "game.h"
+#include "deltarec.h"
+#include "deltarecord.h"
+
+#define DELTAREC_FIELD(name, member) {name, (int)offsetof(entity_state_t, member), (int)sizeof(((entity_state_t*)0)->member)}
+
+// every field delta.lst can name, plus the ones the encoders look at
+static const deltarecfield_t s_Fields[] =
+	{
+		DELTAREC_FIELD("entityType", entityType),
+		DELTAREC_FIELD("number", number),
+		DELTAREC_FIELD("origin[0]", origin.x),
+		DELTAREC_FIELD("origin[1]", origin.y),
+		DELTAREC_FIELD("origin[2]", origin.z),
+		DELTAREC_FIELD("angles[0]", angles.x),
+		DELTAREC_FIELD("angles[1]", angles.y),
+		DELTAREC_FIELD("angles[2]", angles.z),
+		DELTAREC_FIELD("modelindex", modelindex),
+		DELTAREC_FIELD("sequence", sequence),
+		DELTAREC_FIELD("frame", frame),
+		DELTAREC_FIELD("colormap", colormap),
+		DELTAREC_FIELD("skin", skin),
+		DELTAREC_FIELD("solid", solid),
+		DELTAREC_FIELD("effects", effects),
+		DELTAREC_FIELD("scale", scale),
+		DELTAREC_FIELD("eflags", eflags),
+		DELTAREC_FIELD("rendermode", rendermode),
+		DELTAREC_FIELD("renderamt", renderamt),
+		DELTAREC_FIELD("rendercolor.r", rendercolor.r),
+		DELTAREC_FIELD("rendercolor.g", rendercolor.g),
+		DELTAREC_FIELD("rendercolor.b", rendercolor.b),
+		DELTAREC_FIELD("renderfx", renderfx),
+		DELTAREC_FIELD("movetype", movetype),
+		DELTAREC_FIELD("animtime", animtime),
+		DELTAREC_FIELD("framerate", framerate),
+		DELTAREC_FIELD("body", body),
+		DELTAREC_FIELD("controller[0]", controller[0]),
+		DELTAREC_FIELD("controller[1]", controller[1]),
+		DELTAREC_FIELD("controller[2]", controller[2]),
+		DELTAREC_FIELD("controller[3]", controller[3]),
+		DELTAREC_FIELD("blending[0]", blending[0]),
+		DELTAREC_FIELD("blending[1]", blending[1]),
+		DELTAREC_FIELD("blending[2]", blending[2]),
+		DELTAREC_FIELD("blending[3]", blending[3]),
+		DELTAREC_FIELD("velocity[0]", velocity.x),
+		DELTAREC_FIELD("velocity[1]", velocity.y),
+		DELTAREC_FIELD("velocity[2]", velocity.z),
+		DELTAREC_FIELD("mins[0]", mins.x),
+		DELTAREC_FIELD("mins[1]", mins.y),
+		DELTAREC_FIELD("mins[2]", mins.z),
+		DELTAREC_FIELD("maxs[0]", maxs.x),
+		DELTAREC_FIELD("maxs[1]", maxs.y),
+		DELTAREC_FIELD("maxs[2]", maxs.z),
+		DELTAREC_FIELD("aiment", aiment),
+		DELTAREC_FIELD("owner", owner),
+		DELTAREC_FIELD("friction", friction),
+		DELTAREC_FIELD("gravity", gravity),
+		DELTAREC_FIELD("team", team),
+		DELTAREC_FIELD("playerclass", playerclass),
+		DELTAREC_FIELD("health", health),
+		DELTAREC_FIELD("spectator", spectator),
+		DELTAREC_FIELD("weaponmodel", weaponmodel),
+		DELTAREC_FIELD("gaitsequence", gaitsequence),
+		DELTAREC_FIELD("basevelocity[0]", basevelocity.x),
+		DELTAREC_FIELD("basevelocity[1]", basevelocity.y),
+		DELTAREC_FIELD("basevelocity[2]", basevelocity.z),
+		DELTAREC_FIELD("usehull", usehull),
+		DELTAREC_FIELD("oldbuttons", oldbuttons),
+		DELTAREC_FIELD("onground", onground),
+		DELTAREC_FIELD("iStepLeft", iStepLeft),
+		DELTAREC_FIELD("flFallVelocity", flFallVelocity),
+		DELTAREC_FIELD("fov", fov),
+		DELTAREC_FIELD("weaponanim", weaponanim),
+		DELTAREC_FIELD("startpos[0]", startpos.x),
+		DELTAREC_FIELD("startpos[1]", startpos.y),
+		DELTAREC_FIELD("startpos[2]", startpos.z),
+		DELTAREC_FIELD("endpos[0]", endpos.x),
+		DELTAREC_FIELD("endpos[1]", endpos.y),
+		DELTAREC_FIELD("endpos[2]", endpos.z),
+		DELTAREC_FIELD("impacttime", impacttime),
+		DELTAREC_FIELD("starttime", starttime),
+		DELTAREC_FIELD("iuser1", iuser1),
+		DELTAREC_FIELD("iuser2", iuser2),
+		DELTAREC_FIELD("iuser3", iuser3),
+		DELTAREC_FIELD("iuser4", iuser4),
+		DELTAREC_FIELD("fuser1", fuser1),
+		DELTAREC_FIELD("fuser2", fuser2),
+		DELTAREC_FIELD("fuser3", fuser3),
+		DELTAREC_FIELD("fuser4", fuser4),
+		DELTAREC_FIELD("vuser1[0]", vuser1.x),
+		DELTAREC_FIELD("vuser1[1]", vuser1.y),
+		DELTAREC_FIELD("vuser1[2]", vuser1.z),
+		DELTAREC_FIELD("vuser2[0]", vuser2.x),
+		DELTAREC_FIELD("vuser2[1]", vuser2.y),
+		DELTAREC_FIELD("vuser2[2]", vuser2.z),
+		DELTAREC_FIELD("vuser3[0]", vuser3.x),
+		DELTAREC_FIELD("vuser3[1]", vuser3.y),
+		DELTAREC_FIELD("vuser3[2]", vuser3.z),
+		DELTAREC_FIELD("vuser4[0]", vuser4.x),
+		DELTAREC_FIELD("vuser4[1]", vuser4.y),
+		DELTAREC_FIELD("vuser4[2]", vuser4.z),
+};
+
+struct DeltaRecorder
+{
+	FILE* File = nullptr;
+
+	// the last state written for each entity, so unchanged ones are skipped
+	std::vector<entity_state_t> States;
+	std::vector<int> StateClass; // -1 until written
+
+	// baselines are kept from map start, recording may begin later
+	std::vector<entity_state_t> Baselines;
+	std::vector<bool> HaveBaseline;
+
+	std::unordered_map<string_t, int> Classes;
+
+	// the packet being collected
+	int Host = 0;
+	std::vector<short> Packet;
+};
+
+static DeltaRecorder s_Recorder;
+
+/*
+============
+DeltaRecord_WriteChunk
+============
+*/
+static void DeltaRecord_WriteChunk(int type, int number, int count, const void* data, size_t size)
+{
+	deltarecchunk_t chunk;
+
+	chunk.type = type;
+	chunk.number = number;
+	chunk.count = count;
+	chunk.time = gpGlobals->time;
+
+	fwrite(&chunk, sizeof(chunk), 1, s_Recorder.File);
+	if (size != 0)
+		fwrite(data, size, 1, s_Recorder.File);
+}
+
+/*
+============
+DeltaRecord_FlushPacket
+============
+*/
+static void DeltaRecord_FlushPacket()
+{
+	if (s_Recorder.File && 0 != s_Recorder.Host)
+	{
+		DeltaRecord_WriteChunk(DELTAREC_PACKET, s_Recorder.Host, (int)s_Recorder.Packet.size(), s_Recorder.Packet.data(), s_Recorder.Packet.size() * sizeof(short));
+	}
+
+	s_Recorder.Host = 0;
+	s_Recorder.Packet.clear();
+}
+
+/*
+============
+DeltaRecord_Start
+============
+*/
+static void DeltaRecord_Start()
+{
+	deltarecheader_t header;
+	char gamedir[256];
+	char filename[512];
+	int i;
+
+	GET_GAME_DIR(gamedir);
+	snprintf(filename, sizeof(filename), "%s/%s.drec", gamedir, STRING(gpGlobals->mapname));
+
+	s_Recorder.File = fopen(filename, "wb");
+	if (!s_Recorder.File)
+	{
+		ALERT(at_console, "sv_deltarecord: couldn't open %s\n", filename);
+		CVAR_SET_FLOAT("sv_deltarecord", 0);
+		return;
+	}
+
+	header.ident = DELTAREC_IDENT;
+	header.version = DELTAREC_VERSION;
+	header.statesize = sizeof(entity_state_t);
+	header.numfields = ARRAYSIZE(s_Fields);
+	header.maxclients = gpGlobals->maxClients;
+	header.maxentities = gpGlobals->maxEntities;
+
+	fwrite(&header, sizeof(header), 1, s_Recorder.File);
+	fwrite(s_Fields, sizeof(s_Fields), 1, s_Recorder.File);
+
+	s_Recorder.States.resize(gpGlobals->maxEntities);
+	s_Recorder.StateClass.assign(gpGlobals->maxEntities, -1);
+	s_Recorder.Classes.clear();
+	s_Recorder.Host = 0;
+	s_Recorder.Packet.clear();
+
+	for (i = 0; i < (int)s_Recorder.Baselines.size(); i++)
+	{
+		if (s_Recorder.HaveBaseline[i])
+			DeltaRecord_WriteChunk(DELTAREC_BASELINE, i, 0, &s_Recorder.Baselines[i], sizeof(entity_state_t));
+	}
+
+	ALERT(at_console, "sv_deltarecord: recording to %s\n", filename);
+}
+
+/*
+============
+DeltaRecord_Close
+============
+*/
+static void DeltaRecord_Close()
+{
+	if (!s_Recorder.File)
+		return;
+
+	DeltaRecord_FlushPacket();
+	DeltaRecord_WriteChunk(DELTAREC_END, 0, 0, NULL, 0);
+
+	fclose(s_Recorder.File);
+	s_Recorder.File = nullptr;
+
+	ALERT(at_console, "sv_deltarecord: stopped\n");
+}
+
+/*
+============
+DeltaRecord_ServerDeactivate
+============
+*/
+void DeltaRecord_ServerDeactivate()
+{
+	DeltaRecord_Close();
+
+	// the next map brings its own baselines
+	s_Recorder.Baselines.clear();
+	s_Recorder.HaveBaseline.clear();
+}
+
+/*
+============
+DeltaRecord_StartFrame
+
+Starts or stops recording as the cvar changes, and marks the frame whose
+packets follow
+============
+*/
+void DeltaRecord_StartFrame()
+{
+	const bool wanted = 0 != sv_deltarecord.value;
+
+	if (wanted != (s_Recorder.File != nullptr))
+	{
+		if (wanted)
+			DeltaRecord_Start();
+		else
+			DeltaRecord_Close();
+	}
+
+	if (!s_Recorder.File)
+		return;
+
+	DeltaRecord_FlushPacket();
+	DeltaRecord_WriteChunk(DELTAREC_FRAME, 0, 0, NULL, 0);
+}
+
+/*
+============
+DeltaRecord_Baseline
+============
+*/
+void DeltaRecord_Baseline(int eindex, const entity_state_t* baseline)
+{
+	if (eindex < 0 || eindex >= gpGlobals->maxEntities)
+		return;
+
+	if ((int)s_Recorder.Baselines.size() < gpGlobals->maxEntities)
+	{
+		s_Recorder.Baselines.resize(gpGlobals->maxEntities);
+		s_Recorder.HaveBaseline.resize(gpGlobals->maxEntities, false);
+	}
+
+	s_Recorder.Baselines[eindex] = *baseline;
+	s_Recorder.HaveBaseline[eindex] = true;
+
+	if (s_Recorder.File)
+		DeltaRecord_WriteChunk(DELTAREC_BASELINE, eindex, 0, baseline, sizeof(entity_state_t));
+}
+
+/*
+============
+DeltaRecord_AddEntity
+
+Called for every state AddToFullPack fills in.  The engine builds one
+client's packet at a time, so a new host ends the last packet.
+============
+*/
+void DeltaRecord_AddEntity(edict_t* host, int e, edict_t* ent, const entity_state_t* state)
+{
+	int hostnum, classnum;
+
+	if (!s_Recorder.File || e < 0 || e >= (int)s_Recorder.States.size())
+		return;
+
+	hostnum = ENTINDEX(host);
+	if (hostnum != s_Recorder.Host)
+	{
+		DeltaRecord_FlushPacket();
+		s_Recorder.Host = hostnum;
+	}
+
+	auto it = s_Recorder.Classes.find(ent->v.classname);
+	if (it == s_Recorder.Classes.end())
+	{
+		char name[DELTAREC_MAX_NAME] = {};
+
+		classnum = (int)s_Recorder.Classes.size();
+		s_Recorder.Classes.emplace(ent->v.classname, classnum);
+
+		strncpy(name, STRING(ent->v.classname), sizeof(name) - 1);
+		DeltaRecord_WriteChunk(DELTAREC_CLASS, classnum, 0, name, sizeof(name));
+	}
+	else
+	{
+		classnum = it->second;
+	}
+
+	// AddToFullPack clears the state first, so padding compares equal too
+	if (s_Recorder.StateClass[e] != classnum || 0 != memcmp(&s_Recorder.States[e], state, sizeof(*state)))
+	{
+		s_Recorder.States[e] = *state;
+		s_Recorder.StateClass[e] = classnum;
+		DeltaRecord_WriteChunk(DELTAREC_STATE, e, classnum, state, sizeof(*state));
+	}
+
+	s_Recorder.Packet.push_back((short)e);
+}
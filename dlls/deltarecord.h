@@ -0,0 +1,25 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*	
+*	This product contains software technology licensed from Id 
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc. 
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+
+#pragma once
+
+// Records the entity states AddToFullPack hands the engine, for tuning
+// delta.lst offline with deltaprof.  Set sv_deltarecord 1 and each map
+// is written to <gamedir>/<mapname>.drec.
+
+void DeltaRecord_StartFrame();
+void DeltaRecord_Baseline(int eindex, const struct entity_state_s* baseline);
+void DeltaRecord_AddEntity(edict_t* host, int e, edict_t* ent, const struct entity_state_s* state);
+void DeltaRecord_ServerDeactivate();
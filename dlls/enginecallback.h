@@ -128,6 +128,7 @@ inline void* GET_PRIVATE(edict_t* pent)
 #define LOAD_FILE_FOR_ME (*g_engfuncs.pfnLoadFileForMe)
 #define FREE_FILE (*g_engfuncs.pfnFreeFile)
 #define COMPARE_FILE_TIME (*g_engfuncs.pfnCompareFileTime)
+#define GET_FILE_SIZE (*g_engfuncs.pfnGetFileSize)
 #define GET_GAME_DIR (*g_engfuncs.pfnGetGameDir)
 #define IS_MAP_VALID (*g_engfuncs.pfnIsMapValid)
 #define NUMBER_OF_ENTITIES (*g_engfuncs.pfnNumberOfEntities)
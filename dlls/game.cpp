@@ -45,6 +45,8 @@ cvar_t allow_spectators = {"allow_spectators", "0.0", FCVAR_SERVER}; // 0 preven
 cvar_t mp_chattime = {"mp_chattime", "10", FCVAR_SERVER};
 
 cvar_t sv_allowbunnyhopping = {"sv_allowbunnyhopping", "0", FCVAR_SERVER};
+cvar_t sv_deltarecord = {"sv_deltarecord", "0"};
+cvar_t monster_navmesh = {"monster_navmesh", "0", FCVAR_SERVER};
 
 //CVARS FOR SKILL LEVEL SETTINGS
 // Agrunt
@@ -506,6 +508,8 @@ void GameDLLInit()
 	CVAR_REGISTER(&mp_chattime);
 
 	CVAR_REGISTER(&sv_allowbunnyhopping);
+	CVAR_REGISTER(&sv_deltarecord);
+	CVAR_REGISTER(&monster_navmesh);
 
 	// REGISTER CVARS FOR SKILL LEVEL STUFF
 	// Agrunt
@@ -42,6 +42,8 @@ extern cvar_t allow_spectators;
 extern cvar_t mp_chattime;
 
 extern cvar_t sv_allowbunnyhopping;
+extern cvar_t sv_deltarecord;
+extern cvar_t monster_navmesh;
 
 // Engine Cvars
 inline cvar_t* g_psv_gravity;
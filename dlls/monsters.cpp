@@ -24,6 +24,7 @@
 #include "util.h"
 #include "cbase.h"
 #include "nodes.h"
+#include "navroute.h"
 #include "monsters.h"
 #include "animation.h"
 #include "saverestore.h"
@@ -195,6 +196,8 @@ void CBaseMonster::Listen()
 	int iMySounds;
 	float hearingSensitivity;
 	CSound* pCurrentSound;
+	int aiNearSounds[MAX_WORLD_SOUNDS];
+	int cNearSounds, i;
 
 	m_iAudibleList = SOUNDLIST_EMPTY;
 	ClearConditions(bits_COND_HEAR_SOUND | bits_COND_SMELL | bits_COND_SMELL_FOOD);
@@ -209,14 +212,16 @@ void CBaseMonster::Listen()
 		iMySounds &= m_pSchedule->iSoundMask;
 	}
 
-	iSound = CSoundEnt::ActiveList();
-
 	// UNDONE: Clear these here?
 	ClearConditions(bits_COND_HEAR_SOUND | bits_COND_SMELL_FOOD | bits_COND_SMELL);
 	hearingSensitivity = HearingSensitivity();
 
-	while (iSound != SOUNDLIST_EMPTY)
+	// only the sounds in earshot of the loudest one around, not the whole active list
+	cNearSounds = CSoundEnt::SoundsNear(EarPosition(), hearingSensitivity, aiNearSounds);
+
+	for (i = 0; i < cNearSounds; i++)
 	{
+		iSound = aiNearSounds[i];
 		pCurrentSound = CSoundEnt::SoundPointerForIndex(iSound);
 
 		if (nullptr != pCurrentSound &&
@@ -257,9 +262,6 @@ void CBaseMonster::Listen()
 
 			m_iAudibleList = iSound;
 		}
-
-		//		iSound = g_pSoundEnt->m_SoundPool[ iSound ].m_iNext;
-		iSound = pCurrentSound->m_iNext;
 	}
 }
 
@@ -1536,6 +1538,27 @@ bool CBaseMonster::BuildRoute(const Vector& vecGoal, int iMoveFlag, CBaseEntity*
 	m_Route[0].vecLocation = vecGoal;
 	m_Route[0].iType = iMoveFlag | bits_MF_IS_GOAL;
 
+	// the nav mesh already knows the way around the world, so its corners
+	// don't need to be checked or simplified
+	Vector vecPoints[ROUTE_SIZE];
+	bool fComplete;
+	int cPoints = NavRoute_FindPath(this, pev->origin, vecGoal, vecPoints, ROUTE_SIZE, &fComplete);
+
+	if (cPoints > 0)
+	{
+		for (int i = 0; i < cPoints; i++)
+		{
+			m_Route[i].vecLocation = vecPoints[i];
+			m_Route[i].iType = iMoveFlag | bits_MF_TO_DETOUR | bits_MF_DONT_SIMPLIFY;
+		}
+
+		if (fComplete)
+			m_Route[cPoints - 1].iType = iMoveFlag | bits_MF_IS_GOAL;
+
+		m_vecMoveGoal = vecGoal;
+		return true;
+	}
+
 	// check simple local move
 	iLocalMove = CheckLocalMove(pev->origin, vecGoal, pTarget, &flDist);
 
@@ -1637,6 +1660,20 @@ bool CBaseMonster::FTriangulate(const Vector& vecStart, const Vector& vecEnd, fl
 	//if (sizeZ < 24.0)
 	//	sizeZ = 24.0;
 
+	// take the first corner of the way around on the nav mesh, if it gets
+	// around whatever is in the way
+	Vector vecPoints[2];
+	bool fComplete;
+	if (NavRoute_FindPath(this, vecStart, vecEnd, vecPoints, 2, &fComplete) == 2 &&
+		CheckLocalMove(pev->origin, vecPoints[0], pTargetEnt, NULL) == LOCALMOVE_VALID &&
+		CheckLocalMove(vecPoints[0], m_Route[m_iRouteIndex].vecLocation, pTargetEnt, NULL) == LOCALMOVE_VALID)
+	{
+		if (pApex)
+			*pApex = vecPoints[0];
+
+		return true;
+	}
+
 	vecForward = (vecEnd - vecStart).Normalize();
 
 	Vector vecDirUp(0, 0, 1);
@@ -0,0 +1,400 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "monsters.h"
+#include "game.h"
+#include "navroute.h"
+
+#ifdef MONSTER_NAV_MESH
+
+#include <vector>
+
+#include "bot/nav.h"
+#include "bot/nav_area.h"
+#include "pathcache.h"
+
+enum
+{
+	NAVROUTE_UNTRIED = 0,
+	NAVROUTE_READY,
+	NAVROUTE_MISSING
+};
+
+static int s_NavRouteState = NAVROUTE_UNTRIED;
+
+typedef struct
+{
+	Vector2D left;
+	Vector2D right;
+	CNavArea* pArea; // the area the portal leads into
+} navportal_t;
+
+typedef struct
+{
+	CNavArea* pArea;
+	NavDirType dir; // how pArea is entered from the step before it
+} navstep_t;
+
+#define NAVROUTE_MAX_CACHED_STEPS 128
+
+static std::vector<navstep_t> s_Corridor; // start area first
+static std::vector<navportal_t> s_Portals;
+
+// corridors from recent A* searches, keyed on start and goal area IDs, hull
+// radius and whether the monster fits through crouch areas
+static CPathCache<navstep_t, 64, NAVROUTE_MAX_CACHED_STEPS> s_NavPathCache;
+
+//=========================================================
+// CMonsterPathCost - A* costs for a walking monster.
+// Monsters can't climb ladders, jump, crouch or drop off
+// ledges, and can't squeeze through a portal narrower
+// than their hull.
+//=========================================================
+class CMonsterPathCost
+{
+public:
+	CMonsterPathCost(float flRadius, bool fTall) : m_flRadius(flRadius), m_fTall(fTall) {}
+
+	float operator()(CNavArea* area, CNavArea* fromArea, const CNavLadder* ladder)
+	{
+		if (fromArea == NULL)
+			return 0.0f;
+
+		if (ladder != NULL)
+			return -1.0f;
+
+		if ((area->GetAttributes() & NAV_JUMP) != 0)
+			return -1.0f;
+
+		if ((area->GetAttributes() & NAV_CROUCH) != 0 && m_fTall)
+			return -1.0f;
+
+		int dir;
+		for (dir = 0; dir < NUM_DIRECTIONS; dir++)
+		{
+			if (fromArea->IsConnected(area, (NavDirType)dir))
+				break;
+		}
+
+		// only reachable by jumping down
+		if (dir == NUM_DIRECTIONS)
+			return -1.0f;
+
+		Vector vecPortal;
+		float flHalfWidth;
+		fromArea->ComputePortal(area, (NavDirType)dir, &vecPortal, &flHalfWidth);
+
+		if (flHalfWidth < m_flRadius)
+			return -1.0f;
+
+		if (fabs(area->GetZ(&vecPortal) - fromArea->GetZ(&vecPortal)) > StepHeight)
+			return -1.0f;
+
+		return fromArea->GetCostSoFar() + (*area->GetCenter() - *fromArea->GetCenter()).Length();
+	}
+
+private:
+	float m_flRadius;
+	bool m_fTall; // too tall for crouch areas
+};
+
+//=========================================================
+// CONSOLE_ECHO - the nav code reports bad .nav files
+// through this, which the CS bot code provides there
+//=========================================================
+void CONSOLE_ECHO(char* pszMsg, ...)
+{
+	va_list argptr;
+	char szMsg[1024];
+
+	va_start(argptr, pszMsg);
+	vsnprintf(szMsg, sizeof(szMsg), pszMsg, argptr);
+	va_end(argptr);
+
+	ALERT(at_console, "%s", szMsg);
+}
+
+//=========================================================
+// NavRoute_LevelInit - the mesh of the last level must not
+// outlive it, whoever loaded it
+//=========================================================
+void NavRoute_LevelInit()
+{
+	if (s_NavPathCache.GetLookups())
+	{
+		ALERT(at_aiconsole, "Nav path cache: %d lookups, %.0f%% hits, %d evictions, %d invalidations\n",
+			s_NavPathCache.GetLookups(), s_NavPathCache.GetHitRate() * 100.0f,
+			s_NavPathCache.GetEvictions(), s_NavPathCache.GetInvalidations());
+	}
+
+	s_NavPathCache.Clear();
+	s_NavPathCache.ResetStats();
+
+	DestroyNavigationMap();
+	s_NavRouteState = NAVROUTE_UNTRIED;
+}
+
+//=========================================================
+// NavRoute_Ready - loads the .nav file the first time a
+// monster asks for a route
+//=========================================================
+static bool NavRoute_Ready()
+{
+	if (s_NavRouteState == NAVROUTE_UNTRIED)
+	{
+		if (LoadNavigationMap() == NAV_OK && !TheNavAreaList.empty())
+		{
+			ALERT(at_aiconsole, "Monsters routing over %d nav areas\n", (int)TheNavAreaList.size());
+			s_NavRouteState = NAVROUTE_READY;
+		}
+		else
+		{
+			ALERT(at_aiconsole, "No nav mesh, monsters routing over nodes\n");
+			s_NavRouteState = NAVROUTE_MISSING;
+		}
+	}
+
+	return s_NavRouteState == NAVROUTE_READY;
+}
+
+//=========================================================
+// TriArea2D - positive if c is to the left of a->b
+//=========================================================
+static float TriArea2D(const Vector2D& a, const Vector2D& b, const Vector2D& c)
+{
+	return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+static bool Equal2D(const Vector2D& a, const Vector2D& b)
+{
+	return a.x == b.x && a.y == b.y;
+}
+
+//=========================================================
+// NavRoute_PullString - funnel algorithm over s_Portals,
+// which start with the start point and end with the goal.
+// Each corner the string bends around becomes a waypoint.
+//=========================================================
+static int NavRoute_PullString(const Vector& vecGoal, Vector* pPoints, int maxPoints, bool* pfComplete)
+{
+	Vector2D apex, left, right, last;
+	int leftIndex, rightIndex;
+	int count, i;
+
+	apex = left = right = last = s_Portals[0].left;
+	leftIndex = rightIndex = 0;
+	count = 0;
+
+	for (i = 1; i < (int)s_Portals.size() && count < maxPoints; i++)
+	{
+		const navportal_t* portal = &s_Portals[i];
+		int corner = -1;
+
+		// narrow the funnel from the right
+		if (TriArea2D(apex, right, portal->right) >= 0.0f)
+		{
+			if (Equal2D(apex, right) || TriArea2D(apex, left, portal->right) < 0.0f)
+			{
+				right = portal->right;
+				rightIndex = i;
+			}
+			else
+			{
+				// the right side crossed over the left, so the string bends around it
+				corner = leftIndex;
+				apex = right = left;
+			}
+		}
+
+		// narrow the funnel from the left
+		if (corner == -1 && TriArea2D(apex, left, portal->left) <= 0.0f)
+		{
+			if (Equal2D(apex, left) || TriArea2D(apex, right, portal->left) > 0.0f)
+			{
+				left = portal->left;
+				leftIndex = i;
+			}
+			else
+			{
+				corner = rightIndex;
+				apex = left = right;
+			}
+		}
+
+		if (corner == -1)
+			continue;
+
+		// the goal itself is added below
+		if (corner == (int)s_Portals.size() - 1)
+			break;
+
+		// the apex can stay put when a portal edge passes through it
+		if (!Equal2D(apex, last))
+		{
+			pPoints[count].x = apex.x;
+			pPoints[count].y = apex.y;
+			pPoints[count].z = s_Portals[corner].pArea->GetZ(&pPoints[count]);
+			count++;
+			last = apex;
+		}
+
+		// restart the funnel from the corner
+		leftIndex = rightIndex = corner;
+		i = corner;
+	}
+
+	*pfComplete = false;
+	if (count < maxPoints)
+	{
+		pPoints[count++] = vecGoal;
+		*pfComplete = true;
+	}
+
+	return count;
+}
+
+//=========================================================
+// NavRoute_FindCorridor - fills s_Corridor with the areas
+// from startArea to goalArea, reusing a recent search for
+// the same areas and hull when the mesh hasn't changed
+//=========================================================
+static bool NavRoute_FindCorridor(CNavArea* startArea, CNavArea* goalArea, const Vector& vecGoal, int iHull, bool fTall)
+{
+	navstep_t steps[NAVROUTE_MAX_CACHED_STEPS];
+	int cSteps, i;
+
+	s_Corridor.clear();
+
+	cSteps = s_NavPathCache.Lookup(startArea->GetID(), goalArea->GetID(), iHull, fTall, CNavArea::GetMeshVersion(), steps);
+	if (cSteps == 0)
+		return false;
+
+	if (cSteps > 0)
+	{
+		s_Corridor.assign(steps, steps + cSteps);
+		return true;
+	}
+
+	CMonsterPathCost cost(iHull, fTall);
+
+	if (!NavAreaBuildPath(startArea, goalArea, &vecGoal, cost))
+	{
+		s_NavPathCache.Store(startArea->GetID(), goalArea->GetID(), iHull, fTall, CNavArea::GetMeshVersion(), NULL, 0);
+		return false;
+	}
+
+	for (CNavArea* area = goalArea; area != NULL; area = area->GetParent())
+	{
+		navstep_t step;
+		step.pArea = area;
+		step.dir = (NavDirType)area->GetParentHow();
+		s_Corridor.push_back(step);
+	}
+
+	for (i = 0; i < (int)s_Corridor.size() / 2; i++)
+		std::swap(s_Corridor[i], s_Corridor[s_Corridor.size() - 1 - i]);
+
+	s_NavPathCache.Store(startArea->GetID(), goalArea->GetID(), iHull, fTall, CNavArea::GetMeshVersion(), &s_Corridor[0], (int)s_Corridor.size());
+	return true;
+}
+
+//=========================================================
+// NavRoute_FindPath
+//=========================================================
+int NavRoute_FindPath(CBaseMonster* pMonster, const Vector& vecStart, const Vector& vecGoal, Vector* pPoints, int maxPoints, bool* pfComplete)
+{
+	if (monster_navmesh.value == 0 || maxPoints <= 0)
+		return 0;
+
+	// the mesh is only good for things that walk
+	if (pMonster->pev->movetype != MOVETYPE_STEP || (pMonster->pev->flags & (FL_FLY | FL_SWIM)) != 0)
+		return 0;
+
+	if (!NavRoute_Ready())
+		return 0;
+
+	CNavArea* startArea = TheNavAreaGrid.GetNearestNavArea(&vecStart);
+	CNavArea* goalArea = TheNavAreaGrid.GetNavArea(&vecGoal);
+
+	if (startArea == NULL || goalArea == NULL)
+		return 0;
+
+	// whole units, so that monsters of nearly the same size share cached corridors
+	int iHull = (int)ceil(V_max(pMonster->pev->size.x, pMonster->pev->size.y) * 0.5);
+	bool fTall = pMonster->pev->size.z > HalfHumanHeight;
+
+	if (!NavRoute_FindCorridor(startArea, goalArea, vecGoal, iHull, fTall))
+		return 0;
+
+	float flRadius = iHull;
+
+	// portals from the start outwards, each shrunk by the hull radius so the
+	// string can't pull the monster into a wall
+	s_Portals.clear();
+
+	navportal_t start;
+	start.left = start.right = vecStart.Make2D();
+	start.pArea = startArea;
+	s_Portals.push_back(start);
+
+	for (int i = 1; i < (int)s_Corridor.size(); i++)
+	{
+		CNavArea* fromArea = s_Corridor[i - 1].pArea;
+		CNavArea* toArea = s_Corridor[i].pArea;
+		NavDirType dir = s_Corridor[i].dir;
+
+		Vector vecCenter;
+		float flHalfWidth;
+		fromArea->ComputePortal(toArea, dir, &vecCenter, &flHalfWidth);
+
+		flHalfWidth -= flRadius;
+		if (flHalfWidth < 0.0f)
+			flHalfWidth = 0.0f;
+
+		Vector2D forward, side;
+		DirectionToVector2D(dir, &forward);
+		side.x = -forward.y;
+		side.y = forward.x;
+
+		navportal_t portal;
+		portal.left = vecCenter.Make2D() + side * flHalfWidth;
+		portal.right = vecCenter.Make2D() - side * flHalfWidth;
+		portal.pArea = toArea;
+		s_Portals.push_back(portal);
+	}
+
+	navportal_t goal;
+	goal.left = goal.right = vecGoal.Make2D();
+	goal.pArea = goalArea;
+	s_Portals.push_back(goal);
+
+	return NavRoute_PullString(vecGoal, pPoints, maxPoints, pfComplete);
+}
+
+#else
+
+void NavRoute_LevelInit()
+{
+}
+
+int NavRoute_FindPath(CBaseMonster* pMonster, const Vector& vecStart, const Vector& vecGoal, Vector* pPoints, int maxPoints, bool* pfComplete)
+{
+	return 0;
+}
+
+#endif
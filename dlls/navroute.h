@@ -0,0 +1,31 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+
+#pragma once
+
+// Routes walking monsters over the nav mesh in game_shared/bot instead of
+// the node graph, when the map has a .nav file and monster_navmesh is 1.
+// The mesh code is only in game dlls built with MONSTER_NAV_MESH; without
+// it NavRoute_FindPath always fails and monsters use the node graph.
+
+class CBaseMonster;
+
+void NavRoute_LevelInit();
+
+// Fills pPoints with up to maxPoints waypoints from vecStart towards vecGoal,
+// pulled tight through the portals between areas and kept a hull radius away
+// from their edges.  *pfComplete is set if the last point is vecGoal itself.
+// Returns 0 if there is no mesh path, and the caller should use the nodes.
+int NavRoute_FindPath(CBaseMonster* pMonster, const Vector& vecStart, const Vector& vecGoal, Vector* pPoints, int maxPoints, bool* pfComplete);
@@ -28,6 +28,7 @@
 #include "animation.h"
 #include "doors.h"
 #include "filesystem_utils.h"
+#include "pathcache.h"
 
 #define HULL_STEP_SIZE 16 // how far the test hull moves on each step
 #define NODE_HEIGHT 8	  // how high to lift nodes off the ground after we drop them all (make stair/ramp mapping easier)
@@ -41,6 +42,17 @@ Vector VecBModelOrigin(entvars_t* pevBModel);
 
 CGraph WorldGraph;
 
+// Monsters in the same fight keep asking for the same routes.  The graph
+// version changes whenever the nodes, links or routing tables do, which
+// empties the cache.  Not part of CGraph, since that is saved in the .NOD.
+static CPathCache<int, 128, MAX_PATH_SIZE> s_NodePathCache;
+static unsigned int s_iGraphVersion = 1;
+
+static void NodePathCache_Invalidate()
+{
+	s_iGraphVersion++;
+}
+
 LINK_ENTITY_TO_CLASS(info_node, CNodeEnt);
 LINK_ENTITY_TO_CLASS(info_node_air, CNodeEnt);
 
@@ -51,6 +63,13 @@ LINK_ENTITY_TO_CLASS(info_node_air, CNodeEnt);
 //=========================================================
 void CGraph::InitGraph()
 {
+	if (0 != s_NodePathCache.GetLookups())
+	{
+		ALERT(at_aiconsole, "Node path cache: %d lookups, %.1f%% hits, %d evictions, %d invalidations\n",
+			s_NodePathCache.GetLookups(), s_NodePathCache.GetHitRate() * 100, s_NodePathCache.GetEvictions(), s_NodePathCache.GetInvalidations());
+		s_NodePathCache.ResetStats();
+	}
+	NodePathCache_Invalidate();
 
 	// Make the graph unavailable
 	//
@@ -601,6 +620,16 @@ int CGraph::FindShortestPath(int* piPath, int iStart, int iDest, int iHull, int
 		return 2;
 	}
 
+	// only the door caps change the route, and the two searches can
+	// disagree, so each has its own entries
+	int iCacheCaps = ((afCapMask & bits_CAP_DOORS_GROUP) << 1) | (0 != m_fRoutingComplete ? 1 : 0);
+	iNumPathNodes = s_NodePathCache.Lookup(iStart, iDest, iHull, iCacheCaps, s_iGraphVersion, piPath);
+	if (iNumPathNodes >= 0)
+		return iNumPathNodes;
+
+	// a door or button the search looked at can change state later
+	bool fCacheable = true;
+
 	// Is routing information present.
 	//
 	if (0 != m_fRoutingComplete)
@@ -622,6 +651,7 @@ int CGraph::FindShortestPath(int* piPath, int iStart, int iDest, int iHull, int
 			if (iCurrentNode == iNext)
 			{
 				//ALERT(at_aiconsole, "SVD: Can't get there from here..\n");
+				s_NodePathCache.Store(iStart, iDest, iHull, iCacheCaps, s_iGraphVersion, piPath, 0);
 				return 0;
 				break;
 			}
@@ -693,6 +723,7 @@ int CGraph::FindShortestPath(int* piPath, int iStart, int iDest, int iHull, int
 				// check the connection from the current node to the node we're about to mark visited and push into the queue
 				if (m_pLinkPool[m_pNodes[iCurrentNode].m_iFirstLink + i].m_pLinkEnt != NULL)
 				{ // there's a brush ent in the way! Don't mark this node or put it into the queue unless the monster can negotiate it
+					fCacheable = false;
 
 					if (!HandleLinkEnt(iCurrentNode, m_pLinkPool[m_pNodes[iCurrentNode].m_iFirstLink + i].m_pLinkEnt, afCapMask, NODEGRAPH_STATIC))
 					{ // monster should not try to go this way.
@@ -711,6 +742,8 @@ int CGraph::FindShortestPath(int* piPath, int iStart, int iDest, int iHull, int
 		}
 		if (m_pNodes[iDest].m_flClosestSoFar < -0.5)
 		{ // Destination is unreachable, no path found.
+			if (fCacheable)
+				s_NodePathCache.Store(iStart, iDest, iHull, iCacheCaps, s_iGraphVersion, piPath, 0);
 			return 0;
 		}
 
@@ -771,6 +804,9 @@ int CGraph::FindShortestPath(int* piPath, int iStart, int iDest, int iHull, int
 	MESSAGE_END();
 #endif
 
+	if (fCacheable)
+		s_NodePathCache.Store(iStart, iDest, iHull, iCacheCaps, s_iGraphVersion, piPath, iNumPathNodes);
+
 	return iNumPathNodes;
 }
 
@@ -2055,6 +2091,7 @@ void CTestHull::BuildNodeGraph()
 	WorldGraph.m_fGraphPresent = 1;		//graph is in memory.
 	WorldGraph.m_fGraphPointersSet = 1; // since the graph was generated, the pointers are ready
 	WorldGraph.m_fRoutingComplete = 0;	// Optimal routes aren't computed, yet.
+	NodePathCache_Invalidate();
 
 	// Compute and compress the routing information.
 	//
@@ -2473,6 +2510,7 @@ bool CGraph::FLoadGraph(const char* szMapName)
 	//
 	m_fGraphPresent = 1;
 	m_fGraphPointersSet = 0;
+	NodePathCache_Invalidate();
 
 	if (length != 0)
 	{
@@ -3321,6 +3359,7 @@ void CGraph::ComputeStaticRoutingTables()
 	TestRoutingTables();
 #endif
 	m_fRoutingComplete = 1;
+	NodePathCache_Invalidate();
 }
 
 // Test those routing tables. Doesn't really work, yet.
@@ -12,6 +12,9 @@
 *   without written permission from Valve LLC.
 *
 ****/
+
+#include <algorithm>
+
 #include "extdll.h"
 #include "util.h"
 #include "cbase.h"
@@ -32,6 +35,9 @@ void CSound::Clear()
 	m_flExpireTime = 0;
 	m_iNext = SOUNDLIST_EMPTY;
 	m_iNextAudible = 0;
+	m_iCell = SOUNDLIST_EMPTY;
+	m_iNextInCell = SOUNDLIST_EMPTY;
+	m_iPrevInCell = SOUNDLIST_EMPTY;
 }
 
 //=========================================================
@@ -97,6 +103,7 @@ void CSoundEnt::Think()
 
 	iPreviousSound = SOUNDLIST_EMPTY;
 	iSound = m_iActiveSound;
+	m_iMaxGridVolume = 0;
 
 	while (iSound != SOUNDLIST_EMPTY)
 	{
@@ -111,6 +118,10 @@ void CSoundEnt::Think()
 		}
 		else
 		{
+			// shrink the hearing range back down to the loudest sound that's left
+			if (m_SoundPool[iSound].m_iCell != SOUNDLIST_EMPTY)
+				m_iMaxGridVolume = V_max(m_iMaxGridVolume, m_SoundPool[iSound].m_iVolume);
+
 			iPreviousSound = iSound;
 			iSound = m_SoundPool[iSound].m_iNext;
 		}
@@ -156,6 +167,8 @@ void CSoundEnt::FreeSound(int iSound, int iPrevious)
 		pSoundEnt->m_iActiveSound = pSoundEnt->m_SoundPool[iSound].m_iNext;
 	}
 
+	pSoundEnt->UnlinkSound(iSound);
+
 	// make iSound the head of the Free list.
 	pSoundEnt->m_SoundPool[iSound].m_iNext = pSoundEnt->m_iFreeSound;
 	pSoundEnt->m_iFreeSound = iSound;
@@ -169,7 +182,7 @@ int CSoundEnt::IAllocSound()
 {
 	int iNewSound;
 
-	if (m_iFreeSound == SOUNDLIST_EMPTY)
+	if (m_iFreeSound == SOUNDLIST_EMPTY && IReplaceSound() == SOUNDLIST_EMPTY)
 	{
 		// no free sound!
 		ALERT(at_console, "Free Sound List is full!\n");
@@ -216,6 +229,154 @@ void CSoundEnt::InsertSound(int iType, const Vector& vecOrigin, int iVolume, flo
 	pSoundEnt->m_SoundPool[iThisSound].m_iType = iType;
 	pSoundEnt->m_SoundPool[iThisSound].m_iVolume = iVolume;
 	pSoundEnt->m_SoundPool[iThisSound].m_flExpireTime = gpGlobals->time + flDuration;
+
+	pSoundEnt->LinkSound(iThisSound);
+}
+
+//=========================================================
+// SoundGridCoord - grid row or column for a world
+// coordinate, clamped to the edge of the grid
+//=========================================================
+static int SoundGridCoord(float flCoord)
+{
+	return std::clamp((int)floor((flCoord + SOUNDGRID_EXTENT) / SOUNDGRID_CELL_SIZE), 0, SOUNDGRID_CELLS - 1);
+}
+
+//=========================================================
+// LinkSound - bins a newly inserted sound in the grid cell
+// of its origin.
+//=========================================================
+void CSoundEnt::LinkSound(int iSound)
+{
+	CSound* pSound = &m_SoundPool[iSound];
+	int iCell = SoundGridCoord(pSound->m_vecOrigin.y) * SOUNDGRID_CELLS + SoundGridCoord(pSound->m_vecOrigin.x);
+
+	pSound->m_iCell = iCell;
+	pSound->m_iPrevInCell = SOUNDLIST_EMPTY;
+	pSound->m_iNextInCell = m_iCellHead[iCell];
+
+	if (m_iCellHead[iCell] != SOUNDLIST_EMPTY)
+		m_SoundPool[m_iCellHead[iCell]].m_iPrevInCell = iSound;
+
+	m_iCellHead[iCell] = iSound;
+	m_cGridSounds++;
+	m_iMaxGridVolume = V_max(m_iMaxGridVolume, pSound->m_iVolume);
+}
+
+//=========================================================
+// UnlinkSound - takes a sound off the grid, if it's on it.
+//=========================================================
+void CSoundEnt::UnlinkSound(int iSound)
+{
+	CSound* pSound = &m_SoundPool[iSound];
+
+	if (pSound->m_iCell == SOUNDLIST_EMPTY)
+		return;
+
+	if (pSound->m_iPrevInCell != SOUNDLIST_EMPTY)
+		m_SoundPool[pSound->m_iPrevInCell].m_iNextInCell = pSound->m_iNextInCell;
+	else
+		m_iCellHead[pSound->m_iCell] = pSound->m_iNextInCell;
+
+	if (pSound->m_iNextInCell != SOUNDLIST_EMPTY)
+		m_SoundPool[pSound->m_iNextInCell].m_iPrevInCell = pSound->m_iPrevInCell;
+
+	pSound->m_iCell = SOUNDLIST_EMPTY;
+	pSound->m_iNextInCell = pSound->m_iPrevInCell = SOUNDLIST_EMPTY;
+	m_cGridSounds--;
+}
+
+//=========================================================
+// IReplaceSound - when the pool is full, frees the sound
+// that would have expired first, so a new sound isn't
+// dropped in the middle of a firefight. Client sounds and
+// sounds that never expire are kept. Returns the freed
+// index, or SOUNDLIST_EMPTY if nothing could be freed.
+//=========================================================
+int CSoundEnt::IReplaceSound()
+{
+	int iSound, iPrevious;
+	int iBest = SOUNDLIST_EMPTY;
+	int iBestPrevious = SOUNDLIST_EMPTY;
+
+	iPrevious = SOUNDLIST_EMPTY;
+	for (iSound = m_iActiveSound; iSound != SOUNDLIST_EMPTY; iPrevious = iSound, iSound = m_SoundPool[iSound].m_iNext)
+	{
+		if (m_SoundPool[iSound].m_iCell == SOUNDLIST_EMPTY || m_SoundPool[iSound].m_flExpireTime == SOUND_NEVER_EXPIRE)
+			continue;
+
+		if (iBest == SOUNDLIST_EMPTY || m_SoundPool[iSound].m_flExpireTime < m_SoundPool[iBest].m_flExpireTime)
+		{
+			iBest = iSound;
+			iBestPrevious = iPrevious;
+		}
+	}
+
+	if (iBest != SOUNDLIST_EMPTY)
+	{
+		ALERT(at_aiconsole, "Sound pool full, replacing the oldest sound\n");
+		FreeSound(iBest, iBestPrevious);
+	}
+
+	return iBest;
+}
+
+//=========================================================
+// SoundsNear - fills piSounds (which must hold
+// MAX_WORLD_SOUNDS indices) with every active sound that
+// could be heard from vecEar by a monster with the given
+// hearing sensitivity, and returns how many there are.
+// Only the grid cells within earshot of the loudest sound
+// are visited; the caller still has to test each sound's
+// own volume and type.
+//=========================================================
+int CSoundEnt::SoundsNear(const Vector& vecEar, float flSensitivity, int* piSounds)
+{
+	int iSound, i, x, y;
+	int count = 0;
+
+	if (!pSoundEnt)
+	{
+		return 0;
+	}
+
+	float flRange = pSoundEnt->m_iMaxGridVolume * flSensitivity;
+	int xMin = SoundGridCoord(vecEar.x - flRange);
+	int xMax = SoundGridCoord(vecEar.x + flRange);
+	int yMin = SoundGridCoord(vecEar.y - flRange);
+	int yMax = SoundGridCoord(vecEar.y + flRange);
+
+	if ((xMax - xMin + 1) * (yMax - yMin + 1) > pSoundEnt->m_cGridSounds)
+	{
+		// more cells in range than there are sounds, the list is quicker
+		for (iSound = pSoundEnt->m_iActiveSound; iSound != SOUNDLIST_EMPTY; iSound = pSoundEnt->m_SoundPool[iSound].m_iNext)
+			piSounds[count++] = iSound;
+
+		return count;
+	}
+
+	for (y = yMin; y <= yMax; y++)
+	{
+		for (x = xMin; x <= xMax; x++)
+		{
+			iSound = pSoundEnt->m_iCellHead[y * SOUNDGRID_CELLS + x];
+
+			while (iSound != SOUNDLIST_EMPTY)
+			{
+				piSounds[count++] = iSound;
+				iSound = pSoundEnt->m_SoundPool[iSound].m_iNextInCell;
+			}
+		}
+	}
+
+	// client sounds move every frame, so they're never on the grid
+	for (i = 0; i < gpGlobals->maxClients; i++)
+	{
+		if (pSoundEnt->m_SoundPool[i].m_iCell == SOUNDLIST_EMPTY)
+			piSounds[count++] = i;
+	}
+
+	return count;
 }
 
 //=========================================================
@@ -231,6 +392,14 @@ void CSoundEnt::Initialize()
 	m_iFreeSound = 0;
 	m_iActiveSound = SOUNDLIST_EMPTY;
 
+	for (i = 0; i < SOUNDGRID_CELLS * SOUNDGRID_CELLS; i++)
+	{
+		m_iCellHead[i] = SOUNDLIST_EMPTY;
+	}
+
+	m_cGridSounds = 0;
+	m_iMaxGridVolume = 0;
+
 	for (i = 0; i < MAX_WORLD_SOUNDS; i++)
 	{ // clear all sounds, and link them into the free sound list.
 		m_SoundPool[i].Clear();
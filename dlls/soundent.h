@@ -21,7 +21,16 @@
 // lists.
 //=========================================================
 
-#define MAX_WORLD_SOUNDS 64 // maximum number of sounds handled by the world at one time.
+#ifndef MAX_WORLD_SOUNDS
+#define MAX_WORLD_SOUNDS 256 // maximum number of sounds handled by the world at one time. Can be overridden on the compiler command line.
+#endif
+
+// active sounds are also binned by origin on a grid over the x/y plane, so a
+// monster only has to test the sounds near it. Sounds outside the grid land
+// in its edge cells.
+#define SOUNDGRID_CELL_SIZE 256
+#define SOUNDGRID_EXTENT 4096 // the grid spans -SOUNDGRID_EXTENT to SOUNDGRID_EXTENT on both axes
+#define SOUNDGRID_CELLS (2 * SOUNDGRID_EXTENT / SOUNDGRID_CELL_SIZE)
 
 #define bits_SOUND_NONE 0
 #define bits_SOUND_COMBAT (1 << 0)	// gunshots, explosions
@@ -56,6 +65,9 @@ public:
 	float m_flExpireTime; // when the sound should be purged from the list
 	int m_iNext;		  // index of next sound in this list ( Active or Free )
 	int m_iNextAudible;	  // temporary link that monsters use to build a list of audible sounds
+	int m_iCell;		  // grid cell the sound is binned in, or SOUNDLIST_EMPTY for client sounds, which move
+	int m_iNextInCell;	  // links of the list of sounds in m_iCell
+	int m_iPrevInCell;
 
 	bool FIsSound();
 	bool FIsScent();
@@ -80,12 +92,17 @@ public:
 	static int FreeList();							 // return the head of the free list
 	static CSound* SoundPointerForIndex(int iIndex); // return a pointer for this index in the sound list
 	static int ClientSoundIndex(edict_t* pClient);
+	static int SoundsNear(const Vector& vecEar, float flSensitivity, int* piSounds); // fills piSounds with the sounds that might be heard from vecEar
 
 	bool IsEmpty() { return m_iActiveSound == SOUNDLIST_EMPTY; }
 	int ISoundsInList(int iListType);
 	int IAllocSound();
 	int ObjectCaps() override { return FCAP_DONT_SAVE; }
 
+	void LinkSound(int iSound);
+	void UnlinkSound(int iSound);
+	int IReplaceSound();
+
 	int m_iFreeSound;		 // index of the first sound in the free sound list
 	int m_iActiveSound;		 // indes of the first sound in the active sound list
 	int m_cLastActiveSounds; // keeps track of the number of active sounds at the last update. (for diagnostic work)
@@ -93,6 +110,10 @@ public:
 
 private:
 	CSound m_SoundPool[MAX_WORLD_SOUNDS];
+
+	int m_iCellHead[SOUNDGRID_CELLS * SOUNDGRID_CELLS]; // first sound in each grid cell
+	int m_cGridSounds;									// number of sounds on the grid
+	int m_iMaxGridVolume;								// at least as loud as the loudest sound on the grid
 };
 
 inline CSoundEnt* pSoundEnt;
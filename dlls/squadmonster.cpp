@@ -557,6 +557,56 @@ bool CSquadMonster::FValidateCover(const Vector& vecCoverLocation)
 	return true;
 }
 
+//=========================================================
+// FVisible - squad members usually look at the same things
+// from about the same place, so each line of sight trace is
+// posted on the leader, and a member whose eyes and target
+// are both still within SQUAD_SIGHTING_TOLERANCE of a
+// recent one reuses its result instead of tracing again.
+//=========================================================
+bool CSquadMonster::FVisible(CBaseEntity* pEntity)
+{
+	if (!InSquad())
+		return CBaseMonster::FVisible(pEntity);
+
+	CSquadMonster* pSquadLeader = MySquadLeader();
+	Vector vecLooker = pev->origin + pev->view_ofs;
+	Vector vecTarget = pEntity->EyePosition();
+	squadsighting_t* pOldest = &pSquadLeader->m_Sightings[0];
+
+	for (int i = 0; i < MAX_SQUAD_SIGHTINGS; i++)
+	{
+		squadsighting_t* pSighting = &pSquadLeader->m_Sightings[i];
+
+		if (pSighting->flTime < pOldest->flTime)
+			pOldest = pSighting;
+
+		if (pSighting->hTarget != pEntity || gpGlobals->time - pSighting->flTime > SQUAD_SIGHTING_TIME)
+			continue;
+
+		// the water checks in FVisible depend on both ends too
+		if (pSighting->iLookerWaterLevel != pev->waterlevel || pSighting->iTargetWaterLevel != pEntity->pev->waterlevel)
+			continue;
+
+		if ((pSighting->vecLooker - vecLooker).Length() > SQUAD_SIGHTING_TOLERANCE || (pSighting->vecTarget - vecTarget).Length() > SQUAD_SIGHTING_TOLERANCE)
+			continue;
+
+		return pSighting->fVisible;
+	}
+
+	bool fVisible = CBaseMonster::FVisible(pEntity);
+
+	pOldest->hTarget = pEntity;
+	pOldest->vecLooker = vecLooker;
+	pOldest->vecTarget = vecTarget;
+	pOldest->iLookerWaterLevel = pev->waterlevel;
+	pOldest->iTargetWaterLevel = pEntity->pev->waterlevel;
+	pOldest->flTime = gpGlobals->time;
+	pOldest->fVisible = fVisible;
+
+	return fVisible;
+}
+
 //=========================================================
 // SquadEnemySplit- returns true if not all squad members
 // are fighting the same enemy.
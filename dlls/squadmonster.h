@@ -53,6 +53,26 @@
 
 #define MAX_SQUAD_MEMBERS 5
 
+// squad members standing together share their line of sight traces
+#define MAX_SQUAD_SIGHTINGS 8
+#define SQUAD_SIGHTING_TIME 0.2		 // how long a trace result stays good
+#define SQUAD_SIGHTING_TOLERANCE 32 // how far the eyes at either end may be from where the trace was made
+
+//=========================================================
+// squadsighting_t - the result of one member's FVisible
+// check, kept on the leader for the rest of the squad.
+//=========================================================
+typedef struct
+{
+	EHANDLE hTarget;
+	Vector vecLooker; // eye positions the trace was made between
+	Vector vecTarget;
+	int iLookerWaterLevel;
+	int iTargetWaterLevel;
+	float flTime;
+	bool fVisible;
+} squadsighting_t;
+
 //=========================================================
 // CSquadMonster - for any monster that forms squads.
 //=========================================================
@@ -69,6 +89,8 @@ public:
 	// squad member info
 	int m_iMySlot; // this is the behaviour slot that the monster currently holds in the squad.
 
+	squadsighting_t m_Sightings[MAX_SQUAD_SIGHTINGS]; // valid only for leader, not saved
+
 	bool CheckEnemy(CBaseEntity* pEnemy) override;
 	void StartMonster() override;
 	void VacateSlot();
@@ -116,6 +138,8 @@ public:
 	bool Restore(CRestore& restore) override;
 
 	bool FValidateCover(const Vector& vecCoverLocation) override;
+	bool FVisible(CBaseEntity* pEntity) override;
+	using CBaseMonster::FVisible;
 
 	MONSTERSTATE GetIdealState() override;
 	Schedule_t* GetScheduleOfType(int iType) override;
@@ -36,7 +36,11 @@ public:
 	[[nodiscard]] constexpr Vector2D operator*(float fl) const { return Vector2D(x * fl, y * fl); }
 	[[nodiscard]] constexpr Vector2D operator/(float fl) const { return Vector2D(x / fl, y / fl); }
 
-	[[nodiscard]] float Length() const { return static_cast<float>(sqrt(x * x + y * y)); }
+	[[nodiscard]] constexpr float LengthSquared() const { return x * x + y * y; }
+	[[nodiscard]] float Length() const { return static_cast<float>(sqrt(LengthSquared())); }
+
+	[[nodiscard]] constexpr bool IsLengthLessThan(float length) const { return LengthSquared() < length * length; }
+	[[nodiscard]] constexpr bool IsLengthGreaterThan(float length) const { return LengthSquared() > length * length; }
 
 	[[nodiscard]] Vector2D Normalize() const
 	{
@@ -112,6 +116,21 @@ public:
 		return Vector(x * flLen, y * flLen, z * flLen);
 	}
 
+	// Normalizes this vector and returns its old length, leaves a zero vector alone
+	float NormalizeInPlace()
+	{
+		float flLen = Length();
+		if (flLen != 0)
+		{
+			float flInvLen = 1 / flLen;
+			x *= flInvLen, y *= flInvLen, z *= flInvLen;
+		}
+		return flLen;
+	}
+
+	[[nodiscard]] constexpr bool IsLengthLessThan(float length) const { return LengthSquared() < length * length; }
+	[[nodiscard]] constexpr bool IsLengthGreaterThan(float length) const { return LengthSquared() > length * length; }
+
 	[[nodiscard]] constexpr Vector2D Make2D() const
 	{
 		return {x, y};
@@ -24,6 +24,7 @@
 #include "util.h"
 #include "cbase.h"
 #include "nodes.h"
+#include "navroute.h"
 #include "soundent.h"
 #include "client.h"
 #include "decals.h"
@@ -655,6 +656,8 @@ void CWorld::Precache()
 		}
 	}
 
+	NavRoute_LevelInit();
+
 	if (pev->speed > 0)
 		CVAR_SET_FLOAT("sv_zmax", pev->speed);
 	else
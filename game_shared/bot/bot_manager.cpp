@@ -31,6 +31,10 @@
 
 const float smokeRadius = 115.0f;		///< for smoke grenades
 
+/// when nonzero, nav mesh analysis traces on every core - off by default, see RunNavAnalysisJobs().
+/// Like the analysis, it only exists in a game dll built with the CS bots.
+cvar_t cv_bot_nav_threads = { "bot_nav_threads", "0", FCVAR_SERVER };
+
 
 //#define CHECK_PERFORMANCE
 #ifdef CHECK_PERFORMANCE
@@ -69,6 +73,10 @@ GameEventType NameToGameEvent( const char *name )
 CBotManager::CBotManager()
 {
 	InitBotTrig();
+
+	// the manager is recreated each map, but the cvar only needs registering once
+	if (CVAR_GET_POINTER( cv_bot_nav_threads.name ) == NULL)
+		CVAR_REGISTER( &cv_bot_nav_threads );
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -27,6 +27,7 @@ extern cvar_t cv_bot_show_nav;
 extern cvar_t cv_bot_show_danger;
 extern cvar_t cv_bot_nav_edit;
 extern cvar_t cv_bot_nav_zdraw;
+extern cvar_t cv_bot_nav_threads;
 extern cvar_t cv_bot_walk;
 extern cvar_t cv_bot_difficulty;
 extern cvar_t cv_bot_debug;
@@ -96,8 +97,10 @@ extern void		UTIL_DrawBeamFromEnt( int iIndex, Vector vecEnd, int iLifetime, byt
 extern void		UTIL_DrawBeamPoints( Vector vecStart, Vector vecEnd, int iLifetime, byte bRed, byte bGreen, byte bBlue );
 extern CBasePlayer *UTIL_GetClosestPlayer( const Vector *pos, float *distance = NULL );
 extern CBasePlayer *UTIL_GetClosestPlayer( const Vector *pos, int team, float *distance = NULL );
+#ifndef MONSTER_NAV_MESH	// the HL game dll has its own UTIL_GetLocalPlayer(), and no teams
 extern CBasePlayer *UTIL_GetLocalPlayer( void );
 extern bool UTIL_KickBotFromTeam( TeamName kickTeam ); ///< kick a bot from the given team. If no bot exists on the team, return false.
+#endif
 
 extern bool UTIL_IsVisibleToTeam( const Vector &spot, int team, float maxRange = -1.0f ); ///< return true if anyone on the given team can see the given spot
 
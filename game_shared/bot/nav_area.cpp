@@ -8,6 +8,9 @@
 #include <list>
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
 
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -30,10 +33,16 @@
 #include "gamerules.h"
 #include "bot_util.h"
 
+#ifndef MONSTER_NAV_MESH
 /// @todo Abstract hostages and cs-bots out of here
 #include "cs_bot.h"
 #include "cs_bot_manager.h"
 #include "hostage.h"
+#else
+// the HL game dll headers have no min() and max() macros
+using std::min;
+using std::max;
+#endif
 
 #include "nav.h"
 #include "nav_node.h"
@@ -44,12 +53,14 @@
 extern void HintMessageToAllPlayers( const char *message );
 
 unsigned int CNavArea::m_nextID = 1;
+unsigned int CNavArea::m_meshVersion = 1;
 NavAreaList TheNavAreaList;
 
 NavLadderList TheNavLadderList;
 
 unsigned int CNavArea::m_masterMarker = 1;
-CNavArea *CNavArea::m_openList = NULL;
+std::vector<CNavArea *> CNavArea::m_openHeap;
+unsigned int CNavArea::m_openSequence = 0;
 
 bool CNavArea::m_isReset = false;
 static float lastDrawTimestamp = 0.0f;
@@ -127,13 +138,6 @@ HidingSpot::HidingSpot( const Vector *pos, unsigned char flags )
 	TheHidingSpotList.push_back( this );
 }
 
-void HidingSpot::Save( int fd, unsigned int version ) const
-{
-	_write( fd, &m_id, sizeof(unsigned int) );
-	_write( fd, &m_pos, 3 * sizeof(float) );
-	_write( fd, &m_flags, sizeof(unsigned char) );
-}
-
 void HidingSpot::Load( SteamFile *file, unsigned int version )
 {
 	file->Read( &m_id, sizeof(unsigned int) );
@@ -187,6 +191,8 @@ void CNavArea::Initialize( void )
 	// set an ID for splitting and other interactive editing - loads will overwrite this
 	m_id = m_nextID++;
 
+	++m_meshVersion;
+
 	m_prevHash = NULL;
 	m_nextHash = NULL;
 }
@@ -294,6 +300,8 @@ CNavArea::CNavArea( CNavNode *nwNode, CNavNode *neNode, CNavNode *seNode, CNavNo
  */
 CNavArea::~CNavArea()
 {
+	++m_meshVersion;
+
 	// if we are resetting the system, don't bother cleaning up - all areas are being destroyed
 	if (m_isReset)
 		return;
@@ -355,6 +363,8 @@ void CNavArea::ConnectTo( CNavArea *area, NavDirType dir )
 	con.area = area;
 	m_connect[ dir ].push_back( con );
 
+	++m_meshVersion;
+
 	//static char *dirName[] = { "NORTH", "EAST", "SOUTH", "WEST" };
 	//CONSOLE_ECHO( "  Connected area #%d to #%d, %s\n", m_id, area->m_id, dirName[ dir ] );
 }
@@ -370,6 +380,8 @@ void CNavArea::Disconnect( CNavArea *area )
 
 	for( int dir = 0; dir<NUM_DIRECTIONS; dir++ )
 		m_connect[ dir ].remove( connect );
+
+	++m_meshVersion;
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -390,6 +402,8 @@ void CNavArea::FinishMerge( CNavArea *adjArea )
 	m_neZ = m_node[ NORTH_EAST ]->GetPosition()->z;
 	m_swZ = m_node[ SOUTH_WEST ]->GetPosition()->z;
 
+	++m_meshVersion;
+
 	// reassign the adjacent area's internal nodes to the final area
 	adjArea->AssignNodes( this );
 
@@ -1011,6 +1025,7 @@ void DestroyNavigationMap( void )
 	// destroy all hiding spots
 	DestroyHidingSpots();
 
+#if !defined( MONSTER_NAV_MESH ) || defined( NAV_GENERATION )
 	// destroy navigation nodes created during map learning
 	CNavNode *node, *next;
 	for( node = CNavNode::m_list; node; node = next )
@@ -1019,6 +1034,8 @@ void DestroyNavigationMap( void )
 		delete node;
 	}
 	CNavNode::m_list = NULL;
+	CNavNode::m_listLength = 0;
+#endif
 
 	// reset the grid
 	TheNavAreaGrid.Reset();
@@ -1050,6 +1067,7 @@ void CNavArea::Strip( void )
 }
 
 
+#if !defined( MONSTER_NAV_MESH ) || defined( NAV_GENERATION )	// monster routes only load the mesh, but utils/navtest tests generation
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Start at given position and find first area in given direction
@@ -1500,13 +1518,13 @@ void SquareUpAreas( void )
  * All of the nodes must be approximately co-planar w.r.t the NW node's normal, with the
  * exception of 1x1 areas which can be any angle.
  */
+static const float NodeOffPlaneTolerance = 5.0f;
+
 bool TestArea( CNavNode *node, int width, int height )
 {
 	Vector normal = *node->GetNormal();
 	float d = -DotProduct( normal, *node->GetPosition() );
 
-	const float offPlaneTolerance = 5.0f;
-
 	CNavNode *vertNode, *horizNode;
 
 	vertNode = node;
@@ -1534,7 +1552,7 @@ bool TestArea( CNavNode *node, int width, int height )
 			if (width > 1 || height > 1)
 			{
 				float dist = abs(DotProduct( *horizNode->GetPosition(), normal ) + d);
-				if (dist > offPlaneTolerance)
+				if (dist > NodeOffPlaneTolerance)
 					return false;
 			}					
 		}
@@ -1547,7 +1565,7 @@ bool TestArea( CNavNode *node, int width, int height )
 		if (width > 1 || height > 1)
 		{
 			float dist = abs(DotProduct( *vertNode->GetPosition(), normal ) + d);
-			if (dist > offPlaneTolerance)
+			if (dist > NodeOffPlaneTolerance)
 				return false;
 		}					
 	}
@@ -1565,7 +1583,7 @@ bool TestArea( CNavNode *node, int width, int height )
 
 			// nodes must lie on/near the plane
 			float dist = abs(DotProduct( *horizNode->GetPosition(), normal ) + d);
-			if (dist > offPlaneTolerance)
+			if (dist > NodeOffPlaneTolerance)
 				return false;
 		}
 	}
@@ -1887,40 +1905,126 @@ void MarkJumpAreas( void )
 
 
 //--------------------------------------------------------------------------------------------------------------
+// haven't yet seen a map use larger than 30...
+enum { MAX_GENERATED_AREA_SIZE = 50 };
+
 /**
- * This function uses the CNavNodes that have been sampled from the map to
- * generate CNavAreas - rectangular areas of "walkable" space. These areas
- * are connected to each other, allowing the AI to know how to move from
- * area to area.
- *
+ * The largest areas TestArea() accepts with a given node as their NW corner.
+ * Nodes only ever become covered while areas are built, so once computed this stays an upper bound,
+ * and the sizes it rules out never have to be walked again.
+ */
+struct NodeAreaLimit
+{
+	bool isValid;
+	unsigned char maxWidth[ MAX_GENERATED_AREA_SIZE ];		///< the widest area of height i+1, or zero if there is none
+};
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find the widest area TestArea() accepts at each height, with one walk over the nodes.
+ * Each row bounds the width of every taller area, while the row below it closes an area of its height.
+ * 1x1 areas need not be planar, so they are not covered by this.
+ */
+static void ComputeNodeAreaLimit( CNavNode *node, NodeAreaLimit *limit )
+{
+	Vector normal = *node->GetNormal();
+	float d = -DotProduct( normal, *node->GetPosition() );
+
+	limit->isValid = true;
+	memset( limit->maxWidth, 0, sizeof( limit->maxWidth ) );
+
+	int widest = MAX_GENERATED_AREA_SIZE;
+	CNavNode *vertNode = node;
+	CNavNode *horizNode;
+	int x;
+
+	for( int y=0; y<MAX_GENERATED_AREA_SIZE; y++ )
+	{
+		// how far this row can extend as the inside of an area
+		horizNode = vertNode;
+		for( x=0; x<widest; x++ )
+		{
+			if (horizNode->GetAttributes() != node->GetAttributes() ||
+				horizNode->IsCovered() ||
+				!horizNode->IsClosedCell())
+				break;
+
+			horizNode = horizNode->GetConnectedNode( EAST );
+			if (horizNode == NULL || abs(DotProduct( *horizNode->GetPosition(), normal ) + d) > NodeOffPlaneTolerance)
+				break;
+		}
+
+		widest = x;
+		if (widest == 0)
+			return;
+
+		// how far the next row can extend as the southern edge of an area y+1 high
+		vertNode = vertNode->GetConnectedNode( SOUTH );
+		if (vertNode == NULL || abs(DotProduct( *vertNode->GetPosition(), normal ) + d) > NodeOffPlaneTolerance)
+			return;
+
+		horizNode = vertNode;
+		for( x=0; x<widest; x++ )
+		{
+			horizNode = horizNode->GetConnectedNode( EAST );
+			if (horizNode == NULL || abs(DotProduct( *horizNode->GetPosition(), normal ) + d) > NodeOffPlaneTolerance)
+				break;
+		}
+
+		limit->maxWidth[y] = x;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Cover the nodes that are not yet covered with areas, trying the largest rectangles first.
  * This is a "greedy" algorithm that attempts to cover the walkable area 
  * with the fewest, largest, rectangles.
+ * Returns false if the node data is corrupt.
  */
-void GenerateNavigationAreaMesh( void )
+bool CoverNodesWithAreas( int uncoveredNodes )
 {
-	// haven't yet seen a map use larger than 30...
-	int tryWidth = 50;
-	int tryHeight = 50;
-	int uncoveredNodes = CNavNode::GetListLength();
+	int tryWidth = MAX_GENERATED_AREA_SIZE;
+	int tryHeight = MAX_GENERATED_AREA_SIZE;
+
+	// limits are kept in node list order, and computed when a node is first tried
+	int nodeCount = 0;
+	CNavNode *node;
+	for( node = CNavNode::GetFirst(); node; node = node->GetNext() )
+		++nodeCount;
+
+	std::vector< NodeAreaLimit > limit( nodeCount );
 
 	while( uncoveredNodes > 0 )
 	{
-		for( CNavNode *node = CNavNode::GetFirst(); node; node = node->GetNext() )
+		int n = 0;
+		for( node = CNavNode::GetFirst(); node; node = node->GetNext(), ++n )
 		{
 			if (node->IsCovered())
 				continue;
 
+			if (tryWidth > 1 || tryHeight > 1)
+			{
+				if (!limit[n].isValid)
+					ComputeNodeAreaLimit( node, &limit[n] );
+
+				if (limit[n].maxWidth[ tryHeight-1 ] < tryWidth)
+					continue;
+			}
+
 			if (TestArea( node, tryWidth, tryHeight ))
 			{
 				int covered = BuildArea( node, tryWidth, tryHeight );
 				if (covered < 0)
-				{
-					CONSOLE_ECHO( "GenerateNavigationAreaMesh: Error - Data corrupt.\n" );
-					return;
-				}
+					return false;
 
 				uncoveredNodes -= covered;
 			}
+			else
+			{
+				// an area built since the limit was computed is in the way
+				limit[n].isValid = false;
+			}
 		}
 
 		if (tryWidth >= tryHeight)
@@ -1932,6 +2036,24 @@ void GenerateNavigationAreaMesh( void )
 			break;
 	}
 
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * This function uses the CNavNodes that have been sampled from the map to
+ * generate CNavAreas - rectangular areas of "walkable" space. These areas
+ * are connected to each other, allowing the AI to know how to move from
+ * area to area.
+ */
+void GenerateNavigationAreaMesh( void )
+{
+	if (!CoverNodesWithAreas( CNavNode::GetListLength() ))
+	{
+		CONSOLE_ECHO( "GenerateNavigationAreaMesh: Error - Data corrupt.\n" );
+		return;
+	}
+
 	Extent extent;
 	extent.lo.x = 9999999999.9f;
 	extent.lo.y = 9999999999.9f;
@@ -1968,6 +2090,8 @@ void GenerateNavigationAreaMesh( void )
 	MarkJumpAreas();
 }
 
+#endif // !MONSTER_NAV_MESH || NAV_GENERATION
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Return true if 'pos' is within 2D extents of area.
@@ -2506,6 +2630,7 @@ NavDirType CNavArea::ComputeDirection( Vector *point ) const
 	return NUM_DIRECTIONS;
 }
 
+#ifndef MONSTER_NAV_MESH	// drawing is only for the nav editor
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Draw area for debugging
@@ -2627,98 +2752,118 @@ void CNavArea::DrawMarkedCorner( NavCornerType corner, byte red, byte green, byt
 	}
 }
 
+#endif // MONSTER_NAV_MESH
+
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Add to open list in decreasing value order
+ * Areas pop off the open list in increasing cost order.  Equal costs pop in the order the areas were
+ * last queued, which is the order the old sorted linked list kept them in, so paths don't change.
  */
-void CNavArea::AddToOpenList( void )
+inline bool CNavArea::IsOpenBefore( const CNavArea *other ) const
 {
-	// mark as being on open list for quick check
-	m_openMarker = m_masterMarker;
+	if (GetTotalCost() != other->GetTotalCost())
+		return (GetTotalCost() < other->GetTotalCost()) ? true : false;
 
-	// if list is empty, add and return
-	if (m_openList == NULL)
-	{
-		m_openList = this;
-		this->m_prevOpen = NULL;
-		this->m_nextOpen = NULL;
-		return;
-	}
+	return (m_openOrder < other->m_openOrder) ? true : false;
+}
 
-	// insert self in ascending cost order
-	CNavArea *area, *last = NULL;
-	for( area = m_openList; area; area = area->m_nextOpen )
+//--------------------------------------------------------------------------------------------------------------
+void CNavArea::SiftOpenUp( int index )
+{
+	CNavArea *area = m_openHeap[ index ];
+
+	while( index > 0 )
 	{
-		if (this->GetTotalCost() < area->GetTotalCost())
+		int parent = (index - 1) / 2;
+		if (!area->IsOpenBefore( m_openHeap[ parent ] ))
 			break;
 
-		last = area;
+		m_openHeap[ index ] = m_openHeap[ parent ];
+		m_openHeap[ index ]->m_openIndex = index;
+		index = parent;
 	}
 
-	if (area)
-	{
-		// insert before this area
-		this->m_prevOpen = area->m_prevOpen;
-		if (this->m_prevOpen)
-			this->m_prevOpen->m_nextOpen = this;
-		else
-			m_openList = this;
+	m_openHeap[ index ] = area;
+	area->m_openIndex = index;
+}
 
-		this->m_nextOpen = area;
-		area->m_prevOpen = this;
-	}
-	else
+//--------------------------------------------------------------------------------------------------------------
+void CNavArea::SiftOpenDown( int index )
+{
+	CNavArea *area = m_openHeap[ index ];
+	int count = m_openHeap.size();
+
+	while( true )
 	{
-		// append to end of list
-		last->m_nextOpen = this;
+		int child = 2 * index + 1;
+		if (child >= count)
+			break;
 
-		this->m_prevOpen = last;
-		this->m_nextOpen = NULL;
+		if (child + 1 < count && m_openHeap[ child + 1 ]->IsOpenBefore( m_openHeap[ child ] ))
+			++child;
+
+		if (!m_openHeap[ child ]->IsOpenBefore( area ))
+			break;
+
+		m_openHeap[ index ] = m_openHeap[ child ];
+		m_openHeap[ index ]->m_openIndex = index;
+		index = child;
 	}
+
+	m_openHeap[ index ] = area;
+	area->m_openIndex = index;
 }
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * A smaller value has been found, update this area on the open list
- * @todo "bubbling" does unnecessary work, since the order of all other nodes will be unchanged - only this node is altered
+ * Add to open list, which pops in increasing value order
  */
-void CNavArea::UpdateOnOpenList( void )
+void CNavArea::AddToOpenList( void )
 {
-	// since value can only decrease, bubble this area up from current spot
-	while( m_prevOpen && 
-				 this->GetTotalCost() < m_prevOpen->GetTotalCost() )
-	{
-		// swap position with predecessor
-		CNavArea *other = m_prevOpen;
-		CNavArea *before = other->m_prevOpen;
-		CNavArea *after  = this->m_nextOpen;
+	// mark as being on open list for quick check
+	m_openMarker = m_masterMarker;
+	m_openOrder = ++m_openSequence;
+	m_openCost = GetTotalCost();
 
-		this->m_nextOpen = other;
-		this->m_prevOpen = before;
+	m_openHeap.push_back( this );
+	SiftOpenUp( m_openHeap.size() - 1 );
+}
 
-		other->m_prevOpen = this;
-		other->m_nextOpen = after;
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A smaller value has been found, update this area on the open list
+ */
+void CNavArea::UpdateOnOpenList( void )
+{
+	// A cheaper path can round to the same total cost, and then the sorted list left the area where it was.
+	// Otherwise it put the area behind everything it tied with, as if newly queued.
+	if (GetTotalCost() == m_openCost)
+		return;
 
-		if (before)
-			before->m_nextOpen = this;
-		else
-			m_openList = this;
+	m_openOrder = ++m_openSequence;
+	m_openCost = GetTotalCost();
 
-		if (after)
-			after->m_prevOpen = other;
-	}
+	// since value can only decrease, the area can only move towards the front
+	SiftOpenUp( m_openIndex );
 }
 
 //--------------------------------------------------------------------------------------------------------------
 void CNavArea::RemoveFromOpenList( void )
 {
-	if (m_prevOpen)
-		m_prevOpen->m_nextOpen = m_nextOpen;
-	else
-		m_openList = m_nextOpen;
+	int index = m_openIndex;
+	CNavArea *last = m_openHeap.back();
 
-	if (m_nextOpen)
-		m_nextOpen->m_prevOpen = m_prevOpen;
+	m_openHeap.pop_back();
+
+	// fill the hole with the last area, which may belong either side of it
+	if (last != this)
+	{
+		m_openHeap[ index ] = last;
+		last->m_openIndex = index;
+
+		SiftOpenUp( index );
+		SiftOpenDown( last->m_openIndex );
+	}
 
 	// zero is an invalid marker
 	m_openMarker = 0;
@@ -2733,7 +2878,8 @@ void CNavArea::ClearSearchLists( void )
 	// effectively clears all open list pointers and closed flags
 	CNavArea::MakeNewMarker();
 
-	m_openList = NULL;
+	m_openHeap.clear();
+	m_openSequence = 0;
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -2743,7 +2889,8 @@ void CNavArea::ClearSearchLists( void )
  */
 const Vector *CNavArea::GetCorner( NavCornerType corner ) const
 {
-	static Vector pos;
+	// one per thread, as the map learning passes look at corners from several threads at once
+	static thread_local Vector pos;
 
 	switch( corner )
 	{
@@ -2769,19 +2916,20 @@ const Vector *CNavArea::GetCorner( NavCornerType corner ) const
 	return NULL;
 }
 
+#ifndef MONSTER_NAV_MESH	// hiding spots, encounters, danger and the nav editor are for the CS bots
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Returns true if an existing hiding spot is too close to given position
  */
+static const float HidingSpotCollisionRange = 30.0f;
+
 bool CNavArea::IsHidingSpotCollision( const Vector *pos ) const
 {
-	const float collisionRange = 30.0f;
-
 	for( HidingSpotList::const_iterator iter = m_hidingSpotList.begin(); iter != m_hidingSpotList.end(); ++iter )
 	{
 		const HidingSpot *spot = *iter;
 
-		if ((*spot->GetPosition() - *pos).IsLengthLessThan( collisionRange ))
+		if ((*spot->GetPosition() - *pos).IsLengthLessThan( HidingSpotCollisionRange ))
 			return true;
 	}
 
@@ -2832,6 +2980,19 @@ bool IsHidingSpotInCover( const Vector *spot )
  * Analyze local area neighborhood to find "hiding spots" for this area
  */
 void CNavArea::ComputeHidingSpots( void )
+{
+	Vector pos[ MAX_AREA_HIDING_SPOTS ];
+	unsigned char flags[ MAX_AREA_HIDING_SPOTS ];
+
+	AddHidingSpots( pos, flags, FindHidingSpots( pos, flags ) );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find the hiding spots ComputeHidingSpots would create for this area, and whether they are in cover.
+ * Only traces and reads the mesh, so it is safe to run for several areas at once.
+ */
+int CNavArea::FindHidingSpots( Vector *pos, unsigned char *flags ) const
 {
 	struct
 	{
@@ -2841,7 +3002,7 @@ void CNavArea::ComputeHidingSpots( void )
 
 	// "jump areas" cannot have hiding spots
 	if (GetAttributes() & NAV_JUMP)
-		return;
+		return 0;
 
 	int cornerCount[NUM_CORNERS];
 	for( int i=0; i<NUM_CORNERS; ++i )
@@ -2857,7 +3018,7 @@ void CNavArea::ComputeHidingSpots( void )
 
 		bool isHoriz = (d == NORTH || d == SOUTH) ? true : false;
 
-		for( NavConnectList::iterator iter = m_connect[d].begin(); iter != m_connect[d].end(); ++iter )
+		for( NavConnectList::const_iterator iter = m_connect[d].begin(); iter != m_connect[d].end(); ++iter )
 		{
 			NavConnect connect = *iter;
 
@@ -2926,34 +3087,59 @@ void CNavArea::ComputeHidingSpots( void )
 
 	// if a corner count is 2, then it really is a corner (walls on both sides)
 	float offset = 12.5f;
+	int count = 0;
 
-	if (cornerCount[ NORTH_WEST ] == 2)
+	static const struct
 	{
-		Vector pos = *GetCorner( NORTH_WEST ) + Vector(  offset,  offset, 0.0f );
-
-		m_hidingSpotList.push_back( new HidingSpot( &pos, (IsHidingSpotInCover( &pos )) ? HidingSpot::IN_COVER : 0 ) );
+		NavCornerType corner;
+		float dx, dy;
 	}
-
-	if (cornerCount[ NORTH_EAST ] == 2)
+	cornerOffset[ NUM_CORNERS ] =
 	{
-		Vector pos = *GetCorner( NORTH_EAST ) + Vector( -offset,  offset, 0.0f );
-		if (!IsHidingSpotCollision( &pos ))
-			m_hidingSpotList.push_back( new HidingSpot( &pos, (IsHidingSpotInCover( &pos )) ? HidingSpot::IN_COVER : 0 ) );
-	}
+		{ NORTH_WEST,  1.0f,  1.0f },
+		{ NORTH_EAST, -1.0f,  1.0f },
+		{ SOUTH_WEST,  1.0f, -1.0f },
+		{ SOUTH_EAST, -1.0f, -1.0f },
+	};
 
-	if (cornerCount[ SOUTH_WEST ] == 2)
+	for( int i=0; i<NUM_CORNERS; ++i )
 	{
-		Vector pos = *GetCorner( SOUTH_WEST ) + Vector(  offset, -offset, 0.0f );
-		if (!IsHidingSpotCollision( &pos ))
-			m_hidingSpotList.push_back( new HidingSpot( &pos, (IsHidingSpotInCover( &pos )) ? HidingSpot::IN_COVER : 0 ) );
-	}
+		if (cornerCount[ cornerOffset[i].corner ] != 2)
+			continue;
 
-	if (cornerCount[ SOUTH_EAST ] == 2)
-	{
-		Vector pos = *GetCorner( SOUTH_EAST ) + Vector( -offset, -offset, 0.0f );
-		if (!IsHidingSpotCollision( &pos ))
-			m_hidingSpotList.push_back( new HidingSpot( &pos, (IsHidingSpotInCover( &pos )) ? HidingSpot::IN_COVER : 0 ) );
+		Vector spot = *GetCorner( cornerOffset[i].corner ) + Vector( offset * cornerOffset[i].dx, offset * cornerOffset[i].dy, 0.0f );
+
+		// the north west corner always gets its spot, the others are dropped if they collide
+		// with one the area already has or one found above
+		if (i > 0)
+		{
+			if (IsHidingSpotCollision( &spot ))
+				continue;
+
+			int j;
+			for( j=0; j<count; ++j )
+				if ((pos[j] - spot).IsLengthLessThan( HidingSpotCollisionRange ))
+					break;
+			if (j < count)
+				continue;
+		}
+
+		pos[ count ] = spot;
+		flags[ count ] = (IsHidingSpotInCover( &spot )) ? HidingSpot::IN_COVER : 0;
+		++count;
 	}
+
+	return count;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Create the hiding spots FindHidingSpots found for this area
+ */
+void CNavArea::AddHidingSpots( const Vector *pos, const unsigned char *flags, int count )
+{
+	for( int i=0; i<count; ++i )
+		m_hidingSpotList.push_back( new HidingSpot( &pos[i], flags[i] ) );
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -3107,8 +3293,9 @@ void CNavArea::AddSpotEncounters( const CNavArea *from, NavDirType fromDir, cons
 	Vector dir = e.path.to - e.path.from;
 	float length = dir.NormalizeInPlace();
 
-	// create unique marker to flag used spots
-	HidingSpot::ChangeMasterMarker();
+	// flag used spots by their place in TheHidingSpotList rather than marking the spots themselves,
+	// so encounters for several areas can be computed at once
+	std::vector<bool> encountered( TheHidingSpotList.size(), false );
 
 	const float stepSize = 25.0f;		// 50
 	const float seeSpotRange = 2000.0f;	// 3000
@@ -3133,15 +3320,17 @@ void CNavArea::AddSpotEncounters( const CNavArea *from, NavDirType fromDir, cons
 		eye = e.path.from + along * dir;
 
 		// check each hiding spot for visibility
+		int spotIndex = -1;
 		for( HidingSpotList::iterator iter = TheHidingSpotList.begin(); iter != TheHidingSpotList.end(); ++iter )
 		{
 			spot = *iter;
+			++spotIndex;
 
 			// only look at spots with cover (others are out in the open and easily seen)
 			if (!spot->HasGoodCover())
 				continue;
 
-			if (spot->IsMarked())
+			if (encountered[ spotIndex ])
 				continue;
 
 			const Vector *spotPos = spot->GetPosition();
@@ -3176,7 +3365,7 @@ void CNavArea::AddSpotEncounters( const CNavArea *from, NavDirType fromDir, cons
 			}
 
 			// mark spot as encountered
-			spot->Mark();
+			encountered[ spotIndex ] = true;
 		}
 	}
 
@@ -3936,6 +4125,8 @@ void CNavArea::DrawConnectedAreas( void )
  */
 void CNavArea::RaiseCorner( NavCornerType corner, int amount )
 {
+	++m_meshVersion;
+
 	if ( corner == NUM_CORNERS )
 	{
 		m_extent.lo.z += amount;
@@ -4627,6 +4818,8 @@ void EditNavAreas( NavEditCmdType cmd )
 		isCreatingNavArea = false;
 }
 
+#endif // MONSTER_NAV_MESH
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Return the ground height below this point in "height".
@@ -4743,6 +4936,7 @@ bool GetSimpleGroundHeight( const Vector *pos, float *height, Vector *normal )
 	return true;
 }
 
+#ifndef MONSTER_NAV_MESH	// monster routes only load the mesh, they never analyze it
 //--------------------------------------------------------------------------------------------------------------
 enum { MAX_BLOCKED_AREAS = 256 };
 static unsigned int BlockedID[ MAX_BLOCKED_AREAS ];
@@ -4814,24 +5008,57 @@ inline bool IsAreaVisible( const Vector *pos, const CNavArea *area )
  * An approach area is an area representing a place where players 
  * move into/out of our local neighborhood of areas.
  */
-void CNavArea::ComputeApproachAreas( void )
+bool CNavArea::GetApproachEye( Vector *eye ) const
+{
+	// use the center of the nav area as the "view" point
+	*eye = m_center;
+	if (GetGroundHeight( eye, &eye->z ) == false)
+		return false;
+
+	// approximate eye position
+	if (GetAttributes() & NAV_CROUCH)
+		eye->z += 0.9f * HalfHumanHeight;
+	else
+		eye->z += 0.9f * HumanHeight;
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Determine which of the "good-sized" areas can be seen directly from this area, in goodSizedAreaList order.
+ * These are the checks ComputeApproachAreas makes before it starts pathfinding, and unlike the pathfinding
+ * they are safe to run for several areas at once.
+ */
+void CNavArea::ComputeApproachVisibility( std::vector<bool> *farAreaVisible ) const
+{
+	farAreaVisible->clear();
+
+	Vector eye;
+	if (cv_bot_quicksave.value > 0.0f || GetApproachEye( &eye ) == false)
+		return;
+
+	farAreaVisible->reserve( goodSizedAreaList.size() );
+	for( NavAreaList::const_iterator iter = goodSizedAreaList.begin(); iter != goodSizedAreaList.end(); ++iter )
+		farAreaVisible->push_back( IsAreaVisible( &eye, *iter ) );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Determine the set of "approach areas".
+ * If given, farAreaVisible holds the result of ComputeApproachVisibility for this area.
+ */
+void CNavArea::ComputeApproachAreas( const std::vector<bool> *farAreaVisible )
 {
 	m_approachCount = 0;
 
 	if (cv_bot_quicksave.value > 0.0f)
 		return;
 
-	// use the center of the nav area as the "view" point
-	Vector eye = m_center;
-	if (GetGroundHeight( &eye, &eye.z ) == false)
+	Vector eye;
+	if (GetApproachEye( &eye ) == false)
 		return;
 
-	// approximate eye position
-	if (GetAttributes() & NAV_CROUCH)
-		eye.z += 0.9f * HalfHumanHeight;
-	else
-		eye.z += 0.9f * HumanHeight;
-
 	enum { MAX_PATH_LENGTH = 256 };
 	CNavArea *path[ MAX_PATH_LENGTH ];
 
@@ -4841,14 +5068,22 @@ void CNavArea::ComputeApproachAreas( void )
 	// and keep the union of the approach area sets
 	//
 	NavAreaList::iterator iter;
+	int farIndex = -1;
 	for( iter = goodSizedAreaList.begin(); iter != goodSizedAreaList.end(); ++iter )
 	{
 		CNavArea *farArea = *iter;
+		++farIndex;
 
 		BlockedIDCount = 0;
 
 		// if we can see 'farArea', try again - the whole point is to go "around the bend", so to speak
-		if (IsAreaVisible( &eye, farArea ))
+		bool isVisible;
+		if (farAreaVisible && farIndex < (int)farAreaVisible->size())
+			isVisible = (*farAreaVisible)[ farIndex ];
+		else
+			isVisible = IsAreaVisible( &eye, farArea );
+
+		if (isVisible)
 			continue;
 	
 		// make first path to far away area
@@ -4935,6 +5170,108 @@ void CNavArea::ComputeApproachAreas( void )
 	}
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Run job(0) .. job(count-1), handing out the next index to whichever thread is free.
+ * Jobs trace through the engine, which makes no promise that tracing is safe off the main thread,
+ * so unless bot_nav_threads is set the jobs simply run in order on this thread.
+ */
+static void RunNavAnalysisJobs( int count, const std::function< void( int ) > &job )
+{
+	if (cv_bot_nav_threads.value == 0.0f)
+	{
+		for( int i=0; i<count; ++i )
+			job( i );
+
+		return;
+	}
+
+	int threadCount = std::thread::hardware_concurrency();
+	if (threadCount > count)
+		threadCount = count;
+	if (threadCount < 1)
+		threadCount = 1;
+
+	std::atomic<int> nextJob( 0 );
+	auto worker = [ & ]()
+	{
+		for( int i = nextJob++; i < count; i = nextJob++ )
+			job( i );
+	};
+
+	std::vector< std::thread > threads;
+	for( int t=1; t<threadCount; ++t )
+		threads.push_back( std::thread( worker ) );
+
+	// this thread works too
+	worker();
+
+	for( size_t t=0; t<threads.size(); ++t )
+		threads[t].join();
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Compute hiding spots, approach areas, spot encounters and sniper spots for every area.
+ * The tracing may be spread over all cores (see RunNavAnalysisJobs), while anything that allocates IDs,
+ * builds lists or pathfinds is done afterwards in TheNavAreaList order, so the result is the same as
+ * running each Compute...() over the list in turn and the saved .nav file doesn't change.
+ * This is meant for the CS bots' map learning, which is not part of this SDK, so nothing here calls it yet.
+ */
+void AnalyzeNavigationAreas( void )
+{
+	std::vector< CNavArea * > areas( TheNavAreaList.begin(), TheNavAreaList.end() );
+	int areaCount = areas.size();
+
+	// hiding spots - found in parallel, created in order so spot IDs match a serial run
+	struct FoundHidingSpots
+	{
+		Vector pos[ CNavArea::MAX_AREA_HIDING_SPOTS ];
+		unsigned char flags[ CNavArea::MAX_AREA_HIDING_SPOTS ];
+		int count;
+	};
+	std::vector< FoundHidingSpots > found( areaCount );
+
+	RunNavAnalysisJobs( areaCount, [ & ]( int i )
+	{
+		found[i].count = areas[i]->FindHidingSpots( found[i].pos, found[i].flags );
+	} );
+
+	for( int i=0; i<areaCount; ++i )
+		areas[i]->AddHidingSpots( found[i].pos, found[i].flags, found[i].count );
+
+	found.clear();
+
+	// approach areas - the pathfinding uses the areas' shared search state, so only the
+	// initial visibility checks are spread out
+	ApproachAreaAnalysisPrep();
+	{
+		std::vector< std::vector<bool> > visible( areaCount );
+
+		RunNavAnalysisJobs( areaCount, [ & ]( int i )
+		{
+			areas[i]->ComputeApproachVisibility( &visible[i] );
+		} );
+
+		for( int i=0; i<areaCount; ++i )
+			areas[i]->ComputeApproachAreas( &visible[i] );
+	}
+	CleanupApproachAreaAnalysisPrep();
+
+	// spot encounters and sniper spots only write to their own area and its spots
+	RunNavAnalysisJobs( areaCount, [ & ]( int i )
+	{
+		areas[i]->ComputeSpotEncounters();
+	} );
+
+	RunNavAnalysisJobs( areaCount, [ & ]( int i )
+	{
+		areas[i]->ComputeSniperSpots();
+	} );
+}
+
+
+#endif // MONSTER_NAV_MESH
 
 //--------------------------------------------------------------------------------------------------------------
 
@@ -4974,7 +5311,9 @@ void CNavAreaGrid::Reset( void )
 
 	m_areaCount = 0;
 
+#ifndef MONSTER_NAV_MESH
 	EditNavAreasReset(); // reset static vars
+#endif
 }
 
 /**
@@ -5135,11 +5474,8 @@ CNavArea *CNavAreaGrid::GetNearestNavArea( const Vector *pos, bool anyZ ) const
 	if (m_grid == NULL)
 		return NULL;
 
-	CNavArea *close = NULL;
-	float closeDistSq = 99999999.9f;
-
 	// quick check
-	close = GetNavArea( pos );
+	CNavArea *close = GetNavArea( pos );
 	if (close)
 		return close;
 
@@ -5152,36 +5488,87 @@ CNavArea *CNavAreaGrid::GetNearestNavArea( const Vector *pos, bool anyZ ) const
 
 	source.z += HalfHumanHeight;
 
-	/// @todo Step incrementally using grid for speed
+	// step outwards from the source cell a ring of cells at a time
+	int cx = WorldToGridX( source.x );
+	int cy = WorldToGridY( source.y );
+	int maxRing = max( max( cx, m_gridSizeX-1 - cx ), max( cy, m_gridSizeY-1 - cy ) );
 
-	// find closest nav area
-	for( NavAreaList::iterator iter = TheNavAreaList.begin(); iter != TheNavAreaList.end(); ++iter )
+	std::vector<NearAreaCandidate> candidates;
+	unsigned int tested = 0;
+
+	for( int ring = 0; ring <= maxRing; ++ring )
 	{
-		CNavArea *area = *iter;
+		int loX = cx - ring, hiX = cx + ring;
+		int loY = cy - ring, hiY = cy + ring;
+
+		for( int y = max( loY, 0 ); y <= min( hiY, m_gridSizeY-1 ); ++y )
+		{
+			for( int x = max( loX, 0 ); x <= min( hiX, m_gridSizeX-1 ); ++x )
+			{
+				// only the cells on the rim of this ring are new
+				if (y != loY && y != hiY && x != loX && x != hiX)
+					continue;
+
+				NavAreaList *list = &m_grid[ x + y*m_gridSizeX ];
+				for( NavAreaList::iterator iter = list->begin(); iter != list->end(); ++iter )
+				{
+					CNavArea *area = *iter;
+
+					// an area is in every cell it overlaps - only take it from its cell nearest the source
+					const Extent *extent = area->GetExtent();
+					int nearX = min( max( cx, WorldToGridX( extent->lo.x ) ), WorldToGridX( extent->hi.x ) );
+					int nearY = min( max( cy, WorldToGridY( extent->lo.y ) ), WorldToGridY( extent->hi.y ) );
+					if (nearX != x || nearY != y)
+						continue;
+
+					NearAreaCandidate candidate;
+					candidate.area = area;
+					area->GetClosestPointOnArea( &source, &candidate.pos );
+					candidate.distSq = (candidate.pos - source).LengthSquared();
+
+					candidates.push_back( candidate );
+				}
+			}
+		}
 
-		Vector areaPos;
-		area->GetClosestPointOnArea( &source, &areaPos );
+		// nothing beyond this ring can be closer than the edge of the rings searched so far.
+		// Edge cells also hold everything off the side of the grid, so those sides never bound.
+		float ringDist = 99999999.9f;
+		if (ring < maxRing)
+		{
+			if (loX > 0)
+				ringDist = min( ringDist, source.x - (m_minX + loX * m_cellSize) );
+			if (hiX < m_gridSizeX-1)
+				ringDist = min( ringDist, m_minX + (hiX+1) * m_cellSize - source.x );
+			if (loY > 0)
+				ringDist = min( ringDist, source.y - (m_minY + loY * m_cellSize) );
+			if (hiY < m_gridSizeY-1)
+				ringDist = min( ringDist, m_minY + (hiY+1) * m_cellSize - source.y );
+			ringDist = max( ringDist, 0.0f );
+		}
+		float ringDistSq = ringDist * ringDist;
 
-		float distSq = (areaPos - source).LengthSquared();
+		// candidates closer than any unsearched area are final - take the nearest one we can see
+		std::sort( candidates.begin() + tested, candidates.end() );
 
-		// keep the closest area
-		if (distSq < closeDistSq)
+		while( tested < candidates.size() && (ring == maxRing || candidates[ tested ].distSq < ringDistSq) )
 		{
+			const NearAreaCandidate *candidate = &candidates[ tested++ ];
+
 			// check LOS to area
 			if (!anyZ)
 			{
 				TraceResult result;
-				UTIL_TraceLine( source, areaPos + Vector( 0, 0, HalfHumanHeight ), ignore_monsters, ignore_glass, NULL, &result );
+				UTIL_TraceLine( source, candidate->pos + Vector( 0, 0, HalfHumanHeight ), ignore_monsters, ignore_glass, NULL, &result );
 				if (result.flFraction != 1.0f)
 					continue;
 			}
-					
-			closeDistSq = distSq;
-			close = area;
+
+			return candidate->area;
 		}
 	}
 
-	return close;
+	return NULL;
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -5202,6 +5589,49 @@ CNavArea *CNavAreaGrid::GetNavAreaByID( unsigned int id ) const
 	return NULL;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Append every other area whose 2D extent overlaps 'area' to the list.
+ * Overlapping areas always share a grid cell, so only those cells are searched.
+ */
+void CNavAreaGrid::AddOverlappingAreas( CNavArea *area, NavAreaList *list ) const
+{
+	if (m_grid == NULL)
+		return;
+
+	const Extent *extent = area->GetExtent();
+
+	int loX = WorldToGridX( extent->lo.x );
+	int loY = WorldToGridY( extent->lo.y );
+	int hiX = WorldToGridX( extent->hi.x );
+	int hiY = WorldToGridY( extent->hi.y );
+
+	// an area may be in several of the cells, so mark each one as it is checked
+	CNavArea::MakeNewMarker();
+	area->Mark();
+
+	for( int y = loY; y <= hiY; ++y )
+	{
+		for( int x = loX; x <= hiX; ++x )
+		{
+			NavAreaList *cell = &m_grid[ x + y*m_gridSizeX ];
+
+			for( NavAreaList::iterator iter = cell->begin(); iter != cell->end(); ++iter )
+			{
+				CNavArea *other = *iter;
+
+				if (other->IsMarked())
+					continue;
+
+				other->Mark();
+
+				if (area->IsOverlapping( other ))
+					list->push_back( other );
+			}
+		}
+	}
+}
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Return radio chatter place for given coordinate
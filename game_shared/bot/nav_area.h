@@ -6,10 +6,14 @@
 #define _NAV_AREA_H_
 
 #include <list>
+#include <vector>
 #include "nav.h"
 #include "steam_util.h"
 
 class CNavArea;
+struct NavFileWriter;
+struct NavFileView;
+struct NavFileHidingSpot;
 
 void DestroyHidingSpots( void );
 void StripNavigationAreas( void );
@@ -130,8 +134,8 @@ public:
 	void SetFlags( unsigned char flags )		{ m_flags |= flags; }		///< FOR INTERNAL USE ONLY
 	unsigned char GetFlags( void ) const		{ return m_flags; }
 
-	void Save( int fd, unsigned int version ) const;
-	void Load( SteamFile *file, unsigned int version );
+	void Load( SteamFile *file, unsigned int version );		///< load from a version 1-5 nav file
+	void Load( const NavFileHidingSpot *data );
 
 	const Vector *GetPosition( void ) const		{ return &m_pos; }	///< get the position of the hiding spot
 	unsigned int GetID( void ) const			{ return m_id; }
@@ -206,13 +210,15 @@ public:
 	void Disconnect( CNavArea *area );							///< disconnect this area from given area
 
 	void Save( FILE *fp ) const;
-	void Save( int fd, unsigned int version );
-	void Load( SteamFile *file, unsigned int version );
+	void Save( NavFileWriter *file ) const;
+	void Load( SteamFile *file, unsigned int version );		///< load from a version 1-5 nav file
 	NavErrorType PostLoad( void );
+	void Load( NavFileView *file, unsigned int index );		///< load from the flat layout of a version 6 nav file
+	NavErrorType PostLoad( const NavFileView *file, unsigned int index );
 
 	unsigned int GetID( void ) const						{ return m_id; }
 
-	void SetAttributes( unsigned char bits )		{ m_attributeFlags = bits; }
+	void SetAttributes( unsigned char bits )		{ m_attributeFlags = bits; ++m_meshVersion; }
 	unsigned char GetAttributes( void ) const		{ return m_attributeFlags; }
 
 	void SetPlace( Place place )			{ m_place = place; }	///< set place descriptor
@@ -254,6 +260,9 @@ public:
 	//- hiding spots ------------------------------------------------------------------------------------
 	const HidingSpotList *GetHidingSpotList( void ) const	{ return &m_hidingSpotList; }
 	void ComputeHidingSpots( void );							///< analyze local area neighborhood to find "hiding spots" in this area - for map learning
+	enum { MAX_AREA_HIDING_SPOTS = NUM_CORNERS };
+	int FindHidingSpots( Vector *pos, unsigned char *flags ) const;	///< find where ComputeHidingSpots would put spots, without creating them
+	void AddHidingSpots( const Vector *pos, const unsigned char *flags, int count );	///< create spots found by FindHidingSpots
 	void ComputeSniperSpots( void );							///< analyze local area neighborhood to find "sniper spots" in this area - for map learning
 
 	SpotEncounter *GetSpotEncounter( const CNavArea *from, const CNavArea *to );	///< given the areas we are moving between, return the spots we will encounter
@@ -280,19 +289,22 @@ public:
 	};
 	const ApproachInfo *GetApproachInfo( int i ) const	{ return &m_approach[i]; }
 	int GetApproachInfoCount( void ) const							{ return m_approachCount; }
-	void ComputeApproachAreas( void );							///< determine the set of "approach areas" - for map learning
+	void ComputeApproachAreas( const std::vector<bool> *farAreaVisible = NULL );	///< determine the set of "approach areas" - for map learning
+	bool GetApproachEye( Vector *eye ) const;					///< the point approach areas are judged from
+	void ComputeApproachVisibility( std::vector<bool> *farAreaVisible ) const;	///< which far areas ComputeApproachAreas can see directly
 
 	//- A* pathfinding algorithm ------------------------------------------------------------------------
+	static unsigned int GetMeshVersion( void )			{ return m_meshVersion; }	///< changes whenever an area is created, destroyed, reconnected or reshaped, so saved paths can tell they are stale
 	static void MakeNewMarker( void )					{ ++m_masterMarker; if (m_masterMarker == 0) m_masterMarker = 1; }
 	void Mark( void )													{ m_marker = m_masterMarker; }
-	BOOL IsMarked( void ) const								{ return (m_marker == m_masterMarker) ? true : false; }
+	bool IsMarked( void ) const								{ return (m_marker == m_masterMarker) ? true : false; }
 	
 	void SetParent( CNavArea *parent, NavTraverseType how = NUM_TRAVERSE_TYPES )	{ m_parent = parent; m_parentHow = how; }
 	CNavArea *GetParent( void ) const						{ return m_parent; }
 	NavTraverseType GetParentHow( void ) const	{ return m_parentHow; }
 
 	bool IsOpen( void ) const;								///< true if on "open list"
-	void AddToOpenList( void );								///< add to open list in decreasing value order
+	void AddToOpenList( void );								///< add to open list, which pops in increasing value order
 	void UpdateOnOpenList( void );							///< a smaller value has been found, update this area on the open list
 	void RemoveFromOpenList( void );
 	static bool IsOpenListEmpty( void );
@@ -339,6 +351,7 @@ private:
 	static bool m_isReset;									///< if true, don't bother cleaning up in destructor since everything is going away
 
 	static unsigned int m_nextID;							///< used to allocate unique IDs
+	static unsigned int m_meshVersion;						///< see GetMeshVersion()
 	unsigned int m_id;										///< unique area ID
 	Extent m_extent;										///< extents of area in world coords (NOTE: lo.z is not necessarily the minimum Z, but corresponds to Z at point (lo.x, lo.y), etc
 	Vector m_center;										///< centroid of area
@@ -382,10 +395,17 @@ private:
 	float m_totalCost;										///< the distance so far plus an estimate of the distance left
 	float m_costSoFar;										///< distance travelled so far
 
-	static CNavArea *m_openList;
-	CNavArea *m_nextOpen, *m_prevOpen;						///< only valid if m_openMarker == m_masterMarker
+	static std::vector<CNavArea *> m_openHeap;				///< binary heap, cheapest area at the front
+	static unsigned int m_openSequence;
+	int m_openIndex;										///< position in m_openHeap, only valid if m_openMarker == m_masterMarker
+	unsigned int m_openOrder;								///< when this area was last queued, to break cost ties first come first served
+	float m_openCost;										///< total cost when this area was last queued
 	unsigned int m_openMarker;								///< if this equals the current marker value, we are on the open list
 
+	bool IsOpenBefore( const CNavArea *other ) const;		///< true if this area pops off the open list before "other"
+	static void SiftOpenUp( int index );
+	static void SiftOpenDown( int index );
+
 	//- connections to adjacent areas -------------------------------------------------------------------
 	NavConnectList m_connect[ NUM_DIRECTIONS ];				///< a list of adjacent areas for each direction
 	NavLadderList m_ladder[ NUM_LADDER_DIRECTIONS ];		///< list of ladders leading up and down from this area
@@ -401,6 +421,8 @@ private:
 
 	std::list<CNavArea *> m_overlapList;					///< list of areas that overlap this area
 
+	void FinishLoad( void );								///< compute the data that isn't stored, once connections are resolved
+
 	void OnDestroyNotify( CNavArea *dead );					///< invoked when given area is going away
 
 	CNavArea *m_prevHash, *m_nextHash;						///< for hash table in CNavAreaGrid
@@ -439,14 +461,14 @@ inline bool CNavArea::IsOpen( void ) const
 
 inline bool CNavArea::IsOpenListEmpty( void )
 {
-	return (m_openList) ? false : true;
+	return m_openHeap.empty();
 }
 
 inline CNavArea *CNavArea::PopOpenList( void )
 {
-	if (m_openList)
+	if (!m_openHeap.empty())
 	{
-		CNavArea *area = m_openList;
+		CNavArea *area = m_openHeap.front();
 	
 		// disconnect from list
 		area->RemoveFromOpenList();
@@ -496,6 +518,7 @@ public:
 
 	CNavArea *GetNavArea( const Vector *pos, float beneathLimt = 120.0f ) const;	///< given a position, return the nav area that IsOverlapping and is *immediately* beneath it
 	CNavArea *GetNavAreaByID( unsigned int id ) const;
+	void AddOverlappingAreas( CNavArea *area, NavAreaList *list ) const;	///< append every other area whose 2D extent overlaps 'area'
 	CNavArea *GetNearestNavArea( const Vector *pos, bool anyZ = false ) const;
 
 	Place GetPlace( const Vector *pos ) const;				///< return radio chatter place for given coordinate
@@ -517,6 +540,15 @@ private:
 	}
 
 
+	struct NearAreaCandidate								///< an area GetNearestNavArea has found but not yet checked LOS to
+	{
+		CNavArea *area;
+		Vector pos;											///< closest point on the area
+		float distSq;
+
+		bool operator<( const NearAreaCandidate &other ) const	{ return distSq < other.distSq; }
+	};
+
 	inline int WorldToGridX( float wx ) const
 	{ 
 		int x = (wx - m_minX) / m_cellSize;
@@ -554,10 +586,13 @@ extern void SanityCheckNavigationMap( const char *mapName );	///< Performs a lig
 extern void ApproachAreaAnalysisPrep( void );
 extern void CleanupApproachAreaAnalysisPrep( void );
 
+extern void AnalyzeNavigationAreas( void );					///< run every map learning pass over all areas, spreading the tracing over all cores if bot_nav_threads is set
+
 extern void BuildLadders( void );
 
 extern bool TestArea( CNavNode *node, int width, int height );
 extern int BuildArea( CNavNode *node, int width, int height );
+extern bool CoverNodesWithAreas( int uncoveredNodes );		///< greedily cover the uncovered nodes with the largest areas TestArea() accepts
 
 extern bool GetGroundHeight( const Vector *pos, float *height, Vector *normal = NULL );
 extern bool GetSimpleGroundHeight( const Vector *pos, float *height, Vector *normal = NULL );
@@ -31,9 +31,11 @@
 
 #include "bot_util.h"
 
+#ifndef MONSTER_NAV_MESH
 /// @todo Abstract these out of here (TheBotPhrases)
 #include "cs_bot.h"
 #include "cs_bot_manager.h"
+#endif
 
 #include "nav.h"
 #include "nav_node.h"
@@ -118,24 +120,48 @@ public:
 		return m_directory[ i ];
 	}
 
-	/// store the directory
-	void Save( int fd )
+	/// return the number of places in the directory
+	unsigned int GetCount( void ) const
 	{
-		// store number of entries in directory
-		EntryType count = m_directory.size();
-		_write( fd, &count, sizeof(EntryType) );
+		return m_directory.size();
+	}
 
-		// store entries		
+#ifndef MONSTER_NAV_MESH
+	/// store the directory as a block of NUL terminated names, padded to a multiple of 4 bytes
+	void Save( std::vector<char> *names )
+	{
 		std::vector<Place>::iterator it;
 		for( it = m_directory.begin(); it != m_directory.end(); ++it )
 		{
 			const char *placeName = TheBotPhrases->IDToName( *it );
+			names->insert( names->end(), placeName, placeName + strlen(placeName) + 1 );
+		}
+
+		while( names->size() % 4 )
+			names->push_back( '\0' );
+	}
+#endif
+
+	/// load the directory from a block of 'count' NUL terminated names
+	bool Load( const char *names, unsigned int size, unsigned int count )
+	{
+		m_directory.reserve( count );
 
-			// store string length followed by string itself
-			unsigned short len = strlen(placeName)+1;
-			_write( fd, &len, sizeof(unsigned short) );
-			_write( fd, placeName, len );
+		const char *end = names + size;
+		for( unsigned int i=0; i<count; ++i )
+		{
+			const char *placeName = names;
+			while( names < end && *names )
+				++names;
+
+			if (names == end)
+				return false;
+
+			AddPlace( PlaceNameToID( placeName ) );
+			++names;
 		}
+
+		return true;
 	}
 
 	/// load the directory
@@ -155,17 +181,253 @@ public:
 			file->Read( &len, sizeof(unsigned short) );
 			file->Read( placeName, len );
 
-			AddPlace( TheBotPhrases->NameToID( placeName ) );
+			AddPlace( PlaceNameToID( placeName ) );
 		}
 	}
 
 private:
 	std::vector<Place> m_directory;
+
+	Place PlaceNameToID( const char *placeName ) const
+	{
+#ifdef MONSTER_NAV_MESH
+		// without the bot phrases there are no place IDs, so number the places in the order they're read
+		return m_directory.size() + 1;
+#else
+		return TheBotPhrases->NameToID( placeName );
+#endif
+	}
 };
 
 static PlaceDirectory placeDirectory;
 
 
+//
+// Version 6 nav files keep everything in flat arrays of fixed size records, so they
+// can be used straight from the loaded file, and refer to areas and hiding spots by their
+// position in those arrays rather than by ID.  After the magic number, version and bsp size
+// that every version starts with come a NavFileHeader, the place name block, and then the
+// arrays in the order of the header.  A reference is the index of the record plus one,
+// with NAV_FILE_NONE meaning none.  Everything is 4 byte aligned and stored little-endian.
+//
+// Versions 1-5 stored each area as a variable length run of fields and can still be loaded.
+// Saving always writes version 6, which is how old files are converted.
+//
+#define NAV_FILE_NONE 0
+
+struct NavFileHeader
+{
+	unsigned int placeCount;						///< number of names in the place name block
+	unsigned int placeNameSize;						///< size of the place name block
+	unsigned int areaCount;
+	unsigned int connectCount;
+	unsigned int hidingSpotCount;
+	unsigned int approachCount;
+	unsigned int encounterCount;
+	unsigned int encounterSpotCount;
+};
+
+struct NavFileArea
+{
+	unsigned int id;
+	Extent extent;
+	float neZ, swZ;									///< heights of the implicit corners
+	unsigned int firstConnect;						///< connections in the order NORTH, EAST, SOUTH, WEST
+	unsigned short connectCount[ NUM_DIRECTIONS ];
+	unsigned int firstHidingSpot;
+	unsigned int firstApproach;
+	unsigned int firstEncounter;
+	unsigned int encounterCount;
+	unsigned short hidingSpotCount;
+	PlaceDirectory::EntryType place;
+	unsigned char attributeFlags;
+	unsigned char approachCount;
+	unsigned char pad[2];
+};
+
+struct NavFileHidingSpot
+{
+	unsigned int id;
+	Vector pos;
+	unsigned char flags;
+	unsigned char pad[3];
+};
+
+struct NavFileApproach
+{
+	unsigned int here;								///< area references
+	unsigned int prev;
+	unsigned int next;
+	unsigned char prevToHereHow;
+	unsigned char hereToNextHow;
+	unsigned char pad[2];
+};
+
+struct NavFileEncounter
+{
+	unsigned int from;								///< area references
+	unsigned int to;
+	unsigned int firstSpot;
+	unsigned short spotCount;
+	unsigned char fromDir;
+	unsigned char toDir;
+};
+
+struct NavFileEncounterSpot
+{
+	unsigned int spot;								///< hiding spot reference
+	float t;										///< parametric distance along the encounter path
+};
+
+/**
+ * The arrays of a version 6 nav file as they are being built for saving
+ */
+struct NavFileWriter
+{
+	std::vector< unsigned int > areaRef;			///< reference to each area, by ID
+	std::vector< unsigned int > hidingSpotRef;		///< reference to each hiding spot, by ID
+
+	std::vector< NavFileArea > area;
+	std::vector< unsigned int > connect;
+	std::vector< NavFileHidingSpot > hidingSpot;
+	std::vector< NavFileApproach > approach;
+	std::vector< NavFileEncounter > encounter;
+	std::vector< NavFileEncounterSpot > encounterSpot;
+
+	unsigned int AreaRef( const CNavArea *a ) const
+	{
+		return (a && a->GetID() < areaRef.size()) ? areaRef[ a->GetID() ] : NAV_FILE_NONE;
+	}
+
+	unsigned int HidingSpotRef( const HidingSpot *spot ) const
+	{
+		return (spot && spot->GetID() < hidingSpotRef.size()) ? hidingSpotRef[ spot->GetID() ] : NAV_FILE_NONE;
+	}
+};
+
+/**
+ * The arrays of a loaded version 6 nav file, and what their records have become
+ */
+struct NavFileView
+{
+	NavFileHeader header;
+	const NavFileArea *area;
+	const unsigned int *connect;
+	const NavFileHidingSpot *hidingSpot;
+	const NavFileApproach *approach;
+	const NavFileEncounter *encounter;
+	const NavFileEncounterSpot *encounterSpot;
+
+	std::vector< CNavArea * > loadedArea;
+	std::vector< HidingSpot * > loadedHidingSpot;
+
+	/// return the referenced area, setting 'error' if the reference is bad
+	CNavArea *GetArea( unsigned int ref, bool *error ) const
+	{
+		if (ref == NAV_FILE_NONE)
+			return NULL;
+
+		if (ref > loadedArea.size())
+		{
+			*error = true;
+			return NULL;
+		}
+
+		return loadedArea[ ref-1 ];
+	}
+
+	/// return the referenced hiding spot, setting 'error' if the reference is bad
+	HidingSpot *GetHidingSpot( unsigned int ref, bool *error ) const
+	{
+		if (ref == NAV_FILE_NONE)
+			return NULL;
+
+		if (ref > loadedHidingSpot.size())
+		{
+			*error = true;
+			return NULL;
+		}
+
+		return loadedHidingSpot[ ref-1 ];
+	}
+};
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return where an array of 'count' records of 'size' bytes is in the file, or NULL if it doesn't fit
+ */
+static const void *ReadNavFileArray( SteamFile *file, unsigned int count, unsigned int size )
+{
+	if (count > 0x7fffffff / size)
+		return NULL;
+
+	return file->ReadInPlace( count * size );
+}
+
+/**
+ * Return true if the records [first, first+count) are within an array of 'total' records
+ */
+inline bool IsNavFileRange( unsigned int first, unsigned int count, unsigned int total )
+{
+	return (first <= total && count <= total - first) ? true : false;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Point 'view' at the header and arrays of a version 6 nav file, and load its place directory.
+ * Returns false if the file is truncated or a record refers outside of its array.
+ */
+static bool ReadNavFileView( SteamFile *file, NavFileView *view )
+{
+	if (!file->Read( &view->header, sizeof(NavFileHeader) ))
+		return false;
+
+	const NavFileHeader *header = &view->header;
+
+	const char *placeNames = (const char *)ReadNavFileArray( file, header->placeNameSize, sizeof(char) );
+	if (placeNames == NULL || !placeDirectory.Load( placeNames, header->placeNameSize, header->placeCount ))
+		return false;
+
+	view->area = (const NavFileArea *)ReadNavFileArray( file, header->areaCount, sizeof(NavFileArea) );
+	view->connect = (const unsigned int *)ReadNavFileArray( file, header->connectCount, sizeof(unsigned int) );
+	view->hidingSpot = (const NavFileHidingSpot *)ReadNavFileArray( file, header->hidingSpotCount, sizeof(NavFileHidingSpot) );
+	view->approach = (const NavFileApproach *)ReadNavFileArray( file, header->approachCount, sizeof(NavFileApproach) );
+	view->encounter = (const NavFileEncounter *)ReadNavFileArray( file, header->encounterCount, sizeof(NavFileEncounter) );
+	view->encounterSpot = (const NavFileEncounterSpot *)ReadNavFileArray( file, header->encounterSpotCount, sizeof(NavFileEncounterSpot) );
+
+	if (!view->area || !view->connect || !view->hidingSpot || !view->approach || !view->encounter || !view->encounterSpot)
+		return false;
+
+	for( unsigned int i=0; i<header->areaCount; ++i )
+	{
+		const NavFileArea *area = &view->area[i];
+
+		unsigned int connectCount = 0;
+		for( int d=0; d<NUM_DIRECTIONS; ++d )
+			connectCount += area->connectCount[d];
+
+		if (!IsNavFileRange( area->firstConnect, connectCount, header->connectCount ) ||
+			!IsNavFileRange( area->firstHidingSpot, area->hidingSpotCount, header->hidingSpotCount ) ||
+			!IsNavFileRange( area->firstApproach, area->approachCount, header->approachCount ) ||
+			!IsNavFileRange( area->firstEncounter, area->encounterCount, header->encounterCount ))
+			return false;
+	}
+
+	for( unsigned int e=0; e<header->encounterCount; ++e )
+	{
+		const NavFileEncounter *encounter = &view->encounter[e];
+
+		if (!IsNavFileRange( encounter->firstSpot, encounter->spotCount, header->encounterSpotCount ))
+			return false;
+	}
+
+	view->loadedArea.resize( header->areaCount );
+	view->loadedHidingSpot.resize( header->hidingSpotCount );
+
+	return true;
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Replace extension with "bsp"
@@ -187,6 +449,7 @@ char *GetBspFilename( const char *navFilename )
 	return bspFilename;
 }
 
+#ifndef MONSTER_NAV_MESH	// the HL game dll only reads nav files
 //--------------------------------------------------------------------------------------------------------------
 void CNavArea::Save( FILE *fp ) const
 {
@@ -207,171 +470,116 @@ void CNavArea::Save( FILE *fp ) const
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Save a navigation area to the opened binary stream
+ * Append this area's records to the arrays of a version 6 nav file.
+ * The writer must already know the reference of every area and hiding spot.
  */
-void CNavArea::Save( int fd, unsigned int version )
+void CNavArea::Save( NavFileWriter *file ) const
 {
-	// save ID
-	_write( fd, &m_id, sizeof(unsigned int) );
-
-	// save attribute flags
-	_write( fd, &m_attributeFlags, sizeof(unsigned char) );
-
-	// save extent of area
-	_write( fd, &m_extent, 6*sizeof(float) );
+	NavFileArea data;
+	memset( &data, 0, sizeof(data) );
 
-	// save heights of implicit corners
-	_write( fd, &m_neZ, sizeof(float) );
-	_write( fd, &m_swZ, sizeof(float) );
+	data.id = m_id;
+	data.attributeFlags = m_attributeFlags;
+	data.extent = m_extent;
+	data.neZ = m_neZ;
+	data.swZ = m_swZ;
 
 	// save connections to adjacent areas
 	// in the enum order NORTH, EAST, SOUTH, WEST
+	data.firstConnect = file->connect.size();
 	for( int d=0; d<NUM_DIRECTIONS; d++ )
 	{
-		// save number of connections for this direction
-		unsigned int count = m_connect[d].size();
-		_write( fd, &count, sizeof(unsigned int) );
+		data.connectCount[d] = m_connect[d].size();
 
 		NavConnectList::const_iterator iter;
 		for( iter = m_connect[d].begin(); iter != m_connect[d].end(); ++iter )
-		{
-			NavConnect connect = *iter;
-			_write( fd, &connect.area->m_id, sizeof(unsigned int) );
-		}
+			file->connect.push_back( file->AreaRef( iter->area ) );
 	}
 
 	//
 	// Store hiding spots for this area
 	//
-	unsigned char count;
-	if (m_hidingSpotList.size() > 255)
-	{
-		count = 255;
-		CONSOLE_ECHO( "Warning: NavArea #%d: Truncated hiding spot list to 255\n", m_id );
-	}
-	else
-	{
-		count = m_hidingSpotList.size();
-	}
-	_write( fd, &count, sizeof(unsigned char) );
+	data.firstHidingSpot = file->hidingSpot.size();
+	data.hidingSpotCount = m_hidingSpotList.size();
 
-	// store HidingSpot objects
-	unsigned int saveCount = 0;
-	for( HidingSpotList::iterator iter = m_hidingSpotList.begin(); iter != m_hidingSpotList.end(); ++iter )
+	for( HidingSpotList::const_iterator iter = m_hidingSpotList.begin(); iter != m_hidingSpotList.end(); ++iter )
 	{
-		HidingSpot *spot = *iter;
-		
-		spot->Save( fd, version );
+		const HidingSpot *spot = *iter;
+
+		NavFileHidingSpot spotData;
+		memset( &spotData, 0, sizeof(spotData) );
+
+		spotData.id = spot->GetID();
+		spotData.pos = *spot->GetPosition();
+		spotData.flags = spot->GetFlags();
 
-		// overflow check
-		if (++saveCount == count)
-			break;
+		file->hidingSpot.push_back( spotData );
 	}
 
 	//
 	// Save the approach areas for this area
 	//
-
-	// save number of approach areas
-	_write( fd, &m_approachCount, sizeof(unsigned char) );
+	data.firstApproach = file->approach.size();
+	data.approachCount = m_approachCount;
 	if (cv_bot_debug.value > 0.0f)
 		CONSOLE_ECHO( "  m_approachCount = %d\n", m_approachCount );
 
-	// save approach area info
-	unsigned char type;
-	unsigned int zero = 0;
 	for( int a=0; a<m_approachCount; ++a )
 	{
-		if (m_approach[a].here.area)
-			_write( fd, &m_approach[a].here.area->m_id, sizeof(unsigned int) );
-		else
-			_write( fd, &zero, sizeof(unsigned int) );
+		NavFileApproach approach;
+		memset( &approach, 0, sizeof(approach) );
 
-		if (m_approach[a].prev.area)
-			_write( fd, &m_approach[a].prev.area->m_id, sizeof(unsigned int) );
-		else
-			_write( fd, &zero, sizeof(unsigned int) );
-		type = (unsigned char)m_approach[a].prevToHereHow;
-		_write( fd, &type, sizeof(unsigned char) );
+		approach.here = file->AreaRef( m_approach[a].here.area );
+		approach.prev = file->AreaRef( m_approach[a].prev.area );
+		approach.next = file->AreaRef( m_approach[a].next.area );
+		approach.prevToHereHow = (unsigned char)m_approach[a].prevToHereHow;
+		approach.hereToNextHow = (unsigned char)m_approach[a].hereToNextHow;
 
-		if (m_approach[a].next.area)
-			_write( fd, &m_approach[a].next.area->m_id, sizeof(unsigned int) );
-		else
-			_write( fd, &zero, sizeof(unsigned int) );
-		type = (unsigned char)m_approach[a].hereToNextHow;
-		_write( fd, &type, sizeof(unsigned char) );
+		file->approach.push_back( approach );
 	}
 
 	//
 	// Save encounter spots for this area
 	//
+	data.firstEncounter = file->encounter.size();
+	data.encounterCount = m_spotEncounterList.size();
+	if (cv_bot_debug.value > 0.0f)
+		CONSOLE_ECHO( "  m_spotEncounterList.size() = %d\n", data.encounterCount );
+
+	for( SpotEncounterList::const_iterator iter = m_spotEncounterList.begin(); iter != m_spotEncounterList.end(); ++iter )
 	{
-		// save number of encounter paths for this area
-		unsigned int count = m_spotEncounterList.size();
-		_write( fd, &count, sizeof(unsigned int) );
+		const SpotEncounter *e = &(*iter);
 
-		if (cv_bot_debug.value > 0.0f)
-			CONSOLE_ECHO( "  m_spotEncounterList.size() = %d\n", count );
+		NavFileEncounter encounter;
+		encounter.from = file->AreaRef( e->from.area );
+		encounter.to = file->AreaRef( e->to.area );
+		encounter.fromDir = (unsigned char)e->fromDir;
+		encounter.toDir = (unsigned char)e->toDir;
+		encounter.firstSpot = file->encounterSpot.size();
+		encounter.spotCount = e->spotList.size();
 
-		SpotEncounter *e;
-		for( SpotEncounterList::iterator iter = m_spotEncounterList.begin(); iter != m_spotEncounterList.end(); ++iter )
+		for( SpotOrderList::const_iterator oiter = e->spotList.begin(); oiter != e->spotList.end(); ++oiter )
 		{
-			e = &(*iter);
-
-			if (e->from.area)
-				_write( fd, &e->from.area->m_id, sizeof(unsigned int) );
-			else
-				_write( fd, &zero, sizeof(unsigned int) );
+			NavFileEncounterSpot order;
 
-			unsigned char dir = e->fromDir;
-			_write( fd, &dir, sizeof(unsigned char) );
+			// order->spot may be NULL if we've loaded a nav mesh that has been edited but not re-analyzed
+			order.spot = file->HidingSpotRef( oiter->spot );
+			order.t = oiter->t;
 
-			if (e->to.area)
-				_write( fd, &e->to.area->m_id, sizeof(unsigned int) );
-			else
-				_write( fd, &zero, sizeof(unsigned int) );
-
-			dir = e->toDir;
-			_write( fd, &dir, sizeof(unsigned char) );
-
-			// write list of spots along this path
-			unsigned char spotCount;
-			if (e->spotList.size() > 255)
-			{
-				spotCount = 255;
-				CONSOLE_ECHO( "Warning: NavArea #%d: Truncated encounter spot list to 255\n", m_id );
-			}
-			else
-			{
-				spotCount = e->spotList.size();
-			}
-			_write( fd, &spotCount, sizeof(unsigned char) );
-		
-			saveCount = 0;
-			for( SpotOrderList::iterator oiter = e->spotList.begin(); oiter != e->spotList.end(); ++oiter )
-			{
-				SpotOrder *order = &(*oiter);
-
-				// order->spot may be NULL if we've loaded a nav mesh that has been edited but not re-analyzed
-				unsigned int id = (order->spot) ? order->spot->GetID() : 0;
-				_write( fd, &id, sizeof(unsigned int) );
-
-				unsigned char t = 255 * order->t;
-				_write( fd, &t, sizeof(unsigned char) );
-
-				// overflow check
-				if (++saveCount == spotCount)
-					break;
-			}
+			file->encounterSpot.push_back( order );
 		}
+
+		file->encounter.push_back( encounter );
 	}
 
 	// store place dictionary entry
-	PlaceDirectory::EntryType entry = placeDirectory.GetEntry( GetPlace() );
-	_write( fd, &entry, sizeof(entry) );
+	data.place = placeDirectory.GetEntry( GetPlace() );
 
+	file->area.push_back( data );
 }
 
+#endif // MONSTER_NAV_MESH
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Load a navigation area from the file
@@ -554,6 +762,174 @@ void CNavArea::Load( SteamFile *file, unsigned int version )
 	SetPlace( placeDirectory.EntryToPlace( entry ) );
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load a hiding spot from its version 6 nav file record
+ */
+void HidingSpot::Load( const NavFileHidingSpot *data )
+{
+	m_id = data->id;
+	m_pos = data->pos;
+	m_flags = data->flags;
+
+	// update next ID to avoid ID collisions by later spots
+	if (m_id >= m_nextID)
+		m_nextID = m_id+1;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load the area at 'index' in a version 6 nav file.
+ * References to other areas are resolved by PostLoad(), once every area exists.
+ */
+void CNavArea::Load( NavFileView *file, unsigned int index )
+{
+	const NavFileArea *data = &file->area[ index ];
+
+	m_id = data->id;
+
+	// update nextID to avoid collisions
+	if (m_id >= m_nextID)
+		m_nextID = m_id+1;
+
+	m_attributeFlags = data->attributeFlags;
+	m_extent = data->extent;
+
+	m_center.x = (m_extent.lo.x + m_extent.hi.x)/2.0f;
+	m_center.y = (m_extent.lo.y + m_extent.hi.y)/2.0f;
+	m_center.z = (m_extent.lo.z + m_extent.hi.z)/2.0f;
+
+	m_neZ = data->neZ;
+	m_swZ = data->swZ;
+
+	// create the hiding spots, remembering them so encounter spots can refer to them
+	for( unsigned int h=0; h<data->hidingSpotCount; ++h )
+	{
+		HidingSpot *spot = new HidingSpot;
+
+		spot->Load( &file->hidingSpot[ data->firstHidingSpot + h ] );
+
+		m_hidingSpotList.push_back( spot );
+		file->loadedHidingSpot[ data->firstHidingSpot + h ] = spot;
+	}
+
+	// too many approach areas is caught by PostLoad()
+	m_approachCount = (data->approachCount < MAX_APPROACH_AREAS) ? data->approachCount : MAX_APPROACH_AREAS;
+
+	// convert entry to actual Place
+	SetPlace( placeDirectory.EntryToPlace( data->place ) );
+
+	file->loadedArea[ index ] = this;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Resolve the references of the area at 'index' in a version 6 nav file.
+ * References are positions in the file's arrays, so no searching is needed.
+ */
+NavErrorType CNavArea::PostLoad( const NavFileView *file, unsigned int index )
+{
+	const NavFileArea *data = &file->area[ index ];
+	bool corrupt = false;
+
+	// connect areas together
+	const unsigned int *connectRef = &file->connect[ data->firstConnect ];
+	for( int d=0; d<NUM_DIRECTIONS; d++ )
+	{
+		for( unsigned int i=0; i<data->connectCount[d]; ++i )
+		{
+			NavConnect connect;
+			connect.area = file->GetArea( *connectRef++, &corrupt );
+
+			if (connect.area)
+				m_connect[d].push_back( connect );
+			else
+				corrupt = true;
+		}
+	}
+
+	// resolve approach areas
+	if (m_approachCount != data->approachCount)
+		corrupt = true;
+
+	for( int a=0; a<m_approachCount; ++a )
+	{
+		const NavFileApproach *approach = &file->approach[ data->firstApproach + a ];
+
+		m_approach[a].here.area = file->GetArea( approach->here, &corrupt );
+		m_approach[a].prev.area = file->GetArea( approach->prev, &corrupt );
+		m_approach[a].next.area = file->GetArea( approach->next, &corrupt );
+		m_approach[a].prevToHereHow = (NavTraverseType)approach->prevToHereHow;
+		m_approach[a].hereToNextHow = (NavTraverseType)approach->hereToNextHow;
+	}
+
+	// resolve spot encounters
+	for( unsigned int e=0; e<data->encounterCount; ++e )
+	{
+		const NavFileEncounter *encounterData = &file->encounter[ data->firstEncounter + e ];
+
+		SpotEncounter encounter;
+
+		encounter.from.area = file->GetArea( encounterData->from, &corrupt );
+		encounter.fromDir = static_cast<NavDirType>( encounterData->fromDir );
+		encounter.to.area = file->GetArea( encounterData->to, &corrupt );
+		encounter.toDir = static_cast<NavDirType>( encounterData->toDir );
+
+		if (encounter.from.area == NULL || encounter.to.area == NULL)
+			corrupt = true;
+
+		for( unsigned int s=0; s<encounterData->spotCount; ++s )
+		{
+			const NavFileEncounterSpot *orderData = &file->encounterSpot[ encounterData->firstSpot + s ];
+
+			SpotOrder order;
+			order.spot = file->GetHidingSpot( orderData->spot, &corrupt );
+			order.t = orderData->t;
+
+			encounter.spotList.push_back( order );
+		}
+
+		m_spotEncounterList.push_back( encounter );
+	}
+
+	FinishLoad();
+
+	if (corrupt)
+	{
+		CONSOLE_ECHO( "ERROR: Corrupt navigation data in Navigation Area #%d.\n", m_id );
+		return NAV_CORRUPT_DATA;
+	}
+
+	return NAV_OK;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Compute the encounter paths and the overlap list, which are not stored in the nav file
+ */
+void CNavArea::FinishLoad( void )
+{
+	for( SpotEncounterList::iterator iter = m_spotEncounterList.begin(); iter != m_spotEncounterList.end(); ++iter )
+	{
+		SpotEncounter *e = &(*iter);
+
+		if (e->from.area && e->to.area)
+		{
+			// compute path
+			float halfWidth;
+			ComputePortal( e->to.area, e->toDir, &e->path.to, &halfWidth );
+			ComputePortal( e->from.area, e->fromDir, &e->path.from, &halfWidth );
+
+			const float eyeHeight = HalfHumanHeight;
+			e->path.from.z = e->from.area->GetZ( &e->path.from ) + eyeHeight;
+			e->path.to.z = e->to.area->GetZ( &e->path.to ) + eyeHeight;
+		}
+	}
+
+	// build overlap list
+	TheNavAreaGrid.AddOverlappingAreas( this, &m_overlapList );
+}
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Convert loaded IDs to pointers
@@ -626,18 +1002,6 @@ NavErrorType CNavArea::PostLoad( void )
 			error = NAV_CORRUPT_DATA;
 		}
 
-		if (e->from.area && e->to.area)
-		{
-			// compute path
-			float halfWidth;
-			ComputePortal( e->to.area, e->toDir, &e->path.to, &halfWidth );
-			ComputePortal( e->from.area, e->fromDir, &e->path.from, &halfWidth );
-
-			const float eyeHeight = HalfHumanHeight;
-			e->path.from.z = e->from.area->GetZ( &e->path.from ) + eyeHeight;
-			e->path.to.z = e->to.area->GetZ( &e->path.to ) + eyeHeight;
-		}
-
 		// resolve HidingSpot IDs
 		for( SpotOrderList::iterator oiter = e->spotList.begin(); oiter != e->spotList.end(); ++oiter )
 		{
@@ -652,18 +1016,7 @@ NavErrorType CNavArea::PostLoad( void )
 		}
 	}
 
-	// build overlap list
-	/// @todo Optimize this
-	for( NavAreaList::iterator oiter = TheNavAreaList.begin(); oiter != TheNavAreaList.end(); ++oiter )
-	{
-		CNavArea *area = *oiter;
-
-		if (area == this)
-			continue;
-
-		if (IsOverlapping( area ))
-			m_overlapList.push_back( area );
-	}
+	FinishLoad();
 
 	return error;
 }
@@ -696,6 +1049,7 @@ inline void COM_FixSlashes( char *pname )
 #endif
 }
 
+#ifndef MONSTER_NAV_MESH	// the HL game dll only reads nav files, and has no place names for legacy location files
 /**
  * Store AI navigation data to a file
  */
@@ -730,7 +1084,8 @@ bool SaveNavigationMap( const char *filename )
 	// 4 = Includes size of source bsp file to verify nav data correlation
 	// ---- Beta Release at V4 -----
 	// 5 = Added Place info
-	unsigned int version = 5;
+	// 6 = Flat arrays of fixed size records that refer to each other by index
+	unsigned int version = NAV_VERSION;
 	_write( fd, &version, sizeof(unsigned int) );
 
 
@@ -764,25 +1119,77 @@ bool SaveNavigationMap( const char *filename )
 		}
 	}
 
-	placeDirectory.Save( fd );
+	std::vector<char> placeNames;
+	placeDirectory.Save( &placeNames );
 
 
 	//
-	// Store navigation areas
+	// Number the areas and hiding spots in the order they will be stored
 	//
+	NavFileWriter file;
+
+	unsigned int areaCount = 0;
+	unsigned int hidingSpotCount = 0;
+	for( it = TheNavAreaList.begin(); it != TheNavAreaList.end(); ++it )
+	{
+		CNavArea *area = *it;
+
+		if (area->GetID() >= file.areaRef.size())
+			file.areaRef.resize( area->GetID()+1, NAV_FILE_NONE );
 
-	// store number of areas
-	unsigned int count = TheNavAreaList.size();
-	_write( fd, &count, sizeof(unsigned int) );
+		file.areaRef[ area->GetID() ] = ++areaCount;
+
+		for( HidingSpotList::iterator hiter = area->m_hidingSpotList.begin(); hiter != area->m_hidingSpotList.end(); ++hiter )
+		{
+			HidingSpot *spot = *hiter;
+
+			if (spot->GetID() >= file.hidingSpotRef.size())
+				file.hidingSpotRef.resize( spot->GetID()+1, NAV_FILE_NONE );
+
+			file.hidingSpotRef[ spot->GetID() ] = ++hidingSpotCount;
+		}
+	}
+
+	//
+	// Store navigation areas
+	//
+	file.area.reserve( areaCount );
+	file.hidingSpot.reserve( hidingSpotCount );
 
-	// store each area
 	for( it = TheNavAreaList.begin(); it != TheNavAreaList.end(); ++it )
 	{
 		CNavArea *area = *it;
 
-		area->Save( fd, version );
+		area->Save( &file );
 	}
 
+	NavFileHeader header;
+	header.placeCount = placeDirectory.GetCount();
+	header.placeNameSize = placeNames.size();
+	header.areaCount = file.area.size();
+	header.connectCount = file.connect.size();
+	header.hidingSpotCount = file.hidingSpot.size();
+	header.approachCount = file.approach.size();
+	header.encounterCount = file.encounter.size();
+	header.encounterSpotCount = file.encounterSpot.size();
+
+	_write( fd, &header, sizeof(NavFileHeader) );
+
+	if (!placeNames.empty())
+		_write( fd, &placeNames[0], placeNames.size() );
+	if (!file.area.empty())
+		_write( fd, &file.area[0], file.area.size() * sizeof(NavFileArea) );
+	if (!file.connect.empty())
+		_write( fd, &file.connect[0], file.connect.size() * sizeof(unsigned int) );
+	if (!file.hidingSpot.empty())
+		_write( fd, &file.hidingSpot[0], file.hidingSpot.size() * sizeof(NavFileHidingSpot) );
+	if (!file.approach.empty())
+		_write( fd, &file.approach[0], file.approach.size() * sizeof(NavFileApproach) );
+	if (!file.encounter.empty())
+		_write( fd, &file.encounter[0], file.encounter.size() * sizeof(NavFileEncounter) );
+	if (!file.encounterSpot.empty())
+		_write( fd, &file.encounterSpot[0], file.encounterSpot.size() * sizeof(NavFileEncounterSpot) );
+
 	_close( fd );
 
 
@@ -868,6 +1275,7 @@ void LoadLocationFile( const char *filename )
 	}
 }
 
+#endif // MONSTER_NAV_MESH
 
 //--------------------------------------------------------------------------------------------------------------
 /**
@@ -909,7 +1317,7 @@ void SanityCheckNavigationMap( const char *mapName )
 	// read file version number
 	unsigned int version;
 	result = navFile.Read( &version, sizeof(unsigned int) );
-	if (!result || version > 5)
+	if (!result || version > NAV_VERSION)
 	{
 		CONSOLE_ECHO( "ERROR: Unknown version in navigation file %s.\n", navFilename );
 		return;
@@ -980,7 +1388,7 @@ NavErrorType LoadNavigationMap( void )
 	// read file version number
 	unsigned int version;
 	result = navFile.Read( &version, sizeof(unsigned int) );
-	if (!result || version > 5)
+	if (!result || version > NAV_VERSION)
 	{
 		CONSOLE_ECHO( "ERROR: Unknown navigation file version.\n" );
 		return NAV_BAD_FILE_VERSION;
@@ -1003,22 +1411,39 @@ NavErrorType LoadNavigationMap( void )
 		{
 			// this nav file is out of date for this bsp file
 			char *msg = "*** WARNING ***\nThe AI navigation data is from a different version of this map.\nThe CPU players will likely not perform well.\n";
+#ifndef MONSTER_NAV_MESH
 			HintMessageToAllPlayers( msg );
+#endif
 			CONSOLE_ECHO( "\n-----------------\n" );
 			CONSOLE_ECHO( msg );
 			CONSOLE_ECHO( "-----------------\n\n" );
 		}
 	}
 
-	// load Place directory
-	if (version >= 5)
+	// load Place directory, and find the arrays of a version 6 file
+	NavFileView view;
+	unsigned int count;
+
+	if (version >= 6)
 	{
-		placeDirectory.Load( &navFile );
+		if (!ReadNavFileView( &navFile, &view ))
+		{
+			CONSOLE_ECHO( "ERROR: Corrupt navigation file '%s'.\n", filename );
+			return NAV_CORRUPT_DATA;
+		}
+
+		count = view.header.areaCount;
 	}
+	else
+	{
+		if (version >= 5)
+		{
+			placeDirectory.Load( &navFile );
+		}
 
-	// get number of areas
-	unsigned int count;
-	result = navFile.Read( &count, sizeof(unsigned int) );
+		// get number of areas
+		result = navFile.Read( &count, sizeof(unsigned int) );
+	}
 
 	Extent extent;
 	extent.lo.x = 9999999999.9f;
@@ -1030,7 +1455,12 @@ NavErrorType LoadNavigationMap( void )
 	for( unsigned int i=0; i<count; ++i )
 	{
 		CNavArea *area = new CNavArea;
-		area->Load( &navFile, version );
+
+		if (version >= 6)
+			area->Load( &view, i );
+		else
+			area->Load( &navFile, version );
+
 		TheNavAreaList.push_back( area );
 
 		const Extent *areaExtent = area->GetExtent();
@@ -1059,12 +1489,18 @@ NavErrorType LoadNavigationMap( void )
 
 
 	// allow areas to connect to each other, etc
-	for( iter = TheNavAreaList.begin(); iter != TheNavAreaList.end(); ++iter )
+	unsigned int index = 0;
+	for( iter = TheNavAreaList.begin(); iter != TheNavAreaList.end(); ++iter, ++index )
 	{
 		CNavArea *area = *iter;
-		area->PostLoad();
+
+		if (version >= 6)
+			area->PostLoad( &view, index );
+		else
+			area->PostLoad();
 	}
 
+#ifndef MONSTER_NAV_MESH	// monsters don't use places, and can't climb ladders
 	// load legacy location file (Places)
 	if (version < 5)
 	{
@@ -1075,6 +1511,7 @@ NavErrorType LoadNavigationMap( void )
 	// Set up all the ladders
 	//
 	BuildLadders();
+#endif
 
 	return NAV_OK;
 }
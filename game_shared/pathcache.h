@@ -0,0 +1,247 @@
+//========= Copyright © 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Remembers recent paths so identical route requests don't search again
+//
+// $NoKeywords: $
+//=============================================================================
+
+#pragma once
+
+#include <assert.h>
+#include <string.h>
+
+
+// CPathCache keeps the last NUM_ENTRIES paths found between pairs of regions
+// (nodes, nav areas), keyed on the start and goal regions and the hull and
+// capabilities they were searched for.  A failed search is remembered as a
+// path of no steps.  The least recently used path is dropped when the cache
+// is full, and every path is dropped when the graph they were found in
+// changes version.
+template<class T, int NUM_ENTRIES, int MAX_STEPS>
+class CPathCache
+{
+public:
+				CPathCache();
+
+	// Copies the cached path into pPath and returns its length, or returns -1
+	// if the route isn't cached.
+	int			Lookup(int iStart, int iGoal, int iHull, int iCaps, unsigned int version, T *pPath);
+
+	// Paths longer than MAX_STEPS aren't kept.
+	void		Store(int iStart, int iGoal, int iHull, int iCaps, unsigned int version, const T *pPath, int cSteps);
+
+	void		Clear();
+
+	int			GetLookups() const		{ return m_cLookups; }
+	int			GetHits() const			{ return m_cHits; }
+	int			GetEvictions() const	{ return m_cEvictions; }
+	int			GetInvalidations() const	{ return m_cInvalidations; }
+	float		GetHitRate() const		{ return m_cLookups ? (float)m_cHits / m_cLookups : 0.0f; }
+	void		ResetStats();
+
+private:
+
+	struct entry_t
+	{
+		int		iStart, iGoal, iHull, iCaps;
+		int		cSteps;
+		int		iPrev, iNext;	// least recently used list, most recent first
+		int		iHashNext;
+		T		path[MAX_STEPS];
+	};
+
+	int			Find(int iStart, int iGoal, int iHull, int iCaps, int **ppLink);
+	void		Validate(unsigned int version);
+	void		Unlink(int i);
+	void		LinkFirst(int i);
+
+	static int	Bucket(int iStart, int iGoal, int iHull, int iCaps)
+	{
+		unsigned int h = (unsigned int)iStart * 73856093u ^ (unsigned int)iGoal * 19349663u ^ (unsigned int)iHull * 83492791u ^ (unsigned int)iCaps;
+		return (int)(h & (NUM_ENTRIES - 1));
+	}
+
+	entry_t		m_Entries[NUM_ENTRIES];
+	int			m_Buckets[NUM_ENTRIES];
+	int			m_cUsed;
+	int			m_iFirst, m_iLast;
+	unsigned int	m_Version;
+
+	int			m_cLookups, m_cHits, m_cEvictions, m_cInvalidations;
+};
+
+
+// ------------------------------------------------------------------------ //
+// CPathCache inlines.
+// ------------------------------------------------------------------------ //
+
+template<class T, int NUM_ENTRIES, int MAX_STEPS>
+inline CPathCache<T, NUM_ENTRIES, MAX_STEPS>::CPathCache()
+{
+	static_assert((NUM_ENTRIES & (NUM_ENTRIES - 1)) == 0, "CPathCache size must be a power of two");
+
+	m_Version = 0;
+	Clear();
+	ResetStats();
+}
+
+template<class T, int NUM_ENTRIES, int MAX_STEPS>
+inline void CPathCache<T, NUM_ENTRIES, MAX_STEPS>::Clear()
+{
+	for (int i = 0; i < NUM_ENTRIES; i++)
+		m_Buckets[i] = -1;
+
+	m_cUsed = 0;
+	m_iFirst = m_iLast = -1;
+}
+
+template<class T, int NUM_ENTRIES, int MAX_STEPS>
+inline void CPathCache<T, NUM_ENTRIES, MAX_STEPS>::ResetStats()
+{
+	m_cLookups = m_cHits = m_cEvictions = m_cInvalidations = 0;
+}
+
+template<class T, int NUM_ENTRIES, int MAX_STEPS>
+inline void CPathCache<T, NUM_ENTRIES, MAX_STEPS>::Validate(unsigned int version)
+{
+	if (version == m_Version)
+		return;
+
+	if (m_cUsed)
+		m_cInvalidations++;
+
+	Clear();
+	m_Version = version;
+}
+
+template<class T, int NUM_ENTRIES, int MAX_STEPS>
+inline int CPathCache<T, NUM_ENTRIES, MAX_STEPS>::Find(int iStart, int iGoal, int iHull, int iCaps, int **ppLink)
+{
+	int *pLink = &m_Buckets[Bucket(iStart, iGoal, iHull, iCaps)];
+
+	while (*pLink != -1)
+	{
+		entry_t *e = &m_Entries[*pLink];
+		if (e->iStart == iStart && e->iGoal == iGoal && e->iHull == iHull && e->iCaps == iCaps)
+			break;
+		pLink = &e->iHashNext;
+	}
+
+	if (ppLink)
+		*ppLink = pLink;
+
+	return *pLink;
+}
+
+template<class T, int NUM_ENTRIES, int MAX_STEPS>
+inline void CPathCache<T, NUM_ENTRIES, MAX_STEPS>::Unlink(int i)
+{
+	entry_t *e = &m_Entries[i];
+
+	if (e->iPrev != -1)
+		m_Entries[e->iPrev].iNext = e->iNext;
+	else
+		m_iFirst = e->iNext;
+
+	if (e->iNext != -1)
+		m_Entries[e->iNext].iPrev = e->iPrev;
+	else
+		m_iLast = e->iPrev;
+}
+
+template<class T, int NUM_ENTRIES, int MAX_STEPS>
+inline void CPathCache<T, NUM_ENTRIES, MAX_STEPS>::LinkFirst(int i)
+{
+	entry_t *e = &m_Entries[i];
+
+	e->iPrev = -1;
+	e->iNext = m_iFirst;
+
+	if (m_iFirst != -1)
+		m_Entries[m_iFirst].iPrev = i;
+	else
+		m_iLast = i;
+
+	m_iFirst = i;
+}
+
+template<class T, int NUM_ENTRIES, int MAX_STEPS>
+inline int CPathCache<T, NUM_ENTRIES, MAX_STEPS>::Lookup(int iStart, int iGoal, int iHull, int iCaps, unsigned int version, T *pPath)
+{
+	Validate(version);
+	m_cLookups++;
+
+	int i = Find(iStart, iGoal, iHull, iCaps, NULL);
+	if (i == -1)
+		return -1;
+
+	m_cHits++;
+
+	if (i != m_iFirst)
+	{
+		Unlink(i);
+		LinkFirst(i);
+	}
+
+	entry_t *e = &m_Entries[i];
+	for (int s = 0; s < e->cSteps; s++)
+		pPath[s] = e->path[s];
+
+	return e->cSteps;
+}
+
+template<class T, int NUM_ENTRIES, int MAX_STEPS>
+inline void CPathCache<T, NUM_ENTRIES, MAX_STEPS>::Store(int iStart, int iGoal, int iHull, int iCaps, unsigned int version, const T *pPath, int cSteps)
+{
+	if (cSteps < 0 || cSteps > MAX_STEPS)
+		return;
+
+	Validate(version);
+
+	int *pLink;
+	int i = Find(iStart, iGoal, iHull, iCaps, &pLink);
+
+	if (i != -1)
+	{
+		Unlink(i);
+	}
+	else
+	{
+		if (m_cUsed < NUM_ENTRIES)
+		{
+			i = m_cUsed++;
+		}
+		else
+		{
+			// reuse the least recently used entry
+			i = m_iLast;
+			entry_t *old = &m_Entries[i];
+
+			int *pOldLink;
+			Find(old->iStart, old->iGoal, old->iHull, old->iCaps, &pOldLink);
+			assert(*pOldLink == i);
+			*pOldLink = old->iHashNext;
+
+			Unlink(i);
+			m_cEvictions++;
+
+			// the new entry's bucket may have been the one just shortened
+			Find(iStart, iGoal, iHull, iCaps, &pLink);
+		}
+
+		entry_t *e = &m_Entries[i];
+		e->iStart = iStart;
+		e->iGoal = iGoal;
+		e->iHull = iHull;
+		e->iCaps = iCaps;
+		e->iHashNext = -1;
+		*pLink = i;
+	}
+
+	entry_t *e = &m_Entries[i];
+	for (int s = 0; s < cSteps; s++)
+		e->path[s] = pPath[s];
+	e->cSteps = cSteps;
+
+	LinkFirst(i);
+}
@@ -17,6 +17,7 @@ public:
 
 	bool IsValid( void ) const				{ return (m_fileData) ? true : false; }	///< returns true if this file object is attached to a file
 	bool Read( void *data, int length );		///< read 'length' bytes from the file
+	const void *ReadInPlace( int length );		///< skip 'length' bytes, returning where they are in memory, or NULL
 
 private:
 	byte *m_fileData;												///< the file read into memory
@@ -44,15 +45,26 @@ inline bool SteamFile::Read( void *data, int length )
 	if (length > m_bytesLeft || m_cursor == NULL || m_bytesLeft <= 0)
 		return false;
 
-	byte *readCursor = static_cast<byte *>( data );
-
-	for( int i=0; i<length; ++i )
-	{
-		*readCursor++ = *m_cursor++;
-		--m_bytesLeft;
-	}
+	memcpy( data, m_cursor, length );
+	m_cursor += length;
+	m_bytesLeft -= length;
 
 	return true;
 }
 
+/**
+ * The data stays valid for as long as this file object exists
+ */
+inline const void *SteamFile::ReadInPlace( int length )
+{
+	if (length < 0 || length > m_bytesLeft || m_cursor == NULL)
+		return NULL;
+
+	const void *data = m_cursor;
+	m_cursor += length;
+	m_bytesLeft -= length;
+
+	return data;
+}
+
 #endif // _STEAM_UTIL_H_
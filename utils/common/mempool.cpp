@@ -0,0 +1,369 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+#include <atomic>
+#include <mutex>
+
+#include "cmdlib.h"
+#include "mempool.h"
+
+/*
+===================================================================
+
+SIZE CLASS POOLS
+
+Every block carries a small header with its size class, so PoolFree
+doesn't need to know how big the block was.  Blocks too big for the
+largest class come straight from malloc.
+
+The free lists and the current chunk are per thread.  When a worker
+thread exits, its free lists and the unused end of its chunk go back
+to a shared pool, which threads draw from before carving a new chunk.
+Tools that run many threaded passes without ever calling PoolFreeAll,
+like qrad through polylib, would otherwise grow with every pass.
+===================================================================
+*/
+
+#define POOL_GRANULARITY 64
+#define POOL_MAX_BLOCK 4096
+#define NUM_POOL_CLASSES (POOL_MAX_BLOCK / POOL_GRANULARITY)
+#define POOL_CHUNK_SIZE (1024 * 1024)
+#define POOL_SHARED_BATCH 64 // blocks taken from the shared pool at a time
+
+#define POOL_OVERSIZE 0
+
+typedef struct
+{
+	int sizeclass; // POOL_OVERSIZE for blocks from malloc
+	int pad;	   // keeps the block 8 byte aligned for doubles
+} poolheader_t;
+
+typedef struct poolfree_s
+{
+	struct poolfree_s* next;
+} poolfree_t;
+
+typedef struct poolchunk_s
+{
+	struct poolchunk_s* next;
+	double align;
+} poolchunk_t;
+
+typedef struct poolspan_s
+{
+	struct poolspan_s* next;
+	byte* end;
+} poolspan_t;
+
+typedef struct
+{
+	int generation; // lists are stale once PoolFreeAll has run
+	byte* cur;
+	byte* end;
+	poolfree_t* freeblocks[NUM_POOL_CLASSES + 1];
+} poolthread_t;
+
+static void PoolReleaseThread(poolthread_t* pt);
+
+// hands the thread's blocks back to the shared pool when it exits
+struct poolthreadowner_t
+{
+	poolthread_t pt;
+	~poolthreadowner_t() { PoolReleaseThread(&pt); }
+};
+
+static thread_local poolthreadowner_t poolthread;
+
+static std::mutex poolmutex; // guards everything below
+static poolchunk_t* poolchunks;
+static poolfree_t* poolshared[NUM_POOL_CLASSES + 1]; // blocks from exited threads
+static poolspan_t* poolspans;						 // unused chunk ends from exited threads
+static std::atomic<bool> poolhaveshared;			 // any poolshared list is non empty
+static std::atomic<int> poolgeneration;
+
+// statistics since the last PoolFreeAll
+static int c_poolchunks, c_peakpoolchunks;
+static std::atomic<int> c_poolallocs;
+static std::atomic<int> c_poolreused;
+static std::atomic<int> c_pooloversize;
+static std::atomic<int> c_activepoolblocks, c_peakpoolblocks;
+
+/*
+==============
+PoolThread
+==============
+*/
+static poolthread_t* PoolThread(void)
+{
+	poolthread_t* pt = &poolthread.pt;
+	int generation = poolgeneration;
+
+	if (pt->generation != generation)
+	{
+		memset(pt, 0, sizeof(*pt));
+		pt->generation = generation;
+	}
+
+	return pt;
+}
+
+/*
+==============
+PoolReleaseThread
+
+Called as a thread exits.  A thread that never touched the pools,
+or whose lists went stale in a PoolFreeAll, has nothing to give.
+==============
+*/
+static void PoolReleaseThread(poolthread_t* pt)
+{
+	poolfree_t* fb;
+	poolspan_t* span;
+	int i;
+
+	if (pt->generation != poolgeneration)
+		return;
+
+	poolmutex.lock();
+	for (i = 1; i <= NUM_POOL_CLASSES; i++)
+	{
+		while ((fb = pt->freeblocks[i]) != NULL)
+		{
+			pt->freeblocks[i] = fb->next;
+			fb->next = poolshared[i];
+			poolshared[i] = fb;
+			poolhaveshared = true;
+		}
+	}
+
+	if (pt->end - pt->cur >= POOL_GRANULARITY)
+	{
+		span = reinterpret_cast<poolspan_t*>(pt->cur);
+		span->end = pt->end;
+		span->next = poolspans;
+		poolspans = span;
+	}
+	poolmutex.unlock();
+
+	pt->cur = pt->end = NULL;
+}
+
+/*
+==============
+PoolTakeShared
+
+Moves a batch of the shared free blocks of a size class to the
+calling thread, so the other threads get some too.  Returns false
+if there were none.
+==============
+*/
+static bool PoolTakeShared(poolthread_t* pt, int sizeclass)
+{
+	poolfree_t* last;
+	int i;
+
+	if (!poolhaveshared)
+		return false;
+
+	poolmutex.lock();
+	pt->freeblocks[sizeclass] = last = poolshared[sizeclass];
+	if (last)
+	{
+		for (i = 1; i < POOL_SHARED_BATCH && last->next; i++)
+			last = last->next;
+		poolshared[sizeclass] = last->next;
+		last->next = NULL;
+	}
+
+	for (i = 1; i <= NUM_POOL_CLASSES; i++)
+	{
+		if (poolshared[i])
+			break;
+	}
+	if (i > NUM_POOL_CLASSES)
+		poolhaveshared = false;
+	poolmutex.unlock();
+
+	return pt->freeblocks[sizeclass] != NULL;
+}
+
+/*
+==============
+NewPoolChunk
+
+Carries on with the unused end of an exited thread's chunk
+before allocating a new one
+==============
+*/
+static void NewPoolChunk(poolthread_t* pt)
+{
+	poolchunk_t* chunk;
+	poolspan_t* span;
+
+	poolmutex.lock();
+	span = poolspans;
+	if (span)
+		poolspans = span->next;
+	poolmutex.unlock();
+
+	if (span)
+	{
+		pt->cur = reinterpret_cast<byte*>(span);
+		pt->end = span->end;
+		return;
+	}
+
+	chunk = reinterpret_cast<poolchunk_t*>(malloc(POOL_CHUNK_SIZE));
+	if (!chunk)
+		Error("PoolAlloc: out of memory");
+
+	poolmutex.lock();
+	chunk->next = poolchunks;
+	poolchunks = chunk;
+	c_poolchunks++;
+	if (c_poolchunks > c_peakpoolchunks)
+		c_peakpoolchunks = c_poolchunks;
+	poolmutex.unlock();
+
+	pt->cur = reinterpret_cast<byte*>(chunk + 1);
+	pt->end = reinterpret_cast<byte*>(chunk) + POOL_CHUNK_SIZE;
+}
+
+/*
+==============
+PoolAlloc
+
+The block is not cleared
+==============
+*/
+void* PoolAlloc(int size)
+{
+	poolthread_t* pt;
+	poolheader_t* h;
+	int sizeclass, blocksize, active, peak;
+
+	c_poolallocs++;
+	active = ++c_activepoolblocks;
+	peak = c_peakpoolblocks;
+	while (active > peak && !c_peakpoolblocks.compare_exchange_weak(peak, active))
+		;
+
+	blocksize = size + sizeof(poolheader_t);
+	if (blocksize > POOL_MAX_BLOCK)
+	{
+		c_pooloversize++;
+		h = reinterpret_cast<poolheader_t*>(malloc(blocksize));
+		if (!h)
+			Error("PoolAlloc: out of memory");
+		h->sizeclass = POOL_OVERSIZE;
+		return h + 1;
+	}
+
+	sizeclass = (blocksize + POOL_GRANULARITY - 1) / POOL_GRANULARITY;
+	pt = PoolThread();
+
+	if (pt->freeblocks[sizeclass] || PoolTakeShared(pt, sizeclass))
+	{
+		c_poolreused++;
+		h = reinterpret_cast<poolheader_t*>(pt->freeblocks[sizeclass]);
+		pt->freeblocks[sizeclass] = pt->freeblocks[sizeclass]->next;
+	}
+	else
+	{
+		blocksize = sizeclass * POOL_GRANULARITY;
+		while (pt->end - pt->cur < blocksize)
+			NewPoolChunk(pt);
+		h = reinterpret_cast<poolheader_t*>(pt->cur);
+		pt->cur += blocksize;
+	}
+
+	h->sizeclass = sizeclass;
+	return h + 1;
+}
+
+/*
+==============
+PoolFree
+==============
+*/
+void PoolFree(void* p)
+{
+	poolthread_t* pt;
+	poolheader_t* h;
+	poolfree_t* fb;
+	int sizeclass;
+
+	if (!p)
+		return;
+
+	c_activepoolblocks--;
+
+	h = reinterpret_cast<poolheader_t*>(p) - 1;
+	sizeclass = h->sizeclass;
+	if (sizeclass == POOL_OVERSIZE)
+	{
+		free(h);
+		return;
+	}
+	if (sizeclass < 1 || sizeclass > NUM_POOL_CLASSES)
+		Error("PoolFree: bad block");
+
+	pt = PoolThread();
+	fb = reinterpret_cast<poolfree_t*>(h);
+	fb->next = pt->freeblocks[sizeclass];
+	pt->freeblocks[sizeclass] = fb;
+}
+
+/*
+==============
+PoolFreeAll
+==============
+*/
+void PoolFreeAll(void)
+{
+	poolchunk_t *chunk, *next;
+
+	poolmutex.lock();
+	for (chunk = poolchunks; chunk; chunk = next)
+	{
+		next = chunk->next;
+		free(chunk);
+	}
+	poolchunks = NULL;
+	memset(poolshared, 0, sizeof(poolshared));
+	poolspans = NULL;
+	poolhaveshared = false;
+	c_poolchunks = c_peakpoolchunks = 0;
+	poolmutex.unlock();
+
+	c_poolallocs = 0;
+	c_poolreused = 0;
+	c_pooloversize = 0;
+	c_activepoolblocks = c_peakpoolblocks = 0;
+
+	poolgeneration++;
+}
+
+/*
+==============
+PoolPrintStats
+==============
+*/
+void PoolPrintStats(const char* phase)
+{
+	int allocs = c_poolallocs;
+
+	printf("%s pools:\n", phase);
+	printf("%8i block allocations\n", allocs);
+	printf("%8i from free lists (%.1f%%)\n", c_poolreused.load(), allocs ? 100.0 * c_poolreused / allocs : 0.0);
+	printf("%8i oversized\n", c_pooloversize.load());
+	printf("%8i peak live blocks\n", c_peakpoolblocks.load());
+	printf("%8.1f MB peak in %i chunks\n", c_peakpoolchunks * (POOL_CHUNK_SIZE / (1024.0 * 1024.0)), c_peakpoolchunks);
+}
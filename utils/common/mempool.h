@@ -0,0 +1,29 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+// mempool.h -- size class pools for the small, short lived blocks
+// (windings, faces, portals, nodes) the compile tools churn through
+
+#ifndef __MEMPOOL__
+#define __MEMPOOL__
+
+// blocks are carved from large chunks by the thread that asks for them,
+// so allocation never takes a lock.  A freed block goes on the free list
+// of the thread that frees it.
+void* PoolAlloc(int size);
+void PoolFree(void* p);
+
+// releases every chunk at once at the end of a phase.  Nothing allocated
+// from the pools may be used afterwards, and no other thread may be running.
+void PoolFreeAll(void);
+
+void PoolPrintStats(const char* phase);
+
+#endif // __MEMPOOL__
@@ -0,0 +1,47 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+// polyfile.h -- the face stream qcsg hands to qbsp, one file per hull
+
+#ifndef __POLYFILE__
+#define __POLYFILE__
+
+//
+// A binary .p0 - .p3 file is a polyfileheader_t followed by the faces of
+// every model in order.  Each face is a polyfileface_t followed by
+// numpoints * 3 doubles, and each model is terminated by a polyfileface_t
+// with a planenum of -1.  Values are stored little-endian, exactly as qcsg
+// computed them.
+//
+// qcsg -textpolys writes the old text format instead, which has no header;
+// qbsp tells the two apart by the ident.
+//
+#define POLYFILE_IDENT (('F' << 24) + ('P' << 16) + ('S' << 8) + 'Q') // little-endian "QSPF"
+#define POLYFILE_VERSION 1
+
+#define POLYFILE_ENDMODEL -1
+
+typedef struct
+{
+	int ident;
+	int version;
+	int hull;
+	int reserved;
+} polyfileheader_t;
+
+typedef struct
+{
+	int planenum; // POLYFILE_ENDMODEL terminates a model
+	int texinfo;
+	int contents;
+	int numpoints;
+} polyfileface_t;
+
+#endif // __POLYFILE__
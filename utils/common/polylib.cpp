@@ -12,6 +12,7 @@
 #include "cmdlib.h"
 #include "mathlib.h"
 #include "polylib.h"
+#include "mempool.h"
 
 int c_active_windings;
 int c_peak_windings;
@@ -46,7 +47,7 @@ winding_t* AllocWinding(int points)
 	s = sizeof(vec_t) * 3 * points + sizeof(int);
 	s += sizeof(vec_t) - sizeof(w->numpoints); // padding
 
-	w = reinterpret_cast<winding_t*>(malloc(s));
+	w = reinterpret_cast<winding_t*>(PoolAlloc(s));
 	memset(w, 0, s);
 
 	return w;
@@ -55,7 +56,7 @@ winding_t* AllocWinding(int points)
 void FreeWinding(winding_t* w)
 {
 	c_active_windings--;
-	free(w);
+	PoolFree(w);
 }
 
 /*
@@ -255,7 +256,7 @@ winding_t* CopyWinding(winding_t* w)
 	winding_t* c;
 
 	size = (int)((winding_t*)0)->p[w->numpoints];
-	c = reinterpret_cast<winding_t*>(malloc(size));
+	c = AllocWinding(w->numpoints);
 	memcpy(c, w, size);
 	return c;
 }
@@ -0,0 +1,970 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+// deltaprof.cpp -- replays a sv_deltarecord recording through the
+// entity encoders described by delta.lst and reports where the bits go
+
+#include <ctype.h>
+#include <vector>
+
+#include "cmdlib.h"
+#include "deltarec.h"
+
+// delta.lst field types, as the engine numbers them
+#define DT_BYTE (1 << 0)
+#define DT_SHORT (1 << 1)
+#define DT_FLOAT (1 << 2)
+#define DT_INTEGER (1 << 3)
+#define DT_ANGLE (1 << 4)
+#define DT_TIMEWINDOW_8 (1 << 5)
+#define DT_TIMEWINDOW_BIG (1 << 6)
+#define DT_STRING (1 << 7)
+#define DT_SIGNED (1 << 31)
+
+// from entity_state.h, const.h and customentity.h; the game headers
+// don't mix with the tools' vec3_t
+#define ENTITY_BEAM (1 << 1)
+#define MOVETYPE_FOLLOW 12
+#define BEAM_POINTS 0
+#define BEAM_ENTPOINT 1
+#define BEAM_ENTS 2
+
+// what the engine adds around the deltas, in bits.  The entity number
+// encoding varies with the gap to the previous entity.
+#define PACKET_OVERHEAD_BITS (8 + 16 + 8 + 16)
+#define ENTITY_REMOVE_BITS 1
+#define ENTITY_NEXT_BITS 1
+#define ENTITY_SHORTJUMP_BITS (1 + 1 + 6)
+#define ENTITY_LONGJUMP_BITS (1 + 1 + 11)
+#define ENTITY_CUSTOM_BITS 1
+#define FIELDMASK_COUNT_BITS 3
+
+#define MAX_DELTA_FIELDS 56 // the mask is at most 7 bytes
+
+typedef enum
+{
+	DELTA_ENTITY = 0,
+	DELTA_PLAYER,
+	DELTA_CUSTOM,
+	NUM_DELTAS
+} deltatype_t;
+
+static const char* deltanames[NUM_DELTAS] = {"entity_state_t", "entity_state_player_t", "custom_entity_state_t"};
+
+typedef struct
+{
+	char name[DELTAREC_MAX_NAME];
+	int type;
+	int bits;
+	int offset; // into a recorded state
+	int size;
+
+	int sends;
+	double totalbits;
+} deltafield_t;
+
+typedef struct
+{
+	std::vector<deltafield_t> fields;
+	int origin[3], angles[3], skin, sequence, animtime; // fields the encoders touch, -1 if absent
+
+	int sends;
+	double totalbits;
+} deltadesc_t;
+
+typedef struct
+{
+	char name[DELTAREC_MAX_NAME];
+	int updates;
+	double totalbits;
+} classstats_t;
+
+typedef struct
+{
+	std::vector<byte> states; // the state each entity was last sent to this client with
+	std::vector<bool> sent;
+	std::vector<short> lastpacket;
+} deltaclient_t;
+
+static deltadesc_t deltas[NUM_DELTAS];
+
+static deltarecheader_t recheader;
+static deltarecfield_t* recfields;
+
+// offsets of the recorded fields the encoders look at
+static int ofs_number, ofs_entitytype, ofs_movetype, ofs_aiment, ofs_impacttime, ofs_starttime, ofs_rendermode, ofs_animtime;
+
+static std::vector<byte> curstates; // the latest recorded state of every entity
+static std::vector<int> curclass;
+static std::vector<byte> baselines;
+static std::vector<classstats_t> classes;
+static std::vector<deltaclient_t> clients;
+
+static int numframes, numpackets, numremoves;
+static double framebits, peakframebits, totalframebits;
+static double peakpacketbits, totalpacketbits, headerbits;
+static float frametime, peakframetime;
+
+/*
+==============
+FindRecordedField
+==============
+*/
+static deltarecfield_t* FindRecordedField(const char* name)
+{
+	int i;
+
+	for (i = 0; i < recheader.numfields; i++)
+	{
+		if (!Q_strcasecmp(recfields[i].name, name))
+			return &recfields[i];
+	}
+
+	return NULL;
+}
+
+/*
+==============
+RecordedOffset
+==============
+*/
+static int RecordedOffset(const char* name)
+{
+	deltarecfield_t* rf;
+
+	rf = FindRecordedField(name);
+	if (!rf)
+		Error("recording has no %s field", name);
+
+	return rf->offset;
+}
+
+/*
+==============
+FindDeltaField
+==============
+*/
+static int FindDeltaField(deltadesc_t* d, const char* name)
+{
+	int i;
+
+	for (i = 0; i < (int)d->fields.size(); i++)
+	{
+		if (!Q_strcasecmp(d->fields[i].name, name))
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+==============
+ParseFieldType
+==============
+*/
+static int ParseFieldType(const char* name)
+{
+	static const struct
+	{
+		const char* name;
+		int type;
+	} types[] =
+		{
+			{"DT_BYTE", DT_BYTE},
+			{"DT_SHORT", DT_SHORT},
+			{"DT_FLOAT", DT_FLOAT},
+			{"DT_INTEGER", DT_INTEGER},
+			{"DT_ANGLE", DT_ANGLE},
+			{"DT_TIMEWINDOW_8", DT_TIMEWINDOW_8},
+			{"DT_TIMEWINDOW_BIG", DT_TIMEWINDOW_BIG},
+			{"DT_STRING", DT_STRING},
+			{"DT_SIGNED", DT_SIGNED},
+		};
+	int i;
+
+	for (i = 0; i < (int)(sizeof(types) / sizeof(types[0])); i++)
+	{
+		if (!strcmp(types[i].name, name))
+			return types[i].type;
+	}
+
+	Error("delta.lst: unknown type %s", name);
+}
+
+/*
+==============
+ParseFieldTypes
+
+A word may hold several of the or'd flags, "DT_SIGNED|DT_FLOAT"
+==============
+*/
+static int ParseFieldTypes(char* token)
+{
+	char* name;
+	int type;
+
+	type = 0;
+	for (name = strtok(token, "|"); name; name = strtok(NULL, "|"))
+		type |= ParseFieldType(name);
+
+	return type;
+}
+
+/*
+==============
+ParseDeltaDesc
+
+Reads the fields of one structure up to its closing brace
+==============
+*/
+static char* ParseDeltaDesc(char* data, deltadesc_t* d)
+{
+	deltafield_t f;
+	deltarecfield_t* rf;
+	bool post;
+
+	d->fields.clear();
+
+	while (1)
+	{
+		data = COM_Parse(data);
+		if (!data)
+			Error("delta.lst: unexpected end of file");
+		if (!strcmp(com_token, "}"))
+			break;
+
+		post = !strcmp(com_token, "DEFINE_DELTA_POST");
+		if (!post && strcmp(com_token, "DEFINE_DELTA"))
+			Error("delta.lst: expected DEFINE_DELTA, found %s", com_token);
+
+		data = COM_Parse(data);
+		if (strcmp(com_token, "("))
+			Error("delta.lst: expected (");
+
+		memset(&f, 0, sizeof(f));
+
+		data = COM_Parse(data);
+		strncpy(f.name, com_token, sizeof(f.name) - 1);
+
+		// flags run up to the bit count
+		while (1)
+		{
+			data = COM_Parse(data);
+			if (!data)
+				Error("delta.lst: unexpected end of file");
+			if (isdigit(com_token[0]))
+				break;
+			f.type |= ParseFieldTypes(com_token);
+		}
+		f.bits = atoi(com_token);
+
+		// the multipliers only change precision, not size
+		data = COM_Parse(data);
+		if (post)
+			data = COM_Parse(data);
+
+		data = COM_Parse(data);
+		if (!data || strcmp(com_token, ")"))
+			Error("delta.lst: expected ) after %s", f.name);
+
+		if ((f.type & DT_STRING) == 0 && (f.bits <= 0 || f.bits > 32))
+			Error("delta.lst: %s has %i bits", f.name, f.bits);
+
+		rf = FindRecordedField(f.name);
+		if (!rf)
+		{
+			printf("WARNING: %s is not in the recording, ignored\n", f.name);
+			continue;
+		}
+		f.offset = rf->offset;
+		f.size = rf->size;
+
+		d->fields.push_back(f);
+	}
+
+	// the fields the game dll's encoders set and unset by name
+	d->origin[0] = FindDeltaField(d, "origin[0]");
+	d->origin[1] = FindDeltaField(d, "origin[1]");
+	d->origin[2] = FindDeltaField(d, "origin[2]");
+	d->angles[0] = FindDeltaField(d, "angles[0]");
+	d->angles[1] = FindDeltaField(d, "angles[1]");
+	d->angles[2] = FindDeltaField(d, "angles[2]");
+	d->skin = FindDeltaField(d, "skin");
+	d->sequence = FindDeltaField(d, "sequence");
+	d->animtime = FindDeltaField(d, "animtime");
+
+	return data;
+}
+
+/*
+==============
+LoadDeltaList
+
+Only the entity structures are kept, the rest are skipped
+==============
+*/
+static void LoadDeltaList(const char* filename)
+{
+	char* buffer;
+	char* data;
+	int i, found;
+
+	LoadFile(filename, reinterpret_cast<void**>(&buffer));
+
+	// commas only separate, COM_Parse would keep them on the words
+	for (data = buffer; *data; data++)
+	{
+		if (*data == ',')
+			*data = ' ';
+	}
+
+	found = 0;
+	data = buffer;
+	while ((data = COM_Parse(data)) != NULL)
+	{
+		for (i = 0; i < NUM_DELTAS; i++)
+		{
+			if (!strcmp(com_token, deltanames[i]))
+				break;
+		}
+
+		// skip the encoder name and find the body
+		do
+		{
+			data = COM_Parse(data);
+		} while (data && strcmp(com_token, "{"));
+		if (!data)
+			Error("%s: expected {", filename);
+
+		if (i < NUM_DELTAS)
+		{
+			data = ParseDeltaDesc(data, &deltas[i]);
+			found |= 1 << i;
+			qprintf("%s: %i fields\n", deltanames[i], (int)deltas[i].fields.size());
+			continue;
+		}
+
+		do
+		{
+			data = COM_Parse(data);
+		} while (data && strcmp(com_token, "}"));
+	}
+
+	for (i = 0; i < NUM_DELTAS; i++)
+	{
+		if ((found & (1 << i)) == 0)
+			Error("%s has no %s", filename, deltanames[i]);
+	}
+
+	free(buffer);
+}
+
+/*
+==============
+StateInt
+==============
+*/
+static int StateInt(const byte* state, int offset)
+{
+	int i;
+
+	memcpy(&i, state + offset, sizeof(i));
+	return i;
+}
+
+/*
+==============
+StateFloat
+==============
+*/
+static float StateFloat(const byte* state, int offset)
+{
+	float f;
+
+	memcpy(&f, state + offset, sizeof(f));
+	return f;
+}
+
+/*
+==============
+FieldChanged
+==============
+*/
+static bool FieldChanged(const deltafield_t* f, const byte* from, const byte* to)
+{
+	if (f->type & DT_STRING)
+		return 0 != Q_strcasecmp(reinterpret_cast<const char*>(from + f->offset), reinterpret_cast<const char*>(to + f->offset));
+
+	return 0 != memcmp(from + f->offset, to + f->offset, f->size);
+}
+
+/*
+==============
+SetFields
+==============
+*/
+static void SetFields(bool* send, const int* fields, int count, bool set)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		if (fields[i] != -1)
+			send[fields[i]] = set;
+	}
+}
+
+/*
+==============
+RunEncoder
+
+The same decisions the game dll's Entity_Encode, Player_Encode and
+Custom_Encode make once the engine has marked the changed fields
+==============
+*/
+static void RunEncoder(deltatype_t type, deltadesc_t* d, bool* send, const byte* from, const byte* to, int host)
+{
+	int beamtype;
+
+	if (type == DELTA_CUSTOM)
+	{
+		beamtype = StateInt(to, ofs_rendermode) & 0x0f;
+
+		if (beamtype != BEAM_POINTS && beamtype != BEAM_ENTPOINT)
+			SetFields(send, d->origin, 3, false);
+		if (beamtype != BEAM_POINTS)
+			SetFields(send, d->angles, 3, false);
+		if (beamtype != BEAM_ENTS && beamtype != BEAM_ENTPOINT)
+		{
+			SetFields(send, &d->skin, 1, false);
+			SetFields(send, &d->sequence, 1, false);
+		}
+
+		if ((int)StateFloat(from, ofs_animtime) == (int)StateFloat(to, ofs_animtime))
+			SetFields(send, &d->animtime, 1, false);
+		return;
+	}
+
+	// the local player's origin goes in clientdata_t
+	if (StateInt(to, ofs_number) == host)
+		SetFields(send, d->origin, 3, false);
+
+	if (type == DELTA_ENTITY && StateFloat(to, ofs_impacttime) != 0 && StateFloat(to, ofs_starttime) != 0)
+	{
+		SetFields(send, d->origin, 3, false);
+		SetFields(send, d->angles, 3, false);
+	}
+
+	if (StateInt(to, ofs_movetype) == MOVETYPE_FOLLOW && StateInt(to, ofs_aiment) != 0)
+		SetFields(send, d->origin, 3, false);
+	else if (StateInt(to, ofs_aiment) != StateInt(from, ofs_aiment))
+		SetFields(send, d->origin, 3, true);
+}
+
+/*
+==============
+FieldBits
+==============
+*/
+static int FieldBits(const deltafield_t* f, const byte* to)
+{
+	if (f->type & DT_STRING)
+		return 8 * (strlen(reinterpret_cast<const char*>(to + f->offset)) + 1);
+
+	return f->bits;
+}
+
+/*
+==============
+DeltaBits
+
+Returns the bits the engine would write to take from to to, not
+counting the entity header, or 0 if nothing changed
+==============
+*/
+static int DeltaBits(deltatype_t type, const byte* from, const byte* to, int host)
+{
+	deltadesc_t* d = &deltas[type];
+	deltafield_t* f;
+	bool send[MAX_DELTA_FIELDS];
+	int i, numfields, highest, bits, fieldbits;
+
+	numfields = d->fields.size();
+	if (numfields > MAX_DELTA_FIELDS)
+		Error("%s has more than %i fields", deltanames[type], MAX_DELTA_FIELDS);
+
+	for (i = 0; i < numfields; i++)
+		send[i] = FieldChanged(&d->fields[i], from, to);
+
+	RunEncoder(type, d, send, from, to, host);
+
+	highest = -1;
+	bits = 0;
+	for (i = 0; i < numfields; i++)
+	{
+		if (!send[i])
+			continue;
+
+		f = &d->fields[i];
+		fieldbits = FieldBits(f, to);
+		f->sends++;
+		f->totalbits += fieldbits;
+
+		bits += fieldbits;
+		highest = i;
+	}
+
+	if (highest == -1)
+		return 0;
+
+	// only as many mask bytes as the highest field needs
+	bits += FIELDMASK_COUNT_BITS + 8 * (highest / 8 + 1);
+
+	d->sends++;
+	d->totalbits += bits;
+
+	return bits;
+}
+
+/*
+==============
+EntityNumberBits
+==============
+*/
+static int EntityNumberBits(int number, int previous)
+{
+	if (number == previous + 1)
+		return ENTITY_NEXT_BITS;
+	if (number - previous < 64)
+		return ENTITY_SHORTJUMP_BITS;
+	return ENTITY_LONGJUMP_BITS;
+}
+
+/*
+==============
+ReplayPacket
+
+Every packet is assumed to have been acknowledged, so the next one
+deltas from it
+==============
+*/
+static void ReplayPacket(int host, const short* ents, int count)
+{
+	deltaclient_t* cl;
+	const byte *from, *to;
+	deltatype_t type;
+	std::vector<bool> insend;
+	int i, e, previous, statesize, classnum, bits, header;
+	double packetbits;
+
+	if (host < 1 || host > recheader.maxclients)
+		Error("packet for bad client %i", host);
+
+	statesize = recheader.statesize;
+	cl = &clients[host - 1];
+
+	insend.assign(recheader.maxentities, false);
+	for (i = 0; i < count; i++)
+	{
+		if (ents[i] < 0 || ents[i] >= recheader.maxentities)
+			Error("packet has bad entity %i", ents[i]);
+		insend[ents[i]] = true;
+	}
+
+	packetbits = PACKET_OVERHEAD_BITS;
+
+	// entities that dropped out of the packet are removed
+	previous = -1;
+	for (i = 0; i < (int)cl->lastpacket.size(); i++)
+	{
+		e = cl->lastpacket[i];
+		if (insend[e])
+			continue;
+
+		numremoves++;
+		bits = EntityNumberBits(e, previous) + ENTITY_REMOVE_BITS;
+		packetbits += bits;
+		headerbits += bits;
+		previous = e;
+		cl->sent[e] = false;
+	}
+
+	previous = -1;
+	for (i = 0; i < count; i++)
+	{
+		e = ents[i];
+		to = &curstates[e * statesize];
+
+		if (cl->sent[e])
+			from = &cl->states[e * statesize];
+		else
+			from = &baselines[e * statesize];
+
+		if (e >= 1 && e <= recheader.maxclients)
+			type = DELTA_PLAYER;
+		else if (StateInt(to, ofs_entitytype) & ENTITY_BEAM)
+			type = DELTA_CUSTOM;
+		else
+			type = DELTA_ENTITY;
+
+		// an unchanged entity costs nothing, a new one is sent even if
+		// it matches its baseline
+		bits = DeltaBits(type, from, to, host);
+		if (!bits && !cl->sent[e])
+			bits = FIELDMASK_COUNT_BITS;
+
+		if (bits)
+		{
+			header = EntityNumberBits(e, previous) + ENTITY_REMOVE_BITS + ENTITY_CUSTOM_BITS;
+			headerbits += header;
+			bits += header;
+			previous = e;
+
+			classnum = curclass[e];
+			if (classnum >= 0 && classnum < (int)classes.size())
+			{
+				classes[classnum].updates++;
+				classes[classnum].totalbits += bits;
+			}
+		}
+		packetbits += bits;
+
+		memcpy(&cl->states[e * statesize], to, statesize);
+		cl->sent[e] = true;
+	}
+
+	cl->lastpacket.assign(ents, ents + count);
+
+	numpackets++;
+	totalpacketbits += packetbits;
+	if (packetbits > peakpacketbits)
+		peakpacketbits = packetbits;
+	framebits += packetbits;
+}
+
+/*
+==============
+EndFrame
+==============
+*/
+static void EndFrame(void)
+{
+	if (!numframes)
+		return;
+
+	if (verbose)
+		printf("%10.3f %8.0f bytes\n", frametime, framebits / 8);
+
+	totalframebits += framebits;
+	if (framebits > peakframebits)
+	{
+		peakframebits = framebits;
+		peakframetime = frametime;
+	}
+	framebits = 0;
+}
+
+
+/*
+==============
+LoadRecording
+
+Reads the header and field table, returns the first chunk
+==============
+*/
+static byte* LoadRecording(const char* filename, byte** end)
+{
+	byte* buffer;
+	byte* data;
+	int length, i, statesize;
+
+	length = LoadFile(filename, reinterpret_cast<void**>(&buffer));
+	if (length < (int)sizeof(recheader))
+		Error("%s is not a recording", filename);
+
+	memcpy(&recheader, buffer, sizeof(recheader));
+	if (recheader.ident != DELTAREC_IDENT)
+		Error("%s is not a recording", filename);
+	if (recheader.version != DELTAREC_VERSION)
+		Error("%s is version %i, not %i", filename, recheader.version, DELTAREC_VERSION);
+	if (recheader.maxclients < 1 || recheader.maxentities < recheader.maxclients || recheader.statesize <= 0 || recheader.numfields <= 0)
+		Error("%s has a bad header", filename);
+
+	data = buffer + sizeof(recheader);
+	*end = buffer + length;
+
+	if (*end - data < (int)(recheader.numfields * sizeof(deltarecfield_t)))
+		Error("%s is truncated", filename);
+	recfields = reinterpret_cast<deltarecfield_t*>(data);
+	data += recheader.numfields * sizeof(deltarecfield_t);
+
+	for (i = 0; i < recheader.numfields; i++)
+	{
+		recfields[i].name[DELTAREC_MAX_NAME - 1] = 0;
+		if (recfields[i].offset < 0 || recfields[i].size <= 0 || recfields[i].offset + recfields[i].size > recheader.statesize)
+			Error("%s: field %s is outside the state", filename, recfields[i].name);
+	}
+
+	ofs_number = RecordedOffset("number");
+	ofs_entitytype = RecordedOffset("entityType");
+	ofs_movetype = RecordedOffset("movetype");
+	ofs_aiment = RecordedOffset("aiment");
+	ofs_impacttime = RecordedOffset("impacttime");
+	ofs_starttime = RecordedOffset("starttime");
+	ofs_rendermode = RecordedOffset("rendermode");
+	ofs_animtime = RecordedOffset("animtime");
+
+	statesize = recheader.statesize;
+	curstates.assign(recheader.maxentities * statesize, 0);
+	curclass.assign(recheader.maxentities, -1);
+	baselines.assign(recheader.maxentities * statesize, 0); // zero if none was recorded
+	clients.resize(recheader.maxclients);
+	for (i = 0; i < recheader.maxclients; i++)
+	{
+		clients[i].states.assign(recheader.maxentities * statesize, 0);
+		clients[i].sent.assign(recheader.maxentities, false);
+	}
+
+	qprintf("%i fields, %i byte states, %i clients, %i entities\n", recheader.numfields, statesize, recheader.maxclients, recheader.maxentities);
+
+	return data;
+}
+
+/*
+==============
+ChunkData
+==============
+*/
+static byte* ChunkData(byte** data, byte* end, int size)
+{
+	byte* p = *data;
+
+	if (size < 0 || end - p < size)
+		Error("recording is truncated");
+
+	*data += size;
+	return p;
+}
+
+/*
+==============
+ReplayChunks
+==============
+*/
+static void ReplayChunks(byte* data, byte* end)
+{
+	deltarecchunk_t chunk;
+	classstats_t cs;
+	byte* p;
+	int statesize;
+
+	statesize = recheader.statesize;
+
+	while (data < end)
+	{
+		memcpy(&chunk, ChunkData(&data, end, sizeof(chunk)), sizeof(chunk));
+
+		switch (chunk.type)
+		{
+		case DELTAREC_CLASS:
+			p = ChunkData(&data, end, DELTAREC_MAX_NAME);
+			if (chunk.number != (int)classes.size())
+				Error("class %i out of order", chunk.number);
+			memset(&cs, 0, sizeof(cs));
+			memcpy(cs.name, p, DELTAREC_MAX_NAME);
+			cs.name[DELTAREC_MAX_NAME - 1] = 0;
+			classes.push_back(cs);
+			break;
+
+		case DELTAREC_BASELINE:
+			p = ChunkData(&data, end, statesize);
+			if (chunk.number < 0 || chunk.number >= recheader.maxentities)
+				Error("baseline for bad entity %i", chunk.number);
+			memcpy(&baselines[chunk.number * statesize], p, statesize);
+			break;
+
+		case DELTAREC_FRAME:
+			EndFrame();
+			numframes++;
+			frametime = chunk.time;
+			break;
+
+		case DELTAREC_STATE:
+			p = ChunkData(&data, end, statesize);
+			if (chunk.number < 0 || chunk.number >= recheader.maxentities)
+				Error("state for bad entity %i", chunk.number);
+			memcpy(&curstates[chunk.number * statesize], p, statesize);
+			curclass[chunk.number] = chunk.count;
+			break;
+
+		case DELTAREC_PACKET:
+			p = ChunkData(&data, end, chunk.count * sizeof(short));
+			ReplayPacket(chunk.number, reinterpret_cast<short*>(p), chunk.count);
+			break;
+
+		case DELTAREC_END:
+			data = end;
+			break;
+
+		default:
+			Error("bad chunk type %i", chunk.type);
+		}
+	}
+
+	EndFrame();
+}
+
+/*
+==============
+CompareFieldBits
+==============
+*/
+static int CompareFieldBits(const void* a, const void* b)
+{
+	const deltafield_t* f1 = *(const deltafield_t* const*)a;
+	const deltafield_t* f2 = *(const deltafield_t* const*)b;
+
+	if (f1->totalbits > f2->totalbits)
+		return -1;
+	if (f1->totalbits < f2->totalbits)
+		return 1;
+	return 0;
+}
+
+/*
+==============
+CompareClassBits
+==============
+*/
+static int CompareClassBits(const void* a, const void* b)
+{
+	const classstats_t* c1 = *(const classstats_t* const*)a;
+	const classstats_t* c2 = *(const classstats_t* const*)b;
+
+	if (c1->totalbits > c2->totalbits)
+		return -1;
+	if (c1->totalbits < c2->totalbits)
+		return 1;
+	return 0;
+}
+
+/*
+==============
+PrintReport
+==============
+*/
+static void PrintReport(void)
+{
+	std::vector<deltafield_t*> fields;
+	std::vector<classstats_t*> sorted;
+	deltadesc_t* d;
+	deltafield_t* f;
+	int i, j;
+
+	for (i = 0; i < NUM_DELTAS; i++)
+	{
+		d = &deltas[i];
+
+		printf("\n%s: %i deltas, %.0f bytes", deltanames[i], d->sends, d->totalbits / 8);
+		if (d->sends)
+			printf(", %.1f bytes each", d->totalbits / 8 / d->sends);
+		printf("\n");
+		if (!d->sends)
+			continue;
+
+		fields.clear();
+		for (j = 0; j < (int)d->fields.size(); j++)
+			fields.push_back(&d->fields[j]);
+		qsort(fields.data(), fields.size(), sizeof(fields[0]), CompareFieldBits);
+
+		printf("%-20s %4s %10s %12s %6s\n", "field", "bits", "sends", "bytes", "share");
+		for (j = 0; j < (int)fields.size(); j++)
+		{
+			f = fields[j];
+			if (!f->sends)
+				break;
+			printf("%-20s %4i %10i %12.0f %5.1f%%\n", f->name, f->bits, f->sends, f->totalbits / 8, 100 * f->totalbits / d->totalbits);
+		}
+	}
+
+	for (i = 0; i < (int)classes.size(); i++)
+		sorted.push_back(&classes[i]);
+	qsort(sorted.data(), sorted.size(), sizeof(sorted[0]), CompareClassBits);
+
+	printf("\n%-32s %10s %12s %8s\n", "class", "updates", "bytes", "each");
+	for (i = 0; i < (int)sorted.size(); i++)
+	{
+		if (!sorted[i]->updates)
+			break;
+		printf("%-32s %10i %12.0f %8.1f\n", sorted[i]->name, sorted[i]->updates, sorted[i]->totalbits / 8, sorted[i]->totalbits / 8 / sorted[i]->updates);
+	}
+
+	printf("\n%i frames, %i packets, %i removes\n", numframes, numpackets, numremoves);
+	if (numframes)
+		printf("%.1f bytes per frame, peak %.0f at %.3f\n", totalframebits / 8 / numframes, peakframebits / 8, peakframetime);
+	if (numpackets)
+		printf("%.1f bytes per packet, peak %.0f\n", totalpacketbits / 8 / numpackets, peakpacketbits / 8);
+	if (totalpacketbits)
+		printf("%.1f%% in entity headers and packet framing\n", 100 * (headerbits + numpackets * PACKET_OVERHEAD_BITS) / totalpacketbits);
+}
+
+/*
+==============
+main
+==============
+*/
+int main(int argc, char** argv)
+{
+	char deltafile[1024];
+	char source[1024];
+	byte *data, *end;
+	int i;
+
+	printf("deltaprof.exe (%s)\n", __DATE__);
+	printf("---- deltaprof ----\n");
+
+	strcpy(deltafile, "delta.lst");
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-v"))
+		{
+			verbose = true;
+		}
+		else if (!strcmp(argv[i], "-delta"))
+		{
+			if (++i >= argc)
+				Error("-delta needs a file");
+			strcpy(deltafile, argv[i]);
+		}
+		else if (argv[i][0] == '-')
+			Error("Unknown option \"%s\"", argv[i]);
+		else
+			break;
+	}
+
+	if (i != argc - 1)
+		Error("usage: deltaprof [-v] [-delta delta.lst] recording.drec");
+
+	strcpy(source, argv[i]);
+	DefaultExtension(source, ".drec");
+
+	// the field table has to be loaded before delta.lst can be matched to it
+	data = LoadRecording(source, &end);
+	LoadDeltaList(deltafile);
+
+	if (verbose)
+		printf("\n%10s %8s\n", "time", "size");
+	ReplayChunks(data, end);
+
+	PrintReport();
+
+	return 0;
+}
@@ -0,0 +1,811 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+// navtest.cpp -- runs the nav mesh code from game_shared/bot on synthetic
+// data, checking it against the algorithms it replaced
+
+#include <stdarg.h>
+#include <chrono>
+#include <list>
+#include <vector>
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "bot_util.h"
+
+#include "nav.h"
+#include "nav_node.h"
+#include "nav_area.h"
+
+#define LATTICE_MIN_SIZE 16
+#define LATTICE_MAX_SIZE 96
+#define LATTICE_DROPOUT 100 // one node in this many is missing
+#define LATTICE_BROKEN_LINK 100 // one link in this many is one way
+
+#define MESH_AREA_SIZE 50.0f
+#define MESH_BLOCKED 5 // one area in this many is missing
+#define MESH_ONE_WAY 20 // one connection in this many is one way
+
+typedef struct
+{
+	float lox, loy, hix, hiy;
+	unsigned char attributes;
+} arearecord_t;
+
+typedef struct
+{
+	std::vector<arearecord_t> areas; // in TheNavAreaList order
+	std::vector<bool> covered; // per lattice cell
+	double seconds;
+} coverresult_t;
+
+typedef struct
+{
+	float costSoFar;
+	float totalCost;
+	int parent;
+	int parentHow;
+	bool isOpen, isClosed;
+	int prevOpen, nextOpen; // the sorted open list, -1 terminated
+} legacysearch_t;
+
+static bool verbose = false;
+static unsigned int randomseed;
+
+/*
+==============
+The nav code's engine dependencies.  There is no world, so every
+trace is clear.
+==============
+*/
+void CONSOLE_ECHO(char* pszMsg, ...)
+{
+	va_list argptr;
+
+	if (!verbose)
+		return;
+
+	va_start(argptr, pszMsg);
+	vprintf(pszMsg, argptr);
+	va_end(argptr);
+}
+
+void UTIL_TraceLine(const Vector& vecStart, const Vector& vecEnd, IGNORE_MONSTERS igmon, edict_t* pentIgnore, TraceResult* ptr)
+{
+	memset(ptr, 0, sizeof(*ptr));
+	ptr->flFraction = 1.0f;
+	ptr->vecEndPos = vecEnd;
+}
+
+void UTIL_TraceLine(const Vector& vecStart, const Vector& vecEnd, IGNORE_MONSTERS igmon, IGNORE_GLASS ignoreGlass, edict_t* pentIgnore, TraceResult* ptr)
+{
+	UTIL_TraceLine(vecStart, vecEnd, igmon, pentIgnore, ptr);
+}
+
+CBaseEntity* UTIL_FindEntityByClassname(CBaseEntity* pStartEntity, const char* szName)
+{
+	return NULL;
+}
+
+/*
+==============
+Error
+==============
+*/
+static void Error(const char* error, ...)
+{
+	va_list argptr;
+
+	printf("\n************ ERROR ************\n");
+
+	va_start(argptr, error);
+	vprintf(error, argptr);
+	va_end(argptr);
+	printf("\n");
+
+	exit(1);
+}
+
+/*
+==============
+Random
+
+Not rand(), so a seed makes the same data on every platform
+==============
+*/
+static int Random(int range)
+{
+	randomseed = randomseed * 1103515245 + 12345;
+	return (randomseed >> 16) % range;
+}
+
+/*
+==============
+RandomRect
+==============
+*/
+static void RandomRect(int width, int height, int maxsize, int* x0, int* y0, int* x1, int* y1)
+{
+	*x0 = Random(width);
+	*y0 = Random(height);
+	*x1 = *x0 + 1 + Random(maxsize);
+	*y1 = *y0 + 1 + Random(maxsize);
+
+	*x1 = V_min(*x1, width);
+	*y1 = V_min(*y1, height);
+}
+
+/*
+==============
+BuildLattice
+
+Samples a width x height node lattice the way the map learning
+driver would: nodes GenerationStepSize apart, linked to their
+neighbours unless the step between them is too high.  The lattice has
+ramps, steps, patches of crouch and jump nodes, holes, missing nodes
+and one way links, and the nodes are created in a shuffled order.
+Returns the node at each cell, or NULL where there is none.
+==============
+*/
+static std::vector<CNavNode*> BuildLattice(unsigned int seed, int* pwidth, int* pheight)
+{
+	int width, height, count, i, x, y, x0, y0, x1, y1;
+
+	randomseed = seed;
+	width = LATTICE_MIN_SIZE + Random(LATTICE_MAX_SIZE - LATTICE_MIN_SIZE + 1);
+	height = LATTICE_MIN_SIZE + Random(LATTICE_MAX_SIZE - LATTICE_MIN_SIZE + 1);
+
+	count = width * height;
+	std::vector<float> z(count, 0.0f);
+	std::vector<Vector> normal(count, Vector(0, 0, 1));
+	std::vector<unsigned char> attributes(count, 0);
+	std::vector<bool> present(count, true);
+
+	// ramps along x, steep enough that the longer ones leave the plane tolerance
+	for (i = Random(3); i > 0; i--)
+	{
+		float slope = (Random(2) ? 1 : -1) * (0.05f + Random(40) / 100.0f);
+		Vector n = Vector(-slope, 0, 1).Normalize();
+
+		RandomRect(width, height, width / 2, &x0, &y0, &x1, &y1);
+		for (y = y0; y < y1; y++)
+			for (x = x0; x < x1; x++)
+			{
+				z[y * width + x] += slope * (x - x0) * GenerationStepSize;
+				normal[y * width + x] = n;
+			}
+	}
+
+	// raised blocks, some within a step of the floor
+	for (i = Random(4); i > 0; i--)
+	{
+		float rise = 8.0f + Random(20);
+
+		RandomRect(width, height, width / 3, &x0, &y0, &x1, &y1);
+		for (y = y0; y < y1; y++)
+			for (x = x0; x < x1; x++)
+				z[y * width + x] += rise;
+	}
+
+	for (i = Random(4); i > 0; i--)
+	{
+		unsigned char bits = Random(2) ? NAV_CROUCH : NAV_JUMP;
+
+		RandomRect(width, height, width / 4, &x0, &y0, &x1, &y1);
+		for (y = y0; y < y1; y++)
+			for (x = x0; x < x1; x++)
+				attributes[y * width + x] |= bits;
+	}
+
+	for (i = Random(5); i > 0; i--)
+	{
+		RandomRect(width, height, width / 5, &x0, &y0, &x1, &y1);
+		for (y = y0; y < y1; y++)
+			for (x = x0; x < x1; x++)
+				present[y * width + x] = false;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (!Random(LATTICE_DROPOUT))
+			present[i] = false;
+	}
+
+	// each node is pushed on the front of the node list, so shuffle the creation order
+	std::vector<int> order(count);
+	for (i = 0; i < count; i++)
+		order[i] = i;
+	for (i = count - 1; i > 0; i--)
+		std::swap(order[i], order[Random(i + 1)]);
+
+	std::vector<CNavNode*> nodes(count, (CNavNode*)NULL);
+	for (i = 0; i < count; i++)
+	{
+		int cell = order[i];
+
+		if (!present[cell])
+			continue;
+
+		Vector pos((cell % width) * GenerationStepSize, (cell / width) * GenerationStepSize, z[cell]);
+		nodes[cell] = new CNavNode(&pos, &normal[cell]);
+		nodes[cell]->SetAttributes(attributes[cell]);
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		static const int dx[NUM_DIRECTIONS] = {0, 1, 0, -1};
+		static const int dy[NUM_DIRECTIONS] = {-1, 0, 1, 0};
+		int dir;
+
+		if (!nodes[i])
+			continue;
+
+		for (dir = 0; dir < NUM_DIRECTIONS; dir++)
+		{
+			x = i % width + dx[dir];
+			y = i / width + dy[dir];
+
+			if (x < 0 || x >= width || y < 0 || y >= height)
+				continue;
+
+			CNavNode* to = nodes[y * width + x];
+			if (!to || fabs(to->GetPosition()->z - z[i]) > StepHeight || !Random(LATTICE_BROKEN_LINK))
+				continue;
+
+			nodes[i]->ConnectTo(to, (NavDirType)dir);
+		}
+	}
+
+	*pwidth = width;
+	*pheight = height;
+
+	return nodes;
+}
+
+/*
+==============
+LegacyCoverNodesWithAreas
+
+The covering loop as it was before CoverNodesWithAreas() learned to
+skip sizes that cannot fit: every size is tried with TestArea() at
+every uncovered node.
+==============
+*/
+static bool LegacyCoverNodesWithAreas(int uncoveredNodes)
+{
+	int tryWidth = 50;
+	int tryHeight = 50;
+
+	while (uncoveredNodes > 0)
+	{
+		for (CNavNode* node = CNavNode::GetFirst(); node; node = node->GetNext())
+		{
+			if (node->IsCovered())
+				continue;
+
+			if (TestArea(node, tryWidth, tryHeight))
+			{
+				int covered = BuildArea(node, tryWidth, tryHeight);
+				if (covered < 0)
+					return false;
+
+				uncoveredNodes -= covered;
+			}
+		}
+
+		if (tryWidth >= tryHeight)
+			--tryWidth;
+		else
+			--tryHeight;
+
+		if (tryWidth <= 0 || tryHeight <= 0)
+			break;
+	}
+
+	return true;
+}
+
+/*
+==============
+CoverLattice
+
+Covers a fresh copy of the lattice, records the areas and which
+cells ended up covered, and frees everything again
+==============
+*/
+static void CoverLattice(unsigned int seed, bool legacy, coverresult_t* result)
+{
+	int width, height;
+	bool ok;
+
+	std::vector<CNavNode*> nodes = BuildLattice(seed, &width, &height);
+
+	auto start = std::chrono::steady_clock::now();
+	if (legacy)
+		ok = LegacyCoverNodesWithAreas(CNavNode::GetListLength());
+	else
+		ok = CoverNodesWithAreas(CNavNode::GetListLength());
+	result->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (!ok)
+		Error("lattice %u: %s covering failed", seed, legacy ? "old" : "new");
+
+	result->areas.clear();
+	for (NavAreaList::iterator iter = TheNavAreaList.begin(); iter != TheNavAreaList.end(); ++iter)
+	{
+		const Extent* extent = (*iter)->GetExtent();
+		arearecord_t rec;
+
+		rec.lox = extent->lo.x;
+		rec.loy = extent->lo.y;
+		rec.hix = extent->hi.x;
+		rec.hiy = extent->hi.y;
+		rec.attributes = (*iter)->GetAttributes();
+		result->areas.push_back(rec);
+	}
+
+	result->covered.resize(nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++)
+		result->covered[i] = nodes[i] && nodes[i]->IsCovered();
+
+	DestroyNavigationMap();
+}
+
+/*
+==============
+TestLattices
+
+Covers each lattice with the old loop and with CoverNodesWithAreas(),
+which must build the same areas in the same order
+==============
+*/
+static int TestLattices(unsigned int firstseed, int count)
+{
+	coverresult_t legacy, current;
+	double legacyseconds = 0, currentseconds = 0;
+	int failures = 0, totalareas = 0, totalcovered = 0, totalcells = 0;
+	int i;
+
+	if (verbose)
+		printf("\n%10s %8s %8s %10s %10s\n", "seed", "cells", "areas", "old", "new");
+
+	for (i = 0; i < count; i++)
+	{
+		unsigned int seed = firstseed + i;
+		size_t a;
+		int covered = 0;
+		bool same;
+
+		CoverLattice(seed, true, &legacy);
+		CoverLattice(seed, false, &current);
+
+		same = legacy.covered == current.covered && legacy.areas.size() == current.areas.size();
+		for (a = 0; same && a < legacy.areas.size(); a++)
+		{
+			const arearecord_t* l = &legacy.areas[a];
+			const arearecord_t* c = &current.areas[a];
+
+			if (l->lox != c->lox || l->loy != c->loy || l->hix != c->hix || l->hiy != c->hiy || l->attributes != c->attributes)
+				same = false;
+		}
+
+		for (a = 0; a < current.covered.size(); a++)
+		{
+			if (current.covered[a])
+				covered++;
+		}
+
+		if (!same)
+		{
+			printf("lattice %u: old loop built %d areas, new loop %d\n", seed, (int)legacy.areas.size(), (int)current.areas.size());
+			failures++;
+		}
+
+		if (verbose)
+			printf("%10u %8d %8d %9.3fs %9.3fs\n", seed, (int)current.covered.size(), (int)current.areas.size(), legacy.seconds, current.seconds);
+
+		legacyseconds += legacy.seconds;
+		currentseconds += current.seconds;
+		totalareas += current.areas.size();
+		totalcovered += covered;
+		totalcells += current.covered.size();
+	}
+
+	printf("\n%d lattices, %d cells, %d covered by %d areas\n", count, totalcells, totalcovered, totalareas);
+	printf("old loop %.2fs, CoverNodesWithAreas %.2fs\n", legacyseconds, currentseconds);
+	printf("%d lattices differ\n", failures);
+
+	return failures;
+}
+
+/*
+==============
+BuildMesh
+
+A size x size grid of square areas with blocked cells, crouch and
+jump patches, raised platforms and one way connections.  Most of the
+floor is flat and evenly spaced, so many open areas tie on cost.
+Returns the areas in creation order, with NULL for blocked cells.
+==============
+*/
+static std::vector<CNavArea*> BuildMesh(unsigned int seed, int size)
+{
+	static const int dx[NUM_DIRECTIONS] = {0, 1, 0, -1};
+	static const int dy[NUM_DIRECTIONS] = {-1, 0, 1, 0};
+	int count, i, x, y, x0, y0, x1, y1, dir;
+
+	randomseed = seed;
+	count = size * size;
+
+	std::vector<float> z(count, 0.0f);
+	std::vector<unsigned char> attributes(count, 0);
+
+	for (i = Random(size / 4 + 1); i > 0; i--)
+	{
+		float rise = 10.0f + Random(40);
+
+		RandomRect(size, size, size / 4 + 1, &x0, &y0, &x1, &y1);
+		for (y = y0; y < y1; y++)
+			for (x = x0; x < x1; x++)
+				z[y * size + x] += rise;
+	}
+
+	for (i = Random(size / 4 + 1); i > 0; i--)
+	{
+		unsigned char bits = Random(2) ? NAV_CROUCH : NAV_JUMP;
+
+		RandomRect(size, size, size / 8 + 1, &x0, &y0, &x1, &y1);
+		for (y = y0; y < y1; y++)
+			for (x = x0; x < x1; x++)
+				attributes[y * size + x] = bits;
+	}
+
+	std::vector<CNavArea*> areas(count, (CNavArea*)NULL);
+	for (i = 0; i < count; i++)
+	{
+		if (!Random(MESH_BLOCKED))
+			continue;
+
+		Vector lo((i % size) * MESH_AREA_SIZE, (i / size) * MESH_AREA_SIZE, z[i]);
+		Vector hi = lo + Vector(MESH_AREA_SIZE, MESH_AREA_SIZE, 0);
+
+		areas[i] = new CNavArea(&lo, &hi);
+		areas[i]->SetAttributes(attributes[i]);
+		TheNavAreaList.push_back(areas[i]);
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (!areas[i])
+			continue;
+
+		for (dir = 0; dir < NUM_DIRECTIONS; dir++)
+		{
+			x = i % size + dx[dir];
+			y = i / size + dy[dir];
+
+			if (x < 0 || x >= size || y < 0 || y >= size || !areas[y * size + x])
+				continue;
+
+			if (Random(MESH_ONE_WAY))
+				areas[i]->ConnectTo(areas[y * size + x], (NavDirType)dir);
+		}
+	}
+
+	return areas;
+}
+
+/*
+==============
+LegacyBuildPath
+
+NavAreaBuildPath() with ShortestPathCost, keeping the open set in the
+sorted linked list the nav code used before the open heap.  Search
+state is kept by area index (ID - firstid) instead of in the areas.
+==============
+*/
+static bool LegacyBuildPath(CNavArea* startArea, CNavArea* goalArea, const std::vector<CNavArea*>& byid, unsigned int firstid, std::vector<legacysearch_t>& state)
+{
+	int openList = -1;
+	int start = startArea->GetID() - firstid;
+	int goal = goalArea->GetID() - firstid;
+	int s;
+
+	if (startArea == goalArea)
+	{
+		state[start].parent = -1;
+		return true;
+	}
+
+	for (s = 0; s < (int)state.size(); s++)
+	{
+		state[s].isOpen = false;
+		state[s].isClosed = false;
+	}
+
+	Vector actualGoalPos = *goalArea->GetCenter();
+
+	state[start].parent = -1;
+	state[start].totalCost = (*startArea->GetCenter() - actualGoalPos).Length();
+	state[start].costSoFar = 0.0f;
+
+	// an insert goes behind every area it ties with, and an improved area bubbles up until
+	// the area in front of it is no more expensive
+	auto addToOpenList = [&](int a) {
+		int at, last = -1;
+
+		state[a].isOpen = true;
+
+		for (at = openList; at != -1; at = state[at].nextOpen)
+		{
+			if (state[a].totalCost < state[at].totalCost)
+				break;
+			last = at;
+		}
+
+		state[a].prevOpen = last;
+		state[a].nextOpen = at;
+		if (last != -1)
+			state[last].nextOpen = a;
+		else
+			openList = a;
+		if (at != -1)
+			state[at].prevOpen = a;
+	};
+
+	auto removeFromOpenList = [&](int a) {
+		if (state[a].prevOpen != -1)
+			state[state[a].prevOpen].nextOpen = state[a].nextOpen;
+		else
+			openList = state[a].nextOpen;
+
+		if (state[a].nextOpen != -1)
+			state[state[a].nextOpen].prevOpen = state[a].prevOpen;
+
+		state[a].isOpen = false;
+	};
+
+	auto updateOnOpenList = [&](int a) {
+		while (state[a].prevOpen != -1 && state[a].totalCost < state[state[a].prevOpen].totalCost)
+		{
+			int other = state[a].prevOpen;
+
+			removeFromOpenList(a);
+
+			state[a].prevOpen = state[other].prevOpen;
+			state[a].nextOpen = other;
+			if (state[other].prevOpen != -1)
+				state[state[other].prevOpen].nextOpen = a;
+			else
+				openList = a;
+			state[other].prevOpen = a;
+			state[a].isOpen = true;
+		}
+	};
+
+	addToOpenList(start);
+
+	while (openList != -1)
+	{
+		int a = openList;
+		CNavArea* area = byid[a];
+
+		removeFromOpenList(a);
+
+		if (a == goal)
+			return true;
+
+		for (int dir = 0; dir < NUM_DIRECTIONS; dir++)
+		{
+			const NavConnectList* list = area->GetAdjacentList((NavDirType)dir);
+
+			for (NavConnectList::const_iterator iter = list->begin(); iter != list->end(); ++iter)
+			{
+				CNavArea* newArea = (*iter).area;
+				int n = newArea->GetID() - firstid;
+
+				if (newArea == area)
+					continue;
+
+				// ShortestPathCost
+				float dist = (*newArea->GetCenter() - *area->GetCenter()).Length();
+				float newCostSoFar = dist + state[a].costSoFar;
+
+				if (newArea->GetAttributes() & NAV_CROUCH)
+				{
+					const float crouchPenalty = 20.0f;
+					newCostSoFar += crouchPenalty * dist;
+				}
+
+				if (newArea->GetAttributes() & NAV_JUMP)
+				{
+					const float jumpPenalty = 5.0f;
+					newCostSoFar += jumpPenalty * dist;
+				}
+
+				if ((state[n].isOpen || state[n].isClosed) && state[n].costSoFar <= newCostSoFar)
+					continue;
+
+				float newCostRemaining = (*newArea->GetCenter() - actualGoalPos).Length();
+
+				state[n].parent = a;
+				state[n].parentHow = dir;
+				state[n].costSoFar = newCostSoFar;
+				state[n].totalCost = newCostSoFar + newCostRemaining;
+
+				state[n].isClosed = false;
+
+				if (state[n].isOpen)
+					updateOnOpenList(n);
+				else
+					addToOpenList(n);
+			}
+		}
+
+		state[a].isClosed = true;
+	}
+
+	return false;
+}
+
+/*
+==============
+TestPaths
+
+Finds paths between random start and goal areas with NavAreaBuildPath()
+and with the old sorted open list, which must agree on every area and
+step of every path
+==============
+*/
+static int TestPaths(unsigned int seed, int size, int count)
+{
+	ShortestPathCost cost;
+	double legacyseconds = 0, currentseconds = 0;
+	int failures = 0, found = 0, steps = 0;
+	int i;
+
+	std::vector<CNavArea*> grid = BuildMesh(seed, size);
+
+	if (TheNavAreaList.empty())
+		Error("mesh %u has no areas", seed);
+
+	// the areas were created in order, so their IDs are contiguous
+	std::vector<CNavArea*> byid;
+	unsigned int firstid = TheNavAreaList.front()->GetID();
+	for (NavAreaList::iterator iter = TheNavAreaList.begin(); iter != TheNavAreaList.end(); ++iter)
+	{
+		if ((*iter)->GetID() - firstid != byid.size())
+			Error("mesh area IDs are not contiguous");
+		byid.push_back(*iter);
+	}
+
+	std::vector<legacysearch_t> state(byid.size());
+	std::vector<int> currentpath, legacypath;
+
+	for (i = 0; i < count; i++)
+	{
+		CNavArea* startArea = byid[Random(byid.size())];
+		CNavArea* goalArea = byid[Random(byid.size())];
+		bool currentfound, legacyfound;
+
+		auto start = std::chrono::steady_clock::now();
+		currentfound = NavAreaBuildPath(startArea, goalArea, NULL, cost);
+		auto mid = std::chrono::steady_clock::now();
+		legacyfound = LegacyBuildPath(startArea, goalArea, byid, firstid, state);
+		auto end = std::chrono::steady_clock::now();
+
+		currentseconds += std::chrono::duration<double>(mid - start).count();
+		legacyseconds += std::chrono::duration<double>(end - mid).count();
+
+		// paths as area index and how it was entered, goal first
+		currentpath.clear();
+		legacypath.clear();
+
+		if (currentfound)
+		{
+			for (CNavArea* area = goalArea; area; area = area->GetParent())
+			{
+				currentpath.push_back(area->GetID() - firstid);
+				currentpath.push_back(area->GetParent() ? area->GetParentHow() : -1);
+			}
+		}
+
+		if (legacyfound)
+		{
+			for (int a = goalArea->GetID() - firstid; a != -1; a = state[a].parent)
+			{
+				legacypath.push_back(a);
+				legacypath.push_back(state[a].parent != -1 ? state[a].parentHow : -1);
+			}
+		}
+
+		if (currentfound != legacyfound || currentpath != legacypath)
+		{
+			printf("path %d from #%u to #%u: open heap %s %d areas, sorted list %s %d\n", i, startArea->GetID(), goalArea->GetID(),
+				currentfound ? "found" : "failed after", (int)currentpath.size() / 2, legacyfound ? "found" : "failed after", (int)legacypath.size() / 2);
+			failures++;
+		}
+
+		if (currentfound)
+		{
+			found++;
+			steps += currentpath.size() / 2;
+		}
+	}
+
+	printf("\n%d paths over %d areas, %d found with %d areas on average\n", count, (int)byid.size(), found, found ? steps / found : 0);
+	printf("sorted open list %.2fs, open heap %.2fs\n", legacyseconds, currentseconds);
+	printf("%d paths differ\n", failures);
+
+	DestroyNavigationMap();
+
+	return failures;
+}
+
+/*
+==============
+main
+==============
+*/
+int main(int argc, char** argv)
+{
+	unsigned int seed = 1;
+	int count = -1;
+	int size = 150;
+	int i;
+
+	printf("navtest.exe (%s)\n", __DATE__);
+	printf("---- navtest ----\n");
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-v"))
+		{
+			verbose = true;
+		}
+		else if (!strcmp(argv[i], "-seed"))
+		{
+			if (++i >= argc)
+				Error("-seed needs a number");
+			seed = atoi(argv[i]);
+		}
+		else if (!strcmp(argv[i], "-count"))
+		{
+			if (++i >= argc)
+				Error("-count needs a number");
+			count = atoi(argv[i]);
+		}
+		else if (!strcmp(argv[i], "-size"))
+		{
+			if (++i >= argc)
+				Error("-size needs a number");
+			size = atoi(argv[i]);
+		}
+		else if (argv[i][0] == '-')
+			Error("Unknown option \"%s\"", argv[i]);
+		else
+			break;
+	}
+
+	if (i == argc - 1 && !strcmp(argv[i], "lattice"))
+		return TestLattices(seed, count >= 0 ? count : 300) ? 1 : 0;
+
+	if (i == argc - 1 && !strcmp(argv[i], "path"))
+	{
+		if (size < 2)
+			Error("-size must be at least 2");
+		return TestPaths(seed, size, count >= 0 ? count : 2000) ? 1 : 0;
+	}
+
+	Error("usage: navtest [-v] [-seed n] [-count n] lattice\n"
+		  "       navtest [-v] [-seed n] [-count n] [-size n] path");
+	return 1;
+}
@@ -13,6 +13,8 @@
 #include "cmdlib.h"
 #include "mathlib.h"
 #include "bspfile.h"
+#include "polyfile.h"
+#include "mempool.h"
 #include "threads.h"
 
 //#define	ON_EPSILON	0.05
@@ -160,7 +162,7 @@ typedef struct portal_s
 	winding_t* winding;
 } portal_t;
 
-extern node_t outside_node; // portals outside the world face this
+extern thread_local node_t outside_node; // portals outside the world face this
 
 void AddPortalToNodes(portal_t* p, node_t* front, node_t* back);
 void RemovePortalFromNode(portal_t* portal, node_t* l);
@@ -230,11 +232,11 @@ extern qboolean watervis;
 
 extern int subdivide_size;
 
-extern int hullnum;
+extern thread_local int hullnum; // hulls are built on several threads at once
 
 void qprintf(char* fmt, ...); // only prints if verbose
 
-extern int valid;
+extern thread_local int valid;
 
 extern char portfilename[1024];
 extern char g_bspfilename[1024];
@@ -259,6 +261,9 @@ surface_t* AllocSurface(void);
 void FreeSurface(surface_t* s);
 
 node_t* AllocNode(void);
+void FreeNode(node_t* n);
+
+void PrintMemory(void);
 
 //=============================================================================
 
@@ -12,6 +12,12 @@
 
 #include "bsp5.h"
 
+#include <atomic>
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
 //
 // command line flags
 //
@@ -30,9 +36,34 @@ char g_bspfilename[1024];
 char pointfilename[1024];
 char portfilename[1024];
 
-FILE* polyfiles[NUM_HULLS];
+typedef struct
+{
+	FILE* file; // text format only
+
+	// binary format, the whole file is mapped or loaded
+	byte* data;
+	byte* cursor;
+	byte* end;
+#ifdef WIN32
+	HANDLE filehandle;
+	HANDLE maphandle;
+#endif
+} polyfile_t;
 
-int hullnum;
+polyfile_t polyfiles[NUM_HULLS];
+
+// every hull of every model is read before any of them is built
+typedef struct
+{
+	vec3_t mins, maxs;
+	surfchain_t* surfs[NUM_HULLS];
+	node_t* nodes[NUM_HULLS];
+} bspmodel_t;
+
+bspmodel_t* bspmodels;
+int numbspmodels;
+
+thread_local int hullnum;
 
 //===========================================================================
 
@@ -157,7 +188,7 @@ winding_t* CopyWinding(winding_t* w)
 	winding_t* c;
 
 	size = (int)((winding_t*)0)->points[w->numpoints];
-	c = reinterpret_cast<winding_t*>(malloc(size));
+	c = NewWinding(w->numpoints);
 	memcpy(c, w, size);
 	return c;
 }
@@ -547,17 +578,35 @@ void SplitFace(face_t* in, dplane_t* split, face_t** front, face_t** back)
 
 //===========================================================================
 
-int c_activefaces, c_peakfaces;
-int c_activesurfaces, c_peaksurfaces;
-int c_activewindings, c_peakwindings;
-int c_activeportals, c_peakportals;
+// hulls are built on several threads at once
+std::atomic<int> c_activefaces, c_peakfaces;
+std::atomic<int> c_activesurfaces, c_peaksurfaces;
+std::atomic<int> c_activewindings, c_peakwindings;
+std::atomic<int> c_activeportals, c_peakportals;
+std::atomic<int> c_activenodes, c_peaknodes;
 
 void PrintMemory(void)
 {
-	printf("faces   : %6i (%6i)\n", c_activefaces, c_peakfaces);
-	printf("surfaces: %6i (%6i)\n", c_activesurfaces, c_peaksurfaces);
-	printf("windings: %6i (%6i)\n", c_activewindings, c_peakwindings);
-	printf("portals : %6i (%6i)\n", c_activeportals, c_peakportals);
+	printf("faces   : %6i (%6i)\n", c_activefaces.load(), c_peakfaces.load());
+	printf("surfaces: %6i (%6i)\n", c_activesurfaces.load(), c_peaksurfaces.load());
+	printf("windings: %6i (%6i)\n", c_activewindings.load(), c_peakwindings.load());
+	printf("portals : %6i (%6i)\n", c_activeportals.load(), c_peakportals.load());
+	printf("nodes   : %6i (%6i)\n", c_activenodes.load(), c_peaknodes.load());
+}
+
+/*
+==================
+CountAlloc
+==================
+*/
+static void CountAlloc(std::atomic<int>& active, std::atomic<int>& peak)
+{
+	int count, oldpeak;
+
+	count = ++active;
+	oldpeak = peak;
+	while (count > oldpeak && !peak.compare_exchange_weak(oldpeak, count))
+		;
 }
 
 /*
@@ -573,12 +622,10 @@ winding_t* NewWinding(int points)
 	if (points > MAX_POINTS_ON_WINDING)
 		Error("NewWinding: %i points", points);
 
-	c_activewindings++;
-	if (c_activewindings > c_peakwindings)
-		c_peakwindings = c_activewindings;
+	CountAlloc(c_activewindings, c_peakwindings);
 
 	size = (int)((winding_t*)0)->points[points];
-	w = reinterpret_cast<winding_t*>(malloc(size));
+	w = reinterpret_cast<winding_t*>(PoolAlloc(size));
 	memset(w, 0, size);
 
 	return w;
@@ -588,7 +635,7 @@ winding_t* NewWinding(int points)
 void FreeWinding(winding_t* w)
 {
 	c_activewindings--;
-	free(w);
+	PoolFree(w);
 }
 
 
@@ -602,11 +649,9 @@ face_t* AllocFace(void)
 {
 	face_t* f;
 
-	c_activefaces++;
-	if (c_activefaces > c_peakfaces)
-		c_peakfaces = c_activefaces;
+	CountAlloc(c_activefaces, c_peakfaces);
 
-	f = reinterpret_cast<face_t*>(malloc(sizeof(face_t)));
+	f = reinterpret_cast<face_t*>(PoolAlloc(sizeof(face_t)));
 	memset(f, 0, sizeof(face_t));
 	f->planenum = -1;
 
@@ -617,7 +662,7 @@ face_t* AllocFace(void)
 void FreeFace(face_t* f)
 {
 	c_activefaces--;
-	free(f);
+	PoolFree(f);
 }
 
 
@@ -630,12 +675,10 @@ surface_t* AllocSurface(void)
 {
 	surface_t* s;
 
-	s = reinterpret_cast<surface_t*>(malloc(sizeof(surface_t)));
+	s = reinterpret_cast<surface_t*>(PoolAlloc(sizeof(surface_t)));
 	memset(s, 0, sizeof(surface_t));
 
-	c_activesurfaces++;
-	if (c_activesurfaces > c_peaksurfaces)
-		c_peaksurfaces = c_activesurfaces;
+	CountAlloc(c_activesurfaces, c_peaksurfaces);
 
 	return s;
 }
@@ -643,7 +686,7 @@ surface_t* AllocSurface(void)
 void FreeSurface(surface_t* s)
 {
 	c_activesurfaces--;
-	free(s);
+	PoolFree(s);
 }
 
 /*
@@ -655,11 +698,9 @@ portal_t* AllocPortal(void)
 {
 	portal_t* p;
 
-	c_activeportals++;
-	if (c_activeportals > c_peakportals)
-		c_peakportals = c_activeportals;
+	CountAlloc(c_activeportals, c_peakportals);
 
-	p = reinterpret_cast<portal_t*>(malloc(sizeof(portal_t)));
+	p = reinterpret_cast<portal_t*>(PoolAlloc(sizeof(portal_t)));
 	memset(p, 0, sizeof(portal_t));
 
 	return p;
@@ -668,7 +709,7 @@ portal_t* AllocPortal(void)
 void FreePortal(portal_t* p)
 {
 	c_activeportals--;
-	free(p);
+	PoolFree(p);
 }
 
 
@@ -681,12 +722,20 @@ node_t* AllocNode(void)
 {
 	node_t* n;
 
-	n = reinterpret_cast<node_t*>(malloc(sizeof(node_t)));
+	CountAlloc(c_activenodes, c_peaknodes);
+
+	n = reinterpret_cast<node_t*>(PoolAlloc(sizeof(node_t)));
 	memset(n, 0, sizeof(node_t));
 
 	return n;
 }
 
+void FreeNode(node_t* n)
+{
+	c_activenodes--;
+	PoolFree(n);
+}
+
 
 //===========================================================================
 
@@ -754,19 +803,44 @@ surfchain_t* SurflistFromValidFaces(void)
 		validfaces[i + 1] = NULL;
 	}
 
-	// merge all possible polygons
+	return sc;
+}
 
-	MergeAll(sc->surfaces);
+/*
+===============
+NewValidFace
+===============
+*/
+face_t* NewValidFace(int planenum, int texturenum, int contents, int numpoints)
+{
+	face_t* f;
 
-	return sc;
+	if (numpoints < 0 || numpoints > MAXPOINTS)
+		Error("ReadSurfs: %i > MAXPOINTS", numpoints);
+	if (planenum < 0 || planenum > numplanes)
+		Error("ReadSurfs: %i > numplanes", planenum);
+	if (texturenum > numtexinfo)
+		Error("ReadSurfs: %i > numtexinfo", texturenum);
+
+	f = AllocFace();
+	f->planenum = planenum;
+	f->texturenum = texturenum;
+	f->contents = contents;
+	f->numpoints = numpoints;
+	f->next = validfaces[planenum];
+	validfaces[planenum] = f;
+
+	return f;
 }
 
 /*
 ===============
-ReadSurfs
+ReadTextSurfs
+
+Reads the qcsg -textpolys format
 ===============
 */
-surfchain_t* ReadSurfs(FILE* file)
+surfchain_t* ReadTextSurfs(FILE* file)
 {
 	int r;
 	int planenum, texturenum, contents, numpoints;
@@ -784,21 +858,8 @@ surfchain_t* ReadSurfs(FILE* file)
 			break;
 		if (r != 4)
 			Error("ReadSurfs: scanf failure");
-		if (numpoints > MAXPOINTS)
-			Error("ReadSurfs: %i > MAXPOINTS", numpoints);
-		if (planenum > numplanes)
-			Error("ReadSurfs: %i > numplanes", planenum);
-		if (texturenum > numtexinfo)
-			Error("ReadSurfs: %i > numtexinfo", texturenum);
-
-
-		f = AllocFace();
-		f->planenum = planenum;
-		f->texturenum = texturenum;
-		f->contents = contents;
-		f->numpoints = numpoints;
-		f->next = validfaces[planenum];
-		validfaces[planenum] = f;
+
+		f = NewValidFace(planenum, texturenum, contents, numpoints);
 
 		for (i = 0; i < f->numpoints; i++)
 		{
@@ -811,36 +872,206 @@ surfchain_t* ReadSurfs(FILE* file)
 	return SurflistFromValidFaces();
 }
 
+/*
+===============
+ReadSurfs
+===============
+*/
+surfchain_t* ReadSurfs(polyfile_t* pf)
+{
+	polyfileface_t face;
+	face_t* f;
+	int i;
+	double v[3];
+
+	if (pf->file)
+		return ReadTextSurfs(pf->file);
+
+	// read in the polygons
+	while (1)
+	{
+		if (pf->cursor == pf->end)
+			return NULL;
+		if (pf->end - pf->cursor < (int)sizeof(face))
+			Error("ReadSurfs: truncated face stream");
+
+		memcpy(&face, pf->cursor, sizeof(face));
+		pf->cursor += sizeof(face);
+
+		if (face.planenum == POLYFILE_ENDMODEL)
+			break;
+
+		f = NewValidFace(face.planenum, face.texinfo, face.contents, face.numpoints);
+
+		if (pf->end - pf->cursor < (int)(f->numpoints * sizeof(v)))
+			Error("ReadSurfs: truncated face stream");
+
+		for (i = 0; i < f->numpoints; i++)
+		{
+			memcpy(v, pf->cursor, sizeof(v));
+			pf->cursor += sizeof(v);
+			VectorCopy(v, f->pts[i]);
+		}
+	}
+
+	return SurflistFromValidFaces();
+}
 
 /*
 ===============
-ProcessModel
+OpenPolyfile
+
+Binary files start with a polyfileheader_t, anything else is
+taken to be the text format
 ===============
 */
-qboolean ProcessModel(void)
+void OpenPolyfile(polyfile_t* pf, char* name, int hull)
+{
+	FILE* f;
+	polyfileheader_t header;
+	int length;
+	void* buffer;
+
+	memset(pf, 0, sizeof(*pf));
+
+	f = fopen(name, "rb");
+	if (!f)
+		Error("Can't open %s", name);
+
+	if (fread(&header, sizeof(header), 1, f) != 1 || header.ident != POLYFILE_IDENT)
+	{
+		fclose(f);
+		pf->file = fopen(name, "r");
+		if (!pf->file)
+			Error("Can't open %s", name);
+		return;
+	}
+	fclose(f);
+
+	if (header.version != POLYFILE_VERSION)
+		Error("%s is version %i, not %i", name, header.version, POLYFILE_VERSION);
+	if (header.hull != hull)
+		Error("%s holds hull %i, not hull %i", name, header.hull, hull);
+
+#ifdef WIN32
+	pf->filehandle = CreateFile(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (pf->filehandle != INVALID_HANDLE_VALUE)
+	{
+		length = GetFileSize(pf->filehandle, NULL);
+		pf->maphandle = CreateFileMapping(pf->filehandle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (pf->maphandle)
+			pf->data = reinterpret_cast<byte*>(MapViewOfFile(pf->maphandle, FILE_MAP_READ, 0, 0, 0));
+		if (pf->data)
+		{
+			pf->cursor = pf->data + sizeof(header);
+			pf->end = pf->data + length;
+			return;
+		}
+		if (pf->maphandle)
+			CloseHandle(pf->maphandle);
+		CloseHandle(pf->filehandle);
+		pf->maphandle = NULL;
+		pf->filehandle = NULL;
+	}
+	qprintf("Couldn't map %s, loading it instead\n", name);
+#endif
+
+	length = LoadFile(name, &buffer);
+	pf->data = reinterpret_cast<byte*>(buffer);
+	pf->cursor = pf->data + sizeof(header);
+	pf->end = pf->data + length;
+}
+
+/*
+===============
+ClosePolyfile
+===============
+*/
+void ClosePolyfile(polyfile_t* pf)
+{
+	if (pf->file)
+		fclose(pf->file);
+#ifdef WIN32
+	else if (pf->filehandle)
+	{
+		UnmapViewOfFile(pf->data);
+		CloseHandle(pf->maphandle);
+		CloseHandle(pf->filehandle);
+	}
+#endif
+	else
+		free(pf->data);
+
+	memset(pf, 0, sizeof(*pf));
+}
+
+
+/*
+===============
+ReadModels
+
+The polygon files have to be read in order, so all of
+them are read up front on the main thread
+===============
+*/
+void ReadModels(void)
 {
 	surfchain_t* surfs;
-	node_t* nodes;
-	dmodel_t* model;
-	int startleafs;
+	bspmodel_t* m;
+	int i;
 
-	surfs = ReadSurfs(polyfiles[0]);
+	bspmodels = reinterpret_cast<bspmodel_t*>(calloc(MAX_MAP_MODELS, sizeof(bspmodel_t)));
+	if (!bspmodels)
+		Error("Memory allocation failure");
 
-	if (!surfs)
-		return false; // all models are done
+	numbspmodels = 0;
+	while ((surfs = ReadSurfs(&polyfiles[0])) != NULL)
+	{
+		if (numbspmodels >= MAX_MAP_MODELS)
+			Error("nummodels == MAX_MAP_MODELS");
 
-	VectorCopy(surfs->mins, draw_mins);
-	VectorCopy(surfs->maxs, draw_maxs);
+		m = &bspmodels[numbspmodels];
+		numbspmodels++;
 
-	if (nummodels >= MAX_MAP_MODELS)
-		Error("nummodels == MAX_MAP_MODELS");
+		VectorCopy(surfs->mins, m->mins);
+		VectorCopy(surfs->maxs, m->maxs);
+		m->surfs[0] = surfs;
 
-	startleafs = numleafs;
-	model = &dmodels[nummodels];
-	nummodels++;
+		if (noclip)
+			continue;
+
+		for (i = 1; i < NUM_HULLS; i++)
+		{
+			m->surfs[i] = ReadSurfs(&polyfiles[i]);
+			if (!m->surfs[i])
+				Error("ReadSurfs: hull %i has no model %i", i, numbspmodels - 1);
+		}
+	}
+}
+
+/*
+===============
+BuildModelHull
+
+Builds the tree for one hull of one model.  Each hull only
+depends on its own polygons, so these can run in any order
+===============
+*/
+void BuildModelHull(int work)
+{
+	bspmodel_t* m;
+	surfchain_t* surfs;
+	node_t* nodes;
+
+	m = &bspmodels[work / NUM_HULLS];
+	hullnum = work % NUM_HULLS;
+
+	surfs = m->surfs[hullnum];
+	if (!surfs)
+		return; // -noclip
 
-	VectorCopy(surfs->mins, model->mins);
-	VectorCopy(surfs->maxs, model->maxs);
+	// merge all possible polygons
+	MergeAll(surfs->surfaces);
 
 	//
 	// SolidBSP generates a node tree
@@ -851,11 +1082,41 @@ qboolean ProcessModel(void)
 	// build all the portals in the bsp tree
 	// some portals are solid polygons, and some are paths to other leafs
 	//
-	if (nummodels == 1 && !nofill)		  // assume non-world bmodels are simple
-		nodes = FillOutside(nodes, true); // make a leakfile if bad
+	if (m == bspmodels && !nofill)				 // assume non-world bmodels are simple
+		nodes = FillOutside(nodes, hullnum == 0); // make a leakfile if bad
 
 	FreePortals(nodes);
 
+	m->nodes[hullnum] = nodes;
+}
+
+/*
+===============
+EmitModel
+
+Writes the finished trees in model order so the bsp
+file doesn't depend on which thread finished first
+===============
+*/
+void EmitModel(bspmodel_t* m)
+{
+	node_t* nodes;
+	dmodel_t* model;
+	int startleafs;
+
+	VectorCopy(m->mins, draw_mins);
+	VectorCopy(m->maxs, draw_maxs);
+
+	startleafs = numleafs;
+	model = &dmodels[nummodels];
+	nummodels++;
+
+	VectorCopy(m->mins, model->mins);
+	VectorCopy(m->maxs, model->maxs);
+
+	hullnum = 0;
+	nodes = m->nodes[0];
+
 	// fix tjunctions
 	tjunc(nodes);
 
@@ -866,27 +1127,57 @@ qboolean ProcessModel(void)
 	model->firstface = numfaces;
 	WriteDrawNodes(nodes);
 	model->numfaces = numfaces - model->firstface;
-	;
 	model->visleafs = numleafs - startleafs;
 
 	if (noclip)
-		return true;
+		return;
 
 	//
 	// the clipping hulls are simpler
 	//
 	for (hullnum = 1; hullnum < NUM_HULLS; hullnum++)
 	{
-		surfs = ReadSurfs(polyfiles[hullnum]);
-		nodes = SolidBSP(surfs);
-		if (nummodels == 1 && !nofill) // assume non-world bmodels are simple
-			nodes = FillOutside(nodes, false);
-		FreePortals(nodes);
 		model->headnode[hullnum] = numclipnodes;
-		WriteClipNodes(nodes);
+		WriteClipNodes(m->nodes[hullnum]);
 	}
+}
 
-	return true;
+/*
+===============
+ProcessModels
+===============
+*/
+void ProcessModels(void)
+{
+	int i;
+
+	ReadModels();
+
+	// the world hull 0 is job 0, and the longest, so it starts first
+	if (drawflag)
+	{
+		// the draw window belongs to this thread
+		for (i = 0; i < numbspmodels * NUM_HULLS; i++)
+			BuildModelHull(i);
+	}
+	else
+		RunThreadsOnIndividual(numbspmodels * NUM_HULLS, false, BuildModelHull);
+
+	for (i = 0; i < numbspmodels; i++)
+		EmitModel(&bspmodels[i]);
+
+	free(bspmodels);
+	bspmodels = NULL;
+
+	if (allverbose)
+	{
+		printf("active (peak) after BSP:\n");
+		PrintMemory();
+		PoolPrintStats("BSP");
+	}
+
+	// every tree has been written and freed
+	PoolFreeAll();
 }
 
 /*
@@ -911,9 +1202,7 @@ void ProcessFile(char* bspfilename)
 	for (i = 0; i < NUM_HULLS; i++)
 	{
 		sprintf(name, "%s.p%i", bspfilename, i);
-		polyfiles[i] = fopen(name, "r");
-		if (!polyfiles[i])
-			Error("Can't open %s", name);
+		OpenPolyfile(&polyfiles[i], name, i);
 	}
 
 	// load the output of qcsg
@@ -924,9 +1213,11 @@ void ProcessFile(char* bspfilename)
 	// init the tables to be shared by all models
 	BeginBSPFile();
 
-	// process each model individually
-	while (ProcessModel())
-		;
+	// build every hull of every model, then write them out in order
+	ProcessModels();
+
+	for (i = 0; i < NUM_HULLS; i++)
+		ClosePolyfile(&polyfiles[i]);
 
 	// write the updated bsp file out
 	FinishBSPFile();
@@ -19,9 +19,9 @@
 
 */
 
-int c_leaffaces;
-int c_nodefaces;
-int c_splitnodes;
+thread_local int c_leaffaces;
+thread_local int c_nodefaces;
+thread_local int c_splitnodes;
 
 //============================================================================
 
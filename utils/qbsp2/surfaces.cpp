@@ -24,7 +24,7 @@ the outside filling stage can remove some of them so a better bsp can be generat
 
 */
 
-int subdivides;
+thread_local int subdivides;
 
 
 /*
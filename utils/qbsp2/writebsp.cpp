@@ -29,7 +29,7 @@ int WriteClipNodes_r(node_t* node)
 	{
 		num = node->contents;
 		free(node->markfaces);
-		free(node);
+		FreeNode(node);
 		return num;
 	}
 
@@ -45,7 +45,7 @@ int WriteClipNodes_r(node_t* node)
 	for (i = 0; i < 2; i++)
 		cn->children[i] = WriteClipNodes_r(node->children[i]);
 
-	free(node);
+	FreeNode(node);
 	return c;
 }
 
@@ -221,7 +221,7 @@ void FreeDrawNodes_r(node_t* node)
 		FreeFace(f);
 	}
 
-	free(node);
+	FreeNode(node);
 }
 
 /*
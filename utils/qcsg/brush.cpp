@@ -398,8 +398,7 @@ void AddBrushPlane(expand_t* ex, plane_t* plane)
 			return;
 	}
 
-	nf = reinterpret_cast<bface_t*>(malloc(sizeof(*nf)));
-	memset(nf, 0, sizeof(*nf));
+	nf = AllocFace();
 	nf->planenum = FindIntPlane(plane->inormal, plane->iorigin);
 	nf->plane = &mapplanes[nf->planenum];
 	nf->next = h->faces;
@@ -472,8 +471,7 @@ void TestAddPlane(expand_t* ex, plane_t* plane)
 	}
 
 
-	nf = reinterpret_cast<bface_t*>(malloc(sizeof(*nf)));
-	memset(nf, 0, sizeof(*nf));
+	nf = AllocFace();
 	nf->planenum = FindIntPlane(plane->inormal, plane->iorigin);
 	nf->plane = &mapplanes[nf->planenum];
 	nf->next = h->faces;
@@ -641,8 +639,7 @@ void ExpandBrush(brush_t* b, int hullnum)
 				corner = 0;
 			iorigin[x] += p->normal[x] * corner;
 		}
-		nf = reinterpret_cast<bface_t*>(malloc(sizeof(*nf)));
-		memset(nf, 0, sizeof(*nf));
+		nf = AllocFace();
 
 		nf->planenum = FindIntPlane(inormal, iorigin);
 		nf->plane = &mapplanes[nf->planenum];
@@ -840,8 +837,7 @@ qboolean MakeBrushPlanes(brush_t* b)
 			}
 		}
 
-		f = reinterpret_cast<bface_t*>(malloc(sizeof(*f)));
-		memset(f, 0, sizeof(*f));
+		f = AllocFace();
 
 		f->planenum = planenum;
 		f->plane = &mapplanes[planenum];
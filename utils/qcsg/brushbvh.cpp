@@ -0,0 +1,250 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+#include "csg.h"
+
+/*
+===================================================================
+
+BRUSH BOUNDING VOLUME HIERARCHY
+
+Built for one entity at a time, once its brushes have been sorted by
+contents, so CSGBrush only has to look at the brushes whose bounds
+touch the one being clipped instead of every brush in the entity.
+===================================================================
+*/
+
+#define BVH_LEAF_BRUSHES 4
+#define MAX_BVH_DEPTH 128
+
+brushbvh_t brushbvh[NUM_HULLS];
+
+static int bvhfirstbrush;
+static int bvhhull;
+static int bvhaxis;
+
+/*
+==============
+BrushHull
+==============
+*/
+static brushhull_t* BrushHull(int bn)
+{
+	return &mapbrushes[bvhfirstbrush + bn].hulls[bvhhull];
+}
+
+/*
+==============
+CompareBrushCenters
+==============
+*/
+static int CompareBrushCenters(const void* a, const void* b)
+{
+	brushhull_t *h1, *h2;
+	vec_t c1, c2;
+
+	h1 = BrushHull(*(const int*)a);
+	h2 = BrushHull(*(const int*)b);
+	c1 = h1->mins[bvhaxis] + h1->maxs[bvhaxis];
+	c2 = h2->mins[bvhaxis] + h2->maxs[bvhaxis];
+
+	if (c1 < c2)
+		return -1;
+	if (c1 > c2)
+		return 1;
+	return *(const int*)a - *(const int*)b;
+}
+
+/*
+==============
+BuildBrushBVH_r
+
+Median split on the longest axis of the brush centers
+==============
+*/
+static int BuildBrushBVH_r(brushbvh_t* bvh, int first, int count)
+{
+	bvhnode_t* node;
+	brushhull_t* h;
+	vec3_t cmins, cmaxs, center;
+	vec_t size, bestsize;
+	int i, nodenum, half;
+
+	nodenum = bvh->numnodes++;
+	node = &bvh->nodes[nodenum];
+
+	ClearBounds(node->mins, node->maxs);
+	ClearBounds(cmins, cmaxs);
+	for (i = 0; i < count; i++)
+	{
+		h = BrushHull(bvh->brushes[first + i]);
+		AddPointToBounds(h->mins, node->mins, node->maxs);
+		AddPointToBounds(h->maxs, node->mins, node->maxs);
+		VectorAdd(h->mins, h->maxs, center);
+		AddPointToBounds(center, cmins, cmaxs);
+	}
+
+	node->children[0] = node->children[1] = -1;
+	node->firstbrush = first;
+	node->numbrushes = count;
+
+	if (count <= BVH_LEAF_BRUSHES)
+		return nodenum;
+
+	bvhaxis = 0;
+	bestsize = -1;
+	for (i = 0; i < 3; i++)
+	{
+		size = cmaxs[i] - cmins[i];
+		if (size > bestsize)
+		{
+			bestsize = size;
+			bvhaxis = i;
+		}
+	}
+
+	qsort(&bvh->brushes[first], count, sizeof(int), CompareBrushCenters);
+
+	half = count / 2;
+	node->numbrushes = 0;
+	node->children[0] = BuildBrushBVH_r(bvh, first, half);
+	node->children[1] = BuildBrushBVH_r(bvh, first + half, count - half);
+
+	return nodenum;
+}
+
+/*
+==============
+BuildBrushBVH
+
+Only brushes that are present in a hull go into its tree
+==============
+*/
+void BuildBrushBVH(entity_t* e)
+{
+	brushbvh_t* bvh;
+	int hull, bn;
+
+	bvhfirstbrush = e->firstbrush;
+
+	for (hull = 0; hull < NUM_HULLS; hull++)
+	{
+		bvh = &brushbvh[hull];
+		bvh->firstbrush = e->firstbrush;
+		bvhhull = hull;
+
+		bvh->brushes = reinterpret_cast<int*>(malloc((e->numbrushes + 1) * sizeof(int)));
+		bvh->nodes = reinterpret_cast<bvhnode_t*>(malloc((2 * e->numbrushes + 1) * sizeof(bvhnode_t)));
+		if (!bvh->brushes || !bvh->nodes)
+			Error("BuildBrushBVH: out of memory");
+
+		bvh->numbrushes = 0;
+		for (bn = 0; bn < e->numbrushes; bn++)
+		{
+			if (BrushHull(bn)->faces)
+				bvh->brushes[bvh->numbrushes++] = bn;
+		}
+
+		bvh->numnodes = 0;
+		if (bvh->numbrushes)
+			BuildBrushBVH_r(bvh, 0, bvh->numbrushes);
+
+		qprintf("hull %i: %i brushes, %i bvh nodes\n", hull, bvh->numbrushes, bvh->numnodes);
+	}
+}
+
+/*
+==============
+FreeBrushBVH
+==============
+*/
+void FreeBrushBVH(void)
+{
+	int hull;
+
+	for (hull = 0; hull < NUM_HULLS; hull++)
+	{
+		free(brushbvh[hull].brushes);
+		free(brushbvh[hull].nodes);
+		memset(&brushbvh[hull], 0, sizeof(brushbvh[hull]));
+	}
+}
+
+/*
+==============
+CompareBrushNumbers
+==============
+*/
+static int CompareBrushNumbers(const void* a, const void* b)
+{
+	return *(const int*)a - *(const int*)b;
+}
+
+/*
+==============
+BrushesInBounds
+
+Fills list with the entity relative numbers of every brush in the
+hull whose bounds touch mins / maxs, in increasing order, so the
+caller sees them in the same order as a linear walk would.
+Safe to call from several threads at once.
+==============
+*/
+int BrushesInBounds(int hull, vec3_t mins, vec3_t maxs, int* list)
+{
+	brushbvh_t* bvh;
+	bvhnode_t* node;
+	brushhull_t* h;
+	int stack[MAX_BVH_DEPTH];
+	int stackdepth, count, i, j, bn;
+
+	bvh = &brushbvh[hull];
+	if (!bvh->numnodes)
+		return 0;
+
+	count = 0;
+	stackdepth = 0;
+	stack[stackdepth++] = 0;
+
+	while (stackdepth)
+	{
+		node = &bvh->nodes[stack[--stackdepth]];
+
+		for (i = 0; i < 3; i++)
+			if (mins[i] > node->maxs[i] || maxs[i] < node->mins[i])
+				break;
+		if (i < 3)
+			continue;
+
+		if (node->children[0] == -1)
+		{
+			for (j = 0; j < node->numbrushes; j++)
+			{
+				bn = bvh->brushes[node->firstbrush + j];
+				h = &mapbrushes[bvh->firstbrush + bn].hulls[hull];
+				for (i = 0; i < 3; i++)
+					if (mins[i] > h->maxs[i] || maxs[i] < h->mins[i])
+						break;
+				if (i == 3)
+					list[count++] = bn;
+			}
+			continue;
+		}
+
+		if (stackdepth + 2 > MAX_BVH_DEPTH)
+			Error("BrushesInBounds: MAX_BVH_DEPTH");
+		stack[stackdepth++] = node->children[1];
+		stack[stackdepth++] = node->children[0];
+	}
+
+	qsort(list, count, sizeof(int), CompareBrushNumbers);
+
+	return count;
+}
@@ -15,6 +15,8 @@
 #include "polylib.h"
 #include "threads.h"
 #include "bspfile.h"
+#include "polyfile.h"
+#include "mempool.h"
 
 #include <windows.h>
 
@@ -130,8 +132,35 @@ int BrushContents(brush_t* b);
 
 //=============================================================================
 
+// brushbvh.c
+
+typedef struct
+{
+	vec3_t mins, maxs;
+	int children[2];			// -1 for leafs
+	int firstbrush, numbrushes; // leafs only, into brushbvh_t brushes
+} bvhnode_t;
+
+typedef struct
+{
+	int firstbrush; // of the entity
+	int numbrushes;
+	int* brushes; // entity relative brush numbers
+	int numnodes;
+	bvhnode_t* nodes;
+} brushbvh_t;
+
+extern brushbvh_t brushbvh[NUM_HULLS];
+
+void BuildBrushBVH(entity_t* e);
+void FreeBrushBVH(void);
+int BrushesInBounds(int hull, vec3_t mins, vec3_t maxs, int* list);
+
+//=============================================================================
+
 // csg.c
 
+bface_t* AllocFace(void);
 bface_t* NewFaceFromFace(bface_t* in);
 extern qboolean onlyents;
 
@@ -33,12 +33,28 @@ qboolean hullfile = false;
 static char qhullfile[256];
 
 qboolean glview;
+qboolean textpolys;
 qboolean noclip;
 qboolean onlyents;
 qboolean wadtextures = true;
 
 vec3_t world_mins, world_maxs;
 
+/*
+==================
+AllocFace
+==================
+*/
+bface_t* AllocFace(void)
+{
+	bface_t* f;
+
+	f = reinterpret_cast<bface_t*>(PoolAlloc(sizeof(bface_t)));
+	memset(f, 0, sizeof(bface_t));
+
+	return f;
+}
+
 /*
 ==================
 NewFaceFromFace
@@ -50,8 +66,7 @@ bface_t* NewFaceFromFace(bface_t* in)
 {
 	bface_t* newf;
 
-	newf = reinterpret_cast<bface_t*>(malloc(sizeof(bface_t)));
-	memset(newf, 0, sizeof(newf));
+	newf = AllocFace();
 	newf->contents = in->contents;
 	newf->texinfo = in->texinfo;
 	newf->planenum = in->planenum;
@@ -62,8 +77,8 @@ bface_t* NewFaceFromFace(bface_t* in)
 
 void FreeFace(bface_t* f)
 {
-	free(f->w);
-	free(f);
+	FreeWinding(f->w);
+	PoolFree(f);
 }
 
 
@@ -200,9 +215,9 @@ void WriteFace(int hull, bface_t* f)
 		}
 		fprintf(out[hull], "\n");
 	}
-	else
+	else if (textpolys)
 	{
-		// .p0 format
+		// .p0 text format
 		w = f->w;
 		fprintf(out[hull], "%i %i %i %i\n", f->planenum, f->texinfo, f->contents, w->numpoints);
 		for (i = 0; i < w->numpoints; i++)
@@ -214,10 +229,77 @@ void WriteFace(int hull, bface_t* f)
 		}
 		fprintf(out[hull], "\n");
 	}
+	else
+	{
+		// .p0 binary format
+		polyfileface_t face;
+		double v[3];
+
+		w = f->w;
+		face.planenum = f->planenum;
+		face.texinfo = f->texinfo;
+		face.contents = f->contents;
+		face.numpoints = w->numpoints;
+		fwrite(&face, sizeof(face), 1, out[hull]);
+		for (i = 0; i < w->numpoints; i++)
+		{
+			VectorCopy(w->p[i], v);
+			fwrite(v, sizeof(v), 1, out[hull]);
+		}
+	}
 
 	ThreadUnlock();
 }
 
+/*
+===========
+WriteEndOfModel
+===========
+*/
+void WriteEndOfModel(int hull)
+{
+	polyfileface_t face;
+
+	if (textpolys)
+	{
+		fprintf(out[hull], "-1 -1 -1 -1\n");
+		return;
+	}
+
+	memset(&face, 0, sizeof(face));
+	face.planenum = POLYFILE_ENDMODEL;
+	fwrite(&face, sizeof(face), 1, out[hull]);
+}
+
+/*
+===========
+OpenPolyfile
+===========
+*/
+void OpenPolyfile(int hull, char* source)
+{
+	char name[1024];
+	polyfileheader_t header;
+
+	if (glview)
+		sprintf(name, "%s.gl%i", source, hull);
+	else
+		sprintf(name, "%s.p%i", source, hull);
+
+	out[hull] = fopen(name, glview || textpolys ? "w" : "wb");
+	if (!out[hull])
+		Error("Couldn't open %s", name);
+
+	if (glview || textpolys)
+		return;
+
+	memset(&header, 0, sizeof(header));
+	header.ident = POLYFILE_IDENT;
+	header.version = POLYFILE_VERSION;
+	header.hull = hull;
+	fwrite(&header, sizeof(header), 1, out[hull]);
+}
+
 /*
 ==================
 SaveOutside
@@ -372,7 +454,8 @@ void CSGBrush(int brushnum)
 	brushhull_t *bh1, *bh2;
 	int bn;
 	qboolean overwrite;
-	int i;
+	int i, c, numcandidates;
+	int* candidates;
 	bface_t *f, *f2, *next, *fcopy;
 	bface_t *outside, *oldoutside;
 	entity_t* e;
@@ -384,37 +467,33 @@ void CSGBrush(int brushnum)
 
 	e = &entities[b1->entitynum];
 
+	candidates = reinterpret_cast<int*>(malloc((e->numbrushes + 1) * sizeof(int)));
+	if (!candidates)
+		Error("CSGBrush: out of memory");
+
 	for (hull = 0; hull < NUM_HULLS; hull++)
 	{
 		bh1 = &b1->hulls[hull];
 
 		// set outside to a copy of the brush's faces
 		outside = CopyFacesToOutside(bh1);
-		overwrite = false;
 
-		for (bn = 0; bn < e->numbrushes; bn++)
+		// only the brushes in this hull whose bounding boxes touch b1,
+		// in brush order
+		numcandidates = bh1->faces ? BrushesInBounds(hull, bh1->mins, bh1->maxs, candidates) : 0;
+
+		for (c = 0; c < numcandidates; c++)
 		{
 			// see if b2 needs to clip a chunk out of b1
+			bn = candidates[c];
 
 			if (bn == brushnum)
-			{
-				overwrite = true; // later brushes now overwrite
 				continue;
-			}
+			overwrite = bn > brushnum; // later brushes overwrite
 
 			b2 = &mapbrushes[e->firstbrush + bn];
 			bh2 = &b2->hulls[hull];
 
-			if (!bh2->faces)
-				continue; // brush isn't in this hull
-
-			// check brush bounding box first
-			for (i = 0; i < 3; i++)
-				if (bh1->mins[i] > bh2->maxs[i] || bh1->maxs[i] < bh2->mins[i])
-					break;
-			if (i < 3)
-				continue;
-
 			// divide faces by the planes of the b2 to find which
 			// fragments are inside
 
@@ -490,6 +569,8 @@ void CSGBrush(int brushnum)
 		// all of the faces left in outside are real surface faces
 		SaveOutside(b1, hull, outside, b1->contents);
 	}
+
+	free(candidates);
 }
 
 //======================================================================
@@ -650,6 +731,8 @@ void ProcessModels(void)
 			}
 		}
 
+		BuildBrushBVH(&entities[i]);
+
 		//
 		// csg them in order
 		//
@@ -663,11 +746,13 @@ void ProcessModels(void)
 				CSGBrush(first + j);
 		}
 
+		FreeBrushBVH();
+
 		// write end of model marker
 		if (!glview)
 		{
 			for (j = 0; j < NUM_HULLS; j++)
-				fprintf(out[j], "-1 -1 -1 -1\n");
+				WriteEndOfModel(j);
 		}
 	}
 }
@@ -733,6 +818,11 @@ int main(int argc, char** argv)
 		{
 			glview = true;
 		}
+		else if (!strcmp(argv[i], "-textpolys"))
+		{
+			printf("textpolys = true\n");
+			textpolys = true;
+		}
 		else if (!strcmp(argv[i], "-v"))
 		{
 			printf("verbose = true\n");
@@ -781,7 +871,7 @@ int main(int argc, char** argv)
 	}
 
 	if (i != argc - 1)
-		Error("usage: qcsg [-nowadtextures] [-wadinclude <name>] [-draw] [-glview] [-noclip] [-onlyents] [-proj <name>] [-threads #] [-v] [-hullfile <name>] mapfile");
+		Error("usage: qcsg [-nowadtextures] [-wadinclude <name>] [-draw] [-glview] [-textpolys] [-noclip] [-onlyents] [-proj <name>] [-threads #] [-v] [-hullfile <name>] mapfile");
 
 	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_ABOVE_NORMAL);
 	start = I_FloatTime();
@@ -830,17 +920,7 @@ int main(int argc, char** argv)
 	qprintf("%5i map planes\n", nummapplanes);
 
 	for (i = 0; i < NUM_HULLS; i++)
-	{
-		char hullName[1024];
-
-		if (glview)
-			sprintf(hullName, "%s.gl%i", source, i);
-		else
-			sprintf(hullName, "%s.p%i", source, i);
-		out[i] = fopen(hullName, "w");
-		if (!out[i])
-			Error("Couldn't open %s", hullName);
-	}
+		OpenPolyfile(i, source);
 
 	ProcessModels();
 
@@ -849,8 +929,17 @@ int main(int argc, char** argv)
 	qprintf("%5i tiny faces\n", c_tiny);
 	qprintf("%5i tiny clips\n", c_tiny_clip);
 
+	// the brushes and their fragments are finished with
+	if (verbose)
+		PoolPrintStats("CSG");
+	PoolFreeAll();
+
 	for (i = 0; i < NUM_HULLS; i++)
+	{
+		if (ferror(out[i]))
+			Error("Error writing hull %i polygons", i);
 		fclose(out[i]);
+	}
 
 	if (!glview)
 	{
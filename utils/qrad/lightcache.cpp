@@ -0,0 +1,288 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+#include "qrad.h"
+
+/*
+===================================================================
+
+DIRECT LIGHT CACHE
+
+Saved as <map>.r3 by incremental runs.  It is only valid as long as
+the geometry, the sampling options and everything about the direct
+lights except their intensity are unchanged.  Any other change
+(moving, adding or removing a light) rebuilds it from scratch.
+===================================================================
+*/
+
+#define LIGHTCACHE_IDENT (('C' << 24) + ('L' << 16) + ('D' << 8) + 'Q') // little-endian "QDLC"
+#define LIGHTCACHE_VERSION 1
+
+#define NUM_GEOMETRY_CHECKSUMS 13
+
+typedef struct
+{
+	int ident;
+	int version;
+	int checksums[NUM_GEOMETRY_CHECKSUMS];
+	int numfaces;
+	int numdlights;
+	int extra;
+	int skyambient;
+	float smoothing_threshold;
+} lightcacheheader_t;
+
+// everything about a direct light that the cached ratios depend on
+typedef struct
+{
+	int type;
+	int style;
+	float origin[3];
+	float normal[3];
+	float stopdot;
+	float stopdot2;
+} lightkey_t;
+
+lightcache_t lightcache = lightcache_t::off;
+facelightcache_t facelightcache[MAX_MAP_FACES];
+
+/*
+==============
+AddLightContrib
+
+Only called by the thread that owns the face
+==============
+*/
+void AddLightContrib(facelightcache_t* fc, int light, float ratio)
+{
+	if (fc->numcontribs == fc->maxcontribs)
+	{
+		fc->maxcontribs = fc->maxcontribs ? fc->maxcontribs * 2 : 256;
+		fc->contribs = reinterpret_cast<lightcontrib_t*>(realloc(fc->contribs, fc->maxcontribs * sizeof(lightcontrib_t)));
+		if (!fc->contribs)
+			Error("Memory allocation failure");
+	}
+
+	fc->contribs[fc->numcontribs].light = light;
+	fc->contribs[fc->numcontribs].ratio = ratio;
+	fc->numcontribs++;
+}
+
+/*
+==============
+FreeLightCache
+==============
+*/
+void FreeLightCache(void)
+{
+	int i;
+
+	for (i = 0; i < numfaces; i++)
+	{
+		free(facelightcache[i].contribs);
+		memset(&facelightcache[i], 0, sizeof(facelightcache[i]));
+	}
+}
+
+/*
+==============
+MakeLightCacheHeader
+==============
+*/
+static void MakeLightCacheHeader(lightcacheheader_t* header)
+{
+	memset(header, 0, sizeof(*header));
+
+	header->ident = LIGHTCACHE_IDENT;
+	header->version = LIGHTCACHE_VERSION;
+
+	header->checksums[0] = dmodels_checksum;
+	header->checksums[1] = dvertexes_checksum;
+	header->checksums[2] = dplanes_checksum;
+	header->checksums[3] = dleafs_checksum;
+	header->checksums[4] = dnodes_checksum;
+	header->checksums[5] = texinfo_checksum;
+	header->checksums[6] = dclipnodes_checksum;
+	header->checksums[7] = dfacegeometry_checksum;
+	header->checksums[8] = dmarksurfaces_checksum;
+	header->checksums[9] = dsurfedges_checksum;
+	header->checksums[10] = dedges_checksum;
+	header->checksums[11] = dtexdata_checksum;
+	header->checksums[12] = dvisdata_checksum;
+
+	header->numfaces = numfaces;
+	header->numdlights = numdlights;
+	header->extra = extra;
+	header->skyambient = indirect_sun != 0.0;
+	header->smoothing_threshold = smoothing_threshold;
+}
+
+/*
+==============
+MakeLightKey
+==============
+*/
+static void MakeLightKey(directlight_t* dl, lightkey_t* key)
+{
+	int i;
+
+	memset(key, 0, sizeof(*key));
+
+	key->type = static_cast<int>(dl->type);
+	key->style = dl->style;
+	for (i = 0; i < 3; i++)
+	{
+		key->origin[i] = dl->origin[i];
+		key->normal[i] = dl->normal[i];
+	}
+	key->stopdot = dl->stopdot;
+	key->stopdot2 = dl->stopdot2;
+}
+
+/*
+==============
+SaveLightCache
+==============
+*/
+void SaveLightCache(char* filename)
+{
+	FILE* f;
+	lightcacheheader_t header;
+	lightkey_t key;
+	facelightcache_t* fc;
+	int i;
+	long totalcontribs = 0;
+	qboolean ok;
+
+	if ((f = fopen(filename, "wb")) == NULL)
+	{
+		printf("WARNING: Couldn't write light cache [%s]\n", filename);
+		return;
+	}
+
+	qprintf("Writing [%s] with new saved qrad data", filename);
+
+	MakeLightCacheHeader(&header);
+	ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+	for (i = 0; ok && i < numdlights; i++)
+	{
+		MakeLightKey(dlightlist[i], &key);
+		ok = fwrite(&key, sizeof(key), 1, f) == 1;
+	}
+
+	for (i = 0, fc = facelightcache; ok && i < numfaces; i++, fc++)
+	{
+		ok = fwrite(&fc->numcontribs, sizeof(fc->numcontribs), 1, f) == 1 && (!fc->numcontribs || fwrite(fc->contribs, sizeof(lightcontrib_t), fc->numcontribs, f) == (size_t)fc->numcontribs);
+		totalcontribs += fc->numcontribs;
+	}
+
+	fclose(f);
+
+	if (!ok)
+	{
+		printf("\nWARNING: Failed writing light cache [%s]\n", filename);
+		unlink(filename);
+		return;
+	}
+
+	qprintf("(%.3fMB)\n", (sizeof(header) + numdlights * sizeof(key) + numfaces * sizeof(int) + totalcontribs * sizeof(lightcontrib_t)) / (1024.0 * 1024.0));
+}
+
+/*
+==============
+LoadLightCache
+
+Returns false, leaving the cache empty, if the file is missing
+or was made for different geometry, options or lights
+==============
+*/
+qboolean LoadLightCache(char* filename)
+{
+	FILE* f;
+	lightcacheheader_t header, fileheader;
+	lightkey_t key, filekey;
+	facelightcache_t* fc;
+	int i;
+	const char* reason = NULL;
+
+	if ((f = fopen(filename, "rb")) == NULL)
+		return false;
+
+	printf("%-20s Restoring [%-13s - ", "BuildFacelights:", filename);
+
+	MakeLightCacheHeader(&header);
+	if (fread(&fileheader, sizeof(fileheader), 1, f) != 1 || fileheader.ident != LIGHTCACHE_IDENT || fileheader.version != LIGHTCACHE_VERSION)
+		reason = "bad header";
+	else if (memcmp(header.checksums, fileheader.checksums, sizeof(header.checksums)) || header.numfaces != fileheader.numfaces)
+		reason = "geometry changed";
+	else if (header.extra != fileheader.extra || header.skyambient != fileheader.skyambient || header.smoothing_threshold != fileheader.smoothing_threshold)
+		reason = "options changed";
+	else if (header.numdlights != fileheader.numdlights)
+		reason = "lights added or removed";
+
+	for (i = 0; !reason && i < numdlights; i++)
+	{
+		MakeLightKey(dlightlist[i], &key);
+		if (fread(&filekey, sizeof(filekey), 1, f) != 1)
+			reason = "truncated";
+		else if (memcmp(&key, &filekey, sizeof(key)))
+			reason = "lights moved";
+	}
+
+	for (i = 0, fc = facelightcache; !reason && i < numfaces; i++, fc++)
+	{
+		if (fread(&fc->numcontribs, sizeof(fc->numcontribs), 1, f) != 1 || fc->numcontribs < 0)
+		{
+			reason = "truncated";
+			break;
+		}
+
+		fc->maxcontribs = fc->numcontribs;
+		fc->cursor = 0;
+
+		if (!fc->numcontribs)
+			continue;
+
+		fc->contribs = reinterpret_cast<lightcontrib_t*>(malloc(fc->numcontribs * sizeof(lightcontrib_t)));
+		if (!fc->contribs)
+			Error("Memory allocation failure");
+
+		if (fread(fc->contribs, sizeof(lightcontrib_t), fc->numcontribs, f) != (size_t)fc->numcontribs)
+		{
+			reason = "truncated";
+			break;
+		}
+
+		for (int j = 0; j < fc->numcontribs; j++)
+		{
+			int light = fc->contribs[j].light;
+			if (light < LIGHTCONTRIB_END)
+				light = LIGHTCONTRIB_SKYLIGHT(light);
+			if (light >= numdlights)
+			{
+				reason = "bad light index";
+				break;
+			}
+		}
+	}
+
+	fclose(f);
+
+	if (reason)
+	{
+		printf("%s] Cache will be rebuilt.\n", reason);
+		FreeLightCache();
+		return false;
+	}
+
+	printf("%10.3fMB]\n", getfilesize(filename) / (1024.0 * 1024.0));
+	return true;
+}
@@ -787,6 +787,7 @@ typedef struct
 } facelight_t;
 
 directlight_t* directlights[MAX_MAP_LEAFS];
+directlight_t** dlightlist;
 facelight_t facelight[MAX_MAP_FACES];
 int numdlights;
 
@@ -838,8 +839,8 @@ void CreateDirectLights(void)
 	{
 		if (VectorAvg(p->totallight) >= dlight_threshold)
 		{
-			numdlights++;
 			dl = reinterpret_cast<directlight_t*>(calloc(1, sizeof(directlight_t)));
+			dl->index = numdlights++;
 
 			VectorCopy(p->origin, dl->origin);
 
@@ -874,8 +875,8 @@ void CreateDirectLights(void)
 		if (strncmp(name, "light", 5))
 			continue;
 
-		numdlights++;
 		dl = reinterpret_cast<directlight_t*>(calloc(1, sizeof(directlight_t)));
+		dl->index = numdlights++;
 
 		GetVectorForKey(e, "origin", dl->origin);
 
@@ -1014,6 +1015,17 @@ void CreateDirectLights(void)
 		}
 	}
 
+	//
+	// index the lights so the light cache can refer to them
+	//
+	dlightlist = reinterpret_cast<directlight_t**>(calloc(max(numdlights, 1), sizeof(directlight_t*)));
+	if (!dlightlist)
+		Error("Memory allocation failure");
+
+	for (leafnum = 0; leafnum < numleafs; leafnum++)
+		for (dl = directlights[leafnum]; dl; dl = dl->next)
+			dlightlist[dl->index] = dl;
+
 	qprintf("%i direct lights\n", numdlights);
 }
 
@@ -1034,6 +1046,9 @@ void DeleteDirectLights(void)
 			directlights[l] = dl->next;
 			free(dl);
 		}
+
+	free(dlightlist);
+	dlightlist = NULL;
 }
 
 /*
@@ -1048,7 +1063,44 @@ float r_avertexnormals[NUMVERTEXNORMALS][3] = {
 
 #define VectorMaximum(a) (max((a)[0], max((a)[1], (a)[2])))
 
-void GatherSampleLight(vec3_t pos, byte* pvs, vec3_t normal, vec3_t* sample, byte* styles)
+/*
+=============
+AddStyleLight
+
+Adds light to the lightmap of the given style, allocating
+a style slot on the face if this is the first light of that style
+=============
+*/
+void AddStyleLight(vec3_t pos, int style, vec3_t add, vec3_t* sample, byte* styles)
+{
+	int style_index;
+
+	for (style_index = 0; style_index < MAXLIGHTMAPS; style_index++)
+		if (styles[style_index] == style || styles[style_index] == 255)
+			break;
+
+	if (style_index == MAXLIGHTMAPS)
+	{
+		printf("WARNING: Too many direct light styles on a face(%f,%f,%f)\n",
+			pos[0], pos[1], pos[2]);
+		return;
+	}
+
+	if (styles[style_index] == 255)
+		styles[style_index] = style;
+
+	VectorAdd(sample[style_index], add, sample[style_index]);
+}
+
+/*
+=============
+GatherSampleLight
+
+If fc is set, every unoccluded light is recorded in the light cache,
+including those currently too dim to be added to the sample
+=============
+*/
+void GatherSampleLight(vec3_t pos, byte* pvs, vec3_t normal, vec3_t* sample, byte* styles, facelightcache_t* fc)
 {
 	int i;
 	directlight_t* l;
@@ -1057,7 +1109,6 @@ void GatherSampleLight(vec3_t pos, byte* pvs, vec3_t normal, vec3_t* sample, byt
 	float dot, dot2;
 	float dist;
 	float ratio;
-	int style_index;
 	directlight_t* sky_used = NULL;
 
 	for (i = 1; i < numleafs; i++)
@@ -1085,7 +1136,7 @@ void GatherSampleLight(vec3_t pos, byte* pvs, vec3_t normal, vec3_t* sample, byt
 					if (TestLine_r(0, pos, delta) != CONTENTS_SKY)
 						continue; // occluded
 
-					VectorScale(l->intensity, dot, add);
+					ratio = dot;
 				}
 				else
 				{
@@ -1102,7 +1153,6 @@ void GatherSampleLight(vec3_t pos, byte* pvs, vec3_t normal, vec3_t* sample, byt
 					{
 					case emittype_t::point:
 						ratio = dot / (dist * dist);
-						VectorScale(l->intensity, ratio, add);
 						break;
 
 					case emittype_t::surface:
@@ -1110,7 +1160,6 @@ void GatherSampleLight(vec3_t pos, byte* pvs, vec3_t normal, vec3_t* sample, byt
 						if (dot2 <= ON_EPSILON / 10)
 							continue; // behind light surface
 						ratio = dot * dot2 / (dist * dist);
-						VectorScale(l->intensity, ratio, add);
 						break;
 
 					case emittype_t::spotlight:
@@ -1120,34 +1169,30 @@ void GatherSampleLight(vec3_t pos, byte* pvs, vec3_t normal, vec3_t* sample, byt
 						ratio = dot * dot2 / (dist * dist);
 						if (dot2 <= l->stopdot)
 							ratio *= (dot2 - l->stopdot2) / (l->stopdot - l->stopdot2);
-						VectorScale(l->intensity, ratio, add);
 						break;
 					default:
 						Error("Bad l->type");
 					}
 				}
 
-				if (VectorMaximum(add) > (l->style ? coring : 0))
+				VectorScale(l->intensity, ratio, add);
+
+				if (fc)
 				{
 					if (l->type != emittype_t::skylight && TestLine_r(0, pos, l->origin) != CONTENTS_EMPTY)
 						continue; // occluded
 
+					AddLightContrib(fc, l->index, ratio);
 
-					for (style_index = 0; style_index < MAXLIGHTMAPS; style_index++)
-						if (styles[style_index] == l->style || styles[style_index] == 255)
-							break;
-
-					if (style_index == MAXLIGHTMAPS)
-					{
-						printf("WARNING: Too many direct light styles on a face(%f,%f,%f)\n",
-							pos[0], pos[1], pos[2]);
-						continue;
-					}
-
-					if (styles[style_index] == 255)
-						styles[style_index] = l->style;
+					if (VectorMaximum(add) > (l->style ? coring : 0))
+						AddStyleLight(pos, l->style, add, sample, styles);
+				}
+				else if (VectorMaximum(add) > (l->style ? coring : 0))
+				{
+					if (l->type != emittype_t::skylight && TestLine_r(0, pos, l->origin) != CONTENTS_EMPTY)
+						continue; // occluded
 
-					VectorAdd(sample[style_index], add, sample[style_index]);
+					AddStyleLight(pos, l->style, add, sample, styles);
 				}
 			}
 		}
@@ -1156,11 +1201,8 @@ void GatherSampleLight(vec3_t pos, byte* pvs, vec3_t normal, vec3_t* sample, byt
 	{
 		vec3_t total;
 		int j;
-		vec3_t sky_intensity;
+		float visible = 0;
 
-		VectorScale(sky_used->intensity, indirect_sun / (NUMVERTEXNORMALS * 2), sky_intensity);
-
-		total[0] = total[1] = total[2] = 0.0;
 		for (j = 0; j < NUMVERTEXNORMALS; j++)
 		{
 			// make sure the angle is okay
@@ -1174,28 +1216,59 @@ void GatherSampleLight(vec3_t pos, byte* pvs, vec3_t normal, vec3_t* sample, byt
 			if (TestLine_r(0, pos, delta) != CONTENTS_SKY)
 				continue; // occluded
 
-			VectorScale(sky_intensity, dot, add);
-			VectorAdd(total, add, total);
+			visible += dot;
 		}
+
+		ratio = visible / (NUMVERTEXNORMALS * 2);
+		if (fc && ratio > 0)
+			AddLightContrib(fc, LIGHTCONTRIB_SKYAMBIENT(sky_used->index), ratio);
+
+		VectorScale(sky_used->intensity, indirect_sun * ratio, total);
 		if (VectorMaximum(total) > 0)
-		{
-			for (style_index = 0; style_index < MAXLIGHTMAPS; style_index++)
-				if (styles[style_index] == sky_used->style || styles[style_index] == 255)
-					break;
+			AddStyleLight(pos, sky_used->style, total, sample, styles);
+	}
 
-			if (style_index == MAXLIGHTMAPS)
-			{
-				printf("WARNING: Too many direct light styles on a face(%f,%f,%f)\n",
-					pos[0], pos[1], pos[2]);
-				return;
-			}
+	if (fc)
+		AddLightContrib(fc, LIGHTCONTRIB_END, 0);
+}
 
-			if (styles[style_index] == 255)
-				styles[style_index] = sky_used->style;
+/*
+=============
+ReplaySampleLight
 
-			VectorAdd(sample[style_index], total, sample[style_index]);
+Recombines one sample gather from the light cache
+using the current light intensities
+=============
+*/
+void ReplaySampleLight(vec3_t pos, vec3_t* sample, byte* styles, facelightcache_t* fc)
+{
+	lightcontrib_t* c;
+	directlight_t* l;
+	vec3_t add;
+
+	while (fc->cursor < fc->numcontribs)
+	{
+		c = &fc->contribs[fc->cursor++];
+		if (c->light == LIGHTCONTRIB_END)
+			return;
+
+		if (c->light < LIGHTCONTRIB_END)
+		{
+			l = dlightlist[LIGHTCONTRIB_SKYLIGHT(c->light)];
+			VectorScale(l->intensity, indirect_sun * c->ratio, add);
+			if (VectorMaximum(add) > 0)
+				AddStyleLight(pos, l->style, add, sample, styles);
+		}
+		else
+		{
+			l = dlightlist[c->light];
+			VectorScale(l->intensity, c->ratio, add);
+			if (VectorMaximum(add) > (l->style ? coring : 0))
+				AddStyleLight(pos, l->style, add, sample, styles);
 		}
 	}
+
+	Error("ReplaySampleLight: light cache overrun");
 }
 
 /*
@@ -1349,6 +1422,7 @@ void BuildFacelights(int facenum)
 	int thisoffset = -1, lastoffset = -1;
 	int lightmapwidth, lightmapheight, size;
 	vec3_t centroid = {0, 0, 0};
+	facelightcache_t* fc = lightcache != lightcache_t::off ? &facelightcache[facenum] : NULL;
 
 	f = &dfaces[facenum];
 
@@ -1450,8 +1524,13 @@ void BuildFacelights(int facenum)
 						VectorAdd(pos, l.surfpt[subsample], pos);
 						VectorScale(pos, 1.0 / 3.0, pos);
 
-						GetPhongNormal(facenum, pos, pointnormal);
-						GatherSampleLight(pos, pvs, pointnormal, subsampled, f->styles);
+						if (lightcache == lightcache_t::replay)
+							ReplaySampleLight(pos, subsampled, f->styles, fc);
+						else
+						{
+							GetPhongNormal(facenum, pos, pointnormal);
+							GatherSampleLight(pos, pvs, pointnormal, subsampled, f->styles, fc);
+						}
 						for (j = 0; j < MAXLIGHTMAPS && (f->styles[j] != 255); j++)
 						{
 							VectorScale(subsampled[j], weighting[s + 1][t + 1], subsampled[j]);
@@ -1464,10 +1543,14 @@ void BuildFacelights(int facenum)
 			for (j = 0; j < MAXLIGHTMAPS && (f->styles[j] != 255); j++)
 				VectorScale(sampled[j], 1.0 / subsamples, sampled[j]);
 		}
+		else if (lightcache == lightcache_t::replay)
+		{
+			ReplaySampleLight(spot, sampled, f->styles, fc);
+		}
 		else
 		{
 			GetPhongNormal(facenum, spot, pointnormal);
-			GatherSampleLight(spot, pvs, pointnormal, sampled, f->styles);
+			GatherSampleLight(spot, pvs, pointnormal, sampled, f->styles, fc);
 		}
 
 		for (j = 0; j < MAXLIGHTMAPS && (f->styles[j] != 255); j++)
@@ -54,6 +54,7 @@ char designer_lights[MAX_PATH] = "";
 char level_lights[MAX_PATH] = "";
 
 char g_transferfile[MAX_PATH] = "";
+char lightcachefile[_MAX_PATH] = "";
 char vismatfile[_MAX_PATH] = "";
 char incrementfile[_MAX_PATH] = "";
 qboolean incremental = 0;
@@ -1193,9 +1194,21 @@ void RadWorld(void)
 		// create directlights out of patches and lights
 		CreateDirectLights();
 
+		// if only light intensities changed since the last incremental run,
+		// the facelights can be recombined without tracing
+		if (incremental)
+			lightcache = LoadLightCache(lightcachefile) ? lightcache_t::replay : lightcache_t::record;
+		else
+			unlink(lightcachefile);
+
 		// build initial facelights
 		RunThreadsOnIndividual(numfaces, true, BuildFacelights);
 
+		if (lightcache == lightcache_t::record)
+			SaveLightCache(lightcachefile);
+		FreeLightCache();
+		lightcache = lightcache_t::off;
+
 		// free up the direct lights now that we have facelights
 		DeleteDirectLights();
 	} while (numbounce != 0 && ProgressiveRefinement());
@@ -1511,10 +1524,13 @@ int main(int argc, char** argv)
 
 	strcpy(incrementfile, source);
 	DefaultExtension(incrementfile, ".r0");
+	strcpy(lightcachefile, source);
+	DefaultExtension(lightcachefile, ".r3");
 	DefaultExtension(source, ".bsp");
 
 	LoadBSPFile(source);
 	ParseEntities();
+	CalcFaceGeometryChecksum();
 
 	if (!visdatasize)
 	{
@@ -45,6 +45,7 @@ enum class emittype_t
 typedef struct directlight_s
 {
 	struct directlight_s* next;
+	int index; // position in dlightlist, stable between runs with the same lights
 	emittype_t type;
 	int style;
 	vec3_t origin;
@@ -98,6 +99,49 @@ typedef struct patch_s
 	int faceNumber;
 } patch_t;
 
+//
+// direct light cache
+//
+// For every lightmap sample, the unoccluded direct lights that reach it are
+// recorded together with their geometric falloff.  When only the intensity
+// of the lights changes between runs the lightmaps can be recombined from
+// this list without tracing a single line.
+//
+#define LIGHTCONTRIB_END -1				 // terminates the lights of one sample gather
+#define LIGHTCONTRIB_SKYAMBIENT(l) (-2 - (l)) // indirect sky light from light l
+#define LIGHTCONTRIB_SKYLIGHT(c) (-2 - (c))	 // light index of a sky ambient contribution
+
+typedef struct
+{
+	int light;	 // index into dlightlist, or one of the LIGHTCONTRIB_ codes
+	float ratio; // light reaching the sample is intensity * ratio
+} lightcontrib_t;
+
+typedef struct
+{
+	int numcontribs;
+	int maxcontribs;
+	int cursor; // read position while replaying
+	lightcontrib_t* contribs;
+} facelightcache_t;
+
+enum class lightcache_t
+{
+	off,
+	record,
+	replay
+};
+
+extern lightcache_t lightcache;
+extern facelightcache_t facelightcache[MAX_MAP_FACES];
+
+void AddLightContrib(facelightcache_t* fc, int light, float ratio);
+qboolean LoadLightCache(char* filename);
+void SaveLightCache(char* filename);
+void FreeLightCache(void);
+
+//==============================================
+
 extern patch_t* face_patches[MAX_MAP_FACES];
 extern entity_t* face_entity[MAX_MAP_FACES];
 extern vec3_t face_offset[MAX_MAP_FACES]; // for rotating bmodels
@@ -124,6 +168,9 @@ void BuildVisMatrix(void);
 void FreeVisMatrix(void);
 qboolean CheckVisBit(int p1, int p2);
 void TouchVMFFile(void);
+void CalcFaceGeometryChecksum(void);
+
+extern int dfacegeometry_checksum;
 
 //==============================================
 
@@ -132,6 +179,8 @@ extern vec3_t ambient;
 extern float maxlight;
 extern unsigned numbounce;
 extern directlight_t* directlights[MAX_MAP_LEAFS];
+extern directlight_t** dlightlist;
+extern int numdlights;
 extern byte nodehit[MAX_MAP_NODES];
 extern float gamma;
 extern float indirect_sun;
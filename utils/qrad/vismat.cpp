@@ -10,8 +10,6 @@
 
 #include "qrad.h"
 
-#define HALFBIT
-
 extern char source[MAX_PATH];
 extern char vismatfile[_MAX_PATH];
 extern char incrementfile[_MAX_PATH];
@@ -24,9 +22,84 @@ VISIBILITY MATRIX
 
 Determine which patches can see each other
 Use the PVS to accelerate if available
+
+A full patch x patch bit matrix grows with the square of the patch
+count, so it is stored sparsely instead.  Patches are grouped into
+clusters by the leaf their origin is in.  Only the upper triangle is
+kept: the rows of a cluster get a bit block for each higher numbered
+cluster they can actually see, plus a triangular block for the pairs
+inside the cluster itself, so each patch pair is stored exactly once.
+Brush model patches have no rows of their own, so a pair with one of
+them is always stored in the row of the world patch, whichever
+cluster is higher.
 ===================================================================
 */
-byte* vismatrix;
+
+typedef struct
+{
+	int cluster; // cluster of the column patches
+	byte* bits;	 // rows * columns bits, rows first
+} visblock_t;
+
+typedef struct
+{
+	int numpatches;
+	int numblocks;
+	int maxblocks;
+	visblock_t* blocks; // sorted by cluster once built
+} viscluster_t;
+
+typedef struct
+{
+	viscluster_t* cluster; // cluster whose rows are being built
+	int* blockindex;	   // cluster number -> index into cluster->blocks, -1 if none
+} visbuild_t;
+
+viscluster_t* visclusters;
+int* patchcluster; // leaf of each patch origin
+int* patchlocal;   // index of each patch inside its cluster
+
+double vismatrix_megs, vismatrix_peak_megs;
+
+/*
+==============
+VisMatrixMemory
+
+Keeps the current and high water size of everything the matrix
+build has allocated, including the scratch that is freed again
+==============
+*/
+void VisMatrixMemory(double bytes)
+{
+	ThreadLock();
+	vismatrix_megs += bytes / (1024 * 1024.0);
+	if (vismatrix_megs > vismatrix_peak_megs)
+		vismatrix_peak_megs = vismatrix_megs;
+	ThreadUnlock();
+}
+
+/*
+==============
+VisBitPos
+
+Bit of the pair p1 / p2 inside their block, with p1 the patch
+whose row the pair is stored in
+==============
+*/
+unsigned VisBitPos(unsigned p1, unsigned p2)
+{
+	unsigned l1 = patchlocal[p1];
+	unsigned l2 = patchlocal[p2];
+
+	if (patchcluster[p1] == patchcluster[p2])
+	{
+		if (l1 > l2)
+			return l1 * (l1 - 1) / 2 + l2;
+		return l2 * (l2 - 1) / 2 + l1;
+	}
+
+	return l1 * visclusters[patchcluster[p2]].numpatches + l2;
+}
 
 dleaf_t* PointInLeaf(vec3_t point)
 {
@@ -83,6 +156,85 @@ vec_t PatchPlaneDist(patch_t* patch)
 
 
 
+/*
+==============
+IsBModelPatch
+
+BuildVisLeafs only builds rows for the world faces in each leaf
+==============
+*/
+qboolean IsBModelPatch(unsigned p)
+{
+	return nummodels > 1 && patches[p].faceNumber >= dmodels[1].firstface;
+}
+
+/*
+==============
+VisPairInRow
+
+True if the pair p1 / p2 is stored in the rows of p1's cluster
+==============
+*/
+qboolean VisPairInRow(unsigned p1, unsigned p2)
+{
+	qboolean bmodel1 = IsBModelPatch(p1);
+	qboolean bmodel2 = IsBModelPatch(p2);
+
+	if (bmodel1 != bmodel2)
+		return bmodel2;
+
+	if (patchcluster[p1] == patchcluster[p2])
+		return p1 < p2;
+
+	return patchcluster[p1] < patchcluster[p2];
+}
+
+/*
+==============
+SetVisBit
+
+Marks p1 and p2 as visible in the row of p1, which must be
+the one VisPairInRow stores the pair in
+==============
+*/
+void SetVisBit(visbuild_t* vb, unsigned p1, unsigned p2)
+{
+	int c2 = patchcluster[p2];
+	int b = vb->blockindex[c2];
+	viscluster_t* cl = vb->cluster;
+	unsigned bitpos;
+
+	if (b == -1)
+	{
+		int size;
+
+		if (c2 == patchcluster[p1])
+			size = (cl->numpatches * (cl->numpatches - 1) / 2 + 7) >> 3;
+		else
+			size = (cl->numpatches * visclusters[c2].numpatches + 7) >> 3;
+
+		if (cl->numblocks == cl->maxblocks)
+		{
+			VisMatrixMemory(cl->maxblocks ? cl->maxblocks * (double)sizeof(visblock_t) : 16 * (double)sizeof(visblock_t));
+			cl->maxblocks = cl->maxblocks ? cl->maxblocks * 2 : 16;
+			cl->blocks = reinterpret_cast<visblock_t*>(realloc(cl->blocks, cl->maxblocks * sizeof(visblock_t)));
+			if (!cl->blocks)
+				Error("vismatrix too big");
+		}
+
+		b = vb->blockindex[c2] = cl->numblocks++;
+		cl->blocks[b].cluster = c2;
+		cl->blocks[b].bits = reinterpret_cast<byte*>(calloc(size, 1));
+		if (!cl->blocks[b].bits)
+			Error("vismatrix too big");
+
+		VisMatrixMemory(size);
+	}
+
+	bitpos = VisBitPos(p1, p2);
+	cl->blocks[b].bits[bitpos >> 3] |= 1 << (bitpos & 7);
+}
+
 /*
 ==============
 TestPatchToFace
@@ -90,7 +242,7 @@ TestPatchToFace
 Sets vis bits for all patches in the face
 ==============
 */
-void TestPatchToFace(unsigned patchnum, int facenum, int head, unsigned bitpos)
+void TestPatchToFace(unsigned patchnum, int facenum, int head, visbuild_t* vb)
 {
 	patch_t* patch = &patches[patchnum];
 	patch_t* patch2 = face_patches[facenum];
@@ -108,11 +260,10 @@ void TestPatchToFace(unsigned patchnum, int facenum, int head, unsigned bitpos)
 			// if bit has not already been set
 			//  && v2 is not behind light plane
 			//  && v2 is visible from v1
-			if (m > patchnum && DotProduct(patch2->origin, patch->normal) > PatchPlaneDist(patch) + 1.01 && TestLine_r(head, patch->origin, patch2->origin) == CONTENTS_EMPTY)
+			if (VisPairInRow(patchnum, m) && DotProduct(patch2->origin, patch->normal) > PatchPlaneDist(patch) + 1.01 && TestLine_r(head, patch->origin, patch2->origin) == CONTENTS_EMPTY)
 			{
 				// patchnum can see patch m
-				int bitset = bitpos + m;
-				vismatrix[bitset >> 3] |= 1 << (bitset & 7);
+				SetVisBit(vb, patchnum, m);
 			}
 		}
 	}
@@ -125,7 +276,7 @@ BuildVisRow
 Calc vis bits from a single patch
 ==============
 */
-void BuildVisRow(int patchnum, byte* pvs, int head, unsigned bitpos)
+void BuildVisRow(int patchnum, byte* pvs, int head, visbuild_t* vb)
 {
 	int j, k, l;
 	patch_t* patch;
@@ -151,28 +302,46 @@ void BuildVisRow(int patchnum, byte* pvs, int head, unsigned bitpos)
 				continue;
 			face_tested[l] = 1;
 
-			TestPatchToFace(patchnum, l, head, bitpos);
+			TestPatchToFace(patchnum, l, head, vb);
 		}
 	}
 }
 
+/*
+===========
+CompareVisBlocks
+===========
+*/
+int CompareVisBlocks(const void* a, const void* b)
+{
+	return reinterpret_cast<const visblock_t*>(a)->cluster - reinterpret_cast<const visblock_t*>(b)->cluster;
+}
+
 /*
 ===========
 BuildVisLeafs
 
-  This is run by multiple threads
+  This is run by multiple threads, each building
+  all the rows of one cluster at a time
 ===========
 */
 void BuildVisLeafs(int /*threadnum*/)
 {
-	int i;
+	int i, j;
 	int lface, facenum, facenum2;
 	byte pvs[(MAX_MAP_LEAFS + 7) / 8];
-	dleaf_t *srcleaf, *leaf;
+	dleaf_t* srcleaf;
 	patch_t* patch;
 	int head;
-	unsigned bitpos;
 	unsigned patchnum;
+	visbuild_t vb;
+
+	vb.blockindex = reinterpret_cast<int*>(malloc(numleafs * sizeof(int)));
+	if (!vb.blockindex)
+		Error("Memory allocation failure");
+	VisMatrixMemory(numleafs * (double)sizeof(int));
+	for (j = 0; j < numleafs; j++)
+		vb.blockindex[j] = -1;
 
 	while (1)
 	{
@@ -185,6 +354,9 @@ void BuildVisLeafs(int /*threadnum*/)
 			break;
 		i++; // skip leaf 0
 		srcleaf = &dleafs[i];
+		vb.cluster = &visclusters[i];
+		if (!vb.cluster->numpatches)
+			continue;
 		DecompressVis(&dvisdata[srcleaf->visofs], pvs);
 #if 0
 	// is this valid multithreaded???
@@ -216,28 +388,43 @@ void BuildVisLeafs(int /*threadnum*/)
 			facenum = dmarksurfaces[srcleaf->firstmarksurface + lface];
 			for (patch = face_patches[facenum]; patch; patch = patch->next)
 			{
-				leaf = PointInLeaf(patch->origin);
-				if (leaf != srcleaf)
-					continue;
-
 				patchnum = patch - patches;
+				if (patchcluster[patchnum] != i)
+					continue;
 
-#ifdef HALFBIT
-				bitpos = patchnum * num_patches - (patchnum * (patchnum + 1)) / 2;
-#else
-				bitpos = patchnum * num_patches;
-#endif
 				// build to all other world leafs
-				BuildVisRow(patchnum, pvs, head, bitpos);
+				BuildVisRow(patchnum, pvs, head, &vb);
 
 				// build to bmodel faces
 				if (nummodels < 2)
 					continue;
 				for (facenum2 = dmodels[1].firstface; facenum2 < numfaces; facenum2++)
-					TestPatchToFace(patchnum, facenum2, head, bitpos);
+					TestPatchToFace(patchnum, facenum2, head, &vb);
+			}
+		}
+
+		// sort for CheckVisBit and reset the lookup for the next cluster
+		for (j = 0; j < vb.cluster->numblocks; j++)
+			vb.blockindex[vb.cluster->blocks[j].cluster] = -1;
+		qsort(vb.cluster->blocks, vb.cluster->numblocks, sizeof(visblock_t), CompareVisBlocks);
+
+		// give back the slack from doubling the block list
+		if (vb.cluster->numblocks < vb.cluster->maxblocks)
+		{
+			VisMatrixMemory(-(double)(vb.cluster->maxblocks - vb.cluster->numblocks) * sizeof(visblock_t));
+			vb.cluster->maxblocks = vb.cluster->numblocks;
+			if (vb.cluster->numblocks)
+				vb.cluster->blocks = reinterpret_cast<visblock_t*>(realloc(vb.cluster->blocks, vb.cluster->numblocks * sizeof(visblock_t)));
+			else
+			{
+				free(vb.cluster->blocks);
+				vb.cluster->blocks = NULL;
 			}
 		}
 	}
+
+	free(vb.blockindex);
+	VisMatrixMemory(-(double)numleafs * sizeof(int));
 }
 
 /*
@@ -376,6 +563,38 @@ long putfiledata(char* filename, char* buffer, int buffersize)
 	return size;
 }
 
+/*
+==============
+CalcFaceGeometryChecksum
+
+The face lump also carries the lighting offsets and styles written by a
+previous qrad run, which must not invalidate the saved data on a relight.
+==============
+*/
+
+int dfacegeometry_checksum;
+
+void CalcFaceGeometryChecksum(void)
+{
+	int i, j;
+	dface_t* faces;
+
+	faces = reinterpret_cast<dface_t*>(malloc(numfaces * sizeof(dface_t)));
+	if (!faces)
+		Error("Memory allocation failure");
+
+	memcpy(faces, dfaces, numfaces * sizeof(dface_t));
+	for (i = 0; i < numfaces; i++)
+	{
+		faces[i].lightofs = 0;
+		for (j = 0; j < MAXLIGHTMAPS; j++)
+			faces[i].styles[j] = 0;
+	}
+
+	dfacegeometry_checksum = FastChecksum(faces, numfaces * sizeof(dface_t));
+	free(faces);
+}
+
 /*
 ==============
 IsIncremental
@@ -391,7 +610,7 @@ IsIncremental(char* filename)
 
 	if ((handle = _open(filename, _O_RDONLY | _O_BINARY)) != -1)
 	{
-		if (_read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dmodels_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dvertexes_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dplanes_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dleafs_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dnodes_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == texinfo_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dclipnodes_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dfaces_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dmarksurfaces_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dsurfedges_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dedges_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dtexdata_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dvisdata_checksum)
+		if (_read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dmodels_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dvertexes_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dplanes_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dleafs_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dnodes_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == texinfo_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dclipnodes_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dfacegeometry_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dmarksurfaces_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dsurfedges_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dedges_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dtexdata_checksum && _read(handle, &sum, sizeof(sum)) == sizeof(sum) && sum == dvisdata_checksum)
 			status = true;
 		_close(handle);
 	}
@@ -417,7 +636,7 @@ int SaveIncremental(char* filename)
 		{
 			qprintf("Writing [%s] with new saved qrad data", filename);
 
-			if (_write(handle, &dmodels_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dvertexes_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dplanes_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dleafs_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dnodes_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &texinfo_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dclipnodes_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dfaces_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dmarksurfaces_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dsurfedges_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dedges_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dtexdata_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dvisdata_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)))
+			if (_write(handle, &dmodels_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dvertexes_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dplanes_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dleafs_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dnodes_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &texinfo_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dclipnodes_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dfacegeometry_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dmarksurfaces_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dsurfedges_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dedges_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dtexdata_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)) && _write(handle, &dvisdata_checksum, sizeof(int)) == sizeof(int) && (size += sizeof(int)))
 			{
 				qprintf("(%d)\n", size);
 			}
@@ -442,43 +661,55 @@ BuildVisMatrix
 */
 void BuildVisMatrix(void)
 {
-	int c;
-	HANDLE h;
+	unsigned i;
+	int leafnum;
 
-#ifdef HALFBIT
-	c = ((num_patches + 1) * (((num_patches + 1) + 15) / 16));
-#else
-	c = num_patches * ((num_patches + 7) / 8);
-#endif
+	visclusters = reinterpret_cast<viscluster_t*>(calloc(numleafs, sizeof(viscluster_t)));
+	patchcluster = reinterpret_cast<int*>(malloc(num_patches * sizeof(int)));
+	patchlocal = reinterpret_cast<int*>(malloc(num_patches * sizeof(int)));
+	if (!visclusters || !patchcluster || !patchlocal)
+		Error("vismatrix too big");
 
-	qprintf("visibility matrix: %5.1f megs\n", c / (1024 * 1024.0));
+	for (i = 0; i < num_patches; i++)
+	{
+		leafnum = PointInLeaf(patches[i].origin) - dleafs;
+		patchcluster[i] = leafnum;
+		patchlocal[i] = visclusters[leafnum].numpatches++;
+	}
 
-	if (h = GlobalAlloc(GMEM_FIXED | GMEM_ZEROINIT, c); h != nullptr)
-		vismatrix = reinterpret_cast<byte*>(GlobalLock(h));
-	else
-		Error("vismatrix too big");
+	vismatrix_megs = vismatrix_peak_megs = (numleafs * sizeof(viscluster_t) + 2 * num_patches * sizeof(int)) / (1024 * 1024.0);
+
+	RunThreadsOn(numleafs - 1, true, BuildVisLeafs);
 
+	qprintf("visibility matrix: %5.1f megs, %5.1f megs peak while building (%5.1f megs as a full matrix)\n", vismatrix_megs, vismatrix_peak_megs,
+		((num_patches + 1) * (((num_patches + 1) + 15) / 16)) / (1024 * 1024.0));
+
+	// Get rid of any old _bogus_ r1 files; we never read them!
 	strcpy(vismatfile, source);
 	StripExtension(vismatfile);
 	DefaultExtension(vismatfile, ".r1");
-
-	if (!incremental || !IsIncremental(incrementfile) || getfilesize(vismatfile) != c || getfiledata(vismatfile, reinterpret_cast<char*>(vismatrix), c) != c)
-	{
-		// memset (vismatrix, 0, c);
-		RunThreadsOn(numleafs - 1, true, BuildVisLeafs);
-	}
-	// Get rid of any old _bogus_ r1 files; we never read them!
 	unlink(vismatfile);
 }
 
 void FreeVisMatrix(void)
 {
-	if (vismatrix)
+	int i, j;
+
+	if (visclusters)
 	{
-		HANDLE h = GlobalHandle(vismatrix);
-		GlobalUnlock(h);
-		GlobalFree(h);
-		vismatrix = NULL;
+		for (i = 0; i < numleafs; i++)
+		{
+			for (j = 0; j < visclusters[i].numblocks; j++)
+				free(visclusters[i].blocks[j].bits);
+			free(visclusters[i].blocks);
+		}
+		free(visclusters);
+		free(patchcluster);
+		free(patchlocal);
+		visclusters = NULL;
+		patchcluster = patchlocal = NULL;
+
+		vismatrix_megs = vismatrix_peak_megs = 0;
 	}
 }
 
@@ -511,22 +742,43 @@ CheckVisBit
 qboolean CheckVisBit(int p1, int p2)
 {
 	int t;
-	int bitpos;
+	int l, h, m;
+	int c2;
+	unsigned bitpos;
+	viscluster_t* cl;
+
+	// a patch never sets a bit for itself
+	if (p1 == p2)
+		return false;
 
-	if (p1 > p2)
+	if (!VisPairInRow(p1, p2))
 	{
 		t = p1;
 		p1 = p2;
 		p2 = t;
 	}
 
-#ifdef HALFBIT
-	bitpos = p1 * num_patches - (p1 * (p1 + 1)) / 2 + p2;
-#else
-	bitpos = p1 * num_patches + p2;
-#endif
+	// the pair is stored in the row of p1, if the clusters see each other at all
+	cl = &visclusters[patchcluster[p1]];
+	c2 = patchcluster[p2];
+
+	l = 0;
+	h = cl->numblocks - 1;
+	while (l <= h)
+	{
+		m = (l + h) >> 1;
+		if (cl->blocks[m].cluster < c2)
+			l = m + 1;
+		else if (cl->blocks[m].cluster > c2)
+			h = m - 1;
+		else
+		{
+			bitpos = VisBitPos(p1, p2);
+			if (cl->blocks[m].bits[bitpos >> 3] & (1 << (bitpos & 7)))
+				return true;
+			return false;
+		}
+	}
 
-	if (vismatrix[bitpos >> 3] & (1 << (bitpos & 7)))
-		return true;
 	return false;
 }
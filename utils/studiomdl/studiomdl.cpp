@@ -40,6 +40,10 @@
 
 static int force_powerof2_textures = 0;
 
+// time spent reading .smd files, for the phase breakdown
+static double meshtime;
+static double animationtime;
+
 void clip_rotations(vec3_t rot);
 
 #define strcpyn(a, b) strncpy(a, b, sizeof(a))
@@ -1244,17 +1248,117 @@ s_trianglevert_t* lookup_triangle(s_mesh_t* pmesh, int index)
 	return pmesh->triangle[index];
 }
 
-int lookup_normal(s_model_t* pmodel, s_normal_t* pnormal)
+/*
+=================
+Vertex and normal welding
+
+lookup_vertex and lookup_normal return the first earlier vertex or normal
+that would have matched, but only look at the ones hashed near it.
+Vertices are quantised to 0.01 units before they are compared, so
+matching ones always share a cell.  Normals within normal_blend of each
+other are never more than one normal cell apart.
+=================
+*/
+
+#define WELD_HASH_SIZE 4096 // must be a power of two
+
+static int vertexhash[WELD_HASH_SIZE];
+static int vertexchain[MAXSTUDIOVERTS];
+static int normalhash[WELD_HASH_SIZE];
+static int normalchain[MAXSTUDIOVERTS];
+static float normalcellsize;
+
+static unsigned int WeldHash(int x, int y, int z, int a, int b)
+{
+	return ((unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u ^ (unsigned int)z * 83492791u ^ (unsigned int)a * 2654435761u ^ (unsigned int)b * 40503u) & (WELD_HASH_SIZE - 1);
+}
+
+static unsigned int VertexHash(s_vertex_t* pv)
+{
+	return WeldHash(floor(pv->org[0] * 100 + 0.5), floor(pv->org[1] * 100 + 0.5), floor(pv->org[2] * 100 + 0.5), pv->bone, 0);
+}
+
+static void NormalCell(s_normal_t* pnormal, int cell[3])
+{
+	int i;
+
+	for (i = 0; i < 3; i++)
+		cell[i] = floor(pnormal->org[i] / normalcellsize);
+}
+
+static void HashVertex(s_model_t* pmodel, int i)
+{
+	unsigned int h = VertexHash(&pmodel->vert[i]);
+
+	vertexchain[i] = vertexhash[h];
+	vertexhash[h] = i;
+}
+
+static void HashNormal(s_model_t* pmodel, int i)
+{
+	s_normal_t* pnormal = &pmodel->normal[i];
+	int cell[3];
+	unsigned int h;
+
+	NormalCell(pnormal, cell);
+	h = WeldHash(cell[0], cell[1], cell[2], pnormal->bone, pnormal->skinref);
+	normalchain[i] = normalhash[h];
+	normalhash[h] = i;
+}
+
+/*
+=================
+ResetWelding
+
+Called before the triangles of a model are read
+=================
+*/
+void ResetWelding(s_model_t* pmodel)
 {
 	int i;
+
+	for (i = 0; i < WELD_HASH_SIZE; i++)
+		vertexhash[i] = normalhash[i] = -1;
+
+	// unit normals whose dot product is above normal_blend are
+	// closer together than this, plus some room for rounding
+	normalcellsize = sqrt(std::max(0.0, 2.0 - 2.0 * normal_blend)) + 0.001;
+
+	for (i = 0; i < pmodel->numverts; i++)
+		HashVertex(pmodel, i);
 	for (i = 0; i < pmodel->numnorms; i++)
+		HashNormal(pmodel, i);
+}
+
+int lookup_normal(s_model_t* pmodel, s_normal_t* pnormal)
+{
+	int i, x, y, z;
+	int cell[3];
+	int best;
+
+	// the chains aren't in index order, so keep the lowest match
+	best = -1;
+	NormalCell(pnormal, cell);
+	for (x = cell[0] - 1; x <= cell[0] + 1; x++)
 	{
-		// if (VectorCompare( pmodel->normal[i].org, pnormal->org )
-		if (DotProduct(pmodel->normal[i].org, pnormal->org) > normal_blend && pmodel->normal[i].bone == pnormal->bone && pmodel->normal[i].skinref == pnormal->skinref)
+		for (y = cell[1] - 1; y <= cell[1] + 1; y++)
 		{
-			return i;
+			for (z = cell[2] - 1; z <= cell[2] + 1; z++)
+			{
+				for (i = normalhash[WeldHash(x, y, z, pnormal->bone, pnormal->skinref)]; i != -1; i = normalchain[i])
+				{
+					if (best != -1 && i >= best)
+						continue;
+					if (DotProduct(pmodel->normal[i].org, pnormal->org) > normal_blend && pmodel->normal[i].bone == pnormal->bone && pmodel->normal[i].skinref == pnormal->skinref)
+						best = i;
+				}
+			}
 		}
 	}
+	if (best != -1)
+		return best;
+
+	i = pmodel->numnorms;
 	if (i >= MAXSTUDIOVERTS)
 	{
 		Error("too many normals in model: \"%s\"\n", pmodel->name);
@@ -1263,6 +1367,7 @@ int lookup_normal(s_model_t* pmodel, s_normal_t* pnormal)
 	pmodel->normal[i].bone = pnormal->bone;
 	pmodel->normal[i].skinref = pnormal->skinref;
 	pmodel->numnorms = i + 1;
+	HashNormal(pmodel, i);
 	return i;
 }
 
@@ -1270,19 +1375,25 @@ int lookup_normal(s_model_t* pmodel, s_normal_t* pnormal)
 int lookup_vertex(s_model_t* pmodel, s_vertex_t* pv)
 {
 	int i;
+	int best;
 
 	// assume 2 digits of accuracy
 	pv->org[0] = (int)(pv->org[0] * 100) / 100.0;
 	pv->org[1] = (int)(pv->org[1] * 100) / 100.0;
 	pv->org[2] = (int)(pv->org[2] * 100) / 100.0;
 
-	for (i = 0; i < pmodel->numverts; i++)
+	best = -1;
+	for (i = vertexhash[VertexHash(pv)]; i != -1; i = vertexchain[i])
 	{
+		if (best != -1 && i >= best)
+			continue;
 		if (VectorCompare(pmodel->vert[i].org, pv->org) && pmodel->vert[i].bone == pv->bone)
-		{
-			return i;
-		}
+			best = i;
 	}
+	if (best != -1)
+		return best;
+
+	i = pmodel->numverts;
 	if (i >= MAXSTUDIOVERTS)
 	{
 		Error("too many vertices in model: \"%s\"\n", pmodel->name);
@@ -1290,6 +1401,7 @@ int lookup_vertex(s_model_t* pmodel, s_vertex_t* pv)
 	VectorCopy(pv->org, pmodel->vert[i].org);
 	pmodel->vert[i].bone = pv->bone;
 	pmodel->numverts = i + 1;
+	HashVertex(pmodel, i);
 	return i;
 }
 
@@ -1865,6 +1977,7 @@ void Grab_Triangles(s_model_t* pmodel)
 	vmax[0] = vmax[1] = vmax[2] = -99999;
 
 	Build_Reference(pmodel);
+	ResetWelding(pmodel);
 
 	//
 	// load the base triangles
@@ -2159,6 +2272,7 @@ void Grab_Studio(s_model_t* pmodel)
 	int time1;
 	char cmd[1024];
 	int option;
+	double start = I_FloatTime();
 
 	sprintf(filename, "%s/%s.smd", cddir, pmodel->name);
 	time1 = FileTime(filename);
@@ -2202,6 +2316,8 @@ void Grab_Studio(s_model_t* pmodel)
 		}
 	}
 	fclose(input);
+
+	meshtime += I_FloatTime() - start;
 }
 
 
@@ -2544,8 +2660,10 @@ void Option_Animation(char* name, s_animation_t* panim)
 		}
 		else if (strcmp(cmd, "skeleton") == 0)
 		{
+			double start = I_FloatTime();
 			Grab_Animation(panim);
 			Shift_Animation(panim);
+			animationtime += I_FloatTime() - start;
 		}
 		else
 		{
@@ -3462,6 +3580,7 @@ int main(int argc, char** argv)
 {
 	int i;
 	char path[1024];
+	double start, parsed, skinned, simplified, written;
 
 	default_scale = 1.0;
 	defaultzrotation = Q_PI / 2;
@@ -3477,7 +3596,7 @@ int main(int argc, char** argv)
 	gamma = 1.8;
 
 	if (argc == 1)
-		Error("usage: studiomdl [-t texture] -r(tag reversed) -n(tag bad normals) -f(flip all triangles) [-a normal_blend_angle] -h(dump hboxes) -i(ignore warnings) -p(force power of 2 textures) [-g max_sequencegroup_size(K)] file.qc");
+		Error("usage: studiomdl [-t texture] -r(tag reversed) -n(tag bad normals) -f(flip all triangles) [-a normal_blend_angle] -h(dump hboxes) -c(order strips for the vertex cache) -i(ignore warnings) -p(force power of 2 textures) [-g max_sequencegroup_size(K)] file.qc");
 
 	for (i = 1; i < argc - 1; i++)
 	{
@@ -3513,6 +3632,9 @@ int main(int argc, char** argv)
 			case 'h':
 				dump_hboxes = 1;
 				break;
+			case 'c':
+				vertexcache_strips = 1;
+				break;
 			case 'g':
 				i++;
 				maxseqgroupsize = 1024 * atoi(argv[i]);
@@ -3546,10 +3668,24 @@ int main(int argc, char** argv)
 	ClearModel();
 	strcpy(outname, argv[i]);
 
+	start = I_FloatTime();
 	ParseScript();
+	parsed = I_FloatTime();
 	SetSkinValues();
+	skinned = I_FloatTime();
 	SimplifyModel();
+	simplified = I_FloatTime();
 	WriteFile();
+	written = I_FloatTime();
+
+	printf("---- phase times ----\n");
+	printf("%-20s %8.2fs\n", "meshes:", meshtime);
+	printf("%-20s %8.2fs\n", "animations:", animationtime);
+	printf("%-20s %8.2fs\n", "rest of script:", parsed - start - meshtime - animationtime);
+	printf("%-20s %8.2fs\n", "skins:", skinned - parsed);
+	printf("%-20s %8.2fs\n", "simplify:", simplified - skinned);
+	printf("%-20s %8.2fs\n", "write:", written - simplified);
+	printf("%-20s %8.2fs\n", "total:", written - start);
 
 	return 0;
 }
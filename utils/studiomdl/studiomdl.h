@@ -50,6 +50,7 @@ EXTERN int tag_normals;
 EXTERN int flip_triangles;
 EXTERN float normal_blend;
 EXTERN int dump_hboxes;
+EXTERN int vertexcache_strips;
 EXTERN int ignore_warnings;
 
 EXTERN vec3_t eyeposition;
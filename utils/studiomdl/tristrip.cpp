@@ -17,6 +17,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <sys/stat.h>
 
 #include "steam/steamtypes.h"
@@ -48,45 +49,113 @@ int neighbortri[MAXSTUDIOTRIANGLES][3];
 int neighboredge[MAXSTUDIOTRIANGLES][3];
 
 
+// every directed triangle edge, chained by the two corners it runs between
+#define EDGE_HASH_SIZE 16384
+
+int edgehash[EDGE_HASH_SIZE];
+int edgechain[MAXSTUDIOTRIANGLES * 3];
+
+// triangle order the strips are started in with -c
+int cacheorder[MAXSTUDIOTRIANGLES];
+
+// vertex cache simulated when reporting the miss ratio
+#define VERTEX_CACHE_SIZE 24
+
+int numcachemisses;
+
+
 s_trianglevert_t (*triangles)[3];
 s_mesh_t* pmesh;
 
 
+/*
+================
+EdgeHash
+================
+*/
+int EdgeHash(s_trianglevert_t* v1, s_trianglevert_t* v2)
+{
+	unsigned int hash;
+
+	hash = v1->vertindex * 73856093u ^ v1->normindex * 19349663u ^ v1->s * 83492791u ^ v1->t;
+	hash = hash * 31u + (v2->vertindex * 73856093u ^ v2->normindex * 19349663u ^ v2->s * 83492791u ^ v2->t);
+
+	return (hash ^ (hash >> 15)) & (EDGE_HASH_SIZE - 1);
+}
+
+
+/*
+================
+HashEdges
+
+Each chain is kept in increasing triangle and edge order,
+so FindNeighbor sees candidates in the order a linear scan would
+================
+*/
+void HashEdges(void)
+{
+	int i, k, e;
+
+	for (i = 0; i < EDGE_HASH_SIZE; i++)
+		edgehash[i] = -1;
+
+	for (i = pmesh->numtris - 1; i >= 0; i--)
+	{
+		for (k = 2; k >= 0; k--)
+		{
+			e = EdgeHash(&triangles[i][k], &triangles[i][(k + 1) % 3]);
+			edgechain[i * 3 + k] = edgehash[e];
+			edgehash[e] = i * 3 + k;
+		}
+	}
+}
+
+
+/*
+================
+FindNeighbor
+
+Pairs the edge with the first later triangle that runs the
+other way along it
+================
+*/
 void FindNeighbor(int starttri, int startv)
 {
 	s_trianglevert_t m1, m2;
 	int j;
 	s_trianglevert_t *last, *check;
-	int k;
-
-	// used[starttri] |= (1 << startv);
+	int k, e;
 
 	last = &triangles[starttri][0];
 
 	m1 = last[(startv + 1) % 3];
 	m2 = last[(startv + 0) % 3];
 
-	for (j = starttri + 1, check = &triangles[starttri + 1][0]; j < pmesh->numtris; j++, check += 3)
+	for (e = edgehash[EdgeHash(&m1, &m2)]; e != -1; e = edgechain[e])
 	{
+		j = e / 3;
+		k = e % 3;
+
+		if (j <= starttri)
+			continue;
 		if (used[j] == 7)
 			continue;
-		for (k = 0; k < 3; k++)
-		{
-			if (memcmp(&check[k], &m1, sizeof(m1)))
-				continue;
-			if (memcmp(&check[(k + 1) % 3], &m2, sizeof(m2)))
-				continue;
 
-			neighbortri[starttri][startv] = j;
-			neighboredge[starttri][startv] = k;
+		check = &triangles[j][0];
+		if (memcmp(&check[k], &m1, sizeof(m1)))
+			continue;
+		if (memcmp(&check[(k + 1) % 3], &m2, sizeof(m2)))
+			continue;
 
-			neighbortri[j][k] = starttri;
-			neighboredge[j][k] = startv;
+		neighbortri[starttri][startv] = j;
+		neighboredge[starttri][startv] = k;
 
-			used[starttri] |= (1 << startv);
-			used[j] |= (1 << k);
-			return;
-		}
+		neighbortri[j][k] = starttri;
+		neighboredge[j][k] = startv;
+
+		used[starttri] |= (1 << startv);
+		used[j] |= (1 << k);
+		return;
 	}
 }
 
@@ -140,9 +209,8 @@ int StripLength(int starttri, int startv)
 done:
 
 	// clear the temp used flags
-	for (j = 0; j < pmesh->numtris; j++)
-		if (used[j] == 2)
-			used[j] = 0;
+	for (j = 0; j < stripcount; j++)
+		used[striptris[j]] = 0;
 
 	return stripcount;
 }
@@ -189,14 +257,266 @@ int FanLength(int starttri, int startv)
 done:
 
 	// clear the temp used flags
-	for (j = 0; j < pmesh->numtris; j++)
-		if (used[j] == 2)
-			used[j] = 0;
+	for (j = 0; j < stripcount; j++)
+		used[striptris[j]] = 0;
 
 	return stripcount;
 }
 
 
+/*
+===================================================================
+
+VERTEX CACHE ORDERING
+
+Greedy ordering after Tom Forsyth's "Linear-Speed Vertex Cache
+Optimisation".  Vertices score higher the more recently they were
+used and the fewer unordered triangles they have left, and the next
+triangle is always the best scoring one touching the simulated cache.
+===================================================================
+*/
+
+#define FORSYTH_CACHE_SIZE 32
+
+int vertexvalence[MAXSTUDIOVERTS];		// triangles not yet ordered
+int vertexfirsttri[MAXSTUDIOVERTS + 1]; // into vertextris
+int vertextris[MAXSTUDIOTRIANGLES * 3];
+int vertexcachepos[MAXSTUDIOVERTS];
+float vertexscore[MAXSTUDIOVERTS];
+
+int triordered[MAXSTUDIOTRIANGLES];
+float triscore[MAXSTUDIOTRIANGLES];
+
+
+/*
+================
+VertexScore
+================
+*/
+float VertexScore(int v)
+{
+	float score;
+	int pos;
+
+	if (vertexvalence[v] == 0)
+		return -1;
+
+	score = 0;
+	pos = vertexcachepos[v];
+	if (pos >= 0)
+	{
+		// the last triangle's vertices get a fixed score so the
+		// ordering doesn't favour reusing them in strip order
+		if (pos < 3)
+			score = 0.75;
+		else
+			score = pow(1.0 - (pos - 3) / (float)(FORSYTH_CACHE_SIZE - 3), 1.5);
+	}
+
+	// prefer vertices that are nearly done with
+	score += 2.0 * pow((float)vertexvalence[v], -0.5f);
+
+	return score;
+}
+
+
+/*
+================
+OrderForVertexCache
+
+Fills cacheorder with every triangle of the mesh
+================
+*/
+void OrderForVertexCache(void)
+{
+	int cache[FORSYTH_CACHE_SIZE + 3];
+	int newcache[FORSYTH_CACHE_SIZE + 3];
+	int cachesize, newcachesize;
+	int i, j, k, n, v, tri;
+	int besttri, cursor;
+	float bestscore;
+
+	memset(vertexvalence, 0, sizeof(vertexvalence));
+
+	for (i = 0; i < pmesh->numtris; i++)
+	{
+		for (k = 0; k < 3; k++)
+		{
+			v = triangles[i][k].vertindex;
+			if (v < 0 || v >= MAXSTUDIOVERTS)
+				Error("OrderForVertexCache: bad vertex %d", v);
+			vertexvalence[v]++;
+		}
+	}
+
+	vertexfirsttri[0] = 0;
+	for (v = 0; v < MAXSTUDIOVERTS; v++)
+	{
+		vertexfirsttri[v + 1] = vertexfirsttri[v] + vertexvalence[v];
+		vertexvalence[v] = 0;
+		vertexcachepos[v] = -1;
+	}
+
+	for (i = 0; i < pmesh->numtris; i++)
+	{
+		for (k = 0; k < 3; k++)
+		{
+			v = triangles[i][k].vertindex;
+			vertextris[vertexfirsttri[v] + vertexvalence[v]++] = i;
+		}
+	}
+
+	for (v = 0; v < MAXSTUDIOVERTS; v++)
+		vertexscore[v] = VertexScore(v);
+
+	for (i = 0; i < pmesh->numtris; i++)
+	{
+		triordered[i] = 0;
+		triscore[i] = 0;
+		for (k = 0; k < 3; k++)
+			triscore[i] += vertexscore[triangles[i][k].vertindex];
+	}
+
+	cachesize = 0;
+	cursor = 0;
+	besttri = -1;
+
+	for (n = 0; n < pmesh->numtris; n++)
+	{
+		if (besttri == -1)
+		{
+			// nothing in the cache has triangles left, so start on
+			// the next unordered triangle
+			while (triordered[cursor])
+				cursor++;
+			besttri = cursor;
+		}
+
+		cacheorder[n] = besttri;
+		triordered[besttri] = 1;
+
+		// take the triangle off its vertices' lists
+		for (k = 0; k < 3; k++)
+		{
+			v = triangles[besttri][k].vertindex;
+			for (j = vertexfirsttri[v]; j < vertexfirsttri[v] + vertexvalence[v]; j++)
+			{
+				if (vertextris[j] == besttri)
+				{
+					vertextris[j] = vertextris[vertexfirsttri[v] + vertexvalence[v] - 1];
+					vertexvalence[v]--;
+					break;
+				}
+			}
+		}
+
+		// the triangle's vertices go to the front of the cache
+		newcachesize = 0;
+		for (k = 0; k < 3; k++)
+		{
+			v = triangles[besttri][k].vertindex;
+			for (j = 0; j < newcachesize; j++)
+				if (newcache[j] == v)
+					break;
+			if (j == newcachesize)
+				newcache[newcachesize++] = v;
+		}
+		for (i = 0; i < cachesize; i++)
+		{
+			v = cache[i];
+			for (j = 0; j < newcachesize; j++)
+				if (newcache[j] == v)
+					break;
+			if (j == newcachesize)
+				newcache[newcachesize++] = v;
+		}
+
+		// rescore everything that moved, including the ones that fell out
+		for (i = 0; i < newcachesize; i++)
+		{
+			v = newcache[i];
+			vertexcachepos[v] = (i < FORSYTH_CACHE_SIZE) ? i : -1;
+			vertexscore[v] = VertexScore(v);
+		}
+
+		besttri = -1;
+		bestscore = -1;
+		for (i = 0; i < newcachesize; i++)
+		{
+			v = newcache[i];
+			for (j = vertexfirsttri[v]; j < vertexfirsttri[v] + vertexvalence[v]; j++)
+			{
+				tri = vertextris[j];
+				triscore[tri] = 0;
+				for (k = 0; k < 3; k++)
+					triscore[tri] += vertexscore[triangles[tri][k].vertindex];
+				if (triscore[tri] > bestscore)
+				{
+					bestscore = triscore[tri];
+					besttri = tri;
+				}
+			}
+		}
+
+		cachesize = (newcachesize < FORSYTH_CACHE_SIZE) ? newcachesize : FORSYTH_CACHE_SIZE;
+		memcpy(cache, newcache, cachesize * sizeof(int));
+	}
+}
+
+
+/*
+================
+CountCacheMisses
+
+Runs the finished command list through a FIFO vertex cache
+================
+*/
+int CountCacheMisses(void)
+{
+	int cache[VERTEX_CACHE_SIZE];
+	int head, misses;
+	int verts[128];
+	int tri[3];
+	int i, j, k, count, fan;
+	short* cmd;
+
+	for (i = 0; i < VERTEX_CACHE_SIZE; i++)
+		cache[i] = -1;
+	head = 0;
+	misses = 0;
+
+	for (cmd = commands; *cmd;)
+	{
+		fan = *cmd < 0;
+		count = abs(*cmd++);
+		for (i = 0; i < count; i++, cmd += 4)
+			verts[i] = cmd[0];
+
+		for (i = 2; i < count; i++)
+		{
+			tri[0] = fan ? verts[0] : verts[i - 2];
+			tri[1] = verts[i - 1];
+			tri[2] = verts[i];
+
+			for (k = 0; k < 3; k++)
+			{
+				for (j = 0; j < VERTEX_CACHE_SIZE; j++)
+					if (cache[j] == tri[k])
+						break;
+				if (j < VERTEX_CACHE_SIZE)
+					continue;
+
+				misses++;
+				cache[head] = tri[k];
+				head = (head + 1) % VERTEX_CACHE_SIZE;
+			}
+		}
+	}
+
+	return misses;
+}
+
+
 /*
 ================
 BuildTris
@@ -234,6 +554,7 @@ int BuildTris(s_trianglevert_t (*x)[3], s_mesh_t* y, byte** ppdata)
 	}
 
 	// printf("finding neighbors\n");
+	HashEdges();
 	for (i = 0; i < pmesh->numtris; i++)
 	{
 		for (k = 0; k < 3; k++)
@@ -247,6 +568,16 @@ int BuildTris(s_trianglevert_t (*x)[3], s_mesh_t* y, byte** ppdata)
 	}
 	// printf("\n");
 
+	if (vertexcache_strips)
+	{
+		OrderForVertexCache();
+	}
+	else
+	{
+		for (i = 0; i < pmesh->numtris; i++)
+			cacheorder[i] = i;
+	}
+
 	//
 	// build tristrips
 	//
@@ -257,7 +588,7 @@ int BuildTris(s_trianglevert_t (*x)[3], s_mesh_t* y, byte** ppdata)
 	for (i = 0; i < pmesh->numtris;)
 	{
 		// pick an unused triangle and start the trifan
-		if (used[i])
+		if (used[cacheorder[i]])
 		{
 			i++;
 			continue;
@@ -269,11 +600,12 @@ int BuildTris(s_trianglevert_t (*x)[3], s_mesh_t* y, byte** ppdata)
 		for (k = i; k < pmesh->numtris && bestlen < 127; k++)
 		{
 			int localpeak = 0;
+			int tri = cacheorder[k];
 
-			if (used[k])
+			if (used[tri])
 				continue;
 
-			if (peak[k] <= bestlen)
+			if (peak[tri] <= bestlen)
 				continue;
 
 			m++;
@@ -282,9 +614,9 @@ int BuildTris(s_trianglevert_t (*x)[3], s_mesh_t* y, byte** ppdata)
 				for (startv = 0; startv < 3; startv++)
 				{
 					if (type == 1)
-						len = FanLength(k, startv);
+						len = FanLength(tri, startv);
 					else
-						len = StripLength(k, startv);
+						len = StripLength(tri, startv);
 					if (len > 127)
 					{
 						// skip these, they are too long to encode
@@ -304,9 +636,14 @@ int BuildTris(s_trianglevert_t (*x)[3], s_mesh_t* y, byte** ppdata)
 						localpeak = len;
 				}
 			}
-			peak[k] = localpeak;
+			peak[tri] = localpeak;
 			if (localpeak == maxlen)
 				break;
+
+			// in cache order only the next triangle may start a strip,
+			// searching further ahead would throw the ordering away
+			if (vertexcache_strips)
+				break;
 		}
 		total += (bestlen - 2);
 
@@ -346,6 +683,8 @@ int BuildTris(s_trianglevert_t (*x)[3], s_mesh_t* y, byte** ppdata)
 
 	commands[numcommands++] = 0; // end of list marker
 
+	numcachemisses = CountCacheMisses();
+
 	*ppdata = (byte*)commands;
 
 	// printf("%d %d %d\n", numcommandnodes, numcommands, pmesh->numtris  );
@@ -36,6 +36,7 @@
 int totalframes = 0;
 float totalseconds = 0;
 extern int numcommandnodes;
+extern int numcachemisses;
 
 
 
@@ -398,6 +399,9 @@ void WriteModel()
 	byte* cur;
 	int total_tris = 0;
 	int total_strips = 0;
+	int total_misses = 0;
+	int all_tris = 0;
+	int all_misses = 0;
 
 	pbodypart = (mstudiobodyparts_t*)pData;
 	phdr->numbodyparts = numbodyparts;
@@ -496,6 +500,7 @@ void WriteModel()
 
 		total_tris = 0;
 		total_strips = 0;
+		total_misses = 0;
 		for (j = 0; j < model[i]->nummesh; j++)
 		{
 			int numCmdBytes;
@@ -520,10 +525,16 @@ void WriteModel()
 			ALIGN(pData);
 			total_tris += pmesh[j].numtris;
 			total_strips += numcommandnodes;
+			total_misses += numcachemisses;
 		}
-		printf("mesh      %6d bytes (%d tris, %d strips)\n", pData - cur, total_tris, total_strips);
+		printf("mesh      %6d bytes (%d tris, %d strips, %.3f cache misses/tri)\n", pData - cur, total_tris, total_strips, total_tris ? (float)total_misses / total_tris : 0.0f);
 		cur = pData;
+		all_tris += total_tris;
+		all_misses += total_misses;
 	}
+
+	if (all_tris)
+		printf("vertex cache %.3f misses/tri over %d tris\n", (float)all_misses / all_tris, all_tris);
 }
 
 